@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//! Just enough of a CBOR (RFC 8949) encoder for SenML payloads: definite
+//! length arrays and maps, integers, text strings and floats, written into a
+//! caller-supplied buffer. Writes past the end are dropped and flagged, so a
+//! whole message can be encoded and checked with ok() once at the end.
+class cbor_writer
+{
+public:
+    cbor_writer(uint8_t* buffer, size_t capacity)
+    : m_begin(buffer), m_next(buffer), m_end(buffer + capacity), m_overflow(false) {}
+
+    void begin_array(uint32_t count) { head(4, count); }
+    void begin_map(uint32_t count) { head(5, count); }
+
+    void uint(uint32_t value) { head(0, value); }
+    void integer(int32_t value)
+    {
+        if (value >= 0)
+            head(0, static_cast<uint32_t>(value));
+        else
+            head(1, static_cast<uint32_t>(-1 - value));
+    }
+
+    void text(const char* s) { text(s, strlen(s)); }
+    void text(const char* s, size_t length)
+    {
+        head(3, static_cast<uint32_t>(length));
+        put(reinterpret_cast<const uint8_t*>(s), length);
+    }
+
+    //! The shortest exact encoding of value: an integer if it is whole, else a
+    //! half-precision float if that holds it exactly, else single precision.
+    void number(float value)
+    {
+        if (value > -2147483648.0f && value < 2147483648.0f && value == static_cast<float>(static_cast<int32_t>(value)))
+        {
+            integer(static_cast<int32_t>(value));
+            return;
+        }
+
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint16_t half;
+        if (to_half(bits, half))
+        {
+            uint8_t b[3] = { 0xF9, static_cast<uint8_t>(half >> 8), static_cast<uint8_t>(half) };
+            put(b, sizeof(b));
+            return;
+        }
+
+        uint8_t b[5] = { 0xFA, static_cast<uint8_t>(bits >> 24), static_cast<uint8_t>(bits >> 16),
+                         static_cast<uint8_t>(bits >> 8), static_cast<uint8_t>(bits) };
+        put(b, sizeof(b));
+    }
+
+    size_t size() const { return m_next - m_begin; }
+    bool ok() const { return !m_overflow; }
+
+private:
+    //! Major type plus argument, in the fewest bytes.
+    void head(uint8_t major, uint32_t value)
+    {
+        uint8_t b[5];
+        size_t n;
+        major <<= 5;
+        if (value < 24)
+        {
+            b[0] = major | value;
+            n = 1;
+        }
+        else if (value <= 0xFF)
+        {
+            b[0] = major | 24;
+            b[1] = static_cast<uint8_t>(value);
+            n = 2;
+        }
+        else if (value <= 0xFFFF)
+        {
+            b[0] = major | 25;
+            b[1] = static_cast<uint8_t>(value >> 8);
+            b[2] = static_cast<uint8_t>(value);
+            n = 3;
+        }
+        else
+        {
+            b[0] = major | 26;
+            b[1] = static_cast<uint8_t>(value >> 24);
+            b[2] = static_cast<uint8_t>(value >> 16);
+            b[3] = static_cast<uint8_t>(value >> 8);
+            b[4] = static_cast<uint8_t>(value);
+            n = 5;
+        }
+        put(b, n);
+    }
+
+    void put(const uint8_t* p, size_t n)
+    {
+        if (m_overflow || n > static_cast<size_t>(m_end - m_next))
+        {
+            m_overflow = true;
+            return;
+        }
+        memcpy(m_next, p, n);
+        m_next += n;
+    }
+
+    //! Single to half precision, only when no bits are lost. Normal halves
+    //! only; anything that would need a subnormal goes out as a float.
+    static bool to_half(uint32_t bits, uint16_t& half)
+    {
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+
+        if (exponent < -14 || exponent > 15 || (mantissa & 0x1FFFu))
+            return false;
+        half = static_cast<uint16_t>(sign | static_cast<uint32_t>(exponent + 15) << 10 | mantissa >> 13);
+        return true;
+    }
+
+    uint8_t* m_begin;
+    uint8_t* m_next;
+    uint8_t* m_end;
+    bool m_overflow;
+};
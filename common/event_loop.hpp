@@ -0,0 +1,219 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbed.h"
+
+//! A run loop for bare-metal mbed: work posted from interrupts and callbacks
+//! is queued and run one item at a time by run() on the main stack, alongside
+//! periodic tasks, and the core sleeps whenever there is nothing to do.
+//!
+//! post() may be called from any context; it only copies the callback into a
+//! fixed ring with interrupts masked, and fails (counted as dropped) when the
+//! ring is full. Periodic tasks are added with every() before run(); each
+//! keeps its own schedule of absolute deadlines, and one Timeout is armed for
+//! the nearest so the core wakes up in time.
+//!
+//! The loop keeps count of the time spent asleep and of dispatch latency:
+//! from post() to the start of the item, and from a task's deadline to the
+//! start of the task.
+template <size_t Capacity, size_t MaxTasks = 8>
+class event_loop
+{
+public:
+    struct statistics
+    {
+        uint32_t posted;
+        uint32_t dropped;           // posts that found the queue full
+        uint32_t dispatched;        // posted items run
+        uint32_t task_runs;         // periodic task runs
+        uint32_t latency_max_us;    // posted items
+        uint64_t latency_total_us;
+        uint32_t task_late_max_us;  // periodic tasks
+        uint64_t task_late_total_us;
+        uint64_t asleep_us;
+        uint64_t run_us;            // time inside run()
+    };
+
+    event_loop()
+    : m_head(0), m_tail(0), m_tasks(0), m_started(false), m_running(false), m_stats() {}
+
+    //! Queue fn to run on the loop. Safe from interrupts.
+    bool post(Callback<void()> fn)
+    {
+        uint32_t now = us_ticker_read();
+        bool queued = false;
+
+        __disable_irq();
+        size_t next = (m_tail + 1) % (Capacity + 1);
+        if (next != m_head)
+        {
+            m_items[m_tail].fn = fn;
+            m_items[m_tail].posted_us = now;
+            m_tail = next;
+            queued = true;
+            ++m_stats.posted;
+        }
+        else
+            ++m_stats.dropped;
+        __enable_irq();
+        return queued;
+    }
+
+    //! Run fn every period_ms, the first time one period after run() first
+    //! starts.
+    //! Returns false once MaxTasks are taken.
+    bool every(uint32_t period_ms, Callback<void()> fn)
+    {
+        if (m_tasks == MaxTasks || !period_ms)
+            return false;
+        m_task[m_tasks].fn = fn;
+        m_task[m_tasks].period_us = period_ms * 1000u;
+        ++m_tasks;
+        return true;
+    }
+
+    //! Dispatch until stop() is called from a task, a posted item or an
+    //! interrupt. Calling run() again carries on where it left off: the
+    //! tasks keep their schedule, and any that fell due meanwhile run late.
+    void run()
+    {
+        uint32_t start = us_ticker_read();
+        if (!m_started)
+            for (size_t i = 0; i != m_tasks; ++i)
+                m_task[i].due_us = start + m_task[i].period_us;
+        m_started = true;
+
+        m_running = true;
+        while (m_running)
+        {
+            run_due_tasks();
+            run_posted();
+            if (!m_running)
+                break;
+
+            //! Wake for the nearest deadline; posts wake the core by their
+            //! own interrupt.
+            if (m_tasks)
+            {
+                uint32_t now = us_ticker_read();
+                int32_t wait_us = static_cast<int32_t>(next_due() - now);
+                if (wait_us <= 0)
+                    continue;
+                m_wake.attach_us(callback(&event_loop::wake), static_cast<uint32_t>(wait_us));
+            }
+
+            //! Masked around the check, so a post that lands in between
+            //! still ends the sleep.
+            __disable_irq();
+            if (m_head == m_tail)
+            {
+                uint32_t t0 = us_ticker_read();
+                sleep();
+                m_stats.asleep_us += us_ticker_read() - t0;
+            }
+            __enable_irq();
+        }
+        m_wake.detach();
+        m_stats.run_us += us_ticker_read() - start;
+    }
+
+    void stop() { m_running = false; }
+
+    //! Share of the time in run() spent asleep, in thousandths.
+    uint32_t idle_per_mille() const
+    {
+        return m_stats.run_us ? static_cast<uint32_t>(m_stats.asleep_us * 1000 / m_stats.run_us) : 0;
+    }
+
+    const statistics& stats() const { return m_stats; }
+
+private:
+    struct item
+    {
+        Callback<void()> fn;
+        uint32_t posted_us;
+    };
+
+    struct task
+    {
+        Callback<void()> fn;
+        uint32_t period_us;
+        uint32_t due_us;
+    };
+
+    //! The Timeout only has to end the sleep.
+    static void wake() {}
+
+    void run_due_tasks()
+    {
+        for (size_t i = 0; i != m_tasks && m_running; ++i)
+        {
+            task& t = m_task[i];
+            uint32_t now = us_ticker_read();
+            int32_t late = static_cast<int32_t>(now - t.due_us);
+            if (late < 0)
+                continue;
+
+            ++m_stats.task_runs;
+            m_stats.task_late_total_us += static_cast<uint32_t>(late);
+            if (static_cast<uint32_t>(late) > m_stats.task_late_max_us)
+                m_stats.task_late_max_us = static_cast<uint32_t>(late);
+
+            //! Stay on the grid; after a stall, skip the runs that were missed.
+            t.due_us += t.period_us;
+            if (static_cast<int32_t>(now - t.due_us) >= 0)
+                t.due_us = now + t.period_us;
+            t.fn();
+        }
+    }
+
+    void run_posted()
+    {
+        while (m_running)
+        {
+            item it;
+            __disable_irq();
+            bool any = m_head != m_tail;
+            if (any)
+            {
+                it = m_items[m_head];
+                m_head = (m_head + 1) % (Capacity + 1);
+            }
+            __enable_irq();
+            if (!any)
+                return;
+
+            uint32_t latency = us_ticker_read() - it.posted_us;
+            ++m_stats.dispatched;
+            m_stats.latency_total_us += latency;
+            if (latency > m_stats.latency_max_us)
+                m_stats.latency_max_us = latency;
+            it.fn();
+        }
+    }
+
+    uint32_t next_due() const
+    {
+        uint32_t now = us_ticker_read();
+        uint32_t nearest = m_task[0].due_us;
+        for (size_t i = 1; i != m_tasks; ++i)
+            if (static_cast<int32_t>(m_task[i].due_us - now) < static_cast<int32_t>(nearest - now))
+                nearest = m_task[i].due_us;
+        return nearest;
+    }
+
+    //! One slot is kept free to tell a full ring from an empty one.
+    item m_items[Capacity + 1];
+    volatile size_t m_head;
+    volatile size_t m_tail;
+
+    task m_task[MaxTasks];
+    size_t m_tasks;
+    Timeout m_wake;
+
+    bool m_started;
+    volatile bool m_running;
+    statistics m_stats;
+};
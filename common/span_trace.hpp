@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbed.h"
+#include "value_codec.hpp"
+
+//! Spans and latency histograms for finding out where the time goes on a
+//! device in the field, cheap enough to leave in.
+//!
+//! Spans are timed with the DWT cycle counter (on the host, the HAL runs it
+//! off the monotonic clock). A span adds its length to a latency_histogram,
+//! a fixed set of power-of-two microsecond buckets plus a count, total and
+//! maximum, all in static memory; nothing allocates and recording is a few
+//! instructions.
+//!
+//! With SPANS_ENABLED undefined, SPAN() expands to nothing, so the
+//! instrumented code compiles exactly as if it were not there. Keep anything
+//! else that only exists for the spans (the histograms themselves, resources
+//! that show them) under the same #ifdef.
+
+namespace span_clock
+{
+
+//! Start the cycle counter; once at boot, before the first span.
+inline void start()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline uint32_t now() { return DWT->CYCCNT; }
+
+//! Cycles to nanoseconds; spans are far shorter than the 35 s the counter
+//! takes to wrap at 120 MHz. One over 4.29 s reads as 4.29 s.
+inline uint32_t to_ns(uint32_t cycles)
+{
+    uint64_t ns = static_cast<uint64_t>(cycles) * 1000 / (SystemCoreClock / 1000000);
+    return ns > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ns);
+}
+
+} // namespace span_clock
+
+class latency_histogram
+{
+public:
+    //! Bucket 0 is under 1 us, bucket i under 2^i us, and the last one takes
+    //! everything from 2^(buckets - 2) us (16 ms) up.
+    enum { buckets = 16 };
+
+    //! "<count> <mean us> <max us>" and the bucket counts, all spaced.
+    enum { max_text = 3 * codec::max_chars + buckets * 11 };
+
+    latency_histogram() : m_count(0), m_total_ns(0), m_max_ns(0), m_bucket() {}
+
+    void add(uint32_t cycles)
+    {
+        uint32_t ns = span_clock::to_ns(cycles);
+        ++m_count;
+        m_total_ns += ns;
+        if (ns > m_max_ns)
+            m_max_ns = ns;
+
+        uint32_t us = ns / 1000;
+        size_t i = 0;
+        while (us && i != buckets - 1)
+        {
+            us >>= 1;
+            ++i;
+        }
+        ++m_bucket[i];
+    }
+
+    void reset() { *this = latency_histogram(); }
+
+    uint32_t count() const { return m_count; }
+    uint32_t mean_ns() const { return m_count ? static_cast<uint32_t>(m_total_ns / m_count) : 0; }
+    uint32_t max_ns() const { return m_max_ns; }
+    uint32_t bucket(size_t i) const { return m_bucket[i]; }
+
+    //! As text for a resource, e.g. "120 3.412 41.050 0 12 ...": the count,
+    //! the mean and the maximum in microseconds, then the buckets.
+    size_t format(char* out, size_t capacity) const
+    {
+        if (capacity < max_text)
+        {
+            if (capacity)
+                out[0] = '\0';
+            return 0;
+        }
+
+        size_t n = codec::format_uint(out, capacity, m_count);
+        out[n++] = ' ';
+        n += codec::format_ufixed(out + n, capacity - n, mean_ns(), 3);
+        out[n++] = ' ';
+        n += codec::format_ufixed(out + n, capacity - n, m_max_ns, 3);
+        for (size_t i = 0; i != buckets; ++i)
+        {
+            out[n++] = ' ';
+            n += codec::format_uint(out + n, capacity - n, m_bucket[i]);
+        }
+        return n;
+    }
+
+private:
+    uint32_t m_count;
+    uint64_t m_total_ns;
+    uint32_t m_max_ns;
+    uint32_t m_bucket[buckets];
+};
+
+//! Adds the time from construction to the end of the scope to a histogram.
+class span_timer
+{
+public:
+    explicit span_timer(latency_histogram& histogram) : m_histogram(histogram), m_start(span_clock::now()) {}
+    ~span_timer() { m_histogram.add(span_clock::now() - m_start); }
+
+private:
+    latency_histogram& m_histogram;
+    uint32_t m_start;
+};
+
+#define SPAN_CONCAT_(a, b) a##b
+#define SPAN_NAME_(line) SPAN_CONCAT_(span_, line)
+
+#ifdef SPANS_ENABLED
+//! Time the rest of the enclosing scope into histogram.
+#define SPAN(histogram) span_timer SPAN_NAME_(__LINE__)(histogram)
+#else
+#define SPAN(histogram) do {} while (0)
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Timers on a hierarchical wheel: Levels rings of 2^SlotBits slots, each
+//! slot of a level spanning a whole turn of the level below. A timer goes
+//! into the coarsest slot that still tells its expiry apart from now, and
+//! moves down a level each time the level below comes round to it, so
+//! adding, cancelling and advancing one tick are all O(1) however many
+//! timers there are; each timer is moved at most Levels - 1 times.
+//!
+//! Times are ticks of whatever unit the owner counts in, and may wrap.
+//! Timers live in the owner's objects (derive from or embed timer), so the
+//! wheel needs no allocation; a timer must not be destroyed while added.
+//! With the defaults, ticks of a second and timers up to three days out.
+template <size_t Levels = 3, unsigned SlotBits = 6>
+class timer_wheel
+{
+public:
+    enum { slots = 1u << SlotBits };
+
+    struct timer
+    {
+        timer() : next(0), pprev(0), expires(0) {}
+
+        bool pending() const { return pprev != 0; }
+
+        timer* next;
+        timer** pprev;      // whatever points at this one, while added
+        uint32_t expires;
+    };
+
+    explicit timer_wheel(uint32_t now = 0) : m_now(now), m_count(0)
+    {
+        for (size_t l = 0; l != Levels; ++l)
+            for (size_t s = 0; s != slots; ++s)
+                m_slot[l][s] = 0;
+    }
+
+    //! Fire t at tick expires, or on the next tick if that has passed.
+    //! Adding a pending timer moves it.
+    void add(timer& t, uint32_t expires)
+    {
+        cancel(t);
+        t.expires = static_cast<int32_t>(expires - m_now) > 0 ? expires : m_now + 1;
+        insert(t);
+    }
+
+    void cancel(timer& t)
+    {
+        if (!t.pprev)
+            return;
+        *t.pprev = t.next;
+        if (t.next)
+            t.next->pprev = t.pprev;
+        t.next = 0;
+        t.pprev = 0;
+        --m_count;
+    }
+
+    //! Move on to tick now, calling fire(timer&) for every timer that
+    //! expires on the way, in tick order. fire may add and cancel timers.
+    template <typename F>
+    void advance(uint32_t now, F fire)
+    {
+        while (static_cast<int32_t>(now - m_now) > 0)
+        {
+            if (!m_count)
+            {
+                m_now = now;
+                return;
+            }
+            ++m_now;
+
+            //! A level comes round to its next slot when every level below
+            //! it has wrapped; that slot's timers go down to finer slots.
+            for (size_t l = 1; l != Levels && !(m_now & mask(l - 1)); ++l)
+                cascade(l, (m_now >> (l * SlotBits)) & (slots - 1));
+
+            timer* due = m_slot[0][m_now & (slots - 1)];
+            m_slot[0][m_now & (slots - 1)] = 0;
+            if (due)
+                due->pprev = &due;
+            while (due)
+            {
+                timer& t = *due;
+                cancel_from(due);
+                if (t.expires == m_now)
+                    fire(t);
+                else
+                    insert(t);
+            }
+        }
+    }
+
+    uint32_t now() const { return m_now; }
+    size_t size() const { return m_count; }
+
+private:
+    static uint32_t mask(size_t level) { return (1u << ((level + 1) * SlotBits)) - 1; }
+
+    void insert(timer& t)
+    {
+        uint32_t delta = t.expires - m_now;
+        size_t level = 0;
+        while (level + 1 != Levels && delta > mask(level))
+            ++level;
+        //! Beyond the top level: park it as far out as the wheel reaches,
+        //! and place it again when that comes round.
+        uint32_t at = delta > mask(level) ? m_now + mask(level) : t.expires;
+        timer*& head = m_slot[level][(at >> (level * SlotBits)) & (slots - 1)];
+        t.next = head;
+        t.pprev = &head;
+        if (head)
+            head->pprev = &t.next;
+        head = &t;
+        ++m_count;
+    }
+
+    //! Unlink the head of a detached list.
+    void cancel_from(timer*& list)
+    {
+        timer& t = *list;
+        list = t.next;
+        if (list)
+            list->pprev = &list;
+        t.next = 0;
+        t.pprev = 0;
+        --m_count;
+    }
+
+    void cascade(size_t level, size_t slot)
+    {
+        timer* list = m_slot[level][slot];
+        m_slot[level][slot] = 0;
+        if (list)
+            list->pprev = &list;
+        while (list)
+        {
+            timer& t = *list;
+            cancel_from(list);
+            insert(t);
+        }
+    }
+
+    timer* m_slot[Levels][slots];
+    uint32_t m_now;
+    size_t m_count;
+};
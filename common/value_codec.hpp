@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Text encoding of LWM2M resource values without printf, scanf or the heap.
+//! Shared by both firmwares.
+//!
+//! Encoders write into a caller-supplied buffer and always NUL-terminate. They
+//! return the text length, or 0 (with an empty string) if the buffer is too
+//! small; max_chars is always enough. Decoders read straight from a resource's
+//! value()/value_length() buffer, which is not NUL-terminated. They accept
+//! surrounding spaces and reject anything else, including out-of-range values.
+namespace codec
+{
+
+//! Longest encoding plus the terminator: "-2147483.648".
+const size_t max_chars = 16;
+
+namespace detail
+{
+
+//! Digits of v, least significant first; returns how many.
+inline size_t reverse_digits(char* out, uint32_t v)
+{
+    size_t n = 0;
+    do
+    {
+        out[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    return n;
+}
+
+inline bool is_space(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+//! Trim spaces from both ends of [begin, end).
+inline void trim(const uint8_t*& begin, const uint8_t*& end)
+{
+    while (begin != end && is_space(*begin))
+        ++begin;
+    while (end != begin && is_space(end[-1]))
+        --end;
+}
+
+//! Reads [+|-]digits[.digits] scaled by 10^decimals into magnitude and sign.
+//! Extra fraction digits round half away from zero.
+inline bool parse_scaled(const uint8_t* p, size_t size, unsigned decimals, uint32_t limit,
+                         bool allow_sign, uint32_t& magnitude, bool& negative)
+{
+    if (!p)
+        return false;
+    const uint8_t* end = p + size;
+    trim(p, end);
+
+    negative = false;
+    if (p != end && (*p == '+' || *p == '-'))
+    {
+        if (!allow_sign && *p == '-')
+            return false;
+        negative = *p++ == '-';
+    }
+
+    uint32_t v = 0;
+    bool digits = false, point = false;
+    unsigned fraction = 0;
+    for (; p != end; ++p)
+    {
+        if (*p == '.' && !point && decimals)
+        {
+            point = true;
+            continue;
+        }
+        if (*p < '0' || *p > '9')
+            return false;
+        digits = true;
+
+        unsigned d = *p - '0';
+        if (point && fraction >= decimals)
+        {
+            //! First digit past the precision decides rounding; the rest only
+            //! need to be digits.
+            if (fraction++ == decimals && d >= 5)
+            {
+                if (v == limit)
+                    return false;
+                ++v;
+            }
+            continue;
+        }
+        if (v > (limit - d) / 10)
+            return false;
+        v = v * 10 + d;
+        if (point)
+            ++fraction;
+    }
+    if (!digits)
+        return false;
+
+    for (; fraction < decimals; ++fraction)
+    {
+        if (v > limit / 10)
+            return false;
+        v *= 10;
+    }
+
+    magnitude = v;
+    return true;
+}
+
+} // namespace detail
+
+inline size_t format_uint(char* out, size_t capacity, uint32_t value)
+{
+    char digits[10];
+    size_t n = detail::reverse_digits(digits, value);
+    if (n + 1 > capacity)
+    {
+        if (capacity)
+            out[0] = '\0';
+        return 0;
+    }
+
+    for (size_t i = 0; i != n; ++i)
+        out[i] = digits[n - 1 - i];
+    out[n] = '\0';
+    return n;
+}
+
+inline size_t format_int(char* out, size_t capacity, int32_t value)
+{
+    //! Negate in unsigned arithmetic so INT32_MIN works.
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    if (value >= 0)
+        return format_uint(out, capacity, magnitude);
+
+    if (capacity < 2)
+    {
+        if (capacity)
+            out[0] = '\0';
+        return 0;
+    }
+    out[0] = '-';
+    size_t n = format_uint(out + 1, capacity - 1, magnitude);
+    if (!n)
+        out[0] = '\0';
+    return n ? n + 1 : 0;
+}
+
+namespace detail
+{
+
+inline size_t format_scaled(char* out, size_t capacity, uint32_t magnitude, bool negative, unsigned decimals)
+{
+    if (decimals > 9)
+    {
+        if (capacity)
+            out[0] = '\0';
+        return 0;
+    }
+
+    //! Always at least one integer digit: pad with zeros to decimals + 1.
+    char digits[10];
+    size_t n = reverse_digits(digits, magnitude);
+    while (n < decimals + 1)
+        digits[n++] = '0';
+
+    size_t length = n + negative + (decimals ? 1 : 0);
+    if (length + 1 > capacity)
+    {
+        if (capacity)
+            out[0] = '\0';
+        return 0;
+    }
+
+    char* p = out;
+    if (negative)
+        *p++ = '-';
+    for (size_t i = n; i-- > 0;)
+    {
+        *p++ = digits[i];
+        if (i == decimals && decimals)
+            *p++ = '.';
+    }
+    *p = '\0';
+    return length;
+}
+
+} // namespace detail
+
+//! value / 10^decimals with exactly that many fraction digits, e.g.
+//! format_fixed(buf, sizeof(buf), 44001, 3) gives "44.001". decimals <= 9.
+inline size_t format_fixed(char* out, size_t capacity, int32_t value, unsigned decimals)
+{
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    return detail::format_scaled(out, capacity, magnitude, value < 0, decimals);
+}
+
+//! As format_fixed(), for values past INT32_MAX.
+inline size_t format_ufixed(char* out, size_t capacity, uint32_t value, unsigned decimals)
+{
+    return detail::format_scaled(out, capacity, value, false, decimals);
+}
+
+inline bool parse_uint(const uint8_t* text, size_t size, uint32_t& value)
+{
+    uint32_t magnitude;
+    bool negative;
+    if (!detail::parse_scaled(text, size, 0, UINT32_MAX, false, magnitude, negative))
+        return false;
+    value = magnitude;
+    return true;
+}
+
+inline bool parse_int(const uint8_t* text, size_t size, int32_t& value)
+{
+    uint32_t magnitude;
+    bool negative;
+    if (!detail::parse_scaled(text, size, 0, 0x80000000u, true, magnitude, negative) ||
+        (!negative && magnitude > 0x7FFFFFFFu))
+        return false;
+    value = negative ? static_cast<int32_t>(0u - magnitude) : static_cast<int32_t>(magnitude);
+    return true;
+}
+
+//! Reads a decimal such as "12.5" as an integer scaled by 10^decimals (12500
+//! for milligrams from grams). decimals <= 9.
+inline bool parse_fixed(const uint8_t* text, size_t size, unsigned decimals, int32_t& value)
+{
+    uint32_t magnitude;
+    bool negative;
+    if (decimals > 9 ||
+        !detail::parse_scaled(text, size, decimals, 0x80000000u, true, magnitude, negative) ||
+        (!negative && magnitude > 0x7FFFFFFFu))
+        return false;
+    value = negative ? static_cast<int32_t>(0u - magnitude) : static_cast<int32_t>(magnitude);
+    return true;
+}
+
+} // namespace codec
@@ -0,0 +1,256 @@
+//! Reading N load cells: a loop over N Hx711 objects, each with its own
+//! clock and data line, against one Hx711Array on a shared clock that reads
+//! every data line with a single port read per pulse.
+//!
+//! Each round waits (outside the measurement) until every chip has a
+//! conversion ready, then reads them all; reported per round are the virtual
+//! time spent clocking, the GPIO accesses it took and the host wall time.
+//! Every value is checked bit-for-bit against the code its model sent.
+//!
+//! Then the array again with its last chip dead after a while: reads give up
+//! on it at their deadline, the other channels keep coming, and the dead
+//! one's sensor_health reports no data.
+//!
+//! usage: bench_array [rounds]
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "Hx711.h"
+#include "Hx711Array.h"
+#include "bench_util.hpp"
+#include "hx711_sim.hpp"
+#include "sensor_health.hpp"
+
+namespace
+{
+
+//! Data lines PTC0..7 share a port; the separate clocks are PTB0..7.
+const int data_bits[Hx711Array::MAX_CHANNELS] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+//! Two conversion periods at 80 SPS.
+const uint32_t read_timeout_us = 25000;
+
+PinName data_pin(size_t i) { return static_cast<PinName>(PTC0 + data_bits[i]); }
+PinName clock_pin(size_t i) { return static_cast<PinName>(PTB0 + static_cast<int>(i)); }
+
+struct result
+{
+    bench::samples virt_us;
+    bench::samples wall_ns;
+    double accesses;
+    int mismatches;
+};
+
+//! One compartment per channel, each holding a different weight.
+std::vector<sim::weight_script> make_scripts(size_t n)
+{
+    std::vector<sim::weight_script> scripts(n);
+    for (size_t i = 0; i != n; ++i)
+        scripts[i].add_step(0.0, 10.0 * (i + 1));
+    return scripts;
+}
+
+sim::hx711::config channel_config(size_t i)
+{
+    sim::hx711::config cfg;
+    cfg.rate_sps = 80;
+    cfg.seed = static_cast<uint32_t>(i + 1);
+    return cfg;
+}
+
+void wait_ready(host::board& board, const std::vector<PinName>& pins)
+{
+    for (;;)
+    {
+        bool ready = true;
+        for (size_t i = 0; i != pins.size(); ++i)
+            ready = ready && !board.level(pins[i]);
+        if (ready)
+            return;
+        board.advance(10000);
+    }
+}
+
+result run_separate(size_t n, int rounds)
+{
+    host::board board;
+    host::board::set_current(&board);
+
+    std::vector<sim::weight_script> scripts = make_scripts(n);
+    std::vector<std::unique_ptr<sim::hx711> > adcs;
+    std::vector<std::unique_ptr<Hx711> > cells;
+    std::vector<PinName> pins;
+    for (size_t i = 0; i != n; ++i)
+    {
+        adcs.emplace_back(new sim::hx711(board, clock_pin(i), data_pin(i), scripts[i], channel_config(i)));
+        cells.emplace_back(new Hx711(clock_pin(i), data_pin(i), 128));
+        pins.push_back(data_pin(i));
+    }
+
+    result r = result();
+    uint64_t accesses = 0;
+    for (int k = 0; k != rounds; ++k)
+    {
+        wait_ready(board, pins);
+        uint64_t a0 = board.stats().gpio_reads + board.stats().gpio_writes;
+        uint64_t v0 = board.now_ns();
+        uint64_t w0 = bench::wall_ns();
+        uint32_t values[Hx711Array::MAX_CHANNELS];
+        for (size_t i = 0; i != n; ++i)
+            values[i] = cells[i]->readRaw();
+        uint64_t w1 = bench::wall_ns();
+
+        r.virt_us.add((board.now_ns() - v0) / 1e3);
+        r.wall_ns.add(static_cast<double>(w1 - w0));
+        accesses += board.stats().gpio_reads + board.stats().gpio_writes - a0;
+        for (size_t i = 0; i != n; ++i)
+            if (static_cast<int32_t>(values[i]) != -adcs[i]->last_code())
+                ++r.mismatches;
+    }
+    r.accesses = double(accesses) / rounds;
+
+    cells.clear();
+    adcs.clear();
+    host::board::set_current(0);
+    return r;
+}
+
+result run_array(size_t n, int rounds)
+{
+    host::board board;
+    host::board::set_current(&board);
+
+    std::vector<sim::weight_script> scripts = make_scripts(n);
+    std::vector<std::unique_ptr<sim::hx711> > adcs;
+    std::vector<PinName> pins;
+    for (size_t i = 0; i != n; ++i)
+    {
+        adcs.emplace_back(new sim::hx711(board, D13, data_pin(i), scripts[i], channel_config(i)));
+        pins.push_back(data_pin(i));
+    }
+    Hx711Array cells(D13, PortC, data_bits, n, 128);
+
+    result r = result();
+    uint64_t accesses = 0;
+    for (int k = 0; k != rounds; ++k)
+    {
+        wait_ready(board, pins);
+        uint64_t a0 = board.stats().gpio_reads + board.stats().gpio_writes;
+        uint64_t v0 = board.now_ns();
+        uint64_t w0 = bench::wall_ns();
+        uint32_t values[Hx711Array::MAX_CHANNELS];
+        cells.readRaw(values, read_timeout_us);
+        uint64_t w1 = bench::wall_ns();
+
+        r.virt_us.add((board.now_ns() - v0) / 1e3);
+        r.wall_ns.add(static_cast<double>(w1 - w0));
+        accesses += board.stats().gpio_reads + board.stats().gpio_writes - a0;
+        for (size_t i = 0; i != n; ++i)
+            if (static_cast<int32_t>(values[i]) != -adcs[i]->last_code())
+                ++r.mismatches;
+    }
+    r.accesses = double(accesses) / rounds;
+
+    adcs.clear();
+    host::board::set_current(0);
+    return r;
+}
+
+
+struct dead_result
+{
+    int rounds;
+    int late;           // reads that gave up on the dead chip
+    int mismatches;     // among the live ones
+    sensor_health::state dead;
+    int live_faults;    // live channels not ok
+};
+
+//! Reads n chips as fast as they convert for rounds reads; the last one
+//! stops converting at dead_at_s.
+dead_result run_dead(size_t n, int rounds, double dead_at_s)
+{
+    host::board board;
+    host::board::set_current(&board);
+
+    std::vector<sim::weight_script> scripts = make_scripts(n);
+    std::vector<std::unique_ptr<sim::hx711> > adcs;
+    for (size_t i = 0; i != n; ++i)
+    {
+        sim::hx711::config cfg = channel_config(i);
+        if (i == n - 1)
+            cfg.dead_at_s = dead_at_s;
+        adcs.emplace_back(new sim::hx711(board, D13, data_pin(i), scripts[i], cfg));
+    }
+    Hx711Array cells(D13, PortC, data_bits, n, 128);
+
+    const sensor_health::config health_config = { 12500, 1000, 3, 64, 0x0F };
+    std::vector<sensor_health> health(n, sensor_health(health_config));
+
+    dead_result r = dead_result();
+    r.rounds = rounds;
+    for (int k = 0; k != rounds; ++k)
+    {
+        uint32_t values[Hx711Array::MAX_CHANNELS];
+        Hx711::Status status = cells.readRaw(values, read_timeout_us);
+        uint32_t now_us = static_cast<uint32_t>(board.now_ns() / 1000);
+        if (status == Hx711::READ_TIMEOUT)
+            ++r.late;
+        for (size_t i = 0; i != n; ++i)
+        {
+            if (cells.late() & (1u << i))
+            {
+                health[i].timed_out();
+                continue;
+            }
+            health[i].sample(now_us, static_cast<int32_t>(values[i]), now_us / 1000);
+            if (static_cast<int32_t>(values[i]) != -adcs[i]->last_code())
+                ++r.mismatches;
+        }
+        for (size_t i = 0; i != n; ++i)
+            health[i].poll(now_us / 1000);
+    }
+
+    r.dead = health[n - 1].current();
+    for (size_t i = 0; i + 1 < n; ++i)
+        r.live_faults += health[i].current() != sensor_health::ok;
+
+    adcs.clear();
+    host::board::set_current(0);
+    return r;
+}
+}
+
+int main(int argc, char** argv)
+{
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 400;
+
+    std::printf("%d rounds of reading every channel once it is ready, 80 SPS\n", rounds);
+    std::printf("%-4s %-14s %12s %12s %12s %10s\n", "N", "reader", "us virtual", "GPIO/round", "ns wall", "mismatch");
+
+    int mismatches = 0;
+    const size_t counts[] = { 1, 2, 4, 8 };
+    for (size_t c = 0; c != sizeof(counts) / sizeof(counts[0]); ++c)
+    {
+        size_t n = counts[c];
+        result separate = run_separate(n, rounds);
+        result array = run_array(n, rounds);
+
+        std::printf("%-4zu %-14s %12.2f %12.1f %12.0f %10d\n", n, "N x Hx711", separate.virt_us.percentile(50),
+                    separate.accesses, separate.wall_ns.percentile(50), separate.mismatches);
+        std::printf("%-4zu %-14s %12.2f %12.1f %12.0f %10d\n", n, "Hx711Array", array.virt_us.percentile(50),
+                    array.accesses, array.wall_ns.percentile(50), array.mismatches);
+        mismatches += separate.mismatches + array.mismatches;
+    }
+
+    size_t n = Hx711Array::MAX_CHANNELS;
+    dead_result dead = run_dead(n, rounds, 1.0);
+    std::printf("%zu channels, the last dead after 1 s: %d of %d reads gave up on it, %d mismatches, "
+                "its health %s, %d others not ok\n",
+                n, dead.late, dead.rounds, dead.mismatches, sensor_health::name(dead.dead), dead.live_faults);
+    bool dead_ok = dead.late && !dead.mismatches && dead.dead == sensor_health::no_data && !dead.live_faults;
+    return mismatches || !dead_ok ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+//! Compares the float chain the scale used to convert filtered counts to grams
+//! against calibration_table: largest disagreement over the cell's range, and
+//! host cost per conversion. Exits with 1 if the two disagree anywhere by more
+//! than their rounding allows.
+//!
+//! usage: bench_calibration [conversions]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "calibration.hpp"
+
+namespace
+{
+
+//! The conversion main.cpp carried before the table, verbatim.
+float legacy_grams(int data)
+{
+    float mass = -1.0 * data;
+    mass /= 1000.00;
+    mass += 51.50;
+    mass /= 9.00;
+    mass += 0.04;
+    return mass;
+}
+
+constexpr calibration_point factory_points[] = {
+    { -38140, 10000 },
+    {  51860,     0 },
+};
+constexpr calibration_table<8> factory(factory_points);
+
+//! Baked in at compile time: these must not need any code at startup.
+static_assert(factory.valid(), "factory table invalid");
+static_assert(factory.to_milligrams(51860) == 0, "factory zero");
+static_assert(factory.to_milligrams(-38140) == 10000, "factory span");
+
+//! How far the two may disagree at raw. The table rounds its Q16 slope to
+//! half a step, which adds up over the counts from its first point, and its
+//! result to half a milligram. The float chain rounds four times at up to
+//! 1024 g, half a float step (2^-14 g) each.
+double rounding_bound(int raw)
+{
+    const double slope_mg = 0.5 / 65536;
+    const double float_mg = 4 * 0.5 * 1000.0 / 16384;
+    return 0.5 + slope_mg * std::fabs(double(raw) - factory.point(0).raw) + float_mg;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    //! Accuracy: every count from empty pan to 100 g.
+    double worst = 0.0;
+    int worst_raw = 0;
+    int over = 0;
+    for (int raw = 51860; raw >= 51860 - 100 * 9000; --raw)
+    {
+        double diff = std::fabs(legacy_grams(raw) * 1000.0 - factory.to_milligrams(raw));
+        if (diff > worst)
+        {
+            worst = diff;
+            worst_raw = raw;
+        }
+        over += diff > rounding_bound(raw);
+    }
+    std::printf("max |float - table| over 0..100 g: %.3f mg (raw %d, rounding allows %.3f mg), %d counts over\n",
+                worst, worst_raw, rounding_bound(worst_raw), over);
+
+    //! A five point table with a slight non-linearity, loaded at runtime.
+    const calibration_point measured[] = {
+        { 51860, 0 }, { -38100, 10000 }, { -128200, 20000 }, { -398900, 50000 }, { -849900, 100000 },
+    };
+    calibration_table<8> live;
+    live.load(measured, sizeof(measured) / sizeof(measured[0]));
+
+    std::vector<int32_t> input(4096);
+    for (size_t i = 0; i != input.size(); ++i)
+        input[i] = 51860 - static_cast<int32_t>((i * 2654435761u) % 900000u);
+
+    uint64_t t0 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        bench::keep(legacy_grams(input[i & 4095]));
+    uint64_t t1 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        bench::keep(factory.to_milligrams(input[i & 4095]));
+    uint64_t t2 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        bench::keep(live.to_milligrams(input[i & 4095]));
+    uint64_t t3 = bench::wall_ns();
+
+    std::printf("%-28s %8.2f ns per conversion\n", "float chain", double(t1 - t0) / n);
+    std::printf("%-28s %8.2f ns per conversion\n", "table, 2 points", double(t2 - t1) / n);
+    std::printf("%-28s %8.2f ns per conversion\n", "table, 5 points", double(t3 - t2) / n);
+    return over ? 1 : 0;
+}
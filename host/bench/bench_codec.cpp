@@ -0,0 +1,148 @@
+//! Compares common/value_codec.hpp with the sprintf/sscanf code the firmwares
+//! used to format and parse resource values: checks the codec agrees with
+//! printf over a sweep of values, then reports the host cost of each path.
+//!
+//! usage: bench_codec [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "bench_util.hpp"
+#include "m2m.hpp"
+#include "value_codec.hpp"
+
+namespace
+{
+
+//! The old scale path: float grams through sprintf("%f").
+size_t legacy_format_mass(char* out, int32_t mg)
+{
+    float mass = mg / 1000.0f;
+    return std::sprintf(out, "%f", mass);
+}
+
+//! The old metronome PUT path: a heap copy, a String, then sscanf.
+uint32_t legacy_parse_bpm(M2MResource& resource)
+{
+    uint8_t* buffer;
+    size_t buffer_length;
+    resource.get_value(buffer, buffer_length);
+    m2m::String bpm_string(reinterpret_cast<const char*>(buffer), buffer_length);
+    free(buffer);
+
+    unsigned bpm = 0;
+    std::sscanf(bpm_string.c_str(), "%u", &bpm);
+    return bpm;
+}
+
+uint32_t codec_parse_bpm(M2MResource& resource)
+{
+    uint32_t bpm = 0;
+    codec::parse_uint(resource.value(), resource.value_length(), bpm);
+    return bpm;
+}
+
+int check()
+{
+    int failures = 0;
+    char a[codec::max_chars], b[64];
+
+    for (int32_t mg = -200000; mg <= 200000; mg += 7)
+    {
+        size_t n = codec::format_fixed(a, sizeof(a), mg, 3);
+        std::snprintf(b, sizeof(b), "%s%d.%03d", mg < 0 ? "-" : "", std::abs(mg) / 1000, std::abs(mg) % 1000);
+        int32_t back = 0;
+        if (std::strcmp(a, b) || n != std::strlen(b) ||
+            !codec::parse_fixed(reinterpret_cast<const uint8_t*>(a), n, 3, back) || back != mg)
+        {
+            if (failures++ < 5)
+                std::printf("mismatch: %d -> \"%s\" (want \"%s\") -> %d\n", mg, a, b, back);
+        }
+    }
+
+    const int32_t edges[] = { 0, 1, -1, 2147483647, -2147483647 - 1 };
+    for (size_t i = 0; i != sizeof(edges) / sizeof(edges[0]); ++i)
+    {
+        size_t n = codec::format_int(a, sizeof(a), edges[i]);
+        std::snprintf(b, sizeof(b), "%d", edges[i]);
+        int32_t back = 0;
+        if (std::strcmp(a, b) || !codec::parse_int(reinterpret_cast<const uint8_t*>(a), n, back) || back != edges[i])
+            if (failures++ < 5)
+                std::printf("mismatch: %d -> \"%s\"\n", edges[i], a);
+    }
+
+    //! Unsigned fixed point past INT32_MAX, as latency spans over 2.1 s are.
+    const uint32_t unsigned_edges[] = { 0, 999, 2147483647u, 2147483648u, 4294967295u };
+    for (size_t i = 0; i != sizeof(unsigned_edges) / sizeof(unsigned_edges[0]); ++i)
+    {
+        uint32_t v = unsigned_edges[i];
+        size_t n = codec::format_ufixed(a, sizeof(a), v, 3);
+        std::snprintf(b, sizeof(b), "%u.%03u", v / 1000, v % 1000);
+        if (std::strcmp(a, b) || n != std::strlen(b))
+            if (failures++ < 5)
+                std::printf("mismatch: %u -> \"%s\" (want \"%s\")\n", v, a, b);
+    }
+
+    //! Inputs the parsers must refuse.
+    const char* bad[] = { "", " ", "-", "12a", "4294967296", "1 2", "0x10" };
+    for (size_t i = 0; i != sizeof(bad) / sizeof(bad[0]); ++i)
+    {
+        uint32_t v;
+        if (codec::parse_uint(reinterpret_cast<const uint8_t*>(bad[i]), std::strlen(bad[i]), v))
+            if (failures++ < 5)
+                std::printf("accepted \"%s\"\n", bad[i]);
+    }
+    return failures;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    int failures = check();
+    std::printf("codec vs printf: %s\n", failures ? "MISMATCH" : "ok");
+
+    char out[64];
+    uint64_t sink = 0;
+
+    uint64_t t0 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += legacy_format_mass(out, 40000 + (i & 1023));
+    uint64_t t1 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += codec::format_fixed(out, sizeof(out), 40000 + (i & 1023), 3);
+    uint64_t t2 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += std::sprintf(out, "%u", static_cast<unsigned>(60 + (i & 127)));
+    uint64_t t3 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += codec::format_uint(out, sizeof(out), 60 + (i & 127));
+    uint64_t t4 = bench::wall_ns();
+
+    M2MObject* object = M2MInterfaceFactory::create_object("3318");
+    M2MResource* bpm = object->create_object_instance()->create_dynamic_resource(
+        "5700", "integer", M2MResourceInstance::INTEGER, false);
+    bpm->set_value(reinterpret_cast<const uint8_t*>("120"), 3);
+
+    uint64_t t5 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += legacy_parse_bpm(*bpm);
+    uint64_t t6 = bench::wall_ns();
+    for (int i = 0; i != n; ++i)
+        sink += codec_parse_bpm(*bpm);
+    uint64_t t7 = bench::wall_ns();
+    bench::keep(sink);
+
+    std::printf("%-40s %8s %8s %8s\n", "", "legacy", "codec", "speedup");
+    std::printf("%-40s %8.1f %8.1f %7.1fx\n", "format mass (%f vs fixed), ns", double(t1 - t0) / n,
+                double(t2 - t1) / n, double(t1 - t0) / (t2 - t1));
+    std::printf("%-40s %8.1f %8.1f %7.1fx\n", "format bpm (%u vs uint), ns", double(t3 - t2) / n,
+                double(t4 - t3) / n, double(t3 - t2) / (t4 - t3));
+    std::printf("%-40s %8.1f %8.1f %7.1fx\n", "parse bpm (copy+sscanf vs in place), ns", double(t6 - t5) / n,
+                double(t7 - t6) / n, double(t6 - t5) / (t7 - t6));
+    return failures ? 1 : 0;
+}
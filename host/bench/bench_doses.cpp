@@ -0,0 +1,204 @@
+//! Runs the scale's processing chain (filter, calibration, zero tracking and
+//! dose_detector) on randomly generated pill handling and scores the events
+//! against what really happened: missed and false events, and how long after
+//! the bottle was put back each dose was reported.
+//!
+//! Each episode picks the bottle up, holds it off the cell for a while, and
+//! puts it back with 1..3 pills fewer, occasionally one more, or (one time in
+//! five) unchanged, with a landing bump of random size. A nearly empty bottle
+//! is refilled a few pills at a time the same way.
+//!
+//! usage: bench_doses [episodes] [seed]
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "calibration.hpp"
+#include "dose_detector.hpp"
+#include "filters.hpp"
+#include "hx711_sim.hpp"
+#include "zero_tracker.hpp"
+
+namespace
+{
+
+const double pill_grams = 0.5;
+
+struct dose
+{
+    double lifted_s;    // bottle picked up
+    double settled_s;   // bottle back down and still
+    int pills;          // 0 for handling without a dose
+};
+
+struct scenario
+{
+    sim::weight_script script;
+    std::vector<dose> doses;
+};
+
+scenario make_scenario(int episodes, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> gap(8.0, 40.0), off(0.5, 4.0), bump(0.0, 6.0);
+    std::uniform_int_distribution<int> kind(0, 9), count(1, 3);
+
+    scenario s;
+    int in_bottle = 60;
+    double grams = 40.0 + in_bottle * pill_grams;
+    s.script.add_step(0.0, 0.0);
+    s.script.add_ramp(5.0, 0.0);
+    s.script.add_ramp(5.5, grams);
+
+    double t = 5.5;
+    for (int i = 0; i != episodes; ++i)
+    {
+        t += gap(rng);
+        int k = kind(rng);
+        int pills = k < 2 ? 0 : k < 3 ? 1 : -count(rng);
+        if (in_bottle + pills < 0)
+            pills = count(rng);
+        in_bottle += pills;
+
+        double before = grams;
+        grams = 40.0 + in_bottle * pill_grams;
+
+        double down = t + 0.3 + off(rng);
+        s.script.add_ramp(t, before);
+        s.script.add_ramp(t + 0.3, 0.0);
+        s.script.add_step(down, 0.0);
+        s.script.add_ramp(down + 0.4, grams + bump(rng));
+        s.script.add_ramp(down + 0.7, grams);
+
+        dose d = { t, down + 0.7, pills };
+        s.doses.push_back(d);
+        t = down + 0.7;
+    }
+    s.script.add_step(t + 20.0, grams);
+    return s;
+}
+
+std::vector<uint32_t>* g_raw = 0;
+
+void on_sample(uint32_t raw)
+{
+    g_raw->push_back(raw);
+}
+
+struct outcome
+{
+    int expected;
+    int detected;
+    int missed;
+    int wrong_count;
+    int spurious;
+    bench::samples latency_ms;      // settled back down -> reported
+    bench::samples stamp_error_ms;  // event at_ms vs actual pick-up
+};
+
+outcome run(const scenario& s, unsigned rate, double noise)
+{
+    host::board board;
+    host::board::set_current(&board);
+
+    sim::hx711::config cfg;
+    cfg.rate_sps = rate;
+    cfg.noise_counts = noise;
+    sim::hx711 adc(board, D13, D12, s.script, cfg);
+
+    std::vector<uint32_t> raw;
+    g_raw = &raw;
+    Hx711 load_cell(D13, D12, 128);
+    load_cell.start_async(on_sample);
+
+    constexpr calibration_point points[] = { { -38140, 10000 }, { 51860, 0 } };
+    constexpr calibration_table<2> calibration(points);
+    filter_chain<running_median<5>, moving_average<8> > filter;
+    int32_t pill_mg = static_cast<int32_t>(pill_grams * 1000);
+    zero_tracker zero(zero_tracker::capture_for_pill(pill_mg));
+    dose_detector detector(dose_detector::for_pill(pill_mg));
+
+    std::vector<dose_detector::event> events;
+    uint64_t end = static_cast<uint64_t>(s.script.duration_s() * 1e9);
+    while (board.now_ns() < end)
+    {
+        raw.clear();
+        sleep();
+        uint32_t now_ms = static_cast<uint32_t>(board.now_ns() / 1000000);
+        for (size_t i = 0; i != raw.size(); ++i)
+        {
+            filter.update(static_cast<int32_t>(raw[i]));
+            if (!filter.ready())
+                continue;
+            if (detector.update(zero.update(calibration.to_milligrams(filter.value())), now_ms))
+                events.push_back(detector.last());
+        }
+    }
+    load_cell.stop_async();
+    host::board::set_current(0);
+
+    //! Match each real dose with the first unclaimed event stamped within a
+    //! second of the pick-up.
+    outcome o = outcome();
+    std::vector<bool> claimed(events.size(), false);
+    for (size_t d = 0; d != s.doses.size(); ++d)
+    {
+        const dose& truth = s.doses[d];
+        if (truth.pills)
+            ++o.expected;
+
+        for (size_t e = 0; e != events.size(); ++e)
+        {
+            double at_s = events[e].at_ms / 1000.0;
+            if (claimed[e] || at_s < truth.lifted_s - 1.0 || at_s > truth.settled_s)
+                continue;
+
+            claimed[e] = true;
+            if (events[e].pills != truth.pills)
+                ++o.wrong_count;
+            else
+            {
+                ++o.detected;
+                o.latency_ms.add(events[e].detected_ms - truth.settled_s * 1000.0);
+                o.stamp_error_ms.add(events[e].at_ms - truth.lifted_s * 1000.0);
+            }
+            break;
+        }
+    }
+    for (size_t e = 0; e != events.size(); ++e)
+        if (!claimed[e])
+            ++o.spurious;
+    o.missed = o.expected - o.detected - o.wrong_count;
+    return o;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int episodes = argc > 1 ? std::atoi(argv[1]) : 200;
+    uint32_t seed = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1;
+
+    scenario s = make_scenario(episodes, seed);
+    std::printf("%d handling episodes over %.0f s, %.1f g pills\n", episodes, s.script.duration_s(), pill_grams);
+    std::printf("%-5s %-7s %8s %8s %7s %7s %8s %12s %12s %12s\n", "SPS", "noise", "expected", "detected",
+                "missed", "wrong", "false", "lat p50 ms", "lat p99 ms", "stamp p99");
+
+    const unsigned rates[] = { 10, 80 };
+    const double noises[] = { 150.0, 1500.0, 4500.0 };
+    for (size_t r = 0; r != 2; ++r)
+    {
+        for (size_t n = 0; n != 3; ++n)
+        {
+            outcome o = run(s, rates[r], noises[n]);
+            std::printf("%-5u %-7.0f %8d %8d %7d %7d %8d %12.0f %12.0f %12.0f\n", rates[r], noises[n],
+                        o.expected, o.detected, o.missed, o.wrong_count, o.spurious, o.latency_ms.percentile(50),
+                        o.latency_ms.percentile(99), o.stamp_error_ms.percentile(99));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+//! Compares the filter stages in mbed_code/filters.hpp on a simulated sample
+//! stream: residual noise on a steady load, settling time after a pill is
+//! taken out, and host cost per sample.
+//!
+//! usage: bench_filters [rate_sps] [noise_counts]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "filters.hpp"
+#include "hx711_sim.hpp"
+
+namespace
+{
+
+//! Counts per gram of the simulated cell; readRaw() negates the code.
+const double counts_per_gram = 9000.0;
+
+struct capture
+{
+    std::vector<int32_t> raw;
+    std::vector<int32_t> truth;
+    std::vector<double> time_s;
+
+    //! Index of the first sample taken at or after t.
+    size_t at(double t) const
+    {
+        size_t i = 0;
+        while (i < time_s.size() && time_s[i] < t)
+            ++i;
+        return i;
+    }
+};
+
+std::vector<uint32_t>* g_raw = 0;
+
+void on_sample(uint32_t raw)
+{
+    g_raw->push_back(raw);
+}
+
+capture record(unsigned rate, double noise)
+{
+    host::board& board = host::board::current();
+
+    //! 40.5 g steady, then one 0.5 g pill out at 10 s.
+    sim::weight_script script;
+    script.add_step(0.0, 40.5);
+    script.add_step(10.0, 40.0);
+
+    sim::hx711::config cfg;
+    cfg.rate_sps = rate;
+    cfg.noise_counts = noise;
+    sim::hx711 adc(board, D13, D12, script, cfg);
+
+    std::vector<uint32_t> raw;
+    g_raw = &raw;
+
+    Hx711 load_cell(D13, D12, 128);
+    load_cell.start_async(on_sample);
+
+    capture c;
+    while (board.now_ns() < 20000000000ull)
+    {
+        size_t before = raw.size();
+        sleep();
+        for (size_t i = before; i != raw.size(); ++i)
+        {
+            c.raw.push_back(static_cast<int32_t>(raw[i]));
+            c.truth.push_back(-adc.ideal_code(board.now_ns()));
+            c.time_s.push_back(board.now_ns() / 1e9);
+        }
+    }
+    load_cell.stop_async();
+    return c;
+}
+
+template <typename Filter>
+void evaluate(const char* name, const capture& c)
+{
+    Filter f;
+    std::vector<int32_t> out(c.raw.size());
+
+    uint64_t t0 = bench::wall_ns();
+    for (size_t i = 0; i != c.raw.size(); ++i)
+        out[i] = f.update(c.raw[i]);
+    uint64_t t1 = bench::wall_ns();
+
+    //! Noise: RMS error over 5..9 s, well clear of start-up and the step.
+    size_t step = c.at(10.0);
+    double sq = 0.0;
+    size_t n = 0;
+    for (size_t i = c.at(5.0); i < c.at(9.0); ++i, ++n)
+        sq += double(out[i] - c.truth[i]) * (out[i] - c.truth[i]);
+    double rms = n ? std::sqrt(sq / n) : 0.0;
+
+    //! Settling: first sample after the step from which the output stays
+    //! within 0.05 g (a tenth of a pill) of the truth.
+    const double band = 0.05 * counts_per_gram;
+    size_t settled = out.size();
+    for (size_t i = out.size(); i-- > step;)
+    {
+        if (std::fabs(double(out[i] - c.truth[i])) > band)
+            break;
+        settled = i;
+    }
+
+    std::printf("%-34s %9.1f %9.4f %11.0f %11.2f\n", name, rms, rms / counts_per_gram,
+                settled < out.size() ? (c.time_s[settled] - 10.0) * 1000.0 : -1.0,
+                double(t1 - t0) / c.raw.size());
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    unsigned rate = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 80;
+    double noise = argc > 2 ? std::atof(argv[2]) : 1500.0;
+
+    capture c = record(rate, noise);
+
+    std::printf("%u SPS, +/-%.0f counts noise, %zu samples\n", rate, noise, c.raw.size());
+    std::printf("%-34s %9s %9s %11s %11s\n", "filter", "rms cnt", "rms g", "settle ms", "ns/sample");
+
+    evaluate<filter_chain<> >("none", c);
+    evaluate<running_median<5> >("running_median<5>", c);
+    evaluate<moving_average<8> >("moving_average<8>", c);
+    evaluate<moving_average<32> >("moving_average<32>", c);
+    evaluate<iir_lowpass<3> >("iir_lowpass<3>", c);
+    evaluate<iir_lowpass<5> >("iir_lowpass<5>", c);
+    evaluate<filter_chain<running_median<5>, moving_average<8> > >("median<5> + average<8>", c);
+    evaluate<filter_chain<running_median<5>, iir_lowpass<4> > >("median<5> + iir<4>", c);
+    return 0;
+}
@@ -0,0 +1,339 @@
+//! Per-operation cost of the firmware hot paths, as JSON, and a check against
+//! a baseline so a change that slows one of them down shows up.
+//!
+//! Each benchmark is timed over several rounds and the fastest round counts,
+//! which keeps most of the scheduler noise out of host_ns. virtual_ns is the
+//! cost on the host board's clock (GPIO accesses at their modelled cost) and
+//! is exact, so any change to it is a real change in the pin traffic.
+//!
+//!     hx711.decode             Hx711::decode(): bit inversion and sign fill
+//!     hx711.shift_frame        readRaw() of a ready chip: three
+//!                              shiftInMsbFirst() calls, the gain pulses and
+//!                              decode(), against the board's pins
+//!     hx711.convert_to_real    Hx711::convert_to_real()
+//!     scale.to_milligrams      the calibration table on its own
+//!     scale.pipeline           scale_pipeline::update(), per conversion:
+//!                              health, filter, calibration, zero, doses
+//!     lab3.format_resource     the body of lab3's format_resource_value()
+//!     metronome.tap            metronome::tap() with a full buffer, plus
+//!                              moving the board's clock to the next tap
+//!     metronome.get_bpm        metronome::get_bpm()
+//!     reference.xorshift       a fixed integer loop, to scale host_ns by
+//!
+//! usage: bench_hotpaths [--baseline file] [--tolerance fraction] [--rounds n]
+//!
+//! Results go to stdout, one object per line. With --baseline, each result is
+//! also compared with the file (written earlier by this program); the exit
+//! status is 1 if virtual_ns changed at all, which holds on any machine.
+//! host_ns depends on the machine, so it is only compared as a multiple of
+//! the reference loop measured in the same run, and a rise of more than the
+//! tolerance (default 0.5) is reported but does not fail the check.
+//! Regenerate the baseline after an intended change with:
+//! bench_hotpaths > bench/baseline.json
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "m2m.hpp"
+#include "metronome.hpp"
+#include "scale_config.hpp"
+#include "scale_pipeline.hpp"
+#include "value_codec.hpp"
+
+namespace
+{
+
+const char* const reference = "reference.xorshift";
+
+struct result
+{
+    std::string name;
+    double host_ns;
+    double virtual_ns;
+    long iterations;
+};
+
+//! Always has a conversion ready: drives a fixed 24-bit code onto DOUT, one
+//! bit per SCK rising edge, and pulls DOUT low again once the frame is done.
+class ready_chip : private host::peripheral
+{
+public:
+    ready_chip(host::board& board, PinName sck, PinName dout, uint32_t code)
+    : m_board(board), m_sck(sck), m_dout(dout), m_code(code), m_pulses(0), m_level(0)
+    {
+        m_board.attach(m_sck, this);
+        m_board.drive(m_dout, 0);
+    }
+    ~ready_chip() { m_board.detach(m_sck, this); }
+
+private:
+    void pin_written(PinName, int level)
+    {
+        if (level == m_level)
+            return;
+        m_level = level;
+        if (level)
+        {
+            ++m_pulses;
+            m_board.drive(m_dout, m_pulses <= 24 ? (m_code >> (24 - m_pulses)) & 1 : 1);
+        }
+        else if (m_pulses >= 25)
+        {
+            m_pulses = 0;
+            m_board.drive(m_dout, 0);
+        }
+    }
+
+    host::board& m_board;
+    PinName m_sck;
+    PinName m_dout;
+    uint32_t m_code;
+    unsigned m_pulses;
+    int m_level;
+};
+
+//! Run fn(i) n times per round; the fastest round counts.
+template <typename Fn>
+result measure(const char* name, long n, int rounds, host::board& board, Fn fn)
+{
+    result r = { name, 0.0, 0.0, n };
+    for (int k = 0; k != rounds; ++k)
+    {
+        uint64_t v0 = board.now_ns();
+        uint64_t w0 = bench::wall_ns();
+        for (long i = 0; i != n; ++i)
+            fn(i);
+        uint64_t w1 = bench::wall_ns();
+        double host = double(w1 - w0) / n;
+        if (!k || host < r.host_ns)
+            r.host_ns = host;
+        r.virtual_ns = double(board.now_ns() - v0) / n;
+    }
+    return r;
+}
+
+//! Realistic codes around an empty pan, as the driver returns them.
+std::vector<int32_t> make_raw(size_t n)
+{
+    std::vector<int32_t> raw(n);
+    uint32_t x = 12345;
+    for (size_t i = 0; i != n; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        raw[i] = 51860 - static_cast<int32_t>(i / 64 % 8) * 4500 + static_cast<int32_t>(x % 301) - 150;
+    }
+    return raw;
+}
+
+std::vector<result> run(int rounds)
+{
+    std::vector<result> results;
+    host::board board;
+    host::board::set_current(&board);
+    uint64_t sink = 0;
+
+    std::vector<int32_t> raw = make_raw(4096);
+
+    results.push_back(measure("hx711.decode", 4000000, rounds, board, [&](long i) {
+        sink += Hx711::decode(static_cast<uint32_t>(raw[i & 4095]) & 0xFFFFFF);
+    }));
+
+    {
+        ready_chip chip(board, D13, D12, 0x7E5A3Cu);
+        Hx711 adc(D13, D12, 128);
+        results.push_back(measure("hx711.shift_frame", 200000, rounds, board, [&](long) {
+            sink += adc.readRaw();
+        }));
+
+        adc.set_offset(51860);
+        adc.set_scale(1.0f / 9000);
+        float sum = 0.0f;
+        results.push_back(measure("hx711.convert_to_real", 4000000, rounds, board, [&](long i) {
+            sum += adc.convert_to_real(raw[i & 4095]);
+        }));
+        bench::keep(sum);
+    }
+
+    calibration_table<8> calibration = factory_calibration;
+    results.push_back(measure("scale.to_milligrams", 4000000, rounds, board, [&](long i) {
+        sink += calibration.to_milligrams(raw[i & 4095]);
+    }));
+
+    {
+        //! In the firmware's batches: 250 ms of conversions at 10 SPS.
+        scale_pipeline scale(scale_config, calibration);
+        sample batch[3];
+        uint32_t t_us = 0;
+        result r = measure("scale.pipeline", 300000, rounds, board, [&](long i) {
+            for (int j = 0; j != 3; ++j)
+            {
+                t_us += 100000;
+                batch[j].timestamp_us = t_us;
+                batch[j].raw = raw[(i * 3 + j) & 4095];
+            }
+            sink += scale.update(batch, 3, t_us / 1000);
+        });
+        r.host_ns /= 3;
+        r.virtual_ns /= 3;
+        r.iterations *= 3;
+        results.push_back(r);
+    }
+
+    {
+        M2MObject* object = M2MInterfaceFactory::create_object("3318");
+        M2MResource* resource = object->create_object_instance()->create_dynamic_resource(
+            "5700", "integer", M2MResourceInstance::INTEGER, true);
+        results.push_back(measure("lab3.format_resource", 2000000, rounds, board, [&](long i) {
+            char result_string[codec::max_chars];
+            size_t size = codec::format_uint(result_string, sizeof(result_string), static_cast<uint32_t>(60 + (i & 127)));
+            resource->set_value(reinterpret_cast<const uint8_t*>(result_string), size);
+        }));
+        delete object;
+    }
+
+    {
+        metronome m;
+        m.start_timing();
+        result r = measure("metronome.tap", 2000000, rounds, board, [&](long i) {
+            board.advance(500000000ull + (i & 7) * 1000000ull);
+            m.tap();
+        });
+        //! The clock moves are the benchmark's, not tap()'s.
+        r.virtual_ns = 0.0;
+        results.push_back(r);
+        results.push_back(measure("metronome.get_bpm", 4000000, rounds, board, [&](long) {
+            sink += m.get_bpm();
+            bench::keep(sink);
+        }));
+    }
+
+    {
+        uint32_t x = 12345;
+        results.push_back(measure(reference, 4000000, rounds, board, [&](long) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            sink += x;
+        }));
+    }
+
+    bench::keep(sink);
+    host::board::set_current(0);
+    return results;
+}
+
+//! Reads back what print() wrote; nothing else is accepted.
+std::map<std::string, result> load_baseline(const char* path)
+{
+    std::map<std::string, result> baseline;
+    std::FILE* f = std::fopen(path, "r");
+    if (!f)
+        return baseline;
+
+    char line[512];
+    while (std::fgets(line, sizeof(line), f))
+    {
+        char name[128];
+        result r;
+        if (std::sscanf(line, " {\"name\": \"%127[^\"]\", \"host_ns\": %lf, \"virtual_ns\": %lf, \"iterations\": %ld",
+                        name, &r.host_ns, &r.virtual_ns, &r.iterations) == 4)
+        {
+            r.name = name;
+            baseline[r.name] = r;
+        }
+    }
+    std::fclose(f);
+    return baseline;
+}
+
+void print(const std::vector<result>& results)
+{
+    std::printf("{\"suite\": \"hotpaths\", \"results\": [\n");
+    for (size_t i = 0; i != results.size(); ++i)
+        std::printf("  {\"name\": \"%s\", \"host_ns\": %.2f, \"virtual_ns\": %.1f, \"iterations\": %ld}%s\n",
+                    results[i].name.c_str(), results[i].host_ns, results[i].virtual_ns, results[i].iterations,
+                    i + 1 == results.size() ? "" : ",");
+    std::printf("]}\n");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    const char* baseline_path = 0;
+    double tolerance = 0.5;
+    int rounds = 5;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!std::strcmp(argv[i], "--baseline"))
+            baseline_path = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--tolerance"))
+            tolerance = std::atof(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--rounds"))
+            rounds = std::atoi(argv[i + 1]);
+    }
+
+    std::vector<result> results = run(rounds);
+    print(results);
+    if (!baseline_path)
+        return 0;
+
+    std::map<std::string, result> baseline = load_baseline(baseline_path);
+    if (baseline.empty())
+    {
+        std::fprintf(stderr, "cannot read a baseline from %s\n", baseline_path);
+        return 1;
+    }
+
+    std::map<std::string, result>::const_iterator base_ref = baseline.find(reference);
+    const result* run_ref = 0;
+    for (size_t i = 0; i != results.size(); ++i)
+        if (results[i].name == reference)
+            run_ref = &results[i];
+    if (base_ref == baseline.end() || !run_ref || base_ref->second.host_ns <= 0 || run_ref->host_ns <= 0)
+    {
+        std::fprintf(stderr, "no %s in %s; regenerate it\n", reference, baseline_path);
+        return 1;
+    }
+
+    //! The comparison goes to stderr so stdout stays valid JSON. host_ns is
+    //! compared in units of the reference loop, so a faster or slower
+    //! machine scales both sides alike.
+    int regressions = 0;
+    int slower_paths = 0;
+    for (size_t i = 0; i != results.size(); ++i)
+    {
+        const result& r = results[i];
+        if (r.name == reference)
+            continue;
+        std::map<std::string, result>::const_iterator b = baseline.find(r.name);
+        if (b == baseline.end())
+        {
+            std::fprintf(stderr, "%-24s %10.2f ns   (not in baseline)\n", r.name.c_str(), r.host_ns);
+            continue;
+        }
+        double now = r.host_ns / run_ref->host_ns;
+        double then = b->second.host_ns / base_ref->second.host_ns;
+        double ratio = then > 0 ? now / then : 1.0;
+        //! Below a nanosecond the clock itself is the noise.
+        bool slower = ratio > 1.0 + tolerance && r.host_ns - b->second.host_ns * run_ref->host_ns /
+                                                                 base_ref->second.host_ns > 1.0;
+        bool pins = r.virtual_ns != b->second.virtual_ns;
+        regressions += pins;
+        slower_paths += slower;
+        std::fprintf(stderr, "%-24s %10.2f ns %6.2fx  virtual %8.1f ns%s%s\n", r.name.c_str(), r.host_ns, ratio,
+                     r.virtual_ns, slower ? "  slower?" : "", pins ? "  PIN TRAFFIC CHANGED" : "");
+    }
+    if (slower_paths)
+        std::fprintf(stderr, "%d hot paths look slower relative to %s; host timing is advisory\n", slower_paths,
+                     reference);
+    return regressions ? 1 : 0;
+}
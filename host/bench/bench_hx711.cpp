@@ -0,0 +1,101 @@
+//! Runs the real Hx711::readRaw() against the simulated HX711 and reports
+//! sample throughput and per-read latency, in virtual and wall-clock time.
+//! Every read is also checked bit-for-bit against the code the model sent,
+//! for both blocking readRaw() and interrupt-driven acquisition.
+//!
+//! usage: bench_hx711 [reads] [rate_sps]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "hx711_sim.hpp"
+
+int main(int argc, char** argv)
+{
+    int reads = argc > 1 ? std::atoi(argv[1]) : 400;
+    unsigned rate = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 80;
+
+    host::board& board = host::board::current();
+
+    sim::weight_script script;
+    script.add_ramp(reads / double(rate) * 2.0, 100.0);
+
+    sim::hx711::config cfg;
+    cfg.rate_sps = rate;
+    sim::hx711 adc(board, D13, D12, script, cfg);
+
+    Hx711 load_cell(D13, D12, 128);
+
+    //! Back-to-back reads: each one waits out the conversion, so the virtual
+    //! rate should sit at the strapped rate, and the wall rate shows what the
+    //! host pays to simulate that wait.
+    uint64_t virt_start = board.now_ns();
+    uint64_t wall_start = bench::wall_ns();
+    int mismatches = 0;
+    for (int i = 0; i != reads; ++i)
+    {
+        int32_t value = static_cast<int32_t>(load_cell.readRaw());
+        //! readRaw() inverts and increments: it returns the negated code.
+        if (value != -adc.last_code())
+            ++mismatches;
+    }
+    double virt_s = (board.now_ns() - virt_start) / 1e9;
+    double wall_s = (bench::wall_ns() - wall_start) / 1e9;
+
+    std::printf("hx711 @ %u SPS, %d back-to-back reads\n", rate, reads);
+    std::printf("%-28s %10.2f virtual  %12.0f wall\n", "samples/s", reads / virt_s, reads / wall_s);
+
+    //! Per-read latency once DOUT is already low: just the 24 + gain clocks.
+    bench::samples virt_us, wall_ns;
+    for (int i = 0; i != reads; ++i)
+    {
+        while (board.level(D12))
+            board.advance(10000);
+
+        uint64_t v0 = board.now_ns();
+        uint64_t w0 = bench::wall_ns();
+        int32_t value = static_cast<int32_t>(load_cell.readRaw());
+        uint64_t w1 = bench::wall_ns();
+
+        virt_us.add((board.now_ns() - v0) / 1e3);
+        wall_ns.add(static_cast<double>(w1 - w0));
+        if (value != -adc.last_code())
+            ++mismatches;
+    }
+    virt_us.print("readRaw latency (virtual)", "us");
+    wall_ns.print("readRaw latency (wall)", "ns");
+
+    //! Interrupt-driven acquisition: the core sleeps between conversions and
+    //! the data ready interrupt does the shifting.
+    static int async_count;
+    static int async_mismatches;
+    static sim::hx711* async_adc;
+    struct handler
+    {
+        static void on_sample(uint32_t raw)
+        {
+            ++async_count;
+            if (static_cast<int32_t>(raw) != -async_adc->last_code())
+                ++async_mismatches;
+        }
+    };
+    async_count = async_mismatches = 0;
+    async_adc = &adc;
+
+    uint64_t sleep_start = board.stats().sleep_ns;
+    virt_start = board.now_ns();
+    load_cell.start_async(handler::on_sample);
+    while (async_count < reads)
+        sleep();
+    load_cell.stop_async();
+    virt_s = (board.now_ns() - virt_start) / 1e9;
+    mismatches += async_mismatches;
+
+    std::printf("%-28s %10.2f virtual  %10.1f%% asleep\n", "async samples/s",
+                async_count / virt_s, (board.stats().sleep_ns - sleep_start) / 1e7 / virt_s);
+
+    std::printf("%-28s %10d\n", "decode mismatches", mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+//! Compares lab3/metronome.hpp with the metronome it replaced (a shifted
+//! array of millisecond tap times, the BPM recomputed on every call as the
+//! average of per-interval BPMs): the tempo each learns from human-like taps,
+//! with and without a missed tap, and the host cost of tap() and get_bpm().
+//!
+//! usage: bench_metronome [trials] [seed]
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "bench_util.hpp"
+#include "metronome.hpp"
+
+namespace
+{
+
+//! The old metronome, minus the guard against a zero interval it lacked.
+template <size_t BeatSamples>
+class legacy_metronome
+{
+public:
+    legacy_metronome() : m_timing(false), m_beat_count(0) {}
+
+    void start_timing() { m_beat_count = 0; m_timing = true; m_timer.start(); }
+    void stop_timing() { m_timing = false; m_timer.stop(); m_timer.reset(); }
+
+    void tap()
+    {
+        if (!m_timing)
+            return;
+        if (m_beat_count == BeatSamples)
+        {
+            for (size_t i = 1; i != m_beat_count; ++i)
+                m_beats[i - 1] = m_beats[i];
+            m_beat_count -= 1;
+        }
+        m_beats[m_beat_count++] = m_timer.read_ms();
+    }
+
+    size_t get_bpm() const
+    {
+        if (m_beat_count < BeatSamples)
+            return 0;
+        size_t average = 0;
+        for (size_t i = 1; i != m_beat_count; ++i)
+        {
+            size_t delta = m_beats[i] - m_beats[i - 1];
+            average += delta ? (60 * 1000) / delta : 0;
+        }
+        return average / (BeatSamples - 1);
+    }
+
+private:
+    bool m_timing;
+    Timer m_timer;
+    size_t m_beats[BeatSamples];
+    size_t m_beat_count;
+};
+
+//! Tap times for a tempo: every beat off by up to jitter_ms either way, and
+//! optionally one beat in the middle not tapped at all.
+std::vector<double> make_taps(std::mt19937& rng, double bpm, int taps, double jitter_ms, bool miss)
+{
+    std::uniform_real_distribution<double> jitter(-jitter_ms, jitter_ms);
+    std::vector<double> t;
+    double period_ms = 60000.0 / bpm;
+    for (int i = 0; i != taps + (miss ? 1 : 0); ++i)
+    {
+        if (miss && i == taps / 2 + 1)
+            continue;
+        t.push_back(500.0 + i * period_ms + jitter(rng));
+    }
+    return t;
+}
+
+template <typename Metronome>
+double learn(Metronome& m, host::board& board, const std::vector<double>& taps)
+{
+    uint64_t start = board.now_ns();
+    m.start_timing();
+    for (size_t i = 0; i != taps.size(); ++i)
+    {
+        board.advance_to(start + static_cast<uint64_t>(taps[i] * 1e6));
+        m.tap();
+    }
+    m.stop_timing();
+    return static_cast<double>(m.get_bpm());
+}
+
+struct errors
+{
+    bench::samples legacy, mean, median;
+};
+
+template <size_t N>
+void accuracy(int trials, uint32_t seed, bool miss)
+{
+    host::board board;
+    host::board::set_current(&board);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> tempo(60.0, 200.0);
+
+    errors e;
+    for (int k = 0; k != trials; ++k)
+    {
+        double bpm = tempo(rng);
+        std::vector<double> taps = make_taps(rng, bpm, static_cast<int>(N) + 2, 15.0, miss);
+
+        legacy_metronome<N> legacy;
+        basic_metronome<N> mean(basic_metronome<N>::mean);
+        basic_metronome<N> median(basic_metronome<N>::median);
+        e.legacy.add(std::fabs(learn(legacy, board, taps) - bpm));
+        e.mean.add(std::fabs(learn(mean, board, taps) - bpm));
+        e.median.add(std::fabs(learn(median, board, taps) - bpm));
+    }
+    host::board::set_current(0);
+
+    std::printf("%-3zu %-9s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", N, miss ? "one miss" : "steady",
+                e.legacy.percentile(50), e.legacy.percentile(90), e.mean.percentile(50), e.mean.percentile(90),
+                e.median.percentile(50), e.median.percentile(90));
+}
+
+//! Host cost of one tap() plus one get_bpm() with a full buffer.
+template <typename Metronome>
+double cost_ns(host::board& board, Metronome& m, int iterations)
+{
+    m.start_timing();
+    size_t sink = 0;
+    uint64_t w0 = bench::wall_ns();
+    for (int i = 0; i != iterations; ++i)
+    {
+        board.advance(500000000ull);
+        m.tap();
+        sink += m.get_bpm();
+    }
+    uint64_t w1 = bench::wall_ns();
+    bench::keep(sink);
+    m.stop_timing();
+    return double(w1 - w0) / iterations;
+}
+
+template <size_t N>
+void cost(int iterations)
+{
+    host::board board;
+    host::board::set_current(&board);
+    legacy_metronome<N> legacy;
+    basic_metronome<N> mean(basic_metronome<N>::mean);
+    basic_metronome<N> median(basic_metronome<N>::median);
+    double l = cost_ns(board, legacy, iterations);
+    double a = cost_ns(board, mean, iterations);
+    double m = cost_ns(board, median, iterations);
+    host::board::set_current(0);
+
+    std::printf("%-3zu %14.1f %14.1f %14.1f\n", N, l, a, m);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int trials = argc > 1 ? std::atoi(argv[1]) : 2000;
+    uint32_t seed = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1;
+
+    std::printf("BPM error over %d tempos from 60 to 200 BPM, taps within 15 ms\n", trials);
+    std::printf("%-3s %-9s %10s %10s %10s %10s %10s %10s\n", "N", "taps", "old p50", "old p90", "mean p50",
+                "mean p90", "median p50", "median p90");
+    accuracy<4>(trials, seed, false);
+    accuracy<4>(trials, seed, true);
+    accuracy<8>(trials, seed, false);
+    accuracy<8>(trials, seed, true);
+    accuracy<16>(trials, seed, false);
+    accuracy<16>(trials, seed, true);
+
+    std::printf("\nhost ns per tap() + get_bpm()\n");
+    std::printf("%-3s %14s %14s %14s\n", "N", "old", "mean", "median");
+    cost<4>(200000);
+    cost<16>(200000);
+    cost<64>(200000);
+    return 0;
+}
@@ -0,0 +1,220 @@
+//! What powering the HX711 down at rest buys and costs: the scale's chain
+//! (power_scheduler, filter, calibration, zero tracking, dose_detector) on
+//! the pill removal script, repeated with long quiet spells in between, with
+//! the ADC always on and with several idle periods.
+//!
+//! Reports how often the MCU wakes, how much of the time the ADC (and the
+//! bridge excitation it supplies) is powered, the average analog current that
+//! implies, and the reaction latency: from the bottle being picked up to the
+//! scale sampling at the full rate again, and from it being put back to the
+//! dose event.
+//!
+//! usage: bench_power [cycles] [quiet seconds]
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "calibration.hpp"
+#include "dose_detector.hpp"
+#include "filters.hpp"
+#include "hx711_sim.hpp"
+#include "power_scheduler.hpp"
+#include "zero_tracker.hpp"
+
+namespace
+{
+
+//! HX711 analog supply plus a 1 kOhm bridge on its 4.3 V excitation; both
+//! drop to under a microamp when powered down.
+const double adc_ma = 1.5 + 4.3;
+
+struct handling
+{
+    double lifted_s;
+    double settled_s;
+};
+
+struct scenario
+{
+    sim::weight_script script;
+    std::vector<handling> doses;
+};
+
+//! The pill removal script's eight doses, 30 s apart, then quiet_s of nothing,
+//! over and over; the bottle is topped back up between cycles.
+scenario make_scenario(int cycles, double quiet_s)
+{
+    const sim::weight_script one = sim::weight_script::pill_removal();
+    const std::vector<sim::weight_script::point>& p = one.points();
+    double period = one.duration_s() + quiet_s;
+
+    scenario s;
+    for (int c = 0; c != cycles; ++c)
+    {
+        double base = c * period;
+        for (size_t i = 0; i != p.size(); ++i)
+        {
+            if (p[i].ramp)
+                s.script.add_ramp(base + p[i].time_s, p[i].grams);
+            else
+                s.script.add_step(base + p[i].time_s, p[i].grams);
+        }
+        for (int i = 1; i <= 8; ++i)
+        {
+            handling h = { base + 5.0 + 30.0 * i, base + 7.7 + 30.0 * i };
+            s.doses.push_back(h);
+        }
+        s.script.add_step(base + period - 1.0, p.back().grams);
+        s.script.add_ramp(base + period - 0.5, 0.0);
+    }
+    return s;
+}
+
+std::vector<uint32_t>* g_raw = 0;
+power_scheduler* g_power = 0;
+
+void on_sample(uint32_t raw)
+{
+    g_raw->push_back(raw);
+    if (g_power)
+        g_power->converted(raw);
+}
+
+struct outcome
+{
+    double hours;
+    uint64_t mcu_wakeups;
+    double adc_on;              // fraction of the run
+    uint32_t events;
+    bench::samples react_ms;    // picked up -> full rate
+    bench::samples detect_ms;   // put back -> dose event
+};
+
+outcome run(const scenario& s, unsigned rate, uint32_t idle_period_ms)
+{
+    host::board board;
+    host::board::set_current(&board);
+
+    sim::hx711::config cfg;
+    cfg.rate_sps = rate;
+    sim::hx711 adc(board, D13, D12, s.script, cfg);
+
+    std::vector<uint32_t> raw;
+    g_raw = &raw;
+    Hx711 load_cell(D13, D12, 128);
+    load_cell.start_async(on_sample);
+
+    const power_scheduler::config power_config = { idle_period_ms, 100, 30, 3000 };
+    power_scheduler power(load_cell, power_config);
+    bool scheduled = idle_period_ms != 0;
+    g_power = &power;
+
+    constexpr calibration_point points[] = { { -38140, 10000 }, { 51860, 0 } };
+    constexpr calibration_table<2> calibration(points);
+    filter_chain<running_median<5>, moving_average<8> > filter;
+    zero_tracker zero;
+    dose_detector detector(dose_detector::for_pill(500));
+
+    std::vector<uint32_t> activations, detections;
+    uint64_t end = static_cast<uint64_t>(s.script.duration_s() * 1e9);
+    while (board.now_ns() < end)
+    {
+        raw.clear();
+        sleep();
+        uint32_t now_ms = static_cast<uint32_t>(board.now_ns() / 1000000);
+        for (size_t i = 0; i != raw.size(); ++i)
+        {
+            int32_t gross;
+            if (power.idle())
+            {
+                if (power.check(calibration.to_milligrams(static_cast<int32_t>(raw[i])), now_ms))
+                {
+                    activations.push_back(now_ms);
+                    filter.reset();
+                    continue;
+                }
+                gross = power.level();
+            }
+            else
+            {
+                filter.update(static_cast<int32_t>(raw[i]));
+                if (!filter.ready())
+                    continue;
+                gross = calibration.to_milligrams(filter.value());
+                if (scheduled)
+                    power.track(gross, now_ms);
+            }
+            if (detector.update(zero.update(gross), now_ms))
+                detections.push_back(detector.last().detected_ms);
+        }
+    }
+    load_cell.stop_async();
+    g_power = 0;
+
+    outcome o = outcome();
+    o.hours = board.now_ns() / 3600e9;
+    o.mcu_wakeups = board.stats().isrs;
+    o.adc_on = double(adc.powered_ns()) / board.now_ns();
+    o.events = detector.stats().events;
+    host::board::set_current(0);
+
+    //! The first activation and detection after each handling; always on, the
+    //! scale is already at the full rate.
+    size_t a = 0, d = 0;
+    for (size_t h = 0; h != s.doses.size(); ++h)
+    {
+        double lifted_ms = s.doses[h].lifted_s * 1000.0, settled_ms = s.doses[h].settled_s * 1000.0;
+        while (a != activations.size() && activations[a] < lifted_ms)
+            ++a;
+        if (!scheduled)
+            o.react_ms.add(0.0);
+        else if (a != activations.size())
+            o.react_ms.add(activations[a] - lifted_ms);
+
+        while (d != detections.size() && detections[d] < settled_ms)
+            ++d;
+        if (d != detections.size())
+            o.detect_ms.add(detections[d] - settled_ms);
+    }
+    return o;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int cycles = argc > 1 ? std::atoi(argv[1]) : 4;
+    double quiet_s = argc > 2 ? std::atof(argv[2]) : 1800.0;
+
+    scenario s = make_scenario(cycles, quiet_s);
+
+    //! Each refill is an event too: eight pills put back.
+    int expected = 9 * cycles - 1;
+    std::printf("%d cycles of 8 doses and %.0f s quiet, %.1f h, %zu handlings\n", cycles, quiet_s,
+                s.script.duration_s() / 3600.0, s.doses.size());
+    std::printf("%-4s %-10s %10s %8s %8s %7s %11s %11s %11s\n", "SPS", "idle", "wakeups/h", "ADC on",
+                "ADC mA", "events", "react p50", "react max", "detect p99");
+
+    const unsigned rates[] = { 10, 80 };
+    const uint32_t periods[] = { 0, 500, 1000, 2000, 5000 };
+    for (size_t r = 0; r != sizeof(rates) / sizeof(rates[0]); ++r)
+    {
+        for (size_t p = 0; p != sizeof(periods) / sizeof(periods[0]); ++p)
+        {
+            outcome o = run(s, rates[r], periods[p]);
+            char idle[16];
+            if (periods[p])
+                std::snprintf(idle, sizeof(idle), "%u ms", periods[p]);
+            else
+                std::snprintf(idle, sizeof(idle), "always on");
+            std::printf("%-4u %-10s %10.0f %7.1f%% %8.2f %3u/%-3d %8.0f ms %8.0f ms %8.0f ms\n", rates[r], idle,
+                        o.mcu_wakeups / o.hours, o.adc_on * 100.0, o.adc_on * adc_ma, o.events, expected,
+                        o.react_ms.percentile(50), o.react_ms.max(), o.detect_ms.percentile(99));
+        }
+    }
+    return 0;
+}
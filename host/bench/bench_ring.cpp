@@ -0,0 +1,97 @@
+//! Drives sample_ring the way the scale firmware does: the HX711 data ready
+//! interrupt pushes at the ADC rate while a main loop drains it in batches and
+//! then stalls for a configurable time (standing in for network work). Reports
+//! overruns and high water per stall time, and the wall cost of push/drain.
+//!
+//! usage: bench_ring [rate_sps]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "hx711_sim.hpp"
+#include "sample_ring.hpp"
+
+namespace
+{
+
+typedef sample_ring<sample, 64> ring_type;
+ring_type* g_ring = 0;
+
+void on_sample(uint32_t raw)
+{
+    sample s = { us_ticker_read(), static_cast<int32_t>(raw) };
+    g_ring->push(s);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    unsigned rate = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 80;
+
+    host::board& board = host::board::current();
+    sim::weight_script script;
+    sim::hx711::config cfg;
+    cfg.rate_sps = rate;
+    sim::hx711 adc(board, D13, D12, script, cfg);
+
+    ring_type ring;
+    g_ring = &ring;
+
+    Hx711 load_cell(D13, D12, 128);
+    load_cell.start_async(on_sample);
+
+    std::printf("sample_ring<sample, %d> @ %u SPS, 10 s per stall time\n", int(ring_type::capacity), rate);
+    std::printf("%-12s %10s %10s %10s %12s\n", "stall ms", "drained", "overruns", "high water", "batch avg");
+
+    const int stalls_ms[] = { 0, 50, 200, 500, 800, 1000 };
+    for (size_t k = 0; k != sizeof(stalls_ms) / sizeof(stalls_ms[0]); ++k)
+    {
+        //! Fresh counters for every stall time.
+        __disable_irq();
+        ring_type fresh;
+        g_ring = &fresh;
+        __enable_irq();
+
+        uint64_t end = board.now_ns() + 10000000000ull;
+        uint64_t drained = 0, batches = 0;
+        while (board.now_ns() < end)
+        {
+            __disable_irq();
+            if (fresh.empty())
+                sleep();
+            __enable_irq();
+
+            sample batch[ring_type::capacity];
+            size_t n = fresh.drain(batch, ring_type::capacity);
+            if (n)
+            {
+                drained += n;
+                ++batches;
+                wait_ms(stalls_ms[k]);
+            }
+        }
+        std::printf("%-12d %10llu %10lu %10lu %12.1f\n", stalls_ms[k], (unsigned long long)drained,
+                    (unsigned long)fresh.overruns(), (unsigned long)fresh.high_water(),
+                    batches ? double(drained) / batches : 0.0);
+        g_ring = &ring;
+    }
+    load_cell.stop_async();
+
+    //! Raw cost of the ring operations themselves.
+    const int ops = 1000000;
+    sample s = { 0, 0 }, batch[16];
+    uint64_t t0 = bench::wall_ns();
+    for (int i = 0; i != ops; ++i)
+    {
+        s.raw = i;
+        ring.push(s);
+        if ((i & 15) == 15)
+            bench::keep(ring.drain(batch, 16));
+    }
+    uint64_t t1 = bench::wall_ns();
+    std::printf("%-28s %10.2f ns per sample (push + batched drain)\n", "ring cost", double(t1 - t0) / ops);
+    return 0;
+}
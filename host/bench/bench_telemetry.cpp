@@ -0,0 +1,207 @@
+//! What the mass costs on the wire: the old path (a "%f" text value every
+//! 2 s), the change-driven 5700 resource, and SenML-CBOR history batches of
+//! various sizes. Reports notifications per hour and bytes per sample, both
+//! payload only and with an estimate of the per-notification overhead.
+//!
+//! Then the store-and-forward log (history_log.hpp) at a few resolutions:
+//! its compression, how many hours the firmware's 32 blocks would hold of
+//! this, and the worst error of the readings decoded back from its blocks.
+//!
+//! usage: bench_telemetry [hours]
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "Hx711.h"
+#include "calibration.hpp"
+#include "filters.hpp"
+#include "history_log.hpp"
+#include "hx711_sim.hpp"
+#include "publish_policy.hpp"
+#include "scale_config.hpp"
+#include "senml_batch.hpp"
+#include "value_codec.hpp"
+#include "zero_tracker.hpp"
+
+namespace
+{
+
+//! IPv4 + UDP + DTLS 1.2 record (AES-CCM-8) + a CoAP notification with a
+//! 4 byte token, Observe and Content-Format options.
+const double overhead_bytes = 20 + 8 + 29 + 12;
+
+struct reading
+{
+    uint32_t ms;
+    int32_t mg;
+};
+
+std::vector<uint32_t>* g_raw = 0;
+
+void on_sample(uint32_t raw)
+{
+    g_raw->push_back(raw);
+}
+
+//! The scale's readings over the pill removal script, repeated to fill the run.
+std::vector<reading> record(double hours)
+{
+    sim::weight_script script;
+    sim::weight_script one = sim::weight_script::pill_removal();
+    double period = one.duration_s() + 60.0;
+    for (double base = 0.0; base < hours * 3600.0; base += period)
+    {
+        const std::vector<sim::weight_script::point>& p = one.points();
+        for (size_t i = 0; i != p.size(); ++i)
+        {
+            if (p[i].ramp)
+                script.add_ramp(base + p[i].time_s, p[i].grams);
+            else
+                script.add_step(base + p[i].time_s, p[i].grams);
+        }
+        script.add_ramp(base + period - 1.0, 0.0);
+    }
+
+    host::board& board = host::board::current();
+    sim::hx711 adc(board, D13, D12, script, sim::hx711::config());
+
+    std::vector<uint32_t> raw;
+    g_raw = &raw;
+    Hx711 load_cell(D13, D12, 128);
+    load_cell.start_async(on_sample);
+
+    constexpr calibration_point points[] = { { -38140, 10000 }, { 51860, 0 } };
+    constexpr calibration_table<2> calibration(points);
+    filter_chain<running_median<5>, moving_average<8> > filter;
+    zero_tracker zero;
+
+    std::vector<reading> out;
+    uint64_t end = static_cast<uint64_t>(hours * 3600e9);
+    while (board.now_ns() < end)
+    {
+        raw.clear();
+        sleep();
+        for (size_t i = 0; i != raw.size(); ++i)
+        {
+            filter.update(static_cast<int32_t>(raw[i]));
+            if (!filter.ready())
+                continue;
+            reading r = { static_cast<uint32_t>(board.now_ns() / 1000000),
+                          zero.update(calibration.to_milligrams(filter.value())) };
+            out.push_back(r);
+        }
+    }
+    load_cell.stop_async();
+    return out;
+}
+
+void report(const char* name, double hours, uint64_t notifications, uint64_t samples, uint64_t bytes)
+{
+    std::printf("%-30s %10.1f %10.1f %10.2f %10.2f\n", name, notifications / hours,
+                notifications ? double(samples) / notifications : 0.0, samples ? double(bytes) / samples : 0.0,
+                samples ? (bytes + notifications * overhead_bytes) / samples : 0.0);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    double hours = argc > 1 ? std::atof(argv[1]) : 2.0;
+    std::vector<reading> readings = record(hours);
+
+    std::printf("%.1f h of readings, %.0f bytes overhead per notification\n", hours, overhead_bytes);
+    std::printf("%-30s %10s %10s %10s %10s\n", "path", "notif/h", "samples", "B/sample", "wire B/s.");
+
+    //! Before: sprintf("%f") of the newest reading every 2 s.
+    {
+        uint64_t n = 0, bytes = 0;
+        uint32_t next = 0;
+        for (size_t i = 0; i != readings.size(); ++i)
+        {
+            if (readings[i].ms < next)
+                continue;
+            next = readings[i].ms + 2000;
+            char text[32];
+            bytes += std::sprintf(text, "%f", readings[i].mg / 1000.0f);
+            ++n;
+        }
+        report("text every 2 s (old)", hours, n, n, bytes);
+    }
+
+    //! Change-driven text, as 5700 is published now. Not a full history.
+    {
+        const publish_policy::config cfg = { 50, 20, 1000, 60000 };
+        publish_policy policy(cfg);
+        uint64_t n = 0, bytes = 0;
+        for (size_t i = 0; i != readings.size(); ++i)
+        {
+            if (!policy.offer(readings[i].mg, readings[i].ms))
+                continue;
+            char text[codec::max_chars];
+            bytes += codec::format_fixed(text, sizeof(text), readings[i].mg, 3);
+            ++n;
+        }
+        report("text on change (5700)", hours, n, n, bytes);
+    }
+
+    //! SenML-CBOR batches of a 1 s series.
+    const size_t sizes[] = { 8, 30, 60, 120 };
+    for (size_t k = 0; k != sizeof(sizes) / sizeof(sizes[0]); ++k)
+    {
+        const senml_batch<120>::config cfg = { "3318/0/5700", "mg", 1000, 10 * 60 * 1000, sizes[k] };
+        senml_batch<120> batch(cfg);
+        uint8_t payload[senml_batch<120>::max_payload];
+        for (size_t i = 0; i != readings.size(); ++i)
+            if (batch.add(readings[i].mg, readings[i].ms))
+                batch.encode(payload, sizeof(payload), readings[i].ms);
+
+        char name[40];
+        std::snprintf(name, sizeof(name), "senml-cbor 1 s x %zu", sizes[k]);
+        report(name, hours, batch.stats().batches, batch.stats().samples - batch.size(), batch.stats().bytes);
+    }
+
+    //! The log with room for the whole run, so nothing is overwritten; the
+    //! firmware's ring is scale_log.
+    typedef history_log<4096, 128> long_log;
+    const uint32_t ring_bytes = 32 * (scale_log::header_bytes + 128);
+    std::printf("\n%-30s %10s %10s %10s %10s\n", "history log", "ratio", "B/hour", "hours", "max err mg");
+    const int32_t resolutions[] = { 1, 10, 50 };
+    for (size_t k = 0; k != sizeof(resolutions) / sizeof(resolutions[0]); ++k)
+    {
+        const long_log::config cfg = { 1000, resolutions[k] };
+        long_log* log = new long_log(cfg);
+        std::vector<reading> kept;
+        for (size_t i = 0; i != readings.size(); ++i)
+            if (log->record(readings[i].mg, readings[i].ms))
+                kept.push_back(readings[i]);
+        uint32_t ratio = log->compression_x100();
+        uint32_t bytes = log->stored_bytes();
+
+        //! Decode every block and match it against what went in.
+        uint8_t payload[long_log::max_payload];
+        size_t index = 0;
+        int32_t worst = 0;
+        bool ok = true;
+        while (size_t length = log->encode_next(payload, sizeof(payload), 0))
+            ok = long_log::decode(payload, length, [&](uint32_t ms, int32_t mg) {
+                if (index == kept.size() || kept[index].ms / 1000 != ms / 1000)
+                    ok = false;
+                else if (std::abs(mg - kept[index].mg) > worst)
+                    worst = std::abs(mg - kept[index].mg);
+                ++index;
+            }) && ok;
+        if (!ok || index != kept.size())
+        {
+            std::fprintf(stderr, "history log at %d mg does not decode to what went in\n", resolutions[k]);
+            return 1;
+        }
+
+        char name[40];
+        std::snprintf(name, sizeof(name), "%d mg, 1 s", resolutions[k]);
+        std::printf("%-30s %10.2f %10.0f %10.1f %10d\n", name, ratio / 100.0, bytes / hours,
+                    bytes ? ring_bytes * hours / bytes : 0.0, worst);
+        delete log;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+//! Small helpers shared by the host benchmarks: a wall clock and a sample set
+//! that reports percentiles.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bench
+{
+
+inline uint64_t wall_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//! Keep the optimiser from discarding a computed value.
+template <typename T>
+inline void keep(const T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+class samples
+{
+public:
+    void add(double v) { m_values.push_back(v); m_sorted = false; }
+    size_t size() const { return m_values.size(); }
+
+    double percentile(double p)
+    {
+        if (m_values.empty())
+            return 0.0;
+        sort();
+        size_t index = static_cast<size_t>(p / 100.0 * (m_values.size() - 1) + 0.5);
+        return m_values[index];
+    }
+
+    double mean() const
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i != m_values.size(); ++i)
+            sum += m_values[i];
+        return m_values.empty() ? 0.0 : sum / m_values.size();
+    }
+
+    double min() { sort(); return m_values.empty() ? 0.0 : m_values.front(); }
+    double max() { sort(); return m_values.empty() ? 0.0 : m_values.back(); }
+
+    //! One line: "<name>: mean p50 p99 max <unit>".
+    void print(const char* name, const char* unit)
+    {
+        std::printf("%-28s mean %10.2f  p50 %10.2f  p99 %10.2f  max %10.2f %s\n",
+                    name, mean(), percentile(50), percentile(99), max(), unit);
+    }
+
+private:
+    void sort()
+    {
+        if (!m_sorted)
+            std::sort(m_values.begin(), m_values.end());
+        m_sorted = true;
+    }
+
+    std::vector<double> m_values;
+    bool m_sorted = false;
+};
+
+} // namespace bench
@@ -0,0 +1,160 @@
+//! Host wiring for the metronome firmware (lab3/main.cpp): SW3 (mode) and SW2
+//! (tap) are pressed on a script that teaches the metronome a tempo, and the
+//! green LED pulses are checked against that tempo when the run ends: how far
+//! each beat is off an exact grid started at the first one (jitter), and how
+//! far the last one is (drift).
+//!
+//! Environment:
+//!     METRONOME_BPM     tempo tapped in (default 120)
+//!     METRONOME_RETUNE  "<seconds>:<bpm>" PUTs a new tempo to 5700 then
+//!     HOST_RUN_SECONDS  virtual run time (default 60 s)
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "button_sim.hpp"
+#include "frdm_client.hpp"
+#include "mbed.h"
+
+namespace
+{
+
+const uint64_t second_ns = 1000000000ull;
+
+unsigned load_bpm()
+{
+    const char* bpm = std::getenv("METRONOME_BPM");
+    return bpm && std::atoi(bpm) > 0 ? static_cast<unsigned>(std::atoi(bpm)) : 120;
+}
+
+//! Times at which the (active low) green LED was switched on.
+class pulse_log : public host::peripheral
+{
+public:
+    explicit pulse_log(host::board& board) : m_board(board) { m_board.attach(LED_GREEN, this); }
+    ~pulse_log() { m_board.detach(LED_GREEN, this); }
+
+    const std::vector<uint64_t>& on_ns() const { return m_on; }
+
+private:
+    void pin_written(PinName, int level)
+    {
+        if (!level)
+            m_on.push_back(m_board.now_ns());
+    }
+
+    host::board& m_board;
+    std::vector<uint64_t> m_on;
+};
+
+//! Beats [begin, end) against a grid of period_ns started at the first.
+void report_grid(const char* name, const std::vector<uint64_t>& t, size_t begin, size_t end, double period_ns)
+{
+    if (end - begin < 2)
+        return;
+
+    double worst = 0.0;
+    for (size_t i = begin; i != end; ++i)
+    {
+        double error = std::abs(double(t[i] - t[begin]) - (i - begin) * period_ns);
+        worst = error > worst ? error : worst;
+    }
+    double drift = double(t[end - 1] - t[begin]) - (end - 1 - begin) * period_ns;
+    std::fprintf(stderr, "[host] metronome: %s %zu beats, worst %.3f us off the grid, drift %+.3f us\n",
+                 name, end - begin, worst / 1e3, drift / 1e3);
+}
+
+struct metronome_board
+{
+    host::board& board;
+    sim::button mode;
+    sim::button tap;
+    pulse_log pulses;
+    unsigned bpm;
+    uint64_t taught_at;
+    uint64_t retune_at;
+    unsigned retune_bpm;
+    std::chrono::steady_clock::time_point wall_start;
+
+    metronome_board()
+    : board(host::board::current()), mode(board, SW3), tap(board, SW2), pulses(board), bpm(load_bpm()),
+      taught_at(0), retune_at(0), retune_bpm(0), wall_start(std::chrono::steady_clock::now())
+    {
+        if (!board.run_limit_ns())
+            board.set_run_limit_ns(60 * second_ns);
+
+        //! Enter learn mode at 1 s, tap six beats, then leave learn mode.
+        uint64_t period = 60 * second_ns / bpm;
+        uint64_t t = 2 * second_ns;
+
+        mode.press_at(1 * second_ns);
+        for (int i = 0; i != 6; ++i, t += period)
+            tap.press_at(t, period / 4);
+        taught_at = t;
+        mode.press_at(taught_at);
+
+        const char* retune = std::getenv("METRONOME_RETUNE");
+        if (retune)
+        {
+            char* end = 0;
+            retune_at = static_cast<uint64_t>(std::strtod(retune, &end) * 1e9);
+            retune_bpm = *end == ':' ? static_cast<unsigned>(std::atoi(end + 1)) : 0;
+            host::board* b = &board;
+            std::string payload = std::to_string(retune_bpm);
+            board.schedule_at(retune_at, [b, payload]() {
+                frdm_client* client = frdm_client::registered(*b);
+                if (!client || !client->put("3318/0/5700", payload))
+                    std::fprintf(stderr, "[host] metronome: cannot PUT the new tempo\n");
+            }, host::board::hardware);
+        }
+    }
+
+    ~metronome_board()
+    {
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        double virt = board.now_ns() / 1e9;
+
+        //! Every pulse is one write on and one write off.
+        uint64_t pulses = board.write_count(LED_GREEN) / 2;
+        double expected = (board.now_ns() - taught_at) / 1e9 * bpm / 60.0;
+        if (retune_bpm && retune_at < board.now_ns())
+            expected = (retune_at - taught_at) / 1e9 * bpm / 60.0 + (board.now_ns() - retune_at) / 1e9 * retune_bpm / 60.0;
+
+        std::fprintf(stderr, "[host] metronome: %.1f s virtual in %.3f s wall\n", virt, wall);
+        std::fprintf(stderr, "[host] metronome: tapped %u BPM, published %s BPM\n",
+                     bpm, frdm_client::last_value("3318/0/5700").c_str());
+        std::fprintf(stderr, "[host] metronome: %llu green pulses, %.1f expected\n",
+                     (unsigned long long)pulses, expected);
+
+        const std::vector<uint64_t>& t = this->pulses.on_ns();
+        size_t first = 0;
+        while (first != t.size() && t[first] < taught_at)
+            ++first;
+        size_t split = first;
+        while (split != t.size() && (!retune_bpm || t[split] < retune_at))
+            ++split;
+        report_grid("tapped tempo:", t, first, split, 60e9 / bpm);
+
+        //! The first beat after the retune should come when the beat in
+        //! progress would have ended, stretched to the new tempo.
+        if (retune_bpm && split != first && split != t.size())
+        {
+            double old_period = 60e9 / bpm, new_period = 60e9 / retune_bpm;
+            double phase = double(retune_at - t[split - 1]) / old_period;
+            double expected_ns = retune_at + (1.0 - phase) * new_period;
+            std::fprintf(stderr, "[host] metronome: retuned to %u BPM, first beat %+.3f us off the same phase\n",
+                         retune_bpm, (t[split] - expected_ns) / 1e3);
+            report_grid("new tempo:", t, split, t.size(), new_period);
+        }
+        std::fprintf(stderr, "[host] connector: %llu notifications\n",
+                     (unsigned long long)frdm_client::totals().notifications);
+    }
+};
+
+metronome_board g_metronome_board;
+
+}
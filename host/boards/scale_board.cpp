@@ -0,0 +1,183 @@
+//! Host wiring for the scale firmware (mbed_code/main.cpp): an HX711 model on
+//! D13/D12 loaded from a weight script, and a report when the run ends.
+//!
+//! Environment:
+//!     HX711_SCRIPT      weight script file (default: built-in pill removal)
+//!     HX711_RATE        10 or 80 samples/s (default 10)
+//!     HOST_RUN_SECONDS  virtual run time (default: script length + 30 s)
+//!     HOST_FLASH        file backing the MCU flash, so the tare survives runs
+//!     SCALE_TARE_AT     seconds at which to POST the tare resource
+//!     SCALE_CLOCK       local time of day at power up, HH:MM[:SS]; PUT to
+//!                       the schedule's clock once the firmware has registered
+//!     SCALE_SCHEDULE    prescription PUT at the same time, e.g. "08:00=1"
+//!     HX711_RECORD      file to record every conversion read to, as a raw
+//!                       trace (mbed_code/raw_trace.hpp) for host/tools/replay
+//!
+//! Sensor faults (see sim::hx711::config):
+//!     HX711_DROPOUT     fraction of conversions lost, e.g. 0.05
+//!     HX711_DEAD_AT     seconds after which no conversion signals
+//!     HX711_RAIL_AT     seconds after which the code sticks at 0x7FFFFF
+//!     HX711_STUCK       code bits stuck, as mask:bits in hex, e.g. 0x4:0x0
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "Hx711.h"
+#include "frdm_client.hpp"
+#include "hx711_sim.hpp"
+#include "mbed.h"
+#include "raw_trace.hpp"
+
+namespace
+{
+
+sim::weight_script load_script()
+{
+    sim::weight_script script = sim::weight_script::pill_removal();
+
+    const char* path = std::getenv("HX711_SCRIPT");
+    if (path && !script.load(path))
+        std::fprintf(stderr, "[host] cannot load %s; using the built-in script\n", path);
+    return script;
+}
+
+sim::hx711::config load_config()
+{
+    sim::hx711::config cfg;
+    const char* rate = std::getenv("HX711_RATE");
+    if (rate)
+        cfg.rate_sps = static_cast<unsigned>(std::atoi(rate));
+
+    const char* dropout = std::getenv("HX711_DROPOUT");
+    if (dropout)
+        cfg.dropout = std::atof(dropout);
+    const char* dead_at = std::getenv("HX711_DEAD_AT");
+    if (dead_at)
+        cfg.dead_at_s = std::atof(dead_at);
+    const char* rail_at = std::getenv("HX711_RAIL_AT");
+    if (rail_at)
+        cfg.rail_at_s = std::atof(rail_at);
+    const char* stuck = std::getenv("HX711_STUCK");
+    if (stuck)
+    {
+        char* end = 0;
+        cfg.stuck_mask = static_cast<uint32_t>(std::strtoul(stuck, &end, 16));
+        cfg.stuck_bits = *end == ':' ? static_cast<uint32_t>(std::strtoul(end + 1, 0, 16)) : 0;
+    }
+    return cfg;
+}
+
+struct scale_board
+{
+    host::board& board;
+    sim::weight_script script;
+    sim::hx711 adc;
+    std::FILE* trace;
+    std::chrono::steady_clock::time_point wall_start;
+
+    scale_board()
+    : board(host::board::current()), script(load_script()),
+      adc(board, D13, D12, script, load_config()), trace(0), wall_start(std::chrono::steady_clock::now())
+    {
+        if (!board.run_limit_ns())
+            board.set_run_limit_ns(static_cast<uint64_t>((script.duration_s() + 30.0) * 1e9));
+
+        const char* tare_at = std::getenv("SCALE_TARE_AT");
+        if (tare_at)
+        {
+            host::board* b = &board;
+            board.schedule_at(static_cast<uint64_t>(std::atof(tare_at) * 1e9), [b]() {
+                frdm_client* client = frdm_client::registered(*b);
+                if (!client || !client->post("3318/0/5821"))
+                    std::fprintf(stderr, "[host] tare: no tare resource registered\n");
+            }, host::board::hardware);
+        }
+
+        //! Both written two seconds in, by when the firmware has registered,
+        //! the clock as it reads by then.
+        const char* clock = std::getenv("SCALE_CLOCK");
+        const char* prescription = std::getenv("SCALE_SCHEDULE");
+        if (clock || prescription)
+        {
+            const double put_at_s = 2.0;
+            unsigned hours = 0, minutes = 0, seconds = 0;
+            if (clock && std::sscanf(clock, "%u:%u:%u", &hours, &minutes, &seconds) < 2)
+                std::fprintf(stderr, "[host] SCALE_CLOCK is HH:MM[:SS], not %s\n", clock);
+            std::string now = clock ? std::to_string((hours * 3600 + minutes * 60 + seconds +
+                                                      static_cast<unsigned>(put_at_s)) % 86400)
+                                    : std::string();
+            std::string doses = prescription ? prescription : "";
+            host::board* b = &board;
+            board.schedule_at(static_cast<uint64_t>(put_at_s * 1e9), [b, now, doses]() {
+                frdm_client* client = frdm_client::registered(*b);
+                if (!client || (!now.empty() && !client->put("26251/0/1", now)) ||
+                    (!doses.empty() && !client->put("26251/0/0", doses)))
+                    std::fprintf(stderr, "[host] schedule: no schedule resources registered\n");
+            }, host::board::hardware);
+        }
+
+        //! Each frame as the driver decodes it, stamped when it was read.
+        const char* record = std::getenv("HX711_RECORD");
+        if (record && !(trace = std::fopen(record, "w")))
+            std::fprintf(stderr, "[host] cannot write %s\n", record);
+        if (trace)
+        {
+            std::fprintf(trace, "# hx711 raw trace, %u SPS, %s\n", load_config().rate_sps,
+                         std::getenv("HX711_SCRIPT") ? std::getenv("HX711_SCRIPT") : "pill removal");
+            std::FILE* out = trace;
+            host::board* b = &board;
+            adc.on_frame([out, b](int32_t code) {
+                sample s = { static_cast<uint32_t>(b->now_ns() / 1000),
+                             static_cast<int32_t>(Hx711::decode(static_cast<uint32_t>(code) & 0xFFFFFF)) };
+                char line[raw_trace::max_record];
+                std::fwrite(line, 1, raw_trace::format(line, sizeof(line), s), out);
+            });
+        }
+    }
+
+    ~scale_board()
+    {
+        if (trace)
+            std::fclose(trace);
+
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        double virt = board.now_ns() / 1e9;
+        const sim::hx711::statistics& s = adc.stats();
+
+        std::fprintf(stderr, "[host] scale: %.1f s virtual in %.3f s wall, %.1f%% asleep\n",
+                     virt, wall, virt > 0 ? board.stats().sleep_ns / 1e7 / virt : 0.0);
+        std::fprintf(stderr, "[host] scale: %.0f interrupts/h, ADC powered %.1f%% of the time (%llu power-downs)\n",
+                     virt > 0 ? board.stats().isrs * 3600.0 / virt : 0.0,
+                     virt > 0 ? adc.powered_ns() / 1e7 / virt : 0.0, (unsigned long long)s.power_downs);
+        std::fprintf(stderr, "[host] hx711: %llu conversions, %llu reads, %llu overwritten, %llu dropped\n",
+                     (unsigned long long)s.conversions, (unsigned long long)s.reads,
+                     (unsigned long long)s.overwritten, (unsigned long long)s.dropped);
+        if (s.reads)
+        {
+            std::fprintf(stderr, "[host] hx711: %.2f samples/s virtual, %.0f samples/s wall\n",
+                         s.reads / virt, wall > 0 ? s.reads / wall : 0.0);
+            std::fprintf(stderr, "[host] hx711: read frame %.2f us avg (%.2f..%.2f us virtual)\n",
+                         s.frames ? s.frame_ns_total / 1e3 / s.frames : 0.0, s.frame_ns_min / 1e3, s.frame_ns_max / 1e3);
+        }
+        std::fprintf(stderr, "[host] connector: %llu notifications, %llu payload bytes\n",
+                     (unsigned long long)frdm_client::totals().notifications,
+                     (unsigned long long)frdm_client::totals().payload_bytes);
+
+        //! Per resource, scaled to an hour so runs of any length compare.
+        const char* paths[] = { "3318/0/5700", "3318/0/26241", "3318/0/26243", "3318/0/26244", "3318/0/26245" };
+        for (size_t i = 0; i != sizeof(paths) / sizeof(paths[0]); ++i)
+        {
+            frdm_client::statistics p = frdm_client::totals(paths[i]);
+            if (!p.notifications || virt <= 0)
+                continue;
+            std::fprintf(stderr, "[host] connector: %-13s %7.1f notifications/h, %6.1f bytes each\n", paths[i],
+                         p.notifications * 3600.0 / virt, double(p.payload_bytes) / p.notifications);
+        }
+    }
+};
+
+scale_board g_scale_board;
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//! Host stand-in: the network is always up.
+class NetworkInterface
+{
+public:
+    virtual ~NetworkInterface() {}
+    virtual int connect() { return 0; }
+    virtual int disconnect() { return 0; }
+    virtual const char* get_ip_address() { return "127.0.0.1"; }
+};
+
+class EthernetInterface : public NetworkInterface
+{
+};
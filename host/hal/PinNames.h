@@ -0,0 +1,81 @@
+#pragma once
+
+//! Host stand-in for the FRDM-K22F pin map. A pin is encoded as (port << 5) |
+//! bit so that PortIn/PortOut can recover the port and mask, as on the part.
+typedef enum {
+    PortA = 0,
+    PortB = 1,
+    PortC = 2,
+    PortD = 3,
+    PortE = 4
+} PortName;
+
+typedef enum {
+    PTA0 = (0 << 5) | 0, PTA1 = (0 << 5) | 1, PTA2 = (0 << 5) | 2, PTA3 = (0 << 5) | 3,
+    PTA4 = (0 << 5) | 4, PTA5 = (0 << 5) | 5, PTA6 = (0 << 5) | 6, PTA7 = (0 << 5) | 7,
+    PTA8 = (0 << 5) | 8, PTA9 = (0 << 5) | 9, PTA10 = (0 << 5) | 10, PTA11 = (0 << 5) | 11,
+    PTA12 = (0 << 5) | 12, PTA13 = (0 << 5) | 13, PTA14 = (0 << 5) | 14, PTA15 = (0 << 5) | 15,
+    PTA16 = (0 << 5) | 16, PTA17 = (0 << 5) | 17, PTA18 = (0 << 5) | 18, PTA19 = (0 << 5) | 19,
+    PTA20 = (0 << 5) | 20, PTA21 = (0 << 5) | 21, PTA22 = (0 << 5) | 22, PTA23 = (0 << 5) | 23,
+    PTA24 = (0 << 5) | 24, PTA25 = (0 << 5) | 25, PTA26 = (0 << 5) | 26, PTA27 = (0 << 5) | 27,
+    PTA28 = (0 << 5) | 28, PTA29 = (0 << 5) | 29, PTA30 = (0 << 5) | 30, PTA31 = (0 << 5) | 31,
+    PTB0 = (1 << 5) | 0, PTB1 = (1 << 5) | 1, PTB2 = (1 << 5) | 2, PTB3 = (1 << 5) | 3,
+    PTB4 = (1 << 5) | 4, PTB5 = (1 << 5) | 5, PTB6 = (1 << 5) | 6, PTB7 = (1 << 5) | 7,
+    PTB8 = (1 << 5) | 8, PTB9 = (1 << 5) | 9, PTB10 = (1 << 5) | 10, PTB11 = (1 << 5) | 11,
+    PTB12 = (1 << 5) | 12, PTB13 = (1 << 5) | 13, PTB14 = (1 << 5) | 14, PTB15 = (1 << 5) | 15,
+    PTB16 = (1 << 5) | 16, PTB17 = (1 << 5) | 17, PTB18 = (1 << 5) | 18, PTB19 = (1 << 5) | 19,
+    PTB20 = (1 << 5) | 20, PTB21 = (1 << 5) | 21, PTB22 = (1 << 5) | 22, PTB23 = (1 << 5) | 23,
+    PTB24 = (1 << 5) | 24, PTB25 = (1 << 5) | 25, PTB26 = (1 << 5) | 26, PTB27 = (1 << 5) | 27,
+    PTB28 = (1 << 5) | 28, PTB29 = (1 << 5) | 29, PTB30 = (1 << 5) | 30, PTB31 = (1 << 5) | 31,
+    PTC0 = (2 << 5) | 0, PTC1 = (2 << 5) | 1, PTC2 = (2 << 5) | 2, PTC3 = (2 << 5) | 3,
+    PTC4 = (2 << 5) | 4, PTC5 = (2 << 5) | 5, PTC6 = (2 << 5) | 6, PTC7 = (2 << 5) | 7,
+    PTC8 = (2 << 5) | 8, PTC9 = (2 << 5) | 9, PTC10 = (2 << 5) | 10, PTC11 = (2 << 5) | 11,
+    PTC12 = (2 << 5) | 12, PTC13 = (2 << 5) | 13, PTC14 = (2 << 5) | 14, PTC15 = (2 << 5) | 15,
+    PTC16 = (2 << 5) | 16, PTC17 = (2 << 5) | 17, PTC18 = (2 << 5) | 18, PTC19 = (2 << 5) | 19,
+    PTC20 = (2 << 5) | 20, PTC21 = (2 << 5) | 21, PTC22 = (2 << 5) | 22, PTC23 = (2 << 5) | 23,
+    PTC24 = (2 << 5) | 24, PTC25 = (2 << 5) | 25, PTC26 = (2 << 5) | 26, PTC27 = (2 << 5) | 27,
+    PTC28 = (2 << 5) | 28, PTC29 = (2 << 5) | 29, PTC30 = (2 << 5) | 30, PTC31 = (2 << 5) | 31,
+    PTD0 = (3 << 5) | 0, PTD1 = (3 << 5) | 1, PTD2 = (3 << 5) | 2, PTD3 = (3 << 5) | 3,
+    PTD4 = (3 << 5) | 4, PTD5 = (3 << 5) | 5, PTD6 = (3 << 5) | 6, PTD7 = (3 << 5) | 7,
+    PTD8 = (3 << 5) | 8, PTD9 = (3 << 5) | 9, PTD10 = (3 << 5) | 10, PTD11 = (3 << 5) | 11,
+    PTD12 = (3 << 5) | 12, PTD13 = (3 << 5) | 13, PTD14 = (3 << 5) | 14, PTD15 = (3 << 5) | 15,
+    PTD16 = (3 << 5) | 16, PTD17 = (3 << 5) | 17, PTD18 = (3 << 5) | 18, PTD19 = (3 << 5) | 19,
+    PTD20 = (3 << 5) | 20, PTD21 = (3 << 5) | 21, PTD22 = (3 << 5) | 22, PTD23 = (3 << 5) | 23,
+    PTD24 = (3 << 5) | 24, PTD25 = (3 << 5) | 25, PTD26 = (3 << 5) | 26, PTD27 = (3 << 5) | 27,
+    PTD28 = (3 << 5) | 28, PTD29 = (3 << 5) | 29, PTD30 = (3 << 5) | 30, PTD31 = (3 << 5) | 31,
+    PTE0 = (4 << 5) | 0, PTE1 = (4 << 5) | 1, PTE2 = (4 << 5) | 2, PTE3 = (4 << 5) | 3,
+    PTE4 = (4 << 5) | 4, PTE5 = (4 << 5) | 5, PTE6 = (4 << 5) | 6, PTE7 = (4 << 5) | 7,
+    PTE8 = (4 << 5) | 8, PTE9 = (4 << 5) | 9, PTE10 = (4 << 5) | 10, PTE11 = (4 << 5) | 11,
+    PTE12 = (4 << 5) | 12, PTE13 = (4 << 5) | 13, PTE14 = (4 << 5) | 14, PTE15 = (4 << 5) | 15,
+    PTE16 = (4 << 5) | 16, PTE17 = (4 << 5) | 17, PTE18 = (4 << 5) | 18, PTE19 = (4 << 5) | 19,
+    PTE20 = (4 << 5) | 20, PTE21 = (4 << 5) | 21, PTE22 = (4 << 5) | 22, PTE23 = (4 << 5) | 23,
+    PTE24 = (4 << 5) | 24, PTE25 = (4 << 5) | 25, PTE26 = (4 << 5) | 26, PTE27 = (4 << 5) | 27,
+    PTE28 = (4 << 5) | 28, PTE29 = (4 << 5) | 29, PTE30 = (4 << 5) | 30, PTE31 = (4 << 5) | 31,
+
+    //! Arduino header
+    D0 = PTE1, D1 = PTE0, D2 = PTB9, D3 = PTA1,
+    D4 = PTB23, D5 = PTA2, D6 = PTC2, D7 = PTB16,
+    D8 = PTA12, D9 = PTA13, D10 = PTC4, D11 = PTD2,
+    D12 = PTD3, D13 = PTD1, D14 = PTE25, D15 = PTE24,
+
+    A0 = PTB0, A1 = PTB1, A2 = PTC1, A3 = PTC2,
+    A4 = PTB3, A5 = PTB2,
+
+    //! On-board RGB LED and push buttons
+    LED_RED = PTA1,
+    LED_GREEN = PTA2,
+    LED_BLUE = PTD5,
+    LED1 = LED_RED,
+    LED2 = LED_GREEN,
+    LED3 = LED_BLUE,
+    SW2 = PTC1,
+    SW3 = PTB17,
+
+    USBTX = PTE0,
+    USBRX = PTE1,
+
+    NC = -1
+} PinName;
+
+inline PortName pin_port(PinName pin) { return static_cast<PortName>(static_cast<int>(pin) >> 5); }
+inline int pin_bit(PinName pin) { return static_cast<int>(pin) & 31; }
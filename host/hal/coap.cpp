@@ -0,0 +1,332 @@
+#include "coap.hpp"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace coap
+{
+
+namespace
+{
+
+const uint8_t payload_marker = 0xFF;
+
+//! Option delta and length share one header nibble each, extended as
+//! RFC 7252 section 3.1 describes.
+void put_extended(std::vector<uint8_t>& out, uint32_t value)
+{
+    if (value >= 269)
+    {
+        out.push_back(static_cast<uint8_t>((value - 269) >> 8));
+        out.push_back(static_cast<uint8_t>(value - 269));
+    }
+    else if (value >= 13)
+        out.push_back(static_cast<uint8_t>(value - 13));
+}
+
+uint8_t nibble(uint32_t value)
+{
+    return value >= 269 ? 14 : value >= 13 ? 13 : static_cast<uint8_t>(value);
+}
+
+bool get_extended(const uint8_t*& p, const uint8_t* end, uint8_t nib, uint32_t& value)
+{
+    if (nib < 13)
+        value = nib;
+    else if (nib == 13)
+    {
+        if (p == end)
+            return false;
+        value = 13u + *p++;
+    }
+    else if (nib == 14)
+    {
+        if (end - p < 2)
+            return false;
+        value = 269u + (static_cast<uint32_t>(p[0]) << 8 | p[1]);
+        p += 2;
+    }
+    else
+        return false;
+    return true;
+}
+
+sockaddr_in to_sockaddr(const address& a)
+{
+    sockaddr_in sa = sockaddr_in();
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(a.ip);
+    sa.sin_port = htons(a.port);
+    return sa;
+}
+
+}
+
+void message::add(uint16_t number, const std::string& value)
+{
+    std::vector<option>::iterator it = options.begin();
+    while (it != options.end() && it->number <= number)
+        ++it;
+    option o = { number, value };
+    options.insert(it, o);
+}
+
+void message::add_uint(uint16_t number, uint64_t value)
+{
+    //! Shortest big-endian form; zero is the empty string.
+    std::string bytes;
+    for (int shift = 56; shift >= 0; shift -= 8)
+        if (!bytes.empty() || (value >> shift) & 0xFF)
+            bytes.push_back(static_cast<char>((value >> shift) & 0xFF));
+    add(number, bytes);
+}
+
+const std::string* message::find(uint16_t number) const
+{
+    for (size_t i = 0; i != options.size(); ++i)
+        if (options[i].number == number)
+            return &options[i].value;
+    return 0;
+}
+
+bool message::find_uint(uint16_t number, uint64_t& value) const
+{
+    const std::string* bytes = find(number);
+    if (!bytes || bytes->size() > 8)
+        return false;
+    value = 0;
+    for (size_t i = 0; i != bytes->size(); ++i)
+        value = value << 8 | static_cast<uint8_t>((*bytes)[i]);
+    return true;
+}
+
+std::string message::path() const
+{
+    return joined(uri_path, '/');
+}
+
+void message::set_path(const std::string& path)
+{
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (end != start)
+            add(uri_path, path.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+std::string message::joined(uint16_t number, char separator) const
+{
+    std::string text;
+    for (size_t i = 0; i != options.size(); ++i)
+    {
+        if (options[i].number != number)
+            continue;
+        if (!text.empty())
+            text += separator;
+        text += options[i].value;
+    }
+    return text;
+}
+
+std::string code_text(uint8_t code)
+{
+    char text[8];
+    std::snprintf(text, sizeof(text), "%u.%02u", code >> 5, code & 0x1F);
+    return text;
+}
+
+void encode(const message& m, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.push_back(static_cast<uint8_t>(1 << 6 | m.kind << 4 | (m.token.size() & 0x0F)));
+    out.push_back(m.code);
+    out.push_back(static_cast<uint8_t>(m.id >> 8));
+    out.push_back(static_cast<uint8_t>(m.id));
+    out.insert(out.end(), m.token.begin(), m.token.end());
+
+    uint16_t previous = 0;
+    for (size_t i = 0; i != m.options.size(); ++i)
+    {
+        const option& o = m.options[i];
+        uint32_t delta = o.number - previous;
+        uint32_t length = static_cast<uint32_t>(o.value.size());
+        out.push_back(static_cast<uint8_t>(nibble(delta) << 4 | nibble(length)));
+        put_extended(out, delta);
+        put_extended(out, length);
+        out.insert(out.end(), o.value.begin(), o.value.end());
+        previous = o.number;
+    }
+
+    if (!m.payload.empty())
+    {
+        out.push_back(payload_marker);
+        out.insert(out.end(), m.payload.begin(), m.payload.end());
+    }
+}
+
+bool decode(const uint8_t* data, size_t size, message& m)
+{
+    if (size < 4 || data[0] >> 6 != 1)
+        return false;
+    size_t token_length = data[0] & 0x0F;
+    if (token_length > 8 || size < 4 + token_length)
+        return false;
+
+    m.kind = static_cast<type>(data[0] >> 4 & 3);
+    m.code = data[1];
+    m.id = static_cast<uint16_t>(data[2] << 8 | data[3]);
+    m.token.assign(reinterpret_cast<const char*>(data + 4), token_length);
+    m.options.clear();
+    m.payload.clear();
+
+    const uint8_t* p = data + 4 + token_length;
+    const uint8_t* end = data + size;
+    uint32_t number = 0;
+    while (p != end)
+    {
+        if (*p == payload_marker)
+        {
+            //! A marker with nothing after it is a format error.
+            if (++p == end)
+                return false;
+            m.payload.assign(reinterpret_cast<const char*>(p), end - p);
+            return true;
+        }
+
+        uint8_t header = *p++;
+        uint32_t delta = 0;
+        uint32_t length = 0;
+        if (!get_extended(p, end, header >> 4, delta) || !get_extended(p, end, header & 0x0F, length))
+            return false;
+        if (static_cast<size_t>(end - p) < length || number + delta > 0xFFFF)
+            return false;
+
+        number += delta;
+        option o = { static_cast<uint16_t>(number), std::string(reinterpret_cast<const char*>(p), length) };
+        m.options.push_back(o);
+        p += length;
+    }
+    return true;
+}
+
+std::string address::text() const
+{
+    char text[24];
+    std::snprintf(text, sizeof(text), "%u.%u.%u.%u:%u", ip >> 24, ip >> 16 & 0xFF, ip >> 8 & 0xFF, ip & 0xFF, port);
+    return text;
+}
+
+bool parse_address(const std::string& text, address& out)
+{
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+
+    char* end = 0;
+    std::string port = text.substr(colon + 1);
+    unsigned long number = std::strtoul(port.c_str(), &end, 10);
+    if (port.empty() || *end || number > 0xFFFF)
+        return false;
+    out.port = static_cast<uint16_t>(number);
+
+    std::string host = text.substr(0, colon);
+    if (host.empty())
+    {
+        out.ip = INADDR_ANY;
+        return true;
+    }
+
+    addrinfo hints = addrinfo();
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* found = 0;
+    if (getaddrinfo(host.c_str(), 0, &hints, &found) || !found)
+        return false;
+    out.ip = ntohl(reinterpret_cast<sockaddr_in*>(found->ai_addr)->sin_addr.s_addr);
+    freeaddrinfo(found);
+    return true;
+}
+
+udp_socket::udp_socket() : m_fd(socket(AF_INET, SOCK_DGRAM, 0)), m_malformed(0), m_buffer(2048) {}
+
+udp_socket::~udp_socket()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool udp_socket::bind(const address& local)
+{
+    sockaddr_in sa = to_sockaddr(local);
+    return m_fd >= 0 && ::bind(m_fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == 0;
+}
+
+bool udp_socket::set_receive_buffer(int bytes)
+{
+    return setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == 0;
+}
+
+address udp_socket::local() const
+{
+    sockaddr_in sa = sockaddr_in();
+    socklen_t length = sizeof(sa);
+    address a;
+    if (getsockname(m_fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0)
+    {
+        a.ip = ntohl(sa.sin_addr.s_addr);
+        a.port = ntohs(sa.sin_port);
+    }
+    return a;
+}
+
+bool udp_socket::send(const message& m, const address& to)
+{
+    std::vector<uint8_t> datagram;
+    encode(m, datagram);
+    return send_raw(datagram, to);
+}
+
+bool udp_socket::send_raw(const std::vector<uint8_t>& datagram, const address& to)
+{
+    sockaddr_in sa = to_sockaddr(to);
+    return sendto(m_fd, datagram.data(), datagram.size(), 0, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) ==
+           static_cast<ssize_t>(datagram.size());
+}
+
+bool udp_socket::receive(message& m, address& from, int timeout_ms)
+{
+    for (;;)
+    {
+        pollfd p = { m_fd, POLLIN, 0 };
+        if (poll(&p, 1, timeout_ms) <= 0)
+            return false;
+
+        sockaddr_in sa = sockaddr_in();
+        socklen_t length = sizeof(sa);
+        ssize_t size = recvfrom(m_fd, m_buffer.data(), m_buffer.size(), 0, reinterpret_cast<sockaddr*>(&sa), &length);
+        if (size < 0)
+            return false;
+
+        from.ip = ntohl(sa.sin_addr.s_addr);
+        from.port = ntohs(sa.sin_port);
+        if (decode(m_buffer.data(), static_cast<size_t>(size), m))
+            return true;
+        ++m_malformed;
+        //! Don't wait again for the rest of the timeout on a bad datagram.
+        timeout_ms = 0;
+    }
+}
+
+} // namespace coap
@@ -0,0 +1,142 @@
+#pragma once
+
+//! The part of CoAP (RFC 7252) and Observe (RFC 7641) that the device
+//! connector stand-ins speak to each other over UDP: messages with tokens and
+//! options, and a socket to send them on. Enough for LWM2M registration and
+//! GET/PUT/POST/Observe on resources; no blockwise transfer, no DTLS, IPv4
+//! only.
+//!
+//! No system headers here, so the firmware can see frdm_client.hpp without
+//! picking up the socket API.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace coap
+{
+
+enum type { confirmable = 0, non_confirmable = 1, acknowledgement = 2, reset = 3 };
+
+//! Class and detail packed as on the wire: 0x45 is 2.05.
+enum code
+{
+    empty = 0x00,
+    get = 0x01,
+    post = 0x02,
+    put = 0x03,
+    del = 0x04,
+    created = 0x41,
+    deleted = 0x42,
+    changed = 0x44,
+    content = 0x45,
+    bad_request = 0x80,
+    not_found = 0x84,
+    method_not_allowed = 0x85
+};
+
+enum option_number
+{
+    observe = 6,
+    location_path = 8,
+    uri_path = 11,
+    content_format = 12,
+    uri_query = 15,
+
+    //! Not CoAP: the sender's steady_clock reading in ns when a notification
+    //! left, so a connector on the same machine can measure its latency. An
+    //! experimental, elective number; anything else ignores it.
+    host_sent_ns = 65000
+};
+
+enum format { text_plain = 0, link_format = 40 };
+
+struct option
+{
+    uint16_t number;
+    std::string value;
+};
+
+struct message
+{
+    message() : kind(confirmable), code(empty), id(0) {}
+
+    type kind;
+    uint8_t code;
+    uint16_t id;
+    std::string token;
+    std::vector<option> options;    // in number order, as encode() needs
+    std::string payload;
+
+    bool is_request() const { return code >= get && code <= del; }
+
+    //! Options are kept sorted; values of one number keep their order.
+    void add(uint16_t number, const std::string& value);
+    void add_uint(uint16_t number, uint64_t value);
+    const std::string* find(uint16_t number) const;
+    bool find_uint(uint16_t number, uint64_t& value) const;
+
+    //! Uri-Path options joined with '/', no leading slash: "3318/0/5700".
+    std::string path() const;
+    void set_path(const std::string& path);
+    std::string joined(uint16_t number, char separator) const;
+};
+
+//! "2.05" and so on.
+std::string code_text(uint8_t code);
+
+void encode(const message& m, std::vector<uint8_t>& out);
+bool decode(const uint8_t* data, size_t size, message& m);
+
+struct address
+{
+    address() : ip(0), port(0) {}
+
+    uint32_t ip;        // host byte order
+    uint16_t port;
+
+    bool operator<(const address& other) const { return ip != other.ip ? ip < other.ip : port < other.port; }
+    bool operator==(const address& other) const { return ip == other.ip && port == other.port; }
+    std::string text() const;
+};
+
+//! "127.0.0.1:5683", "localhost:5683" or ":5683" (any address).
+bool parse_address(const std::string& text, address& out);
+
+class udp_socket
+{
+public:
+    udp_socket();
+    ~udp_socket();
+
+    //! Port 0 picks a free one; local() says which.
+    bool bind(const address& local);
+    address local() const;
+
+    bool send(const message& m, const address& to);
+    bool send_raw(const std::vector<uint8_t>& datagram, const address& to);
+
+    //! Wait up to timeout_ms (0 polls, -1 blocks) for a datagram. Datagrams
+    //! that are not CoAP are dropped and counted.
+    bool receive(message& m, address& from, int timeout_ms);
+
+    uint64_t malformed() const { return m_malformed; }
+
+    //! Ask the kernel to queue up to bytes of datagrams that have not been
+    //! received yet, so a burst is not dropped while the owner is busy.
+    bool set_receive_buffer(int bytes);
+
+    //! For waiting on this socket together with others.
+    int descriptor() const { return m_fd; }
+
+private:
+    udp_socket(const udp_socket&);
+    udp_socket& operator=(const udp_socket&);
+
+    int m_fd;
+    uint64_t m_malformed;
+    std::vector<uint8_t> m_buffer;
+};
+
+} // namespace coap
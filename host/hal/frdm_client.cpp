@@ -0,0 +1,456 @@
+#include "frdm_client.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#include "coap.hpp"
+
+namespace
+{
+
+frdm_client::statistics g_totals = { 0, 0 };
+
+//! Never destroyed, so end-of-run reports in static destructors can read them.
+//! The lock covers them all; simulators run clients on many threads.
+std::mutex& g_lock = *new std::mutex();
+std::map<std::string, frdm_client::statistics>& g_per_path = *new std::map<std::string, frdm_client::statistics>();
+std::map<std::string, std::string>& g_last_value = *new std::map<std::string, std::string>();
+std::map<const host::board*, frdm_client*>& g_registered = *new std::map<const host::board*, frdm_client*>();
+std::map<const host::board*, std::string>& g_names = *new std::map<const host::board*, std::string>();
+
+//! CoAP's defaults: a confirmable message is sent up to five times, the wait
+//! doubling from 2 s.
+const int ack_timeout_ms = 2000;
+const int max_transmit = 5;
+
+//! Registrations last a day; the stand-in does not send updates.
+const char* const lifetime = "lt=86400";
+
+uint64_t steady_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+std::atomic<unsigned> g_clients(0);
+
+}
+
+struct frdm_client::connection
+{
+    struct observer
+    {
+        std::string token;
+        uint32_t sequence;
+        uint16_t last_id;       // of the latest notification, for a reset
+    };
+
+    coap::udp_socket socket;
+    coap::address server;
+    std::string endpoint;
+    std::string location;       // "rd/<id>" once registered
+
+    uint16_t next_id;
+    uint32_t next_token;
+    std::map<std::string, observer> observers;
+
+    //! The last response, sent again if its request is retransmitted.
+    uint16_t last_request_id;
+    std::vector<uint8_t> last_response;
+
+    uint16_t take_id() { return next_id++; }
+    std::string take_token()
+    {
+        uint32_t t = next_token++;
+        return std::string(reinterpret_cast<const char*>(&t), sizeof(t));
+    }
+};
+
+frdm_client::frdm_client(const std::string& server, NetworkInterface*)
+: m_server(server), m_connection(0), m_board(&host::board::current()), m_state(state::initialized),
+  m_outage_from_ns(0), m_outage_to_ns(0), m_stats()
+{
+    const char* outage = std::getenv("HOST_OUTAGE");
+    double from_s = 0.0, to_s = 0.0;
+    if (outage && std::sscanf(outage, "%lf:%lf", &from_s, &to_s) == 2 && to_s > from_s)
+    {
+        m_outage_from_ns = static_cast<uint64_t>(from_s * 1e9);
+        m_outage_to_ns = static_cast<uint64_t>(to_s * 1e9);
+    }
+
+    const char* connector = std::getenv("HOST_CONNECTOR");
+    if (!connector)
+        return;
+
+    m_connection = new connection();
+    coap::address any;
+    if (!coap::parse_address(connector, m_connection->server) || !m_connection->socket.bind(any))
+    {
+        std::fprintf(stderr, "[host] cannot reach a connector at %s\n", connector);
+        m_state = state::error;
+        return;
+    }
+
+    const char* endpoint = std::getenv("HOST_ENDPOINT");
+    if (endpoint)
+        m_connection->endpoint = endpoint;
+    else
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        std::string& name = g_names[m_board];
+        if (name.empty())
+            name = "host-" + std::to_string(getpid()) + "-" + std::to_string(g_clients++);
+        m_connection->endpoint = name;
+    }
+    m_connection->next_id = static_cast<uint16_t>(steady_ns());
+    m_connection->next_token = static_cast<uint32_t>(steady_ns() >> 16);
+    m_connection->last_request_id = 0;
+}
+
+frdm_client::~frdm_client()
+{
+    disconnect();
+    delete m_connection;
+}
+
+frdm_client::state frdm_client::get_state()
+{
+    m_board->advance(m_board->poll_cost_ns);
+    if (m_board->run_limit_reached())
+        m_state = state::unregistered;
+    else if (network_down())
+        m_state = state::error;
+    else if (m_connection && m_state == state::registered)
+        serve(0);
+    return m_state;
+}
+
+void frdm_client::connect(const M2MObjectList& objects)
+{
+    m_objects = objects;
+    for (size_t o = 0; o != objects.size(); ++o)
+    {
+        const std::vector<M2MObjectInstance*>& instances = objects[o]->instances();
+        for (size_t i = 0; i != instances.size(); ++i)
+        {
+            const std::vector<M2MResource*>& resources = instances[i]->resources();
+            for (size_t r = 0; r != resources.size(); ++r)
+            {
+                resources[r]->set_report_sink(this);
+                m_resources[resources[r]->uri_path()] = resources[r];
+            }
+        }
+    }
+
+    if (network_down())
+        m_state = state::error;
+    if (m_state != state::error)
+    {
+        if (m_connection && !register_endpoint())
+        {
+            m_state = state::error;
+            return;
+        }
+        m_state = state::registered;
+        std::lock_guard<std::mutex> lock(g_lock);
+        g_registered[m_board] = this;
+    }
+}
+
+void frdm_client::disconnect()
+{
+    std::map<std::string, M2MResource*>::iterator it;
+    for (it = m_resources.begin(); it != m_resources.end(); ++it)
+        it->second->set_report_sink(0);
+    m_resources.clear();
+
+    std::unique_lock<std::mutex> lock(g_lock);
+    std::map<const host::board*, frdm_client*>::iterator self = g_registered.find(m_board);
+    if (self != g_registered.end() && self->second == this)
+        g_registered.erase(self);
+    lock.unlock();
+
+    //! Nothing gets through an outage; the connector finds out when the
+    //! device registers again.
+    if (m_connection && !m_connection->location.empty() && !network_down())
+        deregister_endpoint();
+
+    if (m_state == state::registered)
+        m_state = state::unregistered;
+}
+
+M2MDevice* frdm_client::make_device()
+{
+    M2MDevice* device = new M2MDevice();
+    M2MObjectInstance* inst = device->create_object_instance();
+
+    M2MResource* manufacturer = inst->create_dynamic_resource("0", "string", M2MResourceInstance::STRING, false);
+    manufacturer->set_operation(M2MBase::GET_ALLOWED);
+    manufacturer->set_value(reinterpret_cast<const uint8_t*>("host"), 4);
+    return device;
+}
+
+M2MResource* frdm_client::find(const std::string& path) const
+{
+    std::map<std::string, M2MResource*>::const_iterator it = m_resources.find(path);
+    return it == m_resources.end() ? 0 : it->second;
+}
+
+bool frdm_client::put(const std::string& path, const std::string& payload)
+{
+    M2MResource* res = find(path);
+    if (!res || !(res->operation() & M2MBase::PUT_ALLOWED))
+        return false;
+
+    res->server_put(reinterpret_cast<const uint8_t*>(payload.data()), static_cast<uint32_t>(payload.size()));
+    return true;
+}
+
+bool frdm_client::post(const std::string& path)
+{
+    M2MResource* res = find(path);
+    if (!res || !(res->operation() & M2MBase::POST_ALLOWED))
+        return false;
+
+    return res->server_execute(0);
+}
+
+frdm_client* frdm_client::registered(const host::board& board)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::map<const host::board*, frdm_client*>::const_iterator it = g_registered.find(&board);
+    return it == g_registered.end() ? 0 : it->second;
+}
+
+frdm_client::statistics frdm_client::totals()
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    return g_totals;
+}
+
+uint64_t frdm_client::notifications(const std::string& path)
+{
+    return totals(path).notifications;
+}
+
+frdm_client::statistics frdm_client::totals(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::map<std::string, statistics>::const_iterator it = g_per_path.find(path);
+    statistics none = { 0, 0 };
+    return it == g_per_path.end() ? none : it->second;
+}
+
+std::string frdm_client::last_value(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(g_lock);
+    std::map<std::string, std::string>::const_iterator it = g_last_value.find(path);
+    return it == g_last_value.end() ? std::string() : it->second;
+}
+
+void frdm_client::value_changed(M2MResourceInstance& resource)
+{
+    ++m_stats.notifications;
+    m_stats.payload_bytes += resource.value_length();
+
+    {
+        std::lock_guard<std::mutex> lock(g_lock);
+        ++g_totals.notifications;
+        g_totals.payload_bytes += resource.value_length();
+        statistics& path = g_per_path[resource.uri_path()];
+        ++path.notifications;
+        path.payload_bytes += resource.value_length();
+
+        const char* value = reinterpret_cast<const char*>(resource.value());
+        g_last_value[resource.uri_path()] = value ? std::string(value, resource.value_length()) : std::string();
+    }
+
+    if (m_connection)
+        notify(resource);
+}
+
+bool frdm_client::network_down() const
+{
+    return m_board->now_ns() >= m_outage_from_ns && m_board->now_ns() < m_outage_to_ns;
+}
+
+bool frdm_client::register_endpoint()
+{
+    //! POST /rd?ep=<name>&lt=..&b=U with every resource as a link, the
+    //! ones that can be observed (readable as well as observable) marked.
+    coap::message request;
+    request.kind = coap::confirmable;
+    request.code = coap::post;
+    request.id = m_connection->take_id();
+    request.token = m_connection->take_token();
+    request.set_path("rd");
+    request.add_uint(coap::content_format, coap::link_format);
+    request.add(coap::uri_query, "ep=" + m_connection->endpoint);
+    request.add(coap::uri_query, lifetime);
+    request.add(coap::uri_query, "b=U");
+
+    std::map<std::string, M2MResource*>::const_iterator it;
+    for (it = m_resources.begin(); it != m_resources.end(); ++it)
+    {
+        if (!request.payload.empty())
+            request.payload += ',';
+        request.payload += "</" + it->first + ">";
+        if (it->second->is_observable() && (it->second->operation() & M2MBase::GET_ALLOWED))
+            request.payload += ";obs";
+    }
+
+    std::vector<uint8_t> datagram;
+    coap::encode(request, datagram);
+    int timeout_ms = ack_timeout_ms;
+    for (int attempt = 0; attempt != max_transmit; ++attempt, timeout_ms *= 2)
+    {
+        m_connection->socket.send_raw(datagram, m_connection->server);
+
+        coap::message reply;
+        coap::address from;
+        while (m_connection->socket.receive(reply, from, timeout_ms))
+        {
+            if (!(from == m_connection->server) || reply.kind != coap::acknowledgement || reply.id != request.id)
+                continue;
+            if (reply.code != coap::created)
+            {
+                std::fprintf(stderr, "[host] %s refused %s: %s\n", m_connection->server.text().c_str(),
+                             m_connection->endpoint.c_str(), coap::code_text(reply.code).c_str());
+                return false;
+            }
+            m_connection->location = reply.joined(coap::location_path, '/');
+            std::fprintf(stderr, "[host] registered %s with %s as /%s\n", m_connection->endpoint.c_str(),
+                         m_connection->server.text().c_str(), m_connection->location.c_str());
+            return true;
+        }
+    }
+    std::fprintf(stderr, "[host] no answer from a connector at %s\n", m_connection->server.text().c_str());
+    return false;
+}
+
+void frdm_client::deregister_endpoint()
+{
+    //! Once, without waiting: the firmware is on its way out, and the
+    //! registration lapses on its own anyway.
+    coap::message request;
+    request.kind = coap::non_confirmable;
+    request.code = coap::del;
+    request.id = m_connection->take_id();
+    request.token = m_connection->take_token();
+    request.set_path(m_connection->location);
+    m_connection->socket.send(request, m_connection->server);
+    m_connection->location.clear();
+    m_connection->observers.clear();
+}
+
+void frdm_client::serve(int timeout_ms)
+{
+    coap::message request;
+    coap::address from;
+    while (m_connection->socket.receive(request, from, timeout_ms))
+    {
+        if (from == m_connection->server)
+            handle(request, from);
+        timeout_ms = 0;
+    }
+}
+
+void frdm_client::handle(const coap::message& request, const coap::address& from)
+{
+    //! A reset answering a notification: the observer has gone.
+    if (request.kind == coap::reset)
+    {
+        std::map<std::string, connection::observer>::iterator it;
+        for (it = m_connection->observers.begin(); it != m_connection->observers.end(); ++it)
+            if (it->second.last_id == request.id)
+            {
+                m_connection->observers.erase(it);
+                break;
+            }
+        return;
+    }
+    if (!request.is_request())
+        return;
+
+    if (request.kind == coap::confirmable && request.id == m_connection->last_request_id &&
+        !m_connection->last_response.empty())
+    {
+        m_connection->socket.send_raw(m_connection->last_response, from);
+        return;
+    }
+
+    coap::message response;
+    response.kind = request.kind == coap::confirmable ? coap::acknowledgement : coap::non_confirmable;
+    response.id = request.kind == coap::confirmable ? request.id : m_connection->take_id();
+    response.token = request.token;
+
+    std::string path = request.path();
+    M2MResource* res = find(path);
+    uint64_t observe = 0;
+    if (!res)
+        response.code = coap::not_found;
+    else if (request.code == coap::get)
+    {
+        if (!(res->operation() & M2MBase::GET_ALLOWED))
+            response.code = coap::method_not_allowed;
+        else
+        {
+            response.code = coap::content;
+            response.add_uint(coap::content_format, coap::text_plain);
+            const char* value = reinterpret_cast<const char*>(res->value());
+            if (value)
+                response.payload.assign(value, res->value_length());
+
+            //! Observe 0 registers, 1 deregisters; only observable resources
+            //! take observers, the rest just answer.
+            if (request.find_uint(coap::observe, observe) && observe == 0 && res->is_observable())
+            {
+                connection::observer& o = m_connection->observers[path];
+                o.token = request.token;
+                o.last_id = response.id;
+                response.add_uint(coap::observe, o.sequence);
+            }
+            else if (request.find(coap::observe) && observe == 1)
+                m_connection->observers.erase(path);
+        }
+    }
+    else if (request.code == coap::put)
+        response.code = put(path, request.payload) ? coap::changed : coap::method_not_allowed;
+    else if (request.code == coap::post)
+        response.code = post(path) ? coap::changed : coap::method_not_allowed;
+    else
+        response.code = coap::method_not_allowed;
+
+    coap::encode(response, m_connection->last_response);
+    m_connection->last_request_id = request.kind == coap::confirmable ? request.id : 0;
+    m_connection->socket.send_raw(m_connection->last_response, from);
+}
+
+void frdm_client::notify(M2MResourceInstance& resource)
+{
+    std::map<std::string, connection::observer>::iterator it = m_connection->observers.find(resource.uri_path());
+    if (it == m_connection->observers.end())
+        return;
+
+    connection::observer& o = it->second;
+    o.sequence = (o.sequence + 1) & 0xFFFFFF;
+    o.last_id = m_connection->take_id();
+
+    coap::message notification;
+    notification.kind = coap::non_confirmable;
+    notification.code = coap::content;
+    notification.id = o.last_id;
+    notification.token = o.token;
+    notification.add_uint(coap::observe, o.sequence);
+    notification.add_uint(coap::content_format, coap::text_plain);
+    notification.add_uint(coap::host_sent_ns, steady_ns());
+    const char* value = reinterpret_cast<const char*>(resource.value());
+    if (value)
+        notification.payload.assign(value, resource.value_length());
+    m_connection->socket.send(notification, m_connection->server);
+}
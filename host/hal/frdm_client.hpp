@@ -0,0 +1,101 @@
+#pragma once
+
+//! Host stand-in for the FRDM device connector client. Instead of registering
+//! with api.connector.mbed.com it keeps the object list in-process, counts the
+//! notifications an observer would receive, and lets host tools issue the
+//! server-side GET/PUT/POST operations against registered resources.
+//!
+//! With HOST_CONNECTOR set ("127.0.0.1:5683") it also registers over CoAP
+//! with the connector at that address (tools/connector.cpp, or anything that
+//! speaks LWM2M registration), serves its GET/PUT/POST and Observe requests
+//! each time the firmware polls get_state(), and sends a notification to it
+//! for every observed value change. HOST_ENDPOINT names the endpoint; the
+//! default is host-<pid>-<n>, one per board, so a firmware that reconnects
+//! comes back as the same endpoint.
+//!
+//! HOST_OUTAGE="from:to" takes the network away between those seconds of
+//! virtual time: clients report an error and cannot connect until it is
+//! over, which is how the firmware's reconnecting is exercised.
+
+#include <map>
+#include <string>
+
+#include "mbed.h"
+#include "m2m.hpp"
+#include "EthernetInterface.h"
+
+namespace coap
+{
+struct message;
+struct address;
+}
+
+class frdm_client : private host::report_sink
+{
+public:
+    enum class state { initialized, registered, unregistered, error };
+
+    frdm_client(const std::string& server, NetworkInterface* iface);
+    ~frdm_client();
+
+    //! Each poll costs virtual time. Once the board's run limit passes the
+    //! client reports unregistered, as if the connector had ended the
+    //! registration, which is how host runs end firmware loops.
+    state get_state();
+
+    void connect(const M2MObjectList& objects);
+    void disconnect();
+
+    static M2MDevice* make_device();
+
+    //! ****************
+    //! Host-side access
+    //! ****************
+
+    //! Look up a resource by its "3318/0/5700" path.
+    M2MResource* find(const std::string& path) const;
+    bool put(const std::string& path, const std::string& payload);
+    bool post(const std::string& path);
+
+    //! The client registered on a board, if any; lets board wiring act as the
+    //! server without the firmware handing its client over.
+    static frdm_client* registered(const host::board& board);
+
+    struct statistics
+    {
+        uint64_t notifications;     // observable value changes sent
+        uint64_t payload_bytes;     // bytes of those values
+    };
+    //! This client's own, and the totals over every client in the process
+    //! for end-of-run reports. Clients may run on different threads.
+    const statistics& stats() const { return m_stats; }
+    static statistics totals();
+    //! Notification count, totals and last notified value for one resource path.
+    static uint64_t notifications(const std::string& path);
+    static statistics totals(const std::string& path);
+    static std::string last_value(const std::string& path);
+
+private:
+    struct connection;
+
+    void value_changed(M2MResourceInstance& resource);
+
+    //! The CoAP side, when there is a connector to talk to.
+    bool register_endpoint();
+    void deregister_endpoint();
+    void serve(int timeout_ms);
+    void handle(const coap::message& request, const coap::address& from);
+    void notify(M2MResourceInstance& resource);
+
+    bool network_down() const;
+
+    std::string m_server;
+    connection* m_connection;
+    host::board* m_board;
+    state m_state;
+    uint64_t m_outage_from_ns;
+    uint64_t m_outage_to_ns;
+    statistics m_stats;
+    M2MObjectList m_objects;
+    std::map<std::string, M2MResource*> m_resources;
+};
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "PinNames.h"
+
+//! The host board is the piece of the stand-in HAL that replaces the silicon.
+//! It owns a virtual clock, a scheduler for timed events and the logic level
+//! of every pin. The mbed API classes in mbed.h are thin wrappers around it,
+//! and simulated peripherals (such as the HX711 model) attach to its pins.
+//!
+//! Nothing here ever sleeps for real: time only moves when firmware code calls
+//! into the HAL (GPIO accesses, wait(), sleep(), polling the client), which is
+//! what lets a 2 second main loop run thousands of times per wall-clock second.
+namespace host
+{
+
+//! A device that wants to observe the levels the MCU drives onto its pins.
+class peripheral
+{
+public:
+    virtual ~peripheral() {}
+    virtual void pin_written(PinName pin, int level) = 0;
+};
+
+//! Something that reacts to edges on a pin driven by a peripheral; this is how
+//! InterruptIn gets its rise/fall events.
+class edge_listener
+{
+public:
+    virtual ~edge_listener() {}
+    virtual void pin_edge(PinName pin, bool rising) = 0;
+};
+
+class board
+{
+public:
+    typedef std::function<void()> handler;
+    typedef uint64_t event_id;
+
+    //! Events are either hardware (run as soon as they are due, regardless of
+    //! interrupt masking) or interrupts (deferred while another ISR is running
+    //! or while interrupts are disabled, like the NVIC would).
+    enum event_kind { hardware, interrupt };
+
+    board();
+
+    //! The board the calling thread is currently simulating. Defaults to one
+    //! process-wide board; simulators running many devices swap it per thread.
+    static board& current();
+    static void set_current(board* b);
+
+    //! ***********
+    //! Virtual time
+    //! ***********
+
+    uint64_t now_ns() const { return m_now; }
+    uint64_t now_us() const { return m_now / 1000; }
+
+    //! Move time forward, running every event that becomes due on the way.
+    void advance(uint64_t ns) { advance_to(m_now + ns); }
+    void advance_to(uint64_t t);
+
+    //! Model of WFI: jump to the next scheduled event and return once an
+    //! interrupt has been serviced (or, with interrupts masked, has become
+    //! pending), or after one OS tick if nothing happens.
+    void sleep();
+
+    event_id schedule_at(uint64_t when_ns, handler fn, event_kind kind = interrupt);
+    event_id schedule_in(uint64_t delay_ns, handler fn, event_kind kind = interrupt)
+    {
+        return schedule_at(m_now + delay_ns, fn, kind);
+    }
+    void cancel(event_id id);
+
+    //! **********
+    //! Interrupts
+    //! **********
+
+    //! Run fn in interrupt context now, or queue it until interrupts are
+    //! available again.
+    void raise(handler fn);
+    void disable_irq() { ++m_irq_mask; }
+    void enable_irq();
+    bool in_isr() const { return m_in_isr; }
+
+    //! ****
+    //! Pins
+    //! ****
+
+    //! MCU side: every access costs gpio_cost_ns of virtual time.
+    void mcu_write(PinName pin, int level);
+    int mcu_read(PinName pin);
+    //! One access for all the masked pins of a port, as a GPIOx_PDIR read.
+    uint32_t mcu_read_port(PortName port, uint32_t mask);
+
+    //! Peripheral side: free, and may produce edges for InterruptIn.
+    void drive(PinName pin, int level);
+    int level(PinName pin) const;
+
+    void attach(PinName pin, peripheral* p);
+    void detach(PinName pin, peripheral* p);
+    void listen(PinName pin, edge_listener* l);
+    void unlisten(PinName pin, edge_listener* l);
+
+    //! Number of MCU writes to a pin so far; used to count LED pulses.
+    uint64_t write_count(PinName pin) const;
+
+    //! *************
+    //! Run control
+    //! *************
+
+    //! Firmware main loops run forever; the host stops them by having the
+    //! client stand-in report an error once this much virtual time has passed.
+    void set_run_limit_ns(uint64_t t) { m_run_limit = t; }
+    uint64_t run_limit_ns() const { return m_run_limit; }
+    bool run_limit_reached() const { return m_run_limit && m_now >= m_run_limit; }
+
+    //! *****
+    //! Flash
+    //! *****
+
+    //! The MK22FN512 program flash: 512 KiB in 2 KiB sectors, programmed one
+    //! 8 byte phrase at a time and erased to 0xFF. The image is created on
+    //! first use; if HOST_FLASH names a file it is loaded from there and every
+    //! change is written back, so persisted settings survive between runs.
+    static const uint32_t flash_size = 512 * 1024;
+    static const uint32_t flash_sector_size = 2048;
+    static const uint32_t flash_page_size = 8;
+
+    std::vector<uint8_t>& flash();
+    void flash_changed(uint32_t addr, uint32_t size);
+    void set_flash_file(const std::string& path) { m_flash_file = path; }
+
+    //! Power fails after ops more erases or programs: from then on they
+    //! change nothing and return an error, until set_flash_power_cut(-1)
+    //! brings it back as if after a reset. Negative never fails.
+    void set_flash_power_cut(int ops) { m_flash_ops_left = ops; }
+    bool flash_powered();
+
+    //! Virtual cost of one GPIO access and of one pass through a polling loop.
+    uint32_t gpio_cost_ns;
+    uint32_t poll_cost_ns;
+
+    //! Typical MK22 sector erase and phrase program times. The core stalls
+    //! (and interrupts wait) while flash is busy.
+    uint32_t flash_erase_ns;
+    uint32_t flash_program_ns;
+
+    struct statistics
+    {
+        uint64_t isrs;        // interrupt handlers dispatched
+        uint64_t sleeps;      // calls to sleep()
+        uint64_t sleep_ns;    // virtual time spent asleep
+        uint64_t gpio_reads;
+        uint64_t gpio_writes;
+    };
+    const statistics& stats() const { return m_stats; }
+
+private:
+    struct event
+    {
+        handler fn;
+        event_kind kind;
+    };
+    //! (deadline, sequence) keeps same-time events in scheduling order.
+    typedef std::pair<uint64_t, event_id> event_key;
+
+    struct pin_state
+    {
+        int level;
+        uint64_t writes;
+        std::vector<peripheral*> peripherals;
+        std::vector<edge_listener*> listeners;
+    };
+
+    pin_state& pin(PinName p);
+    void dispatch(handler& fn);
+    void drain_pending();
+
+    uint64_t m_now;
+    uint64_t m_run_limit;
+    event_id m_next_id;
+    std::map<event_key, event> m_events;
+    std::map<event_id, uint64_t> m_deadlines;
+    std::deque<handler> m_pending;
+    bool m_in_isr;
+    unsigned m_irq_mask;
+    std::vector<pin_state> m_pins;     // indexed by PinName; the last is NC
+    std::vector<uint8_t> m_flash;      // empty until first used
+    std::string m_flash_file;
+    int m_flash_ops_left;
+    statistics m_stats;
+};
+
+} // namespace host
@@ -0,0 +1,104 @@
+#include "m2m.hpp"
+
+#include <cstdio>
+
+bool M2MResourceInstance::set_value(const uint8_t* value, uint32_t value_length)
+{
+    m_value.assign(value, value + value_length);
+
+    if (m_observable && m_sink)
+        m_sink->value_changed(*this);
+    return true;
+}
+
+bool M2MResourceInstance::set_value(int64_t value)
+{
+    char text[24];
+    int size = std::snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+    return set_value(reinterpret_cast<const uint8_t*>(text), static_cast<uint32_t>(size));
+}
+
+void M2MResourceInstance::get_value(uint8_t*& value, uint32_t& value_length)
+{
+    value_length = 0;
+    value = 0;
+    if (m_value.empty())
+        return;
+
+    value = static_cast<uint8_t*>(std::malloc(m_value.size() + 1));
+    std::memcpy(value, &m_value[0], m_value.size());
+    value[m_value.size()] = 0;
+    value_length = static_cast<uint32_t>(m_value.size());
+}
+
+void M2MResourceInstance::get_value(uint8_t*& value, size_t& value_length)
+{
+    uint32_t length = 0;
+    get_value(value, length);
+    value_length = length;
+}
+
+void M2MResourceInstance::server_put(const uint8_t* value, uint32_t value_length)
+{
+    //! A PUT from the server stores the value without notifying observers,
+    //! then runs the firmware's value-updated callback.
+    m_value.assign(value, value + value_length);
+    if (m_updated)
+        m_updated(name().c_str());
+}
+
+bool M2MResourceInstance::server_execute(void* arguments)
+{
+    if (!m_execute)
+        return false;
+    m_execute(arguments);
+    return true;
+}
+
+M2MObjectInstance::~M2MObjectInstance()
+{
+    for (size_t i = 0; i != m_resources.size(); ++i)
+        delete m_resources[i];
+}
+
+M2MResource* M2MObjectInstance::create_dynamic_resource(const String& resource_name, const String&,
+                                                        M2MResourceInstance::ResourceType type,
+                                                        bool observable, bool)
+{
+    M2MResource* res = new M2MResource(m_path + "/" + resource_name, resource_name, type, observable);
+    m_resources.push_back(res);
+    return res;
+}
+
+M2MResource* M2MObjectInstance::resource(const String& name) const
+{
+    for (size_t i = 0; i != m_resources.size(); ++i)
+        if (m_resources[i]->name() == name)
+            return m_resources[i];
+    return 0;
+}
+
+M2MObject::~M2MObject()
+{
+    for (size_t i = 0; i != m_instances.size(); ++i)
+        delete m_instances[i];
+}
+
+M2MObjectInstance* M2MObject::create_object_instance(uint16_t instance_id)
+{
+    char id[8];
+    std::snprintf(id, sizeof(id), "%u", static_cast<unsigned>(instance_id));
+
+    M2MObjectInstance* inst = new M2MObjectInstance(name() + "/" + id, id);
+    m_instances.push_back(inst);
+    m_ids.push_back(instance_id);
+    return inst;
+}
+
+M2MObjectInstance* M2MObject::object_instance(uint16_t instance_id) const
+{
+    for (size_t i = 0; i != m_ids.size(); ++i)
+        if (m_ids[i] == instance_id)
+            return m_instances[i];
+    return 0;
+}
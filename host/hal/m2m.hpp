@@ -0,0 +1,158 @@
+#pragma once
+
+//! Host stand-in for the mbed-client (LWM2M) object model: objects, object
+//! instances and resources with the value/callback surface the firmware uses.
+//! Resources keep their "object/instance/resource" path so the connector
+//! stand-in can address them the way the device connector would.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace m2m
+{
+typedef std::string String;
+}
+using m2m::String;
+
+class M2MResourceInstance;
+
+namespace host
+{
+//! Receives a resource whenever firmware changes an observable value; this is
+//! where a notification would be sent to every observer.
+class report_sink
+{
+public:
+    virtual ~report_sink() {}
+    virtual void value_changed(M2MResourceInstance& resource) = 0;
+};
+}
+
+class M2MBase
+{
+public:
+    enum Operation
+    {
+        NOT_ALLOWED = 0x00,
+        GET_ALLOWED = 0x01,
+        PUT_ALLOWED = 0x02,
+        GET_PUT_ALLOWED = 0x03,
+        POST_ALLOWED = 0x04,
+        GET_POST_ALLOWED = 0x05,
+        PUT_POST_ALLOWED = 0x06,
+        GET_PUT_POST_ALLOWED = 0x07,
+        DELETE_ALLOWED = 0x08
+    };
+
+    M2MBase(const String& name) : m_name(name), m_operation(NOT_ALLOWED) {}
+    virtual ~M2MBase() {}
+
+    const String& name() const { return m_name; }
+    void set_operation(Operation op) { m_operation = op; }
+    Operation operation() const { return m_operation; }
+
+private:
+    String m_name;
+    Operation m_operation;
+};
+
+typedef void (*value_updated_callback2)(const char* object_name);
+typedef void (*execute_callback_2)(void* arguments);
+
+class M2MResourceInstance : public M2MBase
+{
+public:
+    enum ResourceType { STRING, INTEGER, FLOAT, BOOLEAN, OPAQUE, TIME, OBJLINK };
+
+    M2MResourceInstance(const String& path, const String& name, ResourceType type, bool observable)
+    : M2MBase(name), m_path(path), m_type(type), m_observable(observable),
+      m_sink(0), m_updated(0), m_execute(0) {}
+
+    bool set_value(const uint8_t* value, uint32_t value_length);
+    bool set_value(int64_t value);
+
+    //! Like mbed-client, hands back a malloc'd copy the caller must free.
+    void get_value(uint8_t*& value, uint32_t& value_length);
+    void get_value(uint8_t*& value, size_t& value_length);
+
+    //! Zero-copy access to the stored value.
+    uint8_t* value() const { return m_value.empty() ? 0 : const_cast<uint8_t*>(&m_value[0]); }
+    uint32_t value_length() const { return static_cast<uint32_t>(m_value.size()); }
+
+    void set_value_updated_function(value_updated_callback2 callback) { m_updated = callback; }
+    void set_execute_function(execute_callback_2 callback) { m_execute = callback; }
+
+    ResourceType resource_instance_type() const { return m_type; }
+    bool is_observable() const { return m_observable; }
+    const String& uri_path() const { return m_path; }
+
+    //! Host-side entry points used by the connector stand-in.
+    void set_report_sink(host::report_sink* sink) { m_sink = sink; }
+    void server_put(const uint8_t* value, uint32_t value_length);
+    bool server_execute(void* arguments);
+
+private:
+    String m_path;
+    ResourceType m_type;
+    bool m_observable;
+    std::vector<uint8_t> m_value;
+    host::report_sink* m_sink;
+    value_updated_callback2 m_updated;
+    execute_callback_2 m_execute;
+};
+
+class M2MResource : public M2MResourceInstance
+{
+public:
+    M2MResource(const String& path, const String& name, ResourceType type, bool observable)
+    : M2MResourceInstance(path, name, type, observable) {}
+};
+
+class M2MObjectInstance : public M2MBase
+{
+public:
+    M2MObjectInstance(const String& path, const String& name) : M2MBase(name), m_path(path) {}
+    ~M2MObjectInstance();
+
+    M2MResource* create_dynamic_resource(const String& resource_name, const String& resource_type,
+                                         M2MResourceInstance::ResourceType type, bool observable,
+                                         bool multiple_instance = false);
+    M2MResource* resource(const String& name) const;
+    const std::vector<M2MResource*>& resources() const { return m_resources; }
+
+private:
+    String m_path;
+    std::vector<M2MResource*> m_resources;
+};
+
+class M2MObject : public M2MBase
+{
+public:
+    M2MObject(const String& name) : M2MBase(name) {}
+    ~M2MObject();
+
+    M2MObjectInstance* create_object_instance(uint16_t instance_id = 0);
+    M2MObjectInstance* object_instance(uint16_t instance_id = 0) const;
+    const std::vector<M2MObjectInstance*>& instances() const { return m_instances; }
+
+private:
+    std::vector<M2MObjectInstance*> m_instances;
+    std::vector<uint16_t> m_ids;
+};
+
+class M2MDevice : public M2MObject
+{
+public:
+    M2MDevice() : M2MObject("3") {}
+};
+
+typedef std::vector<M2MObject*> M2MObjectList;
+
+class M2MInterfaceFactory
+{
+public:
+    static M2MObject* create_object(const String& name) { return new M2MObject(name); }
+};
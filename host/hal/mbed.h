@@ -0,0 +1,277 @@
+#pragma once
+
+//! Host stand-in for the subset of the mbed API the firmware uses. Every class
+//! forwards to host::board, so pin levels, interrupts and time all live in one
+//! simulated machine that peripherals (see host/sim) can attach to.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+#include "PinNames.h"
+#include "host_board.hpp"
+
+namespace mbed
+{
+
+//! Minimal Callback<R(Args...)>: a free function or an object/method pair.
+template <typename F>
+class Callback;
+
+template <typename R, typename... Args>
+class Callback<R(Args...)>
+{
+public:
+    Callback() {}
+    Callback(R (*func)(Args...))
+    {
+        if (func)
+            m_fn = func;
+    }
+    template <typename T, typename U>
+    Callback(U* obj, R (T::*method)(Args...))
+    : m_fn([obj, method](Args... args) { return (obj->*method)(args...); }) {}
+
+    R call(Args... args) const { return m_fn(args...); }
+    R operator()(Args... args) const { return m_fn(args...); }
+    explicit operator bool() const { return static_cast<bool>(m_fn); }
+
+private:
+    std::function<R(Args...)> m_fn;
+};
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(R (*func)(Args...))
+{
+    return Callback<R(Args...)>(func);
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(U* obj, R (T::*method)(Args...))
+{
+    return Callback<R(Args...)>(obj, method);
+}
+
+enum PinMode { PullNone, PullUp, PullDown, PullDefault = PullNone };
+
+class DigitalOut
+{
+public:
+    DigitalOut(PinName pin) : m_pin(pin), m_board(&host::board::current()) {}
+    DigitalOut(PinName pin, int value) : m_pin(pin), m_board(&host::board::current()) { write(value); }
+
+    void write(int value) { m_board->mcu_write(m_pin, value ? 1 : 0); }
+    int read() { return m_board->level(m_pin); }
+    int is_connected() { return m_pin != NC; }
+
+    DigitalOut& operator=(int value) { write(value); return *this; }
+    DigitalOut& operator=(DigitalOut& rhs) { write(rhs.read()); return *this; }
+    operator int() { return read(); }
+
+private:
+    PinName m_pin;
+    host::board* m_board;
+};
+
+class DigitalIn
+{
+public:
+    DigitalIn(PinName pin) : m_pin(pin), m_board(&host::board::current()) {}
+    DigitalIn(PinName pin, PinMode) : m_pin(pin), m_board(&host::board::current()) {}
+
+    int read() { return m_board->mcu_read(m_pin); }
+    void mode(PinMode) {}
+    int is_connected() { return m_pin != NC; }
+
+    operator int() { return read(); }
+
+private:
+    PinName m_pin;
+    host::board* m_board;
+};
+
+//! The masked pins of one GPIO port, read together in a single access.
+class PortIn
+{
+public:
+    PortIn(PortName port, int mask = 0xFFFFFFFF)
+    : m_port(port), m_mask(static_cast<uint32_t>(mask)), m_board(&host::board::current()) {}
+
+    int read() { return static_cast<int>(m_board->mcu_read_port(m_port, m_mask)); }
+    void mode(PinMode) {}
+
+    operator int() { return read(); }
+
+private:
+    PortName m_port;
+    uint32_t m_mask;
+    host::board* m_board;
+};
+
+//! Edges are latched while the IRQ is disabled and delivered on enable_irq(),
+//! matching the PORTx_ISFR behaviour of the Kinetis parts.
+class InterruptIn : private host::edge_listener
+{
+public:
+    InterruptIn(PinName pin);
+    virtual ~InterruptIn();
+
+    //! Registered with the board by address, so not copyable (as in mbed).
+    InterruptIn(const InterruptIn&) = delete;
+    InterruptIn& operator=(const InterruptIn&) = delete;
+
+    int read() { return m_board->mcu_read(m_pin); }
+    void mode(PinMode) {}
+    operator int() { return read(); }
+
+    void rise(Callback<void()> func) { m_rise = func; }
+    void fall(Callback<void()> func) { m_fall = func; }
+    template <typename T, typename M>
+    void rise(T* obj, M method) { m_rise = Callback<void()>(obj, method); }
+    template <typename T, typename M>
+    void fall(T* obj, M method) { m_fall = Callback<void()>(obj, method); }
+
+    void enable_irq();
+    void disable_irq() { m_enabled = false; }
+
+private:
+    void pin_edge(PinName pin, bool rising);
+
+    PinName m_pin;
+    host::board* m_board;
+    Callback<void()> m_rise;
+    Callback<void()> m_fall;
+    bool m_enabled;
+    bool m_pending_rise;
+    bool m_pending_fall;
+};
+
+class Timer
+{
+public:
+    Timer() : m_board(&host::board::current()), m_running(false), m_start(0), m_elapsed(0) {}
+
+    void start();
+    void stop();
+    void reset();
+
+    float read() { return elapsed_ns() / 1e9f; }
+    int read_ms() { return static_cast<int>(elapsed_ns() / 1000000); }
+    int read_us() { return static_cast<int>(elapsed_ns() / 1000); }
+    uint64_t read_high_resolution_us() { return elapsed_ns() / 1000; }
+    operator float() { return read(); }
+
+private:
+    uint64_t elapsed_ns() const;
+
+    host::board* m_board;
+    bool m_running;
+    uint64_t m_start;
+    uint64_t m_elapsed;
+};
+
+//! Periodic interrupt. Like the mbed ticker, each deadline is the previous one
+//! plus the period in whole microseconds, so float periods are truncated.
+class Ticker
+{
+public:
+    Ticker() : m_board(&host::board::current()), m_event(0), m_period_us(0), m_deadline_ns(0) {}
+    virtual ~Ticker() { detach(); }
+
+    void attach(Callback<void()> func, float t) { attach_us(func, static_cast<uint64_t>(t * 1000000.0f)); }
+    void attach_us(Callback<void()> func, uint64_t t);
+    template <typename T, typename M>
+    void attach(T* obj, M method, float t) { attach(Callback<void()>(obj, method), t); }
+    void detach();
+
+protected:
+    virtual void fire();
+
+    host::board* m_board;
+    host::board::event_id m_event;
+    std::shared_ptr<bool> m_alive;
+    Callback<void()> m_func;
+    uint64_t m_period_us;
+    uint64_t m_deadline_ns;
+};
+
+//! One-shot Ticker.
+class Timeout : public Ticker
+{
+protected:
+    virtual void fire();
+};
+
+//! In-application programming of the internal flash (see host::board).
+//! Addresses are absolute; the flash starts at 0.
+class FlashIAP
+{
+public:
+    FlashIAP() : m_board(&host::board::current()) {}
+
+    int init() { return 0; }
+    int deinit() { return 0; }
+
+    int read(void* buffer, uint32_t addr, uint32_t size);
+    int program(const void* buffer, uint32_t addr, uint32_t size);
+    int erase(uint32_t addr, uint32_t size);
+
+    uint32_t get_sector_size(uint32_t) const { return host::board::flash_sector_size; }
+    uint32_t get_flash_start() const { return 0; }
+    uint32_t get_flash_size() const { return host::board::flash_size; }
+    uint32_t get_page_size() const { return host::board::flash_page_size; }
+
+private:
+    void busy(uint64_t ns);
+
+    host::board* m_board;
+};
+
+} // namespace mbed
+
+using namespace mbed;
+
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+//! Sleep until the next interrupt (WFI).
+void sleep();
+
+uint32_t us_ticker_read();
+
+void __disable_irq();
+void __enable_irq();
+
+//! CMSIS stand-ins for the core's cycle counter. CYCCNT counts at
+//! SystemCoreClock off the host's monotonic clock, not the board's virtual
+//! one, so it measures what the host really spends in firmware code; it only
+//! runs once TRCENA and CYCCNTENA are set, as on the chip.
+struct host_cycle_counter
+{
+    operator uint32_t() const;
+    host_cycle_counter& operator=(uint32_t value);
+};
+
+struct DWT_Type
+{
+    uint32_t CTRL;
+    host_cycle_counter CYCCNT;
+};
+
+struct CoreDebug_Type
+{
+    uint32_t DEMCR;
+};
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
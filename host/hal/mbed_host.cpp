@@ -0,0 +1,532 @@
+#include "mbed.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace host
+{
+
+namespace
+{
+
+board& default_board()
+{
+    static board b;
+    return b;
+}
+
+thread_local board* t_current = 0;
+
+//! One OS tick; sleep() never stays down longer than this without a reason.
+const uint64_t os_tick_ns = 1000000;
+
+}
+
+board::board()
+: gpio_cost_ns(50), poll_cost_ns(10000), flash_erase_ns(13000000), flash_program_ns(65000), m_now(0), m_run_limit(0), m_next_id(1),
+  m_in_isr(false), m_irq_mask(0), m_pins(5 * 32 + 1), m_flash_ops_left(-1), m_stats()
+{
+    //! HOST_RUN_SECONDS bounds how much virtual time a firmware main() gets.
+    const char* limit = std::getenv("HOST_RUN_SECONDS");
+    if (limit)
+        m_run_limit = static_cast<uint64_t>(std::atof(limit) * 1e9);
+
+    const char* flash = std::getenv("HOST_FLASH");
+    if (flash)
+        m_flash_file = flash;
+}
+
+board& board::current()
+{
+    return t_current ? *t_current : default_board();
+}
+
+void board::set_current(board* b)
+{
+    t_current = b;
+}
+
+void board::advance_to(uint64_t t)
+{
+    //! Always re-read begin(): handlers may schedule, cancel or advance.
+    while (!m_events.empty() && m_events.begin()->first.first <= t)
+    {
+        std::map<event_key, event>::iterator it = m_events.begin();
+        m_now = std::max(m_now, it->first.first);
+
+        event ev = it->second;
+        m_deadlines.erase(it->first.second);
+        m_events.erase(it);
+
+        if (ev.kind == interrupt)
+            raise(ev.fn);
+        else
+            ev.fn();
+    }
+    m_now = std::max(m_now, t);
+}
+
+void board::sleep()
+{
+    ++m_stats.sleeps;
+    uint64_t start = m_now;
+    uint64_t isrs = m_stats.isrs;
+
+    //! Sleep until an ISR has run or is pending; wake on the OS tick regardless.
+    uint64_t tick = m_now + os_tick_ns;
+    while (m_stats.isrs == isrs && m_pending.empty() &&
+           !m_events.empty() && m_events.begin()->first.first <= tick)
+        advance_to(m_events.begin()->first.first);
+    if (m_stats.isrs == isrs && m_pending.empty())
+        advance_to(tick);
+
+    m_stats.sleep_ns += m_now - start;
+}
+
+board::event_id board::schedule_at(uint64_t when_ns, handler fn, event_kind kind)
+{
+    event_id id = m_next_id++;
+    event ev = { fn, kind };
+    m_events[event_key(std::max(when_ns, m_now), id)] = ev;
+    m_deadlines[id] = std::max(when_ns, m_now);
+    return id;
+}
+
+void board::cancel(event_id id)
+{
+    std::map<event_id, uint64_t>::iterator it = m_deadlines.find(id);
+    if (it == m_deadlines.end())
+        return;
+
+    m_events.erase(event_key(it->second, id));
+    m_deadlines.erase(it);
+}
+
+void board::raise(handler fn)
+{
+    if (m_in_isr || m_irq_mask)
+        m_pending.push_back(fn);
+    else
+        dispatch(fn);
+}
+
+void board::enable_irq()
+{
+    if (m_irq_mask)
+        --m_irq_mask;
+    drain_pending();
+}
+
+void board::dispatch(handler& fn)
+{
+    m_in_isr = true;
+    ++m_stats.isrs;
+    fn();
+    m_in_isr = false;
+
+    drain_pending();
+}
+
+void board::drain_pending()
+{
+    while (!m_in_isr && !m_irq_mask && !m_pending.empty())
+    {
+        handler fn = m_pending.front();
+        m_pending.pop_front();
+
+        m_in_isr = true;
+        ++m_stats.isrs;
+        fn();
+        m_in_isr = false;
+    }
+}
+
+board::pin_state& board::pin(PinName p)
+{
+    size_t index = static_cast<size_t>(p);
+    return index < m_pins.size() ? m_pins[index] : m_pins.back();
+}
+
+void board::mcu_write(PinName p, int level)
+{
+    advance(gpio_cost_ns);
+    ++m_stats.gpio_writes;
+
+    pin_state& s = pin(p);
+    s.level = level;
+    ++s.writes;
+
+    //! Copy: a peripheral may detach itself while handling the write.
+    std::vector<peripheral*> peripherals = s.peripherals;
+    for (size_t i = 0; i != peripherals.size(); ++i)
+        peripherals[i]->pin_written(p, level);
+}
+
+int board::mcu_read(PinName p)
+{
+    advance(gpio_cost_ns);
+    ++m_stats.gpio_reads;
+    return pin(p).level;
+}
+
+uint32_t board::mcu_read_port(PortName port, uint32_t mask)
+{
+    advance(gpio_cost_ns);
+    ++m_stats.gpio_reads;
+
+    uint32_t value = 0;
+    for (int bit = 0; bit != 32; ++bit)
+        if (mask & (1u << bit) && pin(static_cast<PinName>(port << 5 | bit)).level)
+            value |= 1u << bit;
+    return value;
+}
+
+void board::drive(PinName p, int level)
+{
+    pin_state& s = pin(p);
+    if (s.level == level)
+        return;
+
+    s.level = level;
+    std::vector<edge_listener*> listeners = s.listeners;
+    for (size_t i = 0; i != listeners.size(); ++i)
+        listeners[i]->pin_edge(p, level != 0);
+}
+
+int board::level(PinName p) const
+{
+    return const_cast<board*>(this)->pin(p).level;
+}
+
+void board::attach(PinName p, peripheral* per)
+{
+    pin(p).peripherals.push_back(per);
+}
+
+void board::detach(PinName p, peripheral* per)
+{
+    std::vector<peripheral*>& v = pin(p).peripherals;
+    v.erase(std::remove(v.begin(), v.end(), per), v.end());
+}
+
+void board::listen(PinName p, edge_listener* l)
+{
+    pin(p).listeners.push_back(l);
+}
+
+void board::unlisten(PinName p, edge_listener* l)
+{
+    std::vector<edge_listener*>& v = pin(p).listeners;
+    v.erase(std::remove(v.begin(), v.end(), l), v.end());
+}
+
+uint64_t board::write_count(PinName p) const
+{
+    return const_cast<board*>(this)->pin(p).writes;
+}
+
+std::vector<uint8_t>& board::flash()
+{
+    if (m_flash.empty())
+    {
+        m_flash.assign(flash_size, 0xFF);
+
+        //! A missing or short file just leaves the rest erased.
+        FILE* f = m_flash_file.empty() ? 0 : std::fopen(m_flash_file.c_str(), "rb");
+        if (f)
+        {
+            size_t n = std::fread(&m_flash[0], 1, m_flash.size(), f);
+            (void)n;
+            std::fclose(f);
+        }
+    }
+    return m_flash;
+}
+
+//! Takes one operation off the power cut, if one is set.
+bool board::flash_powered()
+{
+    if (m_flash_ops_left < 0)
+        return true;
+    if (m_flash_ops_left == 0)
+        return false;
+    --m_flash_ops_left;
+    return true;
+}
+
+void board::flash_changed(uint32_t addr, uint32_t size)
+{
+    if (m_flash_file.empty())
+        return;
+
+    //! Write back just the changed range; create the file the first time.
+    FILE* f = std::fopen(m_flash_file.c_str(), "r+b");
+    if (!f)
+    {
+        f = std::fopen(m_flash_file.c_str(), "w+b");
+        if (!f)
+            return;
+        addr = 0;
+        size = static_cast<uint32_t>(m_flash.size());
+    }
+    if (std::fseek(f, addr, SEEK_SET) == 0)
+        std::fwrite(&m_flash[addr], 1, size, f);
+    std::fclose(f);
+}
+
+} // namespace host
+
+namespace mbed
+{
+
+int FlashIAP::read(void* buffer, uint32_t addr, uint32_t size)
+{
+    std::vector<uint8_t>& image = m_board->flash();
+    if (addr > image.size() || size > image.size() - addr)
+        return -1;
+
+    std::memcpy(buffer, &image[addr], size);
+    return 0;
+}
+
+int FlashIAP::program(const void* buffer, uint32_t addr, uint32_t size)
+{
+    std::vector<uint8_t>& image = m_board->flash();
+    const uint32_t page = host::board::flash_page_size;
+    if (addr % page || size % page || addr > image.size() || size > image.size() - addr)
+        return -1;
+
+    //! NOR flash only clears bits; the FTFA refuses to program a phrase that
+    //! has not been erased, and so does this model.
+    for (uint32_t i = 0; i != size; ++i)
+        if (image[addr + i] != 0xFF)
+            return -1;
+    if (!m_board->flash_powered())
+        return -1;
+
+    std::memcpy(&image[addr], buffer, size);
+    busy(static_cast<uint64_t>(size / page) * m_board->flash_program_ns);
+    m_board->flash_changed(addr, size);
+    return 0;
+}
+
+int FlashIAP::erase(uint32_t addr, uint32_t size)
+{
+    std::vector<uint8_t>& image = m_board->flash();
+    const uint32_t sector = host::board::flash_sector_size;
+    if (addr % sector || size % sector || addr > image.size() || size > image.size() - addr)
+        return -1;
+    if (!m_board->flash_powered())
+        return -1;
+
+    std::memset(&image[addr], 0xFF, size);
+    busy(static_cast<uint64_t>(size / sector) * m_board->flash_erase_ns);
+    m_board->flash_changed(addr, size);
+    return 0;
+}
+
+void FlashIAP::busy(uint64_t ns)
+{
+    //! Code runs from the flash being written, so nothing else runs either.
+    m_board->disable_irq();
+    m_board->advance(ns);
+    m_board->enable_irq();
+}
+
+InterruptIn::InterruptIn(PinName pin)
+: m_pin(pin), m_board(&host::board::current()),
+  m_enabled(true), m_pending_rise(false), m_pending_fall(false)
+{
+    m_board->listen(m_pin, this);
+}
+
+InterruptIn::~InterruptIn()
+{
+    m_board->unlisten(m_pin, this);
+}
+
+void InterruptIn::pin_edge(PinName, bool rising)
+{
+    Callback<void()>& handler = rising ? m_rise : m_fall;
+    if (!handler)
+        return;
+
+    if (!m_enabled)
+    {
+        (rising ? m_pending_rise : m_pending_fall) = true;
+        return;
+    }
+
+    Callback<void()> fn = handler;
+    m_board->raise([fn]() { fn(); });
+}
+
+void InterruptIn::enable_irq()
+{
+    m_enabled = true;
+
+    //! Flags latched while disabled fire as soon as the IRQ is unmasked.
+    if (m_pending_rise && m_rise)
+    {
+        Callback<void()> fn = m_rise;
+        m_board->raise([fn]() { fn(); });
+    }
+    if (m_pending_fall && m_fall)
+    {
+        Callback<void()> fn = m_fall;
+        m_board->raise([fn]() { fn(); });
+    }
+    m_pending_rise = m_pending_fall = false;
+}
+
+void Timer::start()
+{
+    if (m_running)
+        return;
+    m_running = true;
+    m_start = m_board->now_ns();
+}
+
+void Timer::stop()
+{
+    if (!m_running)
+        return;
+    m_elapsed += m_board->now_ns() - m_start;
+    m_running = false;
+}
+
+void Timer::reset()
+{
+    m_elapsed = 0;
+    m_start = m_board->now_ns();
+}
+
+uint64_t Timer::elapsed_ns() const
+{
+    return m_elapsed + (m_running ? m_board->now_ns() - m_start : 0);
+}
+
+void Ticker::attach_us(Callback<void()> func, uint64_t t)
+{
+    detach();
+
+    m_func = func;
+    m_period_us = t ? t : 1;
+    m_deadline_ns = m_board->now_ns() + m_period_us * 1000;
+    m_alive = std::make_shared<bool>(true);
+
+    std::shared_ptr<bool> alive = m_alive;
+    m_event = m_board->schedule_at(m_deadline_ns, [this, alive]() { if (*alive) fire(); });
+}
+
+void Ticker::detach()
+{
+    if (m_alive)
+        *m_alive = false;
+    m_alive.reset();
+
+    m_board->cancel(m_event);
+    m_event = 0;
+}
+
+void Ticker::fire()
+{
+    //! Reschedule from the previous deadline, not from "now".
+    m_deadline_ns += m_period_us * 1000;
+
+    std::shared_ptr<bool> alive = m_alive;
+    m_event = m_board->schedule_at(m_deadline_ns, [this, alive]() { if (*alive) fire(); });
+
+    m_func();
+}
+
+void Timeout::fire()
+{
+    Callback<void()> fn = m_func;
+    m_event = 0;
+    if (m_alive)
+        *m_alive = false;
+    m_alive.reset();
+
+    fn();
+}
+
+} // namespace mbed
+
+void wait(float s)
+{
+    host::board::current().advance(static_cast<uint64_t>(s * 1e9));
+}
+
+void wait_ms(int ms)
+{
+    host::board::current().advance(static_cast<uint64_t>(ms) * 1000000);
+}
+
+void wait_us(int us)
+{
+    host::board::current().advance(static_cast<uint64_t>(us) * 1000);
+}
+
+void sleep()
+{
+    host::board::current().sleep();
+}
+
+DWT_Type host_dwt = {};
+CoreDebug_Type host_core_debug = {};
+
+//! The K22F runs at 120 MHz.
+uint32_t SystemCoreClock = 120000000;
+
+namespace
+{
+
+//! Cycles since the counter was last written, while it runs.
+uint64_t g_cycles_base_ns = 0;
+uint32_t g_cycles_at_base = 0;
+
+bool cycle_counter_running()
+{
+    return (host_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) && (host_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk);
+}
+
+uint64_t monotonic_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+}
+
+host_cycle_counter::operator uint32_t() const
+{
+    if (!cycle_counter_running())
+        return g_cycles_at_base;
+    uint64_t ns = monotonic_ns() - g_cycles_base_ns;
+    return g_cycles_at_base + static_cast<uint32_t>(ns * (SystemCoreClock / 1000000) / 1000);
+}
+
+host_cycle_counter& host_cycle_counter::operator=(uint32_t value)
+{
+    g_cycles_base_ns = monotonic_ns();
+    g_cycles_at_base = value;
+    return *this;
+}
+
+uint32_t us_ticker_read()
+{
+    return static_cast<uint32_t>(host::board::current().now_us());
+}
+
+void __disable_irq()
+{
+    host::board::current().disable_irq();
+}
+
+void __enable_irq()
+{
+    host::board::current().enable_irq();
+}
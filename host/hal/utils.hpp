@@ -0,0 +1,29 @@
+#pragma once
+
+//! Host stand-in for the board utilities shipped with the lab starter code.
+
+#include <chrono>
+
+#include "mbed.h"
+
+namespace utils
+{
+
+//! Length of an LED flash; the LEDs are active low.
+const uint64_t pulse_ns = 50000000;
+
+inline unsigned entropy_seed()
+{
+    return static_cast<unsigned>(std::chrono::steady_clock::now().time_since_epoch().count());
+}
+
+//! Flash an LED once: on now, off again after pulse_ns.
+inline void pulse(DigitalOut& led)
+{
+    led = 0;
+
+    DigitalOut* target = &led;
+    host::board::current().schedule_in(pulse_ns, [target]() { target->write(1); });
+}
+
+} // namespace utils
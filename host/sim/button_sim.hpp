@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+#include "host_board.hpp"
+
+namespace sim
+{
+
+//! A push button to ground with a pull-up: the pin idles high, and a press
+//! produces a falling edge followed by a rising edge on release.
+class button
+{
+public:
+    button(host::board& board, PinName pin) : m_board(board), m_pin(pin), m_presses(0)
+    {
+        m_board.drive(m_pin, 1);
+    }
+
+    void press_at(uint64_t t_ns, uint64_t hold_ns = 80000000)
+    {
+        m_board.schedule_at(t_ns, [this]() { ++m_presses; m_board.drive(m_pin, 0); }, host::board::hardware);
+        m_board.schedule_at(t_ns + hold_ns, [this]() { m_board.drive(m_pin, 1); }, host::board::hardware);
+    }
+
+    uint64_t presses() const { return m_presses; }
+
+private:
+    host::board& m_board;
+    PinName m_pin;
+    uint64_t m_presses;
+};
+
+} // namespace sim
@@ -0,0 +1,240 @@
+#include "hx711_sim.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sim
+{
+
+namespace
+{
+
+const uint64_t power_down_ns = 60000;
+const int32_t code_max = 0x7FFFFF;
+const int32_t code_min = -0x800000;
+
+//! Output settling time after reset or power-up (datasheet, 4 conversions).
+uint64_t settling_ns(unsigned rate_sps)
+{
+    return rate_sps >= 80 ? 50000000ull : 400000000ull;
+}
+
+}
+
+hx711::hx711(host::board& board, PinName sck, PinName dout, const weight_script& script, const config& cfg)
+: m_board(board), m_sck(sck), m_dout(dout), m_script(script), m_config(cfg),
+  m_powered_since(board.now_ns()), m_powered_total(0),
+  m_sck_level(board.level(sck)), m_sck_high_since(board.now_ns()),
+  m_conversion(0), m_ready(false), m_code(0), m_last_code(0),
+  m_frame_pulses(0), m_frame_start(0), m_frame_end(0), m_gain_pulses(1),
+  m_rng(cfg.seed ? cfg.seed : 1), m_fault_rng(m_rng ^ 0x9E3779B9u), m_stats()
+{
+    m_stats.frame_ns_min = UINT64_MAX;
+    if (m_config.rate_sps == 0)
+        m_config.rate_sps = 10;
+
+    m_board.attach(m_sck, this);
+    m_board.drive(m_dout, 1);
+    schedule_conversion(conversion_period_ns());
+}
+
+hx711::~hx711()
+{
+    m_board.cancel(m_conversion);
+    m_board.detach(m_sck, this);
+}
+
+bool hx711::powered() const
+{
+    return !(m_sck_level && m_board.now_ns() - m_sck_high_since >= power_down_ns);
+}
+
+uint64_t hx711::powered_ns() const
+{
+    uint64_t end = powered() ? m_board.now_ns() : m_sck_high_since + power_down_ns;
+    return m_powered_total + (end - m_powered_since);
+}
+
+int32_t hx711::ideal_code(uint64_t t_ns) const
+{
+    double code = m_config.zero_code + m_config.counts_per_gram * grams_at(t_ns);
+
+    //! Channel A/64 halves the front-end gain; channel B runs at 32.
+    if (m_gain_pulses == 3)
+        code /= 2.0;
+    else if (m_gain_pulses == 2)
+        code /= 4.0;
+
+    code = std::floor(code + 0.5);
+    return static_cast<int32_t>(std::max<double>(code_min, std::min<double>(code_max, code)));
+}
+
+int32_t hx711::noisy_code()
+{
+    //! xorshift32, two draws for a triangular distribution.
+    double u[2];
+    for (int i = 0; i != 2; ++i)
+    {
+        m_rng ^= m_rng << 13;
+        m_rng ^= m_rng >> 17;
+        m_rng ^= m_rng << 5;
+        u[i] = m_rng / 4294967296.0;
+    }
+
+    double code = ideal_code(m_board.now_ns()) + (u[0] + u[1] - 1.0) * m_config.noise_counts;
+    code = std::floor(code + 0.5);
+    return static_cast<int32_t>(std::max<double>(code_min, std::min<double>(code_max, code)));
+}
+
+int32_t hx711::faulty_code(int32_t code) const
+{
+    double t = m_board.now_ns() / 1e9;
+    if (m_config.rail_at_s > 0.0 && t >= m_config.rail_at_s)
+        return code_max;
+    if (!m_config.stuck_mask)
+        return code;
+
+    //! Force the bits on the 24-bit wire value, then sign extend it again.
+    uint32_t wire = static_cast<uint32_t>(code) & 0xFFFFFFu;
+    wire = (wire & ~m_config.stuck_mask) | (m_config.stuck_bits & m_config.stuck_mask & 0xFFFFFFu);
+    return static_cast<int32_t>(wire << 8) >> 8;
+}
+
+bool hx711::dropped()
+{
+    double t = m_board.now_ns() / 1e9;
+    if (m_config.dead_at_s > 0.0 && t >= m_config.dead_at_s)
+        return true;
+    if (m_config.dropout <= 0.0)
+        return false;
+
+    m_fault_rng ^= m_fault_rng << 13;
+    m_fault_rng ^= m_fault_rng >> 17;
+    m_fault_rng ^= m_fault_rng << 5;
+    return m_fault_rng / 4294967296.0 < m_config.dropout;
+}
+
+void hx711::schedule_conversion(uint64_t delay_ns)
+{
+    m_board.cancel(m_conversion);
+    m_conversion = m_board.schedule_in(delay_ns, [this]() { on_conversion(); }, host::board::hardware);
+}
+
+void hx711::on_conversion()
+{
+    m_conversion = 0;
+
+    //! SCK has been high long enough that the part is already asleep; the
+    //! falling edge will restart conversions.
+    if (!powered())
+        return;
+
+    //! The output register is not updated in the middle of a read.
+    if (m_frame_pulses > 0 && m_frame_pulses < 25)
+    {
+        schedule_conversion(conversion_period_ns());
+        return;
+    }
+
+    end_frame();
+
+    //! A lost conversion leaves DOUT alone, as if it had never happened.
+    int32_t code = noisy_code();
+    if (dropped())
+    {
+        ++m_stats.dropped;
+        schedule_conversion(conversion_period_ns());
+        return;
+    }
+
+    if (m_ready)
+        ++m_stats.overwritten;
+
+    m_code = faulty_code(code);
+    m_ready = true;
+    ++m_stats.conversions;
+    m_board.drive(m_dout, 0);
+
+    schedule_conversion(conversion_period_ns());
+}
+
+void hx711::end_frame()
+{
+    if (m_frame_pulses >= 25)
+    {
+        //! The pulse count of the read selects the gain of the next conversion.
+        m_gain_pulses = std::min(m_frame_pulses, 27u) - 24;
+
+        uint64_t ns = m_frame_end - m_frame_start;
+        ++m_stats.frames;
+        m_stats.frame_ns_total += ns;
+        m_stats.frame_ns_min = std::min(m_stats.frame_ns_min, ns);
+        m_stats.frame_ns_max = std::max(m_stats.frame_ns_max, ns);
+    }
+    m_frame_pulses = 0;
+}
+
+void hx711::pin_written(PinName, int level)
+{
+    if (level == m_sck_level)
+        return;
+    m_sck_level = level;
+
+    if (level)
+        on_sck_rise();
+    else
+        on_sck_fall();
+}
+
+void hx711::on_sck_rise()
+{
+    m_sck_high_since = m_board.now_ns();
+    ++m_stats.pulses;
+
+    //! Clocks with no data pending are ignored.
+    if (m_frame_pulses == 0 && !m_ready)
+        return;
+
+    if (m_frame_pulses == 0)
+        m_frame_start = m_board.now_ns();
+    ++m_frame_pulses;
+
+    if (m_frame_pulses <= 24)
+    {
+        int bit = (static_cast<uint32_t>(m_code) >> (24 - m_frame_pulses)) & 1;
+        m_board.drive(m_dout, bit);
+    }
+    else if (m_frame_pulses == 25)
+    {
+        m_board.drive(m_dout, 1);
+        m_ready = false;
+        m_last_code = m_code;
+        ++m_stats.reads;
+        if (m_on_frame)
+            m_on_frame(m_code);
+    }
+}
+
+void hx711::on_sck_fall()
+{
+    uint64_t now = m_board.now_ns();
+    if (m_frame_pulses)
+        m_frame_end = now;
+
+    if (now - m_sck_high_since < power_down_ns)
+        return;
+
+    //! SCK was high for more than 60 us: the part powered down back then and
+    //! this edge wakes it up in its reset state.
+    m_powered_total += m_sck_high_since + power_down_ns - m_powered_since;
+    m_powered_since = now;
+    ++m_stats.power_downs;
+
+    m_ready = false;
+    m_frame_pulses = 0;
+    m_gain_pulses = 1;
+    m_board.drive(m_dout, 1);
+    schedule_conversion(settling_ns(m_config.rate_sps));
+}
+
+} // namespace sim
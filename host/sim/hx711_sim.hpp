@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "host_board.hpp"
+#include "weight_script.hpp"
+
+namespace sim
+{
+
+//! Bit-accurate model of the HX711 serial interface, attached to a host board.
+//!
+//! - A conversion completes every 1/rate seconds; DOUT then falls to signal
+//!   that data is ready, and stays low (with the data being replaced by each
+//!   new conversion) until it is read.
+//! - Each SCK rising edge shifts the next bit, MSB first, onto DOUT. The 25th
+//!   edge pulls DOUT high again; 25, 26 or 27 edges in total select A/128,
+//!   B/32 or A/64 for the next conversion.
+//! - Holding SCK high for more than 60 us powers the part down; the falling
+//!   edge powers it back up, resets it to A/128 and restarts conversions after
+//!   the output settling time.
+//!
+//! The 24-bit code is derived from the weight script: zero_code plus
+//! counts_per_gram per gram (both at gain 128), with deterministic noise.
+//!
+//! Faults can be injected: conversions that never signal (a fraction of them
+//! at random, or all of them from dead_at_s on, as with an unplugged cell),
+//! a code stuck at the positive rail from rail_at_s on, and code bits stuck
+//! at a fixed value.
+class hx711 : private host::peripheral
+{
+public:
+    struct config
+    {
+        unsigned rate_sps;          // 10 or 80, as strapped on the RATE pin
+        int32_t zero_code;          // code with nothing on the cell, gain 128
+        double counts_per_gram;     // sensitivity at gain 128
+        double noise_counts;        // peak amplitude of triangular noise
+        uint32_t seed;              // noise generator seed
+
+        double dropout;             // fraction of conversions that never signal
+        double dead_at_s;           // no conversions signal from then on; 0: never
+        double rail_at_s;           // code stuck at 0x7FFFFF from then on; 0: never
+        uint32_t stuck_mask;        // code bits forced to stuck_bits
+        uint32_t stuck_bits;
+
+        config()
+        : rate_sps(10), zero_code(-51860), counts_per_gram(9000.0), noise_counts(150.0), seed(1),
+          dropout(0.0), dead_at_s(0.0), rail_at_s(0.0), stuck_mask(0), stuck_bits(0) {}
+    };
+
+    struct statistics
+    {
+        uint64_t conversions;       // conversions latched
+        uint64_t reads;             // frames shifted out completely
+        uint64_t overwritten;       // conversions replaced before being read
+        uint64_t dropped;           // conversions lost to injected faults
+        uint64_t pulses;            // SCK rising edges seen
+        uint64_t power_downs;
+        uint64_t frames;            // reads whose clock train has finished
+        uint64_t frame_ns_total;    // virtual time from first to last SCK edge
+        uint64_t frame_ns_min;
+        uint64_t frame_ns_max;
+    };
+
+    hx711(host::board& board, PinName sck, PinName dout, const weight_script& script,
+          const config& cfg = config());
+    ~hx711();
+
+    const statistics& stats() const { return m_stats; }
+
+    //! Virtual time the analog front end has been powered.
+    uint64_t powered_ns() const;
+    bool powered() const;
+
+    //! Code the part would convert right now, without noise; for checking
+    //! what the firmware reads against ground truth.
+    int32_t ideal_code(uint64_t t_ns) const;
+    //! Code of the most recent frame shifted out.
+    int32_t last_code() const { return m_last_code; }
+    //! Weight on the cell at a virtual time, straight from the script.
+    double grams_at(uint64_t t_ns) const { return m_script.grams_at(t_ns / 1e9); }
+
+    uint64_t conversion_period_ns() const { return 1000000000ull / m_config.rate_sps; }
+
+    //! Called with the code of every frame as the 25th clock edge ends it;
+    //! lets board wiring record what the firmware read.
+    typedef std::function<void(int32_t code)> frame_handler;
+    void on_frame(frame_handler fn) { m_on_frame = fn; }
+
+private:
+    void pin_written(PinName pin, int level);
+    void on_sck_rise();
+    void on_sck_fall();
+    void on_conversion();
+    void schedule_conversion(uint64_t delay_ns);
+    void end_frame();
+    int32_t noisy_code();
+    int32_t faulty_code(int32_t code) const;
+    bool dropped();
+
+    host::board& m_board;
+    PinName m_sck;
+    PinName m_dout;
+    weight_script m_script;
+    config m_config;
+
+    uint64_t m_powered_since;
+    uint64_t m_powered_total;
+    int m_sck_level;
+    uint64_t m_sck_high_since;
+
+    host::board::event_id m_conversion;
+    bool m_ready;
+    int32_t m_code;
+    int32_t m_last_code;
+    unsigned m_frame_pulses;
+    uint64_t m_frame_start;
+    uint64_t m_frame_end;
+    unsigned m_gain_pulses;     // 1 = A/128, 2 = B/32, 3 = A/64
+
+    uint32_t m_rng;
+    uint32_t m_fault_rng;       // separate, so dropouts leave the noise as it was
+    frame_handler m_on_frame;
+    statistics m_stats;
+};
+
+} // namespace sim
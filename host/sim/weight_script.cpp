@@ -0,0 +1,99 @@
+#include "weight_script.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace sim
+{
+
+void weight_script::add(double time_s, double grams, bool ramp)
+{
+    point p = { time_s, grams, ramp };
+
+    //! Keep points ordered; equal times keep insertion order.
+    std::vector<point>::iterator it = m_points.end();
+    while (it != m_points.begin() && (it - 1)->time_s > time_s)
+        --it;
+    m_points.insert(it, p);
+}
+
+double weight_script::grams_at(double time_s) const
+{
+    double previous_t = 0.0;
+    double previous_g = 0.0;
+
+    for (size_t i = 0; i != m_points.size(); ++i)
+    {
+        const point& p = m_points[i];
+        if (time_s < p.time_s)
+        {
+            if (!p.ramp || p.time_s <= previous_t)
+                return previous_g;
+
+            double f = (time_s - previous_t) / (p.time_s - previous_t);
+            return previous_g + f * (p.grams - previous_g);
+        }
+        previous_t = p.time_s;
+        previous_g = p.grams;
+    }
+    return previous_g;
+}
+
+bool weight_script::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return false;
+
+    weight_script parsed;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        double t, g;
+        if (!(fields >> t))
+            continue;
+        if (!(fields >> g))
+            return false;
+
+        std::string kind;
+        fields >> kind;
+        if (!kind.empty() && kind != "ramp" && kind != "step")
+            return false;
+
+        parsed.add(t, g, kind == "ramp");
+    }
+
+    *this = parsed;
+    return true;
+}
+
+weight_script weight_script::pill_removal(int pills, double pill_grams)
+{
+    const double bottle = 40.0;
+    weight_script s;
+
+    s.add_step(0.0, 0.0);
+    s.add_ramp(5.0, 0.0);
+    s.add_ramp(5.5, bottle + pills * pill_grams);
+
+    for (int i = 1; i <= pills; ++i)
+    {
+        double t = 5.0 + 30.0 * i;
+        double before = bottle + (pills - i + 1) * pill_grams;
+        double after = bottle + (pills - i) * pill_grams;
+
+        //! Bottle lifted off, pill taken out, bottle put back down.
+        s.add_ramp(t, before);
+        s.add_ramp(t + 0.3, 0.0);
+        s.add_step(t + 2.0, 0.0);
+        s.add_ramp(t + 2.4, after + 3.0);
+        s.add_ramp(t + 2.7, after);
+    }
+    return s;
+}
+
+} // namespace sim
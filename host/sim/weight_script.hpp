@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace sim
+{
+
+//! The load on a simulated cell over time, as a list of (time, grams) points.
+//! A point either steps to its weight at its time, or ramps linearly to it
+//! from the previous point. Before the first point the load is 0 g.
+//!
+//! Text form, one point per line ('#' starts a comment):
+//!     <seconds> <grams> [ramp]
+class weight_script
+{
+public:
+    struct point
+    {
+        double time_s;
+        double grams;
+        bool ramp;
+    };
+
+    void add_step(double time_s, double grams) { add(time_s, grams, false); }
+    void add_ramp(double time_s, double grams) { add(time_s, grams, true); }
+
+    double grams_at(double time_s) const;
+    double duration_s() const { return m_points.empty() ? 0.0 : m_points.back().time_s; }
+    const std::vector<point>& points() const { return m_points; }
+
+    //! Returns false (and leaves the script untouched) on a parse error.
+    bool load(const std::string& path);
+
+    //! A 40 g bottle is placed at 5 s, then one 0.5 g pill is removed every
+    //! 30 s, with the usual pick-up/put-down bump around each removal.
+    static weight_script pill_removal(int pills = 8, double pill_grams = 0.5);
+
+private:
+    void add(double time_s, double grams, bool ramp);
+
+    std::vector<point> m_points;
+};
+
+} // namespace sim
@@ -0,0 +1,208 @@
+//! A local stand-in for the mbed Device Connector, for load testing the
+//! firmware's notifications without the cloud service. Host builds of the
+//! firmware register with it when HOST_CONNECTOR gives its address.
+//!
+//! Like lab3/app.js does with putResourceSubscription(), it observes the
+//! resources each device registers (every observable one, or those named
+//! with --observe), then sends the device the --get, --put and --post
+//! requests given, in that order. At the end it reports notifications per
+//! second, their end-to-end latency (from the firmware's set_value() to
+//! arrival here, which only means something with both on one machine),
+//! sequence gaps, and the round trip of each request.
+//!
+//! usage: connector [--listen addr:port] [--seconds n] [--once] [--quiet]
+//!                  [--observe path]... [--get path]... [--put path=value]...
+//!                  [--post path]...
+//!
+//! --once ends the run when the last registered device deregisters, which is
+//! how `make connector-test` runs it.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "device_connector.hpp"
+
+namespace
+{
+
+struct options
+{
+    options() : listen(":5683"), seconds(0.0), once(false), quiet(false) {}
+
+    std::string listen;
+    double seconds;
+    bool once;
+    bool quiet;
+    std::vector<std::string> observe;
+    std::vector<std::pair<uint8_t, std::string> > requests;    // method, path[=value]
+};
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_signal(int)
+{
+    g_stop = 1;
+}
+
+const char* method_name(uint8_t method)
+{
+    return method == coap::get ? "GET" : method == coap::put ? "PUT" : method == coap::post ? "POST" : "?";
+}
+
+struct path_totals
+{
+    uint64_t notifications;
+    uint64_t payload_bytes;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for (int i = 1; i != argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 != argc;
+        if (arg == "--once")
+            opt.once = true;
+        else if (arg == "--quiet")
+            opt.quiet = true;
+        else if (arg == "--listen" && has_value)
+            opt.listen = argv[++i];
+        else if (arg == "--seconds" && has_value)
+            opt.seconds = std::atof(argv[++i]);
+        else if (arg == "--observe" && has_value)
+            opt.observe.push_back(argv[++i]);
+        else if (arg == "--get" && has_value)
+            opt.requests.push_back(std::make_pair(uint8_t(coap::get), std::string(argv[++i])));
+        else if (arg == "--put" && has_value)
+            opt.requests.push_back(std::make_pair(uint8_t(coap::put), std::string(argv[++i])));
+        else if (arg == "--post" && has_value)
+            opt.requests.push_back(std::make_pair(uint8_t(coap::post), std::string(argv[++i])));
+        else
+        {
+            std::fprintf(stderr, "usage: connector [--listen addr:port] [--seconds n] [--once] [--quiet]\n"
+                                 "                 [--observe path]... [--get path]... [--put path=value]...\n"
+                                 "                 [--post path]...\n");
+            return 2;
+        }
+    }
+
+    coap::address local;
+    device_connector connector;
+    if (!coap::parse_address(opt.listen, local) || !connector.listen(local))
+    {
+        std::fprintf(stderr, "cannot listen on %s\n", opt.listen.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, "listening on %s\n", connector.local().text().c_str());
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    uint64_t start_ns = bench::wall_ns();
+    uint64_t first_ns = 0;
+    uint64_t last_ns = 0;
+    bench::samples latency_us;
+    bench::samples round_trip_us;
+    std::map<std::string, path_totals> per_path;
+
+    device_connector::response_handler print_response = [&](const device_connector::response& r) {
+        if (r.code == coap::empty)
+        {
+            std::printf("%s %s %s timed out\n", r.endpoint.c_str(), method_name(r.method), r.path.c_str());
+            return;
+        }
+        round_trip_us.add(r.round_trip_ns / 1e3);
+        if (!opt.quiet)
+            std::printf("%s %s %s %s %s (%.0f us)\n", r.endpoint.c_str(), method_name(r.method), r.path.c_str(),
+                        coap::code_text(r.code).c_str(), r.payload.c_str(), r.round_trip_ns / 1e3);
+    };
+
+    connector.on_registered([&](const device_connector::endpoint& device) {
+        if (!opt.quiet)
+            std::printf("%s registered from %s as /%s, %zu resources\n", device.name.c_str(),
+                        device.address.text().c_str(), device.location.c_str(), device.resources.size());
+
+        const std::vector<std::string>& paths = opt.observe.empty() ? device.observable : opt.observe;
+        for (size_t i = 0; i != paths.size(); ++i)
+            connector.observe(device.name, paths[i], [&](const device_connector::response& r) {
+                if (r.code != coap::content)
+                    std::printf("%s observe %s: %s\n", r.endpoint.c_str(), r.path.c_str(),
+                                r.code == coap::empty ? "timed out" : coap::code_text(r.code).c_str());
+            });
+
+        for (size_t i = 0; i != opt.requests.size(); ++i)
+        {
+            const std::string& target = opt.requests[i].second;
+            size_t equals = target.find('=');
+            std::string path = target.substr(0, equals);
+            if (opt.requests[i].first == coap::get)
+                connector.get(device.name, path, print_response);
+            else if (opt.requests[i].first == coap::put)
+                connector.put(device.name, path, equals == std::string::npos ? "" : target.substr(equals + 1),
+                              print_response);
+            else
+                connector.post(device.name, path, print_response);
+        }
+    });
+
+    connector.on_deregistered([&](const device_connector::endpoint& device) {
+        if (!opt.quiet)
+            std::printf("%s deregistered\n", device.name.c_str());
+    });
+
+    connector.on_notification([&](const device_connector::notification& n) {
+        if (!first_ns)
+            first_ns = n.received_ns;
+        last_ns = n.received_ns;
+        if (n.latency_ns)
+            latency_us.add(n.latency_ns / 1e3);
+        path_totals& totals = per_path[*n.path];
+        ++totals.notifications;
+        totals.payload_bytes += n.payload->size();
+        if (!opt.quiet)
+            std::printf("%s %s %s\n", n.device->name.c_str(), n.path->c_str(), n.payload->c_str());
+    });
+
+    while (!g_stop)
+    {
+        connector.poll(100);
+        if (opt.seconds > 0 && bench::wall_ns() - start_ns >= opt.seconds * 1e9)
+            break;
+        if (opt.once && connector.stats().registrations && !connector.endpoints())
+            break;
+    }
+
+    const device_connector::statistics& s = connector.stats();
+    double active = first_ns && last_ns > first_ns ? (last_ns - first_ns) / 1e9 : 0.0;
+    std::printf("devices: %llu registrations, %llu deregistrations, %zu still registered\n",
+                (unsigned long long)s.registrations, (unsigned long long)s.deregistrations, connector.endpoints());
+    std::printf("notifications: %llu in %.3f s, %.0f/s, %llu lost, %llu unmatched\n",
+                (unsigned long long)s.notifications, active, active > 0 ? s.notifications / active : 0.0,
+                (unsigned long long)s.lost, (unsigned long long)s.unmatched);
+    if (latency_us.size())
+        std::printf("latency: p50 %.1f us, p99 %.1f us, max %.1f us\n", latency_us.percentile(50),
+                    latency_us.percentile(99), latency_us.percentile(100));
+    for (std::map<std::string, path_totals>::const_iterator it = per_path.begin(); it != per_path.end(); ++it)
+        std::printf("  %-14s %8llu notifications, %6.1f bytes each\n", it->first.c_str(),
+                    (unsigned long long)it->second.notifications,
+                    double(it->second.payload_bytes) / it->second.notifications);
+    std::printf("requests: %llu sent, %llu answered, %llu retransmitted, %llu timed out",
+                (unsigned long long)s.requests, (unsigned long long)s.responses,
+                (unsigned long long)s.retransmissions, (unsigned long long)s.timeouts);
+    if (round_trip_us.size())
+        std::printf(", round trip p50 %.0f us, max %.0f us", round_trip_us.percentile(50),
+                    round_trip_us.percentile(100));
+    std::printf("\n");
+    if (s.malformed)
+        std::printf("%llu datagrams were not CoAP\n", (unsigned long long)s.malformed);
+    return 0;
+}
@@ -0,0 +1,536 @@
+#include "dashboard_gateway.hpp"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "bench_util.hpp"
+#include "value_codec.hpp"
+#include "websocket.hpp"
+
+namespace
+{
+
+//! Frames written to a socket with one call.
+const size_t max_iov = 64;
+
+//! Endpoint names come from the device; keep them from breaking the JSON.
+void append_json_string(std::string& out, const std::string& text)
+{
+    out += '"';
+    for (size_t i = 0; i != text.size(); ++i)
+    {
+        char c = text[i];
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20)
+            out += c;
+    }
+    out += '"';
+}
+
+//! An LWM2M path: an object id, then optionally an instance and a resource,
+//! e.g. "3318/0/5700". Anything else no device has, and is not asked for.
+bool lwm2m_path(const std::string& path)
+{
+    size_t ids = 0, digits = 0;
+    for (size_t i = 0; i <= path.size(); ++i)
+    {
+        if (i == path.size() || path[i] == '/')
+        {
+            if (!digits || ++ids > 3)
+                return false;
+            digits = 0;
+        }
+        else if (path[i] < '0' || path[i] > '9' || ++digits > 5)
+            return false;
+    }
+    return true;
+}
+
+}
+
+dashboard_gateway::dashboard_gateway(device_connector& devices, const config& cfg)
+: m_devices(devices), m_config(cfg), m_listener(-1), m_epoll(epoll_create1(0)), m_next_id(0),
+  m_cache(cfg.ttl_ns, [this](const std::string& endpoint, const std::string& path) { return fetch(endpoint, path); }),
+  m_stats()
+{
+    epoll_event e = epoll_event();
+    e.events = EPOLLIN;
+    e.data.ptr = &m_devices;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_devices.descriptor(), &e);
+
+    //! As app.js does with putResourceSubscription(), for every device. The
+    //! observation's first answer carries the current value.
+    m_devices.on_registered([this](const device_connector::endpoint& device) {
+        m_devices.observe(device.name, m_config.path, [this](const device_connector::response& r) {
+            if (r.code == coap::content)
+                forward(r.endpoint, r.payload);
+        });
+    });
+    m_devices.on_deregistered([this](const device_connector::endpoint& device) { m_cache.forget(device.name); });
+    m_devices.on_notification([this](const device_connector::notification& n) {
+        if (*n.path == m_config.path)
+            forward(n.device->name, *n.payload);
+    });
+}
+
+dashboard_gateway::~dashboard_gateway()
+{
+    for (std::map<int, client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+    {
+        close(it->first);
+        delete it->second;
+    }
+    reap();
+    if (m_listener >= 0)
+        close(m_listener);
+    close(m_epoll);
+}
+
+bool dashboard_gateway::listen(const coap::address& local)
+{
+    m_listener = ws::listen_tcp(local, 1024);
+    if (m_listener < 0)
+        return false;
+    epoll_event e = epoll_event();
+    e.events = EPOLLIN;
+    e.data.ptr = &m_listener;
+    return epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listener, &e) == 0;
+}
+
+coap::address dashboard_gateway::local() const
+{
+    return ws::local_address(m_listener);
+}
+
+size_t dashboard_gateway::subscribers(const std::string& endpoint) const
+{
+    std::map<std::string, group>::const_iterator it = m_groups.find(endpoint);
+    return it == m_groups.end() ? 0 : it->second.members.size();
+}
+
+void dashboard_gateway::poll(int timeout_ms)
+{
+    epoll_event events[256];
+    int n = epoll_wait(m_epoll, events, 256, timeout_ms);
+    for (int i = 0; i < n; ++i)
+    {
+        void* source = events[i].data.ptr;
+        if (source == &m_devices)
+            continue;
+        if (source == &m_listener)
+        {
+            accept_clients();
+            continue;
+        }
+
+        //! A client dropped earlier in this batch is still allocated, until
+        //! reap().
+        client& c = *static_cast<client*>(source);
+        if (!c.dead && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            read(c);
+        if (!c.dead && (events[i].events & EPOLLOUT))
+        {
+            c.writable = true;
+            flush(c);
+        }
+    }
+
+    //! Also retransmits the connector's requests when they are due.
+    m_devices.poll(0);
+    flush_queued();
+    reap();
+}
+
+void dashboard_gateway::accept_clients()
+{
+    for (;;)
+    {
+        int fd = ws::accept_tcp(m_listener);
+        if (fd < 0)
+            return;
+
+        client* c = new client();
+        c->fd = fd;
+        c->id = m_next_id++;
+        epoll_event e = epoll_event();
+        e.events = EPOLLIN;
+        e.data.ptr = c;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &e);
+        m_clients[fd] = c;
+        ++m_stats.accepted;
+    }
+}
+
+void dashboard_gateway::read(client& c)
+{
+    char buffer[4096];
+    bool hung_up = false;
+    for (;;)
+    {
+        ssize_t size = recv(c.fd, buffer, sizeof(buffer), 0);
+        if (size > 0)
+        {
+            c.in.append(buffer, static_cast<size_t>(size));
+            continue;
+        }
+        if (size < 0 && errno == EINTR)
+            continue;
+        hung_up = size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    //! What came before a hang-up is handled first: it may be a close.
+    if (c.closing)
+        c.in.clear();
+    else if (!c.subscribed)
+        handle_upgrade(c);
+    else
+        handle_frames(c);
+
+    if (hung_up && !c.dead)
+    {
+        //! A hang-up after a close handshake is how it is meant to end.
+        if (!c.closing)
+            ++m_stats.dropped;
+        drop(c);
+    }
+}
+
+void dashboard_gateway::handle_upgrade(client& c)
+{
+    std::string path;
+    std::string key;
+    long length = ws::parse_upgrade(c.in, path, key);
+    if (length == 0)
+        return;
+
+    //! "/scale" or "/scale?anything"; "/" for the default endpoint.
+    bool valid = length > 0 && !path.empty() && path[0] == '/';
+    std::string name = valid ? path.substr(1, path.find('?') - 1) : std::string();
+    if (name.empty())
+        name = m_config.default_endpoint;
+    if (!valid || name.empty())
+    {
+        ++m_stats.rejected;
+        std::string answer = valid ? ws::reject_response(404, "Not Found") : ws::reject_response(400, "Bad Request");
+        c.closing = true;
+        c.in.clear();
+        send(c, std::make_shared<std::vector<uint8_t> >(answer.begin(), answer.end()));
+        return;
+    }
+
+    std::string answer = ws::upgrade_response(key);
+    send(c, std::make_shared<std::vector<uint8_t> >(answer.begin(), answer.end()));
+    c.in.erase(0, static_cast<size_t>(length));
+
+    group& g = m_groups[name];
+    g.name = name;
+    subscribe(c, g);
+    if (g.latest)
+        send(c, g.latest);
+    if (!c.dead && !c.in.empty())
+        handle_frames(c);
+}
+
+void dashboard_gateway::handle_frames(client& c)
+{
+    size_t at = 0;
+    while (!c.dead && !c.closing)
+    {
+        uint8_t op = 0;
+        std::string payload;
+        long length = ws::decode(reinterpret_cast<const uint8_t*>(c.in.data()) + at, c.in.size() - at, op, payload);
+        if (length == 0)
+            break;
+        if (length < 0)
+        {
+            ++m_stats.dropped;
+            drop(c);
+            return;
+        }
+        at += static_cast<size_t>(length);
+
+        if (op == ws::text)
+            handle_request(c, payload);
+        else if (op == ws::close)
+        {
+            ++m_stats.closed;
+            std::shared_ptr<std::vector<uint8_t> > f = std::make_shared<std::vector<uint8_t> >();
+            ws::encode(ws::close, payload.data(), payload.size() < 2 ? payload.size() : 2, *f);
+            c.closing = true;
+            unsubscribe(c);
+            send(c, f);
+        }
+        else if (op == ws::ping)
+        {
+            std::shared_ptr<std::vector<uint8_t> > f = std::make_shared<std::vector<uint8_t> >();
+            ws::encode(ws::pong, payload.data(), payload.size(), *f);
+            send(c, f);
+        }
+    }
+    if (!c.dead)
+        c.in.erase(0, at);
+}
+
+void dashboard_gateway::send(client& c, const frame& f)
+{
+    if (c.dead)
+        return;
+    if (c.out.size() >= m_config.max_queued)
+    {
+        ++m_stats.slow;
+        drop(c);
+        return;
+    }
+    c.out.push_back(f);
+    if (!c.flushing)
+    {
+        c.flushing = true;
+        m_flush.push_back(&c);
+    }
+}
+
+void dashboard_gateway::flush_queued()
+{
+    uint64_t start_ns = bench::wall_ns();
+    for (size_t i = 0; i != m_flush.size(); ++i)
+    {
+        client& c = *m_flush[i];
+        c.flushing = false;
+        if (!c.dead && c.writable)
+            flush(c);
+    }
+    m_flush.clear();
+    m_stats.write_ns += bench::wall_ns() - start_ns;
+}
+
+void dashboard_gateway::flush(client& c)
+{
+    while (!c.out.empty())
+    {
+        iovec iov[max_iov];
+        size_t count = 0;
+        for (std::deque<frame>::const_iterator it = c.out.begin(); it != c.out.end() && count != max_iov; ++it)
+        {
+            size_t skip = count == 0 ? c.offset : 0;
+            iov[count].iov_base = const_cast<uint8_t*>((*it)->data()) + skip;
+            iov[count].iov_len = (*it)->size() - skip;
+            ++count;
+        }
+
+        msghdr m = msghdr();
+        m.msg_iov = iov;
+        m.msg_iovlen = count;
+        ssize_t sent = sendmsg(c.fd, &m, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                want_writable(c, true);
+                return;
+            }
+            ++m_stats.dropped;
+            drop(c);
+            return;
+        }
+
+        m_stats.bytes_sent += static_cast<uint64_t>(sent);
+        size_t left = static_cast<size_t>(sent);
+        while (left && !c.out.empty())
+        {
+            size_t rest = c.out.front()->size() - c.offset;
+            if (left < rest)
+            {
+                c.offset += left;
+                break;
+            }
+            left -= rest;
+            c.offset = 0;
+            c.out.pop_front();
+        }
+    }
+
+    want_writable(c, false);
+    if (c.closing)
+        drop(c);
+}
+
+void dashboard_gateway::want_writable(client& c, bool want)
+{
+    if (want != c.writable)
+        return;
+    epoll_event e = epoll_event();
+    e.events = want ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    e.data.ptr = &c;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, c.fd, &e);
+    c.writable = !want;
+}
+
+void dashboard_gateway::drop(client& c)
+{
+    if (c.dead)
+        return;
+    c.dead = true;
+    unsubscribe(c);
+    c.out.clear();
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, c.fd, 0);
+    close(c.fd);
+    //! The descriptor can be handed out again at once, so it goes from the
+    //! map now; the client itself lives until the end of this poll().
+    m_clients.erase(c.fd);
+    m_dead.push_back(&c);
+}
+
+void dashboard_gateway::reap()
+{
+    for (size_t i = 0; i != m_dead.size(); ++i)
+        delete m_dead[i];
+    m_dead.clear();
+}
+
+dashboard_gateway::frame dashboard_gateway::encode_value(const std::string& endpoint, const std::string& path,
+                                                         const std::string& payload, bool& numeric) const
+{
+    //! The value goes out in the codec's canonical form whatever the device
+    //! sent; one that is not a number goes out as a string.
+    int32_t value = 0;
+    numeric = codec::parse_fixed(reinterpret_cast<const uint8_t*>(payload.data()), payload.size(),
+                                 m_config.decimals, value);
+
+    std::string text = "{\"endpoint\":";
+    append_json_string(text, endpoint);
+    text += ",\"path\":";
+    append_json_string(text, "/" + path);
+    text += ",\"value\":";
+    if (numeric)
+    {
+        char number[codec::max_chars];
+        codec::format_fixed(number, sizeof(number), value, m_config.decimals);
+        text += number;
+    }
+    else
+        append_json_string(text, payload);
+    text += '}';
+
+    std::shared_ptr<std::vector<uint8_t> > f = std::make_shared<std::vector<uint8_t> >();
+    f->reserve(text.size() + 4);
+    ws::encode(ws::text, text.data(), text.size(), *f);
+    return f;
+}
+
+void dashboard_gateway::forward(const std::string& endpoint, const std::string& payload)
+{
+    uint64_t start_ns = bench::wall_ns();
+    ++m_stats.notifications;
+
+    //! Decoded once, here, for every dashboard on this endpoint and every
+    //! read of it until the next one.
+    bool numeric = false;
+    frame f = encode_value(endpoint, m_config.path, payload, numeric);
+    if (!numeric)
+    {
+        ++m_stats.undecodable;
+        return;
+    }
+    ++m_stats.frames;
+    m_cache.store(endpoint, m_config.path, f, start_ns);
+
+    group& g = m_groups[endpoint];
+    g.latest = f;
+
+    //! From the back: a member dropped on the way is replaced by the last
+    //! one, which has already been sent to.
+    size_t i = g.members.size();
+    while (i--)
+    {
+        client& c = *g.members[i];
+        send(c, g.latest);
+        if (!c.dead)
+            ++m_stats.deliveries;
+    }
+    m_stats.fanout_ns += bench::wall_ns() - start_ns;
+}
+
+void dashboard_gateway::handle_request(client& c, const std::string& text)
+{
+    //! "get" reads the observed resource, "get <path>" any other.
+    if (text.compare(0, 3, "get") != 0 || (text.size() > 3 && text[3] != ' ') || !c.subscribed)
+    {
+        ++m_stats.bad_requests;
+        return;
+    }
+    std::string path = text.size() > 4 ? text.substr(4) : m_config.path;
+    if (!path.empty() && path[0] == '/')
+        path.erase(0, 1);
+    if (!lwm2m_path(path))
+    {
+        ++m_stats.bad_requests;
+        return;
+    }
+    ++m_stats.reads;
+
+    //! The client may be gone by the time the device answers; its
+    //! descriptor may even belong to another one by then.
+    int fd = c.fd;
+    uint64_t id = c.id;
+    const std::string& endpoint = c.subscribed->name;
+    m_cache.read(endpoint, path, bench::wall_ns(), [this, fd, id, endpoint, path](const frame* value) {
+        std::map<int, client*>::iterator it = m_clients.find(fd);
+        if (it == m_clients.end() || it->second->id != id)
+            return;
+        if (value)
+        {
+            send(*it->second, *value);
+            return;
+        }
+        std::string error = "{\"endpoint\":";
+        append_json_string(error, endpoint);
+        error += ",\"path\":";
+        append_json_string(error, "/" + path);
+        error += ",\"error\":\"unavailable\"}";
+        std::shared_ptr<std::vector<uint8_t> > f = std::make_shared<std::vector<uint8_t> >();
+        ws::encode(ws::text, error.data(), error.size(), *f);
+        send(*it->second, f);
+    });
+}
+
+bool dashboard_gateway::fetch(const std::string& endpoint, const std::string& path)
+{
+    return m_devices.get(endpoint, path, [this](const device_connector::response& r) {
+        uint64_t now_ns = bench::wall_ns();
+        if (r.code != coap::content)
+        {
+            m_cache.answer(r.endpoint, r.path, 0, now_ns);
+            return;
+        }
+        bool numeric = false;
+        frame f = encode_value(r.endpoint, r.path, r.payload, numeric);
+        m_cache.answer(r.endpoint, r.path, &f, now_ns);
+    });
+}
+
+void dashboard_gateway::subscribe(client& c, group& g)
+{
+    c.subscribed = &g;
+    c.index = g.members.size();
+    g.members.push_back(&c);
+}
+
+void dashboard_gateway::unsubscribe(client& c)
+{
+    group* g = c.subscribed;
+    if (!g)
+        return;
+    client* last = g->members.back();
+    g->members[c.index] = last;
+    last->index = c.index;
+    g->members.pop_back();
+    c.subscribed = 0;
+}
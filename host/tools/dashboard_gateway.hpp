@@ -0,0 +1,159 @@
+#pragma once
+
+//! The server side of lab3/app.js done natively: it observes one resource on
+//! every device that registers with a device_connector, and pushes each
+//! notification to the dashboards watching that device over WebSocket.
+//!
+//! app.js parses every notification once per socket and calls emit() on
+//! every socket it ever accepted, open or not. Here a notification is
+//! decoded once, turned into one frame that every subscriber shares by
+//! reference, and queued only to the sockets subscribed to its endpoint;
+//! sockets that close, fail or fall too far behind are dropped from their
+//! group straight away. The cost of a notification is then one decode, one
+//! encode and a queue push per subscriber, and each client is written to
+//! once per poll() with everything queued for it, however many
+//! notifications arrived together.
+//!
+//! A dashboard subscribes by the path it connects to: ws://<gateway>/<name>
+//! watches the endpoint called name, "/" the default endpoint if there is
+//! one. It is sent the latest value on connecting, then every notification,
+//! as text:
+//!
+//!     {"endpoint":"scale","path":"/3318/0/5700","value":44.001}
+//!
+//! A dashboard can also read a resource of its endpoint by sending the text
+//! "get" (the observed one) or "get 3318/0/5701". The answer comes in the
+//! same form, or with "error":"unavailable" in place of the value, from a
+//! resource_cache fed by the notifications: reads cost the device a request
+//! only when the cache has nothing fresh, and only one however many
+//! dashboards are asking.
+//!
+//! Single-threaded: everything, the connector's handlers included, runs
+//! inside poll(), which waits on the connector and every socket at once.
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "coap.hpp"
+#include "device_connector.hpp"
+#include "resource_cache.hpp"
+
+class dashboard_gateway
+{
+public:
+    //! One encoded frame, shared by every client it is queued to.
+    typedef std::shared_ptr<const std::vector<uint8_t> > frame;
+
+    struct config
+    {
+        config() : path("3318/0/5700"), decimals(3), max_queued(256), ttl_ns(90000000000ull) {}
+
+        std::string path;               // the resource observed and forwarded
+        unsigned decimals;              // fraction digits its values carry
+        std::string default_endpoint;   // for dashboards connecting to "/"
+        size_t max_queued;              // frames a client may fall behind by
+        uint64_t ttl_ns;                // how long a value answers reads for
+    };
+
+    dashboard_gateway(device_connector& devices, const config& cfg);
+    ~dashboard_gateway();
+
+    bool listen(const coap::address& local);
+    coap::address local() const;
+
+    //! Handle the connector and every socket, waiting up to timeout_ms for
+    //! the first of them to have something.
+    void poll(int timeout_ms);
+
+    size_t clients() const { return m_clients.size(); }
+    size_t subscribers(const std::string& endpoint) const;
+
+    struct statistics
+    {
+        uint64_t notifications;     // values received, observe responses included
+        uint64_t undecodable;       // payloads that were not a number; not forwarded
+        uint64_t frames;            // frames encoded, one per forwarded value
+        uint64_t deliveries;        // frames queued to a client
+        uint64_t bytes_sent;
+        uint64_t accepted;
+        uint64_t rejected;          // bad upgrade, or no such endpoint
+        uint64_t closed;            // by a close frame
+        uint64_t dropped;           // on a socket error or hang-up
+        uint64_t slow;              // dropped for being max_queued behind
+        uint64_t fanout_ns;         // decoding, encoding and queueing
+        uint64_t write_ns;          // writing the queues out
+        uint64_t reads;             // "get" requests from dashboards
+        uint64_t bad_requests;      // any other text, or not an LWM2M path
+    };
+    const statistics& stats() const { return m_stats; }
+    const resource_cache<frame>::statistics& cache_stats() const { return m_cache.stats(); }
+
+private:
+    struct client;
+
+    //! The dashboards watching one endpoint, and what they were last sent.
+    struct group
+    {
+        std::string name;
+        std::vector<client*> members;
+        frame latest;
+    };
+
+    struct client
+    {
+        client()
+        : fd(-1), id(0), subscribed(0), index(0), offset(0), writable(true), flushing(false), closing(false),
+          dead(false)
+        {
+        }
+
+        int fd;
+        uint64_t id;                // unlike fd, never reused
+        std::string in;             // bytes read and not yet handled
+        group* subscribed;
+        size_t index;               // in subscribed->members
+        std::deque<frame> out;      // frames waiting, the first offset bytes sent
+        size_t offset;
+        bool writable;              // no EPOLLOUT wait outstanding
+        bool flushing;              // in m_flush
+        bool closing;               // close once out is empty
+        bool dead;
+    };
+
+    void accept_clients();
+    void read(client& c);
+    void handle_upgrade(client& c);
+    void handle_frames(client& c);
+    void send(client& c, const frame& f);
+    void flush(client& c);
+    void flush_queued();
+    void want_writable(client& c, bool want);
+    void drop(client& c);
+    void reap();
+
+    frame encode_value(const std::string& endpoint, const std::string& path, const std::string& payload,
+                       bool& numeric) const;
+    void forward(const std::string& endpoint, const std::string& payload);
+    void handle_request(client& c, const std::string& text);
+    bool fetch(const std::string& endpoint, const std::string& path);
+    void subscribe(client& c, group& g);
+    void unsubscribe(client& c);
+
+    device_connector& m_devices;
+    config m_config;
+    int m_listener;
+    int m_epoll;
+    uint64_t m_next_id;
+
+    std::map<int, client*> m_clients;       // by descriptor
+    std::map<std::string, group> m_groups;  // by endpoint
+    std::vector<client*> m_flush;           // sent to since the last flush
+    std::vector<client*> m_dead;
+    resource_cache<frame> m_cache;
+
+    statistics m_stats;
+};
@@ -0,0 +1,356 @@
+#include "device_connector.hpp"
+
+#include "bench_util.hpp"
+
+namespace
+{
+
+//! As on the device side: up to five transmissions, the wait doubling from 2 s.
+const uint64_t ack_timeout_ns = 2000000000ull;
+const int max_transmit = 5;
+
+//! "</3318/0/5700>;obs,</3318/0/5605>" into paths, and the observable ones.
+void parse_links(const std::string& links, std::vector<std::string>& paths, std::vector<std::string>& observable)
+{
+    size_t start = 0;
+    while (start < links.size())
+    {
+        size_t end = links.find(',', start);
+        if (end == std::string::npos)
+            end = links.size();
+        std::string link = links.substr(start, end - start);
+        start = end + 1;
+
+        size_t open = link.find("</");
+        size_t close = link.find('>');
+        if (open == std::string::npos || close == std::string::npos || close < open + 2)
+            continue;
+        std::string path = link.substr(open + 2, close - open - 2);
+        paths.push_back(path);
+
+        //! Attributes follow as ";name" or ";name=value".
+        std::string attributes = link.substr(close + 1) + ";";
+        if (attributes.find(";obs;") != std::string::npos || attributes.find(";obs=") != std::string::npos)
+            observable.push_back(path);
+    }
+}
+
+}
+
+device_connector::device_connector()
+: m_next_id(static_cast<uint16_t>(bench::wall_ns())), m_next_token(1), m_next_location(1), m_stats()
+{
+}
+
+bool device_connector::listen(const coap::address& local)
+{
+    //! Every device's notifications arrive on this one socket; the default
+    //! buffer holds only a few hundred of them.
+    m_socket.set_receive_buffer(4 << 20);
+    return m_socket.bind(local);
+}
+
+bool device_connector::get(const std::string& name, const std::string& path, response_handler fn)
+{
+    return request(name, coap::get, path, std::string(), false, fn);
+}
+
+bool device_connector::put(const std::string& name, const std::string& path, const std::string& payload,
+                           response_handler fn)
+{
+    return request(name, coap::put, path, payload, false, fn);
+}
+
+bool device_connector::post(const std::string& name, const std::string& path, response_handler fn)
+{
+    return request(name, coap::post, path, std::string(), false, fn);
+}
+
+bool device_connector::observe(const std::string& name, const std::string& path, response_handler fn)
+{
+    return request(name, coap::get, path, std::string(), true, fn);
+}
+
+bool device_connector::request(const std::string& name, uint8_t method, const std::string& path,
+                               const std::string& payload, bool observe, response_handler fn)
+{
+    std::map<std::string, endpoint>::const_iterator device = m_endpoints.find(name);
+    if (device == m_endpoints.end())
+        return false;
+
+    coap::message m;
+    m.kind = coap::confirmable;
+    m.code = method;
+    m.id = m_next_id++;
+    m.token = take_token();
+    m.set_path(path);
+    if (observe)
+        m.add_uint(coap::observe, 0);
+    if (!payload.empty())
+    {
+        m.add_uint(coap::content_format, coap::text_plain);
+        m.payload = payload;
+    }
+
+    pending& p = m_pending[m.token];
+    p.endpoint = name;
+    p.path = path;
+    p.method = method;
+    p.to = device->second.address;
+    coap::encode(m, p.datagram);
+    p.first_sent_ns = bench::wall_ns();
+    p.timeout_ns = ack_timeout_ns;
+    p.deadline_ns = p.first_sent_ns + p.timeout_ns;
+    p.attempts = 1;
+    p.handler = fn;
+
+    if (observe)
+    {
+        observation& o = m_observations[m.token];
+        o.endpoint = name;
+        o.path = path;
+        o.sequence = 0;
+        o.seen = false;
+    }
+
+    ++m_stats.requests;
+    m_socket.send_raw(p.datagram, p.to);
+    return true;
+}
+
+void device_connector::poll(int timeout_ms)
+{
+    coap::message m;
+    coap::address from;
+    while (m_socket.receive(m, from, timeout_ms))
+    {
+        handle(m, from, bench::wall_ns());
+        timeout_ms = 0;
+    }
+    retransmit(bench::wall_ns());
+}
+
+const device_connector::endpoint* device_connector::find(const std::string& name) const
+{
+    std::map<std::string, endpoint>::const_iterator it = m_endpoints.find(name);
+    return it == m_endpoints.end() ? 0 : &it->second;
+}
+
+const device_connector::statistics& device_connector::stats() const
+{
+    m_stats.malformed = m_socket.malformed();
+    return m_stats;
+}
+
+void device_connector::handle(const coap::message& m, const coap::address& from, uint64_t now_ns)
+{
+    if (m.is_request())
+    {
+        std::string path = m.path();
+        if (m.code == coap::post && path == "rd")
+            handle_registration(m, from);
+        else if (m.code == coap::del && m_locations.count(path))
+            handle_deregistration(m, from);
+        else
+            reply(m, from, coap::not_found);
+        return;
+    }
+
+    //! The answer to one of our requests, piggybacked or separate.
+    std::map<std::string, pending>::iterator p = m_pending.find(m.token);
+    if (p != m_pending.end() && m.code != coap::empty)
+    {
+        if (m.kind == coap::confirmable)
+            reply(m, from, coap::empty);
+
+        response r;
+        r.endpoint = p->second.endpoint;
+        r.path = p->second.path;
+        r.method = p->second.method;
+        r.code = m.code;
+        r.payload = m.payload;
+        r.round_trip_ns = now_ns - p->second.first_sent_ns;
+        response_handler handler = p->second.handler;
+        m_pending.erase(p);
+        ++m_stats.responses;
+
+        //! An observation the device did not take does not exist.
+        std::map<std::string, observation>::iterator o = m_observations.find(m.token);
+        if (o != m_observations.end() && !m.find(coap::observe))
+            m_observations.erase(o);
+
+        if (handler)
+            handler(r);
+        return;
+    }
+
+    std::map<std::string, observation>::iterator o = m_observations.find(m.token);
+    if (o == m_observations.end() || m.code == coap::empty)
+    {
+        //! Nobody asked for it; RFC 7641 says to reject it so it stops.
+        if (m.code != coap::empty && m.kind != coap::acknowledgement)
+        {
+            ++m_stats.unmatched;
+            coap::message rst;
+            rst.kind = coap::reset;
+            rst.id = m.id;
+            m_socket.send(rst, from);
+        }
+        return;
+    }
+    if (m.kind == coap::confirmable)
+        reply(m, from, coap::empty);
+
+    ++m_stats.notifications;
+    uint64_t sequence = 0;
+    m.find_uint(coap::observe, sequence);
+    observation& ob = o->second;
+    if (ob.seen && sequence > ob.sequence + 1)
+        m_stats.lost += sequence - ob.sequence - 1;
+    if (!ob.seen || sequence > ob.sequence)
+        ob.sequence = static_cast<uint32_t>(sequence);
+    ob.seen = true;
+
+    uint64_t sent_ns = 0;
+    std::map<std::string, endpoint>::const_iterator device = m_endpoints.find(ob.endpoint);
+    if (!m_notified || device == m_endpoints.end())
+        return;
+    notification n;
+    n.device = &device->second;
+    n.path = &ob.path;
+    n.payload = &m.payload;
+    n.sequence = static_cast<uint32_t>(sequence);
+    n.received_ns = now_ns;
+    n.latency_ns = m.find_uint(coap::host_sent_ns, sent_ns) && sent_ns && now_ns > sent_ns ? now_ns - sent_ns : 0;
+    m_notified(n);
+}
+
+void device_connector::handle_registration(const coap::message& m, const coap::address& from)
+{
+    std::string name;
+    for (size_t i = 0; i != m.options.size(); ++i)
+        if (m.options[i].number == coap::uri_query && m.options[i].value.compare(0, 3, "ep=") == 0)
+            name = m.options[i].value.substr(3);
+    if (name.empty())
+    {
+        reply(m, from, coap::bad_request);
+        return;
+    }
+
+    //! A device registering again (or retransmitting) keeps its location.
+    endpoint& device = m_endpoints[name];
+    if (device.location.empty())
+    {
+        device.name = name;
+        device.location = "rd/" + std::to_string(m_next_location++);
+        m_locations[device.location] = name;
+    }
+    else
+        forget(name);
+    device.address = from;
+    device.resources.clear();
+    device.observable.clear();
+    parse_links(m.payload, device.resources, device.observable);
+    ++m_stats.registrations;
+
+    coap::message ack;
+    ack.kind = m.kind == coap::confirmable ? coap::acknowledgement : coap::non_confirmable;
+    ack.code = coap::created;
+    ack.id = m.kind == coap::confirmable ? m.id : m_next_id++;
+    ack.token = m.token;
+    ack.add(coap::location_path, "rd");
+    ack.add(coap::location_path, device.location.substr(3));
+    m_socket.send(ack, from);
+
+    if (m_registered)
+        m_registered(device);
+}
+
+void device_connector::handle_deregistration(const coap::message& m, const coap::address& from)
+{
+    std::string path = m.path();
+    std::string name = m_locations[path];
+    reply(m, from, coap::deleted);
+
+    std::map<std::string, endpoint>::iterator device = m_endpoints.find(name);
+    if (device == m_endpoints.end())
+        return;
+    ++m_stats.deregistrations;
+    forget(name);
+    if (m_deregistered)
+        m_deregistered(device->second);
+    m_locations.erase(path);
+    m_endpoints.erase(name);
+}
+
+void device_connector::reply(const coap::message& m, const coap::address& to, uint8_t code)
+{
+    //! Non-confirmable requests get non-confirmable answers; an empty code
+    //! is a bare acknowledgement.
+    coap::message r;
+    r.kind = m.kind == coap::confirmable ? coap::acknowledgement : coap::non_confirmable;
+    r.code = code;
+    r.id = m.kind == coap::confirmable ? m.id : m_next_id++;
+    if (code != coap::empty)
+        r.token = m.token;
+    else if (m.kind != coap::confirmable)
+        return;
+    m_socket.send(r, to);
+}
+
+void device_connector::retransmit(uint64_t now_ns)
+{
+    std::map<std::string, pending>::iterator it = m_pending.begin();
+    while (it != m_pending.end())
+    {
+        pending& p = it->second;
+        if (now_ns < p.deadline_ns)
+        {
+            ++it;
+            continue;
+        }
+        if (p.attempts != max_transmit)
+        {
+            ++p.attempts;
+            ++m_stats.retransmissions;
+            p.timeout_ns *= 2;
+            p.deadline_ns = now_ns + p.timeout_ns;
+            m_socket.send_raw(p.datagram, p.to);
+            ++it;
+            continue;
+        }
+
+        ++m_stats.timeouts;
+        response r;
+        r.endpoint = p.endpoint;
+        r.path = p.path;
+        r.method = p.method;
+        r.code = coap::empty;
+        r.round_trip_ns = now_ns - p.first_sent_ns;
+        response_handler handler = p.handler;
+        m_observations.erase(it->first);
+        m_pending.erase(it++);
+        if (handler)
+            handler(r);
+    }
+}
+
+void device_connector::forget(const std::string& name)
+{
+    //! Observations end with the registration; requests still in flight
+    //! time out on their own.
+    std::map<std::string, observation>::iterator it = m_observations.begin();
+    while (it != m_observations.end())
+    {
+        if (it->second.endpoint == name)
+            m_observations.erase(it++);
+        else
+            ++it;
+    }
+}
+
+std::string device_connector::take_token()
+{
+    uint64_t t = m_next_token++;
+    return std::string(reinterpret_cast<const char*>(&t), sizeof(t));
+}
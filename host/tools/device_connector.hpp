@@ -0,0 +1,151 @@
+#pragma once
+
+//! The server half of the connector stand-in: it takes LWM2M registrations
+//! over CoAP, sends GET/PUT/POST and Observe requests to registered devices,
+//! and hands on their notifications. It covers what the firmware and
+//! lab3/app.js use of the mbed Device Connector, for load testing without
+//! the cloud service; the host frdm_client speaks to it when HOST_CONNECTOR
+//! is set.
+//!
+//! Single-threaded: everything, handlers included, runs inside poll().
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "coap.hpp"
+
+class device_connector
+{
+public:
+    struct endpoint
+    {
+        std::string name;
+        std::string location;               // "rd/<n>", without the slash
+        coap::address address;
+        std::vector<std::string> resources; // "3318/0/5700", ...
+        std::vector<std::string> observable;
+    };
+
+    struct notification
+    {
+        const endpoint* device;
+        const std::string* path;
+        const std::string* payload;
+        uint32_t sequence;
+        uint64_t received_ns;
+        uint64_t latency_ns;    // 0 when the device sent no timestamp
+    };
+
+    struct response
+    {
+        std::string endpoint;
+        std::string path;
+        uint8_t method;
+        uint8_t code;           // coap::empty when it timed out
+        std::string payload;
+        uint64_t round_trip_ns;
+    };
+
+    typedef std::function<void(const endpoint&)> endpoint_handler;
+    typedef std::function<void(const notification&)> notification_handler;
+    typedef std::function<void(const response&)> response_handler;
+
+    device_connector();
+
+    bool listen(const coap::address& local);
+    coap::address local() const { return m_socket.local(); }
+
+    void on_registered(endpoint_handler fn) { m_registered = fn; }
+    void on_deregistered(endpoint_handler fn) { m_deregistered = fn; }
+    void on_notification(notification_handler fn) { m_notified = fn; }
+
+    //! Requests to a registered device, sent confirmable and retransmitted
+    //! as CoAP does. The handler (which may be empty) runs from poll() with
+    //! the answer, or with coap::empty after the last attempt. False if
+    //! there is no such endpoint.
+    bool get(const std::string& name, const std::string& path, response_handler fn);
+    bool put(const std::string& name, const std::string& path, const std::string& payload, response_handler fn);
+    bool post(const std::string& name, const std::string& path, response_handler fn);
+
+    //! A GET with Observe 0: notifications follow until the device goes.
+    bool observe(const std::string& name, const std::string& path, response_handler fn);
+
+    //! Handle what arrives, waiting up to timeout_ms for the first datagram,
+    //! then retransmit requests that are overdue.
+    void poll(int timeout_ms);
+
+    //! Readable when poll() has something to handle, for callers that wait
+    //! on other sockets as well.
+    int descriptor() const { return m_socket.descriptor(); }
+
+    const endpoint* find(const std::string& name) const;
+    size_t endpoints() const { return m_endpoints.size(); }
+
+    struct statistics
+    {
+        uint64_t registrations;
+        uint64_t deregistrations;
+        uint64_t notifications;
+        uint64_t lost;              // gaps in the Observe sequence numbers
+        uint64_t unmatched;         // for no observation; answered with a reset
+        uint64_t requests;
+        uint64_t responses;
+        uint64_t retransmissions;
+        uint64_t timeouts;
+        uint64_t malformed;
+    };
+    const statistics& stats() const;
+
+private:
+    struct pending
+    {
+        std::string endpoint;
+        std::string path;
+        uint8_t method;
+        coap::address to;
+        std::vector<uint8_t> datagram;
+        uint64_t first_sent_ns;
+        uint64_t deadline_ns;
+        uint64_t timeout_ns;
+        int attempts;
+        response_handler handler;
+    };
+
+    struct observation
+    {
+        std::string endpoint;
+        std::string path;
+        uint32_t sequence;
+        bool seen;
+    };
+
+    bool request(const std::string& name, uint8_t method, const std::string& path, const std::string& payload,
+                 bool observe, response_handler fn);
+    void handle(const coap::message& m, const coap::address& from, uint64_t now_ns);
+    void handle_registration(const coap::message& m, const coap::address& from);
+    void handle_deregistration(const coap::message& m, const coap::address& from);
+    void reply(const coap::message& m, const coap::address& to, uint8_t code);
+    void retransmit(uint64_t now_ns);
+    void forget(const std::string& name);
+
+    std::string take_token();
+
+    coap::udp_socket m_socket;
+    uint16_t m_next_id;
+    uint64_t m_next_token;
+    unsigned m_next_location;
+
+    std::map<std::string, endpoint> m_endpoints;        // by name
+    std::map<std::string, std::string> m_locations;     // location to name
+    std::map<std::string, pending> m_pending;           // by token
+    std::map<std::string, observation> m_observations;  // by token
+
+    endpoint_handler m_registered;
+    endpoint_handler m_deregistered;
+    notification_handler m_notified;
+
+    mutable statistics m_stats;
+};
@@ -0,0 +1,326 @@
+//! Runs a fleet of virtual scales on one host, to size the gateway for the
+//! notifications hundreds of devices send and to catch loop timing
+//! regressions that only show at fleet scale.
+//!
+//! Each device is the scale firmware's own application (mbed_code/
+//! scale_app.hpp) on its own host board: the same tasks on the same event
+//! loop as main.cpp, an Hx711 driver taking interrupts from a bit-accurate
+//! HX711 model that plays the pill removal script, the power scheduler, and
+//! an in-process connector client counting its notifications. Devices differ
+//! only in the noise seed of their load cell. They have no flash, so a tare
+//! is not persisted.
+//!
+//! The devices run in slices of virtual time on a work-stealing thread pool,
+//! once for each thread count given, and the report shows how the run
+//! scales: wall time, notifications per wall second, CPU time per device,
+//! speedup and efficiency against the first count. Below that are the totals
+//! every run must agree on: notifications, dose events and how late the
+//! loop's tasks started.
+//!
+//! The devices' serial output is discarded unless --serial is given. With
+//! HOST_CONNECTOR set every device also registers with that connector
+//! (tools/connector.cpp), which makes it a load test of the connector.
+//!
+//! usage: fleet [--devices n] [--threads n,n,...] [--seconds s] [--slice s]
+//!              [--script file] [--serial]
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "frdm_client.hpp"
+#include "hx711_sim.hpp"
+#include "mbed.h"
+#include "scale_app.hpp"
+#include "work_stealing_pool.hpp"
+
+namespace
+{
+
+struct options
+{
+    options() : devices(1000), run_s(0.0), slice_s(10.0), serial(false) {}
+
+    size_t devices;
+    std::vector<unsigned> threads;
+    double run_s;
+    double slice_s;
+    std::string script;
+    bool serial;
+};
+
+uint64_t thread_cpu_ns()
+{
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return static_cast<uint64_t>(t.tv_sec) * 1000000000ull + static_cast<uint64_t>(t.tv_nsec);
+}
+
+//! The firmware of one device, wired as main.cpp wires it. Built with
+//! board::current() set to the device's board, which everything in it
+//! binds to.
+struct firmware
+{
+    firmware(host::board& board, const sim::weight_script& script, const sim::hx711::config& cfg)
+    : model(board, D13, D12, script, cfg), app(loop), client("coap://api.connector.mbed.com:5684", 0),
+      load_cell(D13, D12, 128), power(load_cell, power_config)
+    {
+        objects.push_back(frdm_client::make_device());
+        app.create_objects(objects, 0, 0);
+        client.connect(objects);
+
+        load_cell.start_async(callback(&app, &scale_app::on_sample));
+        app.start(power);
+        app.schedule();
+        loop.every(1000, callback(this, &firmware::client_task));
+    }
+
+    ~firmware()
+    {
+        client.disconnect();
+        for (size_t i = 0; i != objects.size(); ++i)
+            delete objects[i];
+    }
+
+    void client_task()
+    {
+        if (client.get_state() != frdm_client::state::registered)
+            loop.stop();
+    }
+
+    sim::hx711 model;
+    scale_app::loop_type loop;
+    scale_app app;
+    frdm_client client;
+    M2MObjectList objects;
+    Hx711 load_cell;
+    power_scheduler power;
+};
+
+struct device
+{
+    host::board board;
+    std::unique_ptr<firmware> fw;
+    uint64_t cpu_ns;
+    bool done;
+
+    device() : cpu_ns(0), done(false) {}
+
+    //! Run until the end of the next slice, or of the run.
+    bool run_slice(uint64_t slice_ns)
+    {
+        host::board::set_current(&board);
+        uint64_t t0 = thread_cpu_ns();
+
+        scale_app::loop_type* loop = &fw->loop;
+        host::board::event_id stop = board.schedule_in(slice_ns, [loop]() { loop->stop(); });
+        fw->loop.run();
+        board.cancel(stop);
+
+        done = board.run_limit_reached();
+        cpu_ns += thread_cpu_ns() - t0;
+        host::board::set_current(0);
+        return !done;
+    }
+};
+
+struct run_result
+{
+    unsigned threads;
+    double wall_s;
+    uint64_t cpu_ns;
+    uint64_t notifications;
+    uint64_t doses;
+    uint64_t task_runs;
+    uint64_t late_total_us;
+    uint32_t late_max_us;
+    uint64_t steals;
+    uint64_t slices;
+};
+
+run_result run_fleet(const options& opt, unsigned threads, const sim::weight_script& script)
+{
+    uint64_t run_ns = static_cast<uint64_t>(opt.run_s * 1e9);
+    std::vector<std::unique_ptr<device> > fleet(opt.devices);
+    for (size_t i = 0; i != fleet.size(); ++i)
+    {
+        fleet[i].reset(new device());
+        device& d = *fleet[i];
+        d.board.set_run_limit_ns(run_ns);
+        d.board.set_flash_file(std::string());
+
+        sim::hx711::config cfg;
+        cfg.seed = static_cast<uint32_t>(i + 1);
+        host::board::set_current(&d.board);
+        d.fw.reset(new firmware(d.board, script, cfg));
+    }
+    host::board::set_current(0);
+
+    work_stealing_pool pool(threads);
+    uint64_t slice_ns = static_cast<uint64_t>(opt.slice_s * 1e9);
+    for (size_t i = 0; i != fleet.size(); ++i)
+    {
+        device* d = fleet[i].get();
+        pool.submit([d, slice_ns]() { return d->run_slice(slice_ns); });
+    }
+
+    uint64_t w0 = bench::wall_ns();
+    pool.run();
+    uint64_t w1 = bench::wall_ns();
+
+    run_result r = run_result();
+    r.threads = threads;
+    r.wall_s = (w1 - w0) / 1e9;
+    r.steals = pool.stats().steals;
+    r.slices = pool.stats().runs;
+    for (size_t i = 0; i != fleet.size(); ++i)
+    {
+        device& d = *fleet[i];
+        const scale_app::loop_type::statistics& loop = d.fw->loop.stats();
+        r.cpu_ns += d.cpu_ns;
+        r.notifications += d.fw->client.stats().notifications;
+        r.doses += d.fw->app.scale().doses().stats().events;
+        r.task_runs += loop.task_runs;
+        r.late_total_us += loop.task_late_total_us;
+        r.late_max_us = std::max(r.late_max_us, loop.task_late_max_us);
+
+        host::board::set_current(&d.board);
+        d.fw.reset();
+    }
+    host::board::set_current(0);
+    return r;
+}
+
+bool parse_threads(const char* text, std::vector<unsigned>& out)
+{
+    out.clear();
+    const char* p = text;
+    while (*p)
+    {
+        char* end = 0;
+        long n = std::strtol(p, &end, 10);
+        if (end == p || n <= 0)
+            return false;
+        out.push_back(static_cast<unsigned>(n));
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return false;
+    }
+    return !out.empty();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for (int i = 1; i != argc; ++i)
+    {
+        bool has_value = i + 1 != argc;
+        if (!std::strcmp(argv[i], "--devices") && has_value)
+            opt.devices = static_cast<size_t>(std::atol(argv[++i]));
+        else if (!std::strcmp(argv[i], "--threads") && has_value && parse_threads(argv[i + 1], opt.threads))
+            ++i;
+        else if (!std::strcmp(argv[i], "--seconds") && has_value)
+            opt.run_s = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--slice") && has_value)
+            opt.slice_s = std::atof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--script") && has_value)
+            opt.script = argv[++i];
+        else if (!std::strcmp(argv[i], "--serial"))
+            opt.serial = true;
+        else
+        {
+            std::fprintf(stderr, "usage: fleet [--devices n] [--threads n,n,...] [--seconds s] [--slice s]\n"
+                                 "             [--script file] [--serial]\n");
+            return 2;
+        }
+    }
+    if (!opt.devices || opt.slice_s <= 0)
+    {
+        std::fprintf(stderr, "fleet: need at least one device and a positive slice\n");
+        return 2;
+    }
+
+    sim::weight_script script = sim::weight_script::pill_removal();
+    if (!opt.script.empty() && !script.load(opt.script))
+    {
+        std::fprintf(stderr, "cannot load %s\n", opt.script.c_str());
+        return 1;
+    }
+    if (opt.run_s <= 0)
+        opt.run_s = script.duration_s() + 30.0;
+
+    //! One thread, then doubling up to every core.
+    if (opt.threads.empty())
+    {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned n = 1; n < cores; n *= 2)
+            opt.threads.push_back(n);
+        opt.threads.push_back(cores);
+    }
+
+    //! The report keeps the real stdout; the firmware's printf()s go to
+    //! /dev/null unless asked for.
+    std::FILE* report = stdout;
+    if (!opt.serial)
+    {
+        report = fdopen(dup(fileno(stdout)), "w");
+        if (!report || !std::freopen("/dev/null", "w", stdout))
+        {
+            std::fprintf(stderr, "fleet: cannot redirect the serial output\n");
+            return 1;
+        }
+    }
+
+    double device_hours = opt.devices * opt.run_s / 3600.0;
+    std::fprintf(report, "%zu devices, %.0f s each (%.1f device-hours), slices of %.0f s\n", opt.devices, opt.run_s,
+                 device_hours, opt.slice_s);
+    std::fprintf(report, "threads    wall s  notifications/s  CPU ms/device  speedup  efficiency    steals\n");
+
+    std::vector<run_result> results;
+    for (size_t i = 0; i != opt.threads.size(); ++i)
+    {
+        run_result r = run_fleet(opt, opt.threads[i], script);
+        results.push_back(r);
+
+        double speedup = r.wall_s > 0 ? results[0].wall_s / r.wall_s : 0.0;
+        double efficiency = speedup * results[0].threads / r.threads;
+        std::fprintf(report, "%7u %9.3f %16.0f %14.2f %8.2f %10.0f%% %9" PRIu64 "\n", r.threads, r.wall_s,
+                     r.wall_s > 0 ? r.notifications / r.wall_s : 0.0, r.cpu_ns / 1e6 / opt.devices, speedup,
+                     efficiency * 100, r.steals);
+        std::fflush(report);
+    }
+
+    //! Every run simulates the same fleet, so these must not depend on the
+    //! thread count; a difference is a bug in the simulation.
+    const run_result& first = results[0];
+    bool consistent = true;
+    for (size_t i = 1; i != results.size(); ++i)
+        consistent &= results[i].notifications == first.notifications && results[i].doses == first.doses &&
+                      results[i].task_runs == first.task_runs;
+
+    std::fprintf(report, "per device: %.1f notifications/h, %.1f dose events, %.1f ms CPU per device-hour\n",
+                 first.notifications / device_hours, double(first.doses) / opt.devices,
+                 first.cpu_ns / 1e6 / device_hours);
+    std::fprintf(report, "fleet: %" PRIu64 " notifications, %" PRIu64 " dose events, %" PRIu64 " slices\n",
+                 first.notifications, first.doses, first.slices);
+    std::fprintf(report, "loop: %" PRIu64 " task runs, started %.1f us late on average, %" PRIu32 " us at worst\n",
+                 first.task_runs, first.task_runs ? double(first.late_total_us) / first.task_runs : 0.0,
+                 first.late_max_us);
+    if (!consistent)
+        std::fprintf(report, "runs disagree: the simulation depends on the thread count\n");
+    std::fclose(report);
+    return consistent ? 0 : 1;
+}
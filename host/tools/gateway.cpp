@@ -0,0 +1,142 @@
+//! The dashboard gateway (dashboard_gateway.hpp) on the local connector
+//! stand-in: devices register with it over CoAP as with tools/connector.cpp,
+//! and browsers watch them over WebSocket instead of through lab3/app.js.
+//!
+//! At the end it reports what came in from the devices, what went out to the
+//! dashboards, how many of those were dropped and why, the gateway's own
+//! cost per notification and per delivered frame, and how many of the
+//! dashboards' reads the cache kept from the devices.
+//!
+//! usage: gateway [--listen addr:port] [--ws addr:port] [--endpoint name]
+//!                [--path path] [--max-queued n] [--ttl s] [--seconds n] [--once]
+//!
+//! --listen is the CoAP side (default :5683) and --ws the WebSocket side
+//! (default :8080). --once ends the run when the last registered device
+//! deregisters, which is how `make gateway-test` runs it.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "bench_util.hpp"
+#include "dashboard_gateway.hpp"
+#include "device_connector.hpp"
+#include "websocket.hpp"
+
+namespace
+{
+
+struct options
+{
+    options() : listen(":5683"), ws(":8080"), seconds(0.0), once(false) {}
+
+    std::string listen;
+    std::string ws;
+    double seconds;
+    bool once;
+    dashboard_gateway::config gateway;
+};
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_signal(int)
+{
+    g_stop = 1;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for (int i = 1; i != argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 != argc;
+        if (arg == "--once")
+            opt.once = true;
+        else if (arg == "--listen" && has_value)
+            opt.listen = argv[++i];
+        else if (arg == "--ws" && has_value)
+            opt.ws = argv[++i];
+        else if (arg == "--endpoint" && has_value)
+            opt.gateway.default_endpoint = argv[++i];
+        else if (arg == "--path" && has_value)
+            opt.gateway.path = argv[++i];
+        else if (arg == "--max-queued" && has_value)
+            opt.gateway.max_queued = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--ttl" && has_value)
+            opt.gateway.ttl_ns = static_cast<uint64_t>(std::atof(argv[++i]) * 1e9);
+        else if (arg == "--seconds" && has_value)
+            opt.seconds = std::atof(argv[++i]);
+        else
+        {
+            std::fprintf(stderr, "usage: gateway [--listen addr:port] [--ws addr:port] [--endpoint name]\n"
+                                 "               [--path path] [--max-queued n] [--ttl s] [--seconds n] [--once]\n");
+            return 2;
+        }
+    }
+    if (!opt.gateway.max_queued)
+        opt.gateway.max_queued = 1;
+
+    unsigned long descriptors = ws::raise_descriptor_limit();
+
+    coap::address coap_local;
+    device_connector connector;
+    if (!coap::parse_address(opt.listen, coap_local) || !connector.listen(coap_local))
+    {
+        std::fprintf(stderr, "cannot listen on %s\n", opt.listen.c_str());
+        return 1;
+    }
+
+    coap::address ws_local;
+    dashboard_gateway gateway(connector, opt.gateway);
+    if (!coap::parse_address(opt.ws, ws_local) || !gateway.listen(ws_local))
+    {
+        std::fprintf(stderr, "cannot listen on %s\n", opt.ws.c_str());
+        return 1;
+    }
+    std::fprintf(stderr, "devices on %s, dashboards on ws://%s/<endpoint>, up to %lu descriptors\n",
+                 connector.local().text().c_str(), gateway.local().text().c_str(), descriptors);
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    uint64_t start_ns = bench::wall_ns();
+    while (!g_stop)
+    {
+        gateway.poll(100);
+        if (opt.seconds > 0 && bench::wall_ns() - start_ns >= opt.seconds * 1e9)
+            break;
+        if (opt.once && connector.stats().registrations && !connector.endpoints())
+            break;
+    }
+
+    const device_connector::statistics& d = connector.stats();
+    const dashboard_gateway::statistics& s = gateway.stats();
+    std::printf("devices: %llu registrations, %llu deregistrations, %llu notifications, %llu lost\n",
+                (unsigned long long)d.registrations, (unsigned long long)d.deregistrations,
+                (unsigned long long)d.notifications, (unsigned long long)d.lost);
+    std::printf("values: %llu forwarded as %llu frames, %llu undecodable\n",
+                (unsigned long long)(s.notifications - s.undecodable), (unsigned long long)s.frames,
+                (unsigned long long)s.undecodable);
+    std::printf("dashboards: %llu accepted, %zu still open, %llu rejected, %llu closed, %llu dropped, %llu too "
+                "slow\n",
+                (unsigned long long)s.accepted, gateway.clients(), (unsigned long long)s.rejected,
+                (unsigned long long)s.closed, (unsigned long long)s.dropped, (unsigned long long)s.slow);
+    std::printf("sent: %llu frames to dashboards, %llu bytes\n", (unsigned long long)s.deliveries,
+                (unsigned long long)s.bytes_sent);
+    if (s.frames)
+        std::printf("fan-out: %.1f us per value, %.0f ns per delivery, then %.0f ns per delivery writing\n",
+                    s.fanout_ns / 1e3 / s.frames, s.deliveries ? double(s.fanout_ns) / s.deliveries : 0.0,
+                    s.deliveries ? double(s.write_ns) / s.deliveries : 0.0);
+
+    const resource_cache<dashboard_gateway::frame>::statistics& c = gateway.cache_stats();
+    std::printf("reads: %llu from dashboards, %llu hits, %llu coalesced, %llu sent to devices (%llu stale), "
+                "%llu failed, %llu bad requests\n",
+                (unsigned long long)s.reads, (unsigned long long)c.hits, (unsigned long long)c.coalesced,
+                (unsigned long long)c.misses, (unsigned long long)c.stale, (unsigned long long)c.failures,
+                (unsigned long long)s.bad_requests);
+    return 0;
+}
@@ -0,0 +1,540 @@
+//! Load test for the dashboard gateway (tools/gateway.cpp). It plays both of
+//! the gateway's sides at once: a few devices that register over CoAP and
+//! send notifications of the mass resource, and thousands of dashboards
+//! watching them over WebSocket, spread evenly over the devices.
+//!
+//! Each device sends its values 0.001, 0.002, ... g in order, keeping at most
+//! --window of them on the way to its dashboards. A value counts as
+//! delivered once every dashboard still watching that device has it, and its
+//! fan-out latency is from the device sending it to then. Halfway through,
+//! --drop dashboards disappear without a close handshake, which the gateway
+//! has to notice and stop sending to.
+//!
+//! Then every dashboard reads the units resource (3318/0/5701) --reads times,
+//! all at once each time. The gateway answers from its cache, so the devices
+//! should see one request each however many dashboards there are.
+//!
+//! It reports notifications and frames per second, the fan-out latency and
+//! values a dashboard never saw, which is UDP loss on the device side. It
+//! fails if a dashboard saw a value out of order or the run did not finish.
+//!
+//! usage: gateway_load [--connector addr:port] [--gateway addr:port]
+//!                     [--devices n] [--clients n] [--notifications n]
+//!                     [--window n] [--drop n] [--reads n] [--seconds n]
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_util.hpp"
+#include "coap.hpp"
+#include "value_codec.hpp"
+#include "websocket.hpp"
+
+namespace
+{
+
+struct options
+{
+    options()
+    : connector("127.0.0.1:5683"), gateway("127.0.0.1:8080"), devices(10), clients(1000), notifications(10000),
+      window(16), drop(0), reads(0), seconds(60.0)
+    {
+    }
+
+    std::string connector;
+    std::string gateway;
+    size_t devices;
+    size_t clients;
+    size_t notifications;
+    size_t window;
+    size_t drop;
+    size_t reads;
+    double seconds;
+};
+
+const char* const mass_path = "3318/0/5700";
+const char* const units_path = "3318/0/5701";
+
+//! One device as the gateway sees it: registered, observed, notifying.
+struct device
+{
+    device() : observed(false), sequence(2), sent(0), completed(0), live(0), reads(0), next_id(1) {}
+
+    std::string name;
+    coap::udp_socket socket;
+    std::string location;
+    std::string token;              // of the gateway's observation
+    bool observed;
+    uint32_t sequence;
+
+    size_t sent;                    // values sent so far, value k is k mg
+    size_t completed;               // values every live dashboard has
+    size_t live;                    // dashboards watching it
+    std::vector<uint32_t> got;      // by value, dashboards that have it
+    std::vector<uint64_t> sent_ns;  // by value
+    size_t reads;                   // plain GETs that reached it
+    uint16_t next_id;
+};
+
+struct dashboard
+{
+    dashboard() : fd(-1), owner(0), requested(false), open(false), gone(false), received(0), answers(0) {}
+
+    int fd;
+    device* owner;
+    std::string key;
+    std::string in;
+    bool requested;
+    bool open;
+    bool gone;
+    size_t received;
+    size_t answers;                 // to reads of the units
+};
+
+bool send_request(device& d, const coap::address& to, uint8_t code, const std::string& path,
+                  const std::string& query, const std::string& payload)
+{
+    coap::message m;
+    m.kind = coap::confirmable;
+    m.code = code;
+    m.id = d.next_id++;
+    m.token = "reg";
+    m.set_path(path);
+    if (!payload.empty())
+        m.add_uint(coap::content_format, coap::link_format);
+    if (!query.empty())
+        m.add(coap::uri_query, query);
+    m.payload = payload;
+    return d.socket.send(m, to);
+}
+
+//! Answer what the gateway sends a device: the acknowledgement of its
+//! registration, the observation of the mass, and reads.
+void serve(device& d)
+{
+    coap::message m;
+    coap::address from;
+    while (d.socket.receive(m, from, 0))
+    {
+        if (m.kind == coap::acknowledgement && m.code == coap::created)
+            d.location = m.joined(coap::location_path, '/');
+        else if (m.is_request() && m.code == coap::get && m.path() == mass_path && m.find(coap::observe))
+        {
+            coap::message r;
+            r.kind = m.kind == coap::confirmable ? coap::acknowledgement : coap::non_confirmable;
+            r.code = coap::content;
+            r.id = m.kind == coap::confirmable ? m.id : d.next_id++;
+            r.token = m.token;
+            r.add_uint(coap::observe, 1);
+            r.add_uint(coap::content_format, coap::text_plain);
+            r.payload = "0.000";
+            d.socket.send(r, from);
+            d.token = m.token;
+            d.observed = true;
+        }
+        else if (m.is_request() && m.code == coap::get)
+        {
+            char text[codec::max_chars];
+            codec::format_fixed(text, sizeof(text), static_cast<int32_t>(d.sent), 3);
+            coap::message r;
+            r.kind = m.kind == coap::confirmable ? coap::acknowledgement : coap::non_confirmable;
+            r.code = coap::content;
+            r.id = m.kind == coap::confirmable ? m.id : d.next_id++;
+            r.token = m.token;
+            r.add_uint(coap::content_format, coap::text_plain);
+            r.payload = m.path() == mass_path ? text : "g";
+            d.socket.send(r, from);
+            ++d.reads;
+        }
+    }
+}
+
+void notify(device& d, const coap::address& to)
+{
+    size_t value = ++d.sent;
+    char text[codec::max_chars];
+    codec::format_fixed(text, sizeof(text), static_cast<int32_t>(value), 3);
+
+    coap::message m;
+    m.kind = coap::non_confirmable;
+    m.code = coap::content;
+    m.id = d.next_id++;
+    m.token = d.token;
+    m.add_uint(coap::observe, d.sequence++);
+    m.add_uint(coap::content_format, coap::text_plain);
+    m.payload = text;
+    d.sent_ns[value] = bench::wall_ns();
+    d.socket.send(m, to);
+}
+
+//! Values every live dashboard of d now has, and how long they took.
+void complete(device& d, bench::samples& latency_us)
+{
+    uint64_t now_ns = bench::wall_ns();
+    while (d.completed < d.sent && d.got[d.completed + 1] >= d.live)
+    {
+        ++d.completed;
+        latency_us.add((now_ns - d.sent_ns[d.completed]) / 1e3);
+    }
+}
+
+void forget(dashboard& c, bench::samples& latency_us)
+{
+    device& d = *c.owner;
+    for (size_t k = d.completed + 1; k <= c.received; ++k)
+        --d.got[k];
+    --d.live;
+    c.gone = true;
+    complete(d, latency_us);
+}
+
+//! The value in {"endpoint":...,"value":0.002}, in mg; false if there is none.
+bool parse_value(const std::string& text, int32_t& mg)
+{
+    size_t at = text.find("\"value\":");
+    if (at == std::string::npos)
+        return false;
+    at += 8;
+    size_t end = text.find('}', at);
+    if (end == std::string::npos)
+        return false;
+    return codec::parse_fixed(reinterpret_cast<const uint8_t*>(text.data()) + at, end - at, 3, mg);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for (int i = 1; i != argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 != argc;
+        if (arg == "--connector" && has_value)
+            opt.connector = argv[++i];
+        else if (arg == "--gateway" && has_value)
+            opt.gateway = argv[++i];
+        else if (arg == "--devices" && has_value)
+            opt.devices = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--clients" && has_value)
+            opt.clients = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--notifications" && has_value)
+            opt.notifications = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--window" && has_value)
+            opt.window = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--drop" && has_value)
+            opt.drop = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--reads" && has_value)
+            opt.reads = static_cast<size_t>(std::atol(argv[++i]));
+        else if (arg == "--seconds" && has_value)
+            opt.seconds = std::atof(argv[++i]);
+        else
+        {
+            std::fprintf(stderr, "usage: gateway_load [--connector addr:port] [--gateway addr:port]\n"
+                                 "                    [--devices n] [--clients n] [--notifications n]\n"
+                                 "                    [--window n] [--drop n] [--reads n] [--seconds n]\n");
+            return 2;
+        }
+    }
+    if (!opt.devices || opt.clients < opt.devices || !opt.window || opt.drop >= opt.clients)
+    {
+        std::fprintf(stderr, "gateway_load: need a dashboard per device, a window, and dashboards left over\n");
+        return 2;
+    }
+
+    coap::address connector;
+    coap::address gateway;
+    if (!coap::parse_address(opt.connector, connector) || !coap::parse_address(opt.gateway, gateway))
+    {
+        std::fprintf(stderr, "gateway_load: bad address\n");
+        return 2;
+    }
+    unsigned long descriptors = ws::raise_descriptor_limit();
+    if (descriptors && descriptors < opt.clients + opt.devices + 16)
+    {
+        std::fprintf(stderr, "gateway_load: only %lu descriptors for %zu dashboards\n", descriptors, opt.clients);
+        return 1;
+    }
+
+    size_t per_device = opt.notifications / opt.devices;
+    if (!per_device)
+        per_device = 1;
+    uint64_t deadline_ns = bench::wall_ns() + static_cast<uint64_t>(opt.seconds * 1e9);
+
+    //! The devices register and wait to be observed.
+    coap::address any;
+    any.ip = 0x7F000001;
+    std::vector<std::unique_ptr<device> > devices(opt.devices);
+    for (size_t i = 0; i != devices.size(); ++i)
+    {
+        devices[i].reset(new device());
+        device& d = *devices[i];
+        d.name = "load-" + std::to_string(i);
+        d.got.assign(per_device + 1, 0);
+        d.sent_ns.assign(per_device + 1, 0);
+        if (!d.socket.bind(any) ||
+            !send_request(d, connector, coap::post, "rd", "ep=" + d.name, std::string("</") + mass_path + ">;obs"))
+        {
+            std::fprintf(stderr, "gateway_load: cannot reach %s\n", opt.connector.c_str());
+            return 1;
+        }
+    }
+    for (size_t ready = 0; ready != devices.size() && bench::wall_ns() < deadline_ns;)
+    {
+        ready = 0;
+        for (size_t i = 0; i != devices.size(); ++i)
+        {
+            serve(*devices[i]);
+            ready += devices[i]->observed;
+        }
+        if (ready != devices.size())
+            usleep(1000);
+    }
+
+    //! The dashboards connect, one device each in turn.
+    int epoll = epoll_create1(0);
+    std::vector<dashboard> clients(opt.clients);
+    for (size_t i = 0; i != clients.size(); ++i)
+    {
+        dashboard& c = clients[i];
+        c.owner = devices[i % devices.size()].get();
+        c.key = "ZGFzaGJvYXJkLWxvYWQtMA==";
+        c.fd = ws::connect_tcp(gateway);
+        if (c.fd < 0)
+        {
+            std::fprintf(stderr, "gateway_load: cannot connect to %s\n", opt.gateway.c_str());
+            return 1;
+        }
+        ++c.owner->live;
+        epoll_event e = epoll_event();
+        e.events = EPOLLIN | EPOLLOUT;
+        e.data.ptr = &c;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, c.fd, &e);
+    }
+
+    bench::samples latency_us;
+    size_t open = 0;
+    size_t out_of_order = 0;
+    size_t missed = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t start_ns = 0;
+    bool dropped = opt.drop == 0;
+    uint64_t notified_ns = 0;
+    size_t round = 0;
+    size_t unavailable = 0;
+    uint64_t round_ns = 0;
+    bench::samples read_us;
+    std::vector<char> buffer(64 * 1024);
+
+    for (;;)
+    {
+        bool notified = open == clients.size();
+        for (size_t i = 0; i != devices.size() && notified; ++i)
+            notified = devices[i]->completed == per_device;
+        if (bench::wall_ns() >= deadline_ns)
+            break;
+
+        //! Then the rounds of reads, each once the last has been answered.
+        if (notified)
+        {
+            if (!notified_ns)
+                notified_ns = bench::wall_ns();
+            bool answered = true;
+            for (size_t i = 0; i != clients.size() && answered; ++i)
+                answered = clients[i].gone || clients[i].answers == round;
+            if (answered && round)
+                read_us.add((bench::wall_ns() - round_ns) / 1e3);
+            if (answered && round == opt.reads)
+                break;
+            if (answered)
+            {
+                ++round;
+                round_ns = bench::wall_ns();
+                std::string request = std::string("get ") + units_path;
+                for (size_t i = 0; i != clients.size(); ++i)
+                {
+                    if (clients[i].gone)
+                        continue;
+                    std::vector<uint8_t> f;
+                    ws::encode(ws::text, request.data(), request.size(), f, true, 0x1EAD0000u + static_cast<uint32_t>(i));
+                    ::send(clients[i].fd, f.data(), f.size(), MSG_NOSIGNAL);
+                }
+            }
+            for (size_t i = 0; i != devices.size(); ++i)
+                serve(*devices[i]);
+        }
+
+        //! Once every dashboard is open, the devices keep their windows full.
+        if (open == clients.size() && !notified)
+        {
+            if (!start_ns)
+                start_ns = bench::wall_ns();
+            size_t sent = 0;
+            for (size_t i = 0; i != devices.size(); ++i)
+            {
+                device& d = *devices[i];
+                serve(d);
+                while (d.sent != per_device && d.sent - d.completed < opt.window)
+                    notify(d, connector);
+                sent += d.sent;
+            }
+
+            if (!dropped && sent >= per_device * devices.size() / 2)
+            {
+                dropped = true;
+                for (size_t i = 0; i != opt.drop; ++i)
+                {
+                    dashboard& c = clients[clients.size() - 1 - i];
+                    close(c.fd);
+                    forget(c, latency_us);
+                }
+            }
+        }
+
+        epoll_event events[256];
+        int n = epoll_wait(epoll, events, 256, 1);
+        for (int i = 0; i < n; ++i)
+        {
+            dashboard& c = *static_cast<dashboard*>(events[i].data.ptr);
+            if (c.gone)
+                continue;
+            if (!c.requested && (events[i].events & EPOLLOUT))
+            {
+                std::string request = ws::upgrade_request(opt.gateway, "/" + c.owner->name, c.key);
+                c.requested = ::send(c.fd, request.data(), request.size(), MSG_NOSIGNAL) ==
+                              static_cast<ssize_t>(request.size());
+                epoll_event e = epoll_event();
+                e.events = EPOLLIN;
+                e.data.ptr = &c;
+                epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &e);
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+                continue;
+
+            ssize_t size;
+            while ((size = recv(c.fd, buffer.data(), buffer.size(), 0)) > 0)
+            {
+                c.in.append(buffer.data(), static_cast<size_t>(size));
+                bytes += static_cast<uint64_t>(size);
+            }
+            if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                std::fprintf(stderr, "gateway_load: the gateway closed a dashboard of %s\n", c.owner->name.c_str());
+                epoll_ctl(epoll, EPOLL_CTL_DEL, c.fd, 0);
+                forget(c, latency_us);
+                continue;
+            }
+
+            size_t at = 0;
+            if (!c.open)
+            {
+                long length = ws::check_upgrade_response(c.in, c.key);
+                if (length <= 0)
+                {
+                    if (length < 0)
+                    {
+                        std::fprintf(stderr, "gateway_load: upgrade refused\n");
+                        return 1;
+                    }
+                    continue;
+                }
+                at = static_cast<size_t>(length);
+                c.open = true;
+                ++open;
+            }
+
+            uint8_t op = 0;
+            std::string payload;
+            long length;
+            while ((length = ws::decode(reinterpret_cast<const uint8_t*>(c.in.data()) + at, c.in.size() - at, op,
+                                        payload)) > 0)
+            {
+                at += static_cast<size_t>(length);
+                if (op == ws::text && payload.find(std::string("\"path\":\"/") + units_path + "\"") != std::string::npos)
+                {
+                    unavailable += payload.find("\"error\"") != std::string::npos;
+                    ++c.answers;
+                    continue;
+                }
+                int32_t mg = 0;
+                if (op != ws::text || !parse_value(payload, mg) || mg == 0)
+                    continue;
+                ++frames;
+                size_t value = static_cast<size_t>(mg);
+                if (value <= c.received || value > per_device)
+                {
+                    ++out_of_order;
+                    continue;
+                }
+                //! A value lost on the way still counts as delivered once
+                //! a later one is, or the window would never move on.
+                missed += value - c.received - 1;
+                while (c.received != value)
+                    ++c.owner->got[++c.received];
+                complete(*c.owner, latency_us);
+            }
+            c.in.erase(0, at);
+        }
+    }
+    uint64_t end_ns = bench::wall_ns();
+
+    size_t completed = 0;
+    size_t device_reads = 0;
+    for (size_t i = 0; i != devices.size(); ++i)
+    {
+        completed += devices[i]->completed;
+        device_reads += devices[i]->reads;
+    }
+    bool finished = completed == per_device * devices.size() && round == opt.reads && read_us.size() == opt.reads;
+
+    //! Leave properly: dashboards close, devices deregister.
+    for (size_t i = 0; i != clients.size(); ++i)
+    {
+        dashboard& c = clients[i];
+        if (c.gone)
+            continue;
+        std::vector<uint8_t> close_frame;
+        uint8_t status[2] = { 0x03, 0xE8 };
+        ws::encode(ws::close, status, sizeof(status), close_frame, true, 0x5A17C0DEu + static_cast<uint32_t>(i));
+        ::send(c.fd, close_frame.data(), close_frame.size(), MSG_NOSIGNAL);
+        close(c.fd);
+    }
+    close(epoll);
+    //! Give the gateway time to see the dashboards go before the devices do.
+    usleep(200000);
+    for (size_t i = 0; i != devices.size(); ++i)
+        if (!devices[i]->location.empty())
+            send_request(*devices[i], connector, coap::del, devices[i]->location, std::string(), std::string());
+
+    if (!notified_ns)
+        notified_ns = end_ns;
+    double active = start_ns && notified_ns > start_ns ? (notified_ns - start_ns) / 1e9 : 0.0;
+    std::printf("%zu dashboards on %zu devices, %zu dropped halfway, window %zu\n", opt.clients, opt.devices,
+                opt.drop, opt.window);
+    std::printf("notifications: %zu of %zu delivered in %.3f s, %.0f/s\n", completed, per_device * devices.size(),
+                active, active > 0 ? completed / active : 0.0);
+    std::printf("frames: %llu received, %.0f/s, %.1f MB/s, %zu missed, %zu out of order\n",
+                (unsigned long long)frames, active > 0 ? frames / active : 0.0, active > 0 ? bytes / active / 1e6 : 0.0,
+                missed, out_of_order);
+    if (latency_us.size())
+        std::printf("fan-out latency: p50 %.0f us, p99 %.0f us, max %.0f us\n", latency_us.percentile(50),
+                    latency_us.percentile(99), latency_us.percentile(100));
+    if (opt.reads)
+        std::printf("reads: %zu rounds of %zu dashboards, %zu reached the devices, %zu unavailable, round p50 %.0f "
+                    "us, max %.0f us\n",
+                    round, opt.clients - opt.drop, device_reads, unavailable, read_us.percentile(50),
+                    read_us.percentile(100));
+    if (!finished)
+        std::printf("did not finish in %.0f s\n", opt.seconds);
+    return finished && !out_of_order ? 0 : 1;
+}
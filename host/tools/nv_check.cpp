@@ -0,0 +1,157 @@
+//! Checks nv_record on the host board's flash, cutting the power at every
+//! erase and program a run of saves makes:
+//!
+//!     saves       500 saves, through several turns of the two sectors; a
+//!                 fresh record loads the last one after each.
+//!     power cut   the same saves from blank flash, with the power gone after
+//!                 each number of flash operations in turn, including the one
+//!                 between a full sector's erase and the write after it. On
+//!                 the reset that follows, load() must return the last value
+//!                 whose save() succeeded, and saving must carry on from there.
+//!
+//! Prints one line per part; the exit status is 1 if any check failed.
+//!
+//! usage: nv_check
+
+#include <cstdio>
+
+#include "mbed.h"
+#include "host_board.hpp"
+#include "nv_record.hpp"
+
+namespace
+{
+
+int g_failures = 0;
+
+void fail(const char* part, const char* what, int at)
+{
+    if (g_failures++ < 20)
+        std::printf("%s: %s at %d\n", part, what, at);
+}
+
+struct settings
+{
+    int32_t tare_mg;
+};
+
+typedef nv_record<settings> record;
+
+const int saves = 500;
+
+//! The last two sectors, as the scale uses them.
+uint32_t first_sector()
+{
+    return host::board::flash_size - 2 * host::board::flash_sector_size;
+}
+
+//! What a reset finds: a record made anew and loaded. -1 if it found nothing.
+int32_t reload(FlashIAP& flash)
+{
+    record r(flash, first_sector());
+    settings s = { -1 };
+    return r.load(s) ? s.tare_mg : -1;
+}
+
+void check_saves()
+{
+    host::board board;
+    board.set_flash_file("");
+    host::board::set_current(&board);
+    {
+        FlashIAP flash;
+        record r(flash, first_sector());
+        settings s = { 0 };
+        if (r.load(s))
+            fail("saves", "blank flash loaded", 0);
+
+        int turns = 0;
+        for (int i = 1; i <= saves; ++i)
+        {
+            uint32_t used = r.used();
+            s.tare_mg = i;
+            if (!r.save(s))
+                fail("saves", "save failed", i);
+            turns += r.used() < used;
+            if (reload(flash) != i)
+                fail("saves", "reload is not the last save", i);
+        }
+        if (turns < 2)
+            fail("saves", "the sectors did not turn over twice", saves);
+        std::printf("saves: %d saves, %d sector turns\n", saves, turns);
+    }
+    host::board::set_current(0);
+}
+
+//! Saves 1..saves from blank flash with the power cut after ops flash
+//! operations. Returns the number of operations the run took, or -1 once
+//! the cut came before the run ended.
+int cut_after(int ops, int& between)
+{
+    host::board board;
+    board.set_flash_file("");
+    host::board::set_current(&board);
+    int result = -1;
+    {
+        FlashIAP flash;
+        record r(flash, first_sector());
+        settings s = { 0 };
+        r.load(s);
+
+        board.set_flash_power_cut(ops);
+        int saved = -1;
+        int i = 1;
+        for (; i <= saves; ++i)
+        {
+            s.tare_mg = i;
+            uint32_t used = r.used();
+            if (!r.save(s))
+            {
+                //! Back at the start of a sector: the erase went through and
+                //! the program did not.
+                between += r.used() < used;
+                break;
+            }
+            saved = i;
+        }
+        if (i > saves)
+            result = ops;
+
+        board.set_flash_power_cut(-1);
+        if (reload(flash) != saved)
+            fail("power cut", "reset lost the last save", ops);
+
+        //! Carry on after the reset.
+        record after(flash, first_sector());
+        settings t = { 0 };
+        after.load(t);
+        t.tare_mg = saves + 1;
+        if (!after.save(t) || reload(flash) != saves + 1)
+            fail("power cut", "cannot save after the reset", ops);
+    }
+    host::board::set_current(0);
+    return result;
+}
+
+void check_power_cut()
+{
+    int between = 0;
+    int ops = 0;
+    while (cut_after(ops, between) < 0)
+        ++ops;
+    if (!between)
+        fail("power cut", "no cut fell between an erase and its write", ops);
+    std::printf("power cut: after each of %d flash operations, %d between an erase and its write\n", ops, between);
+}
+
+}
+
+int main()
+{
+    check_saves();
+    check_power_cut();
+
+    if (g_failures)
+        std::printf("%d checks failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,527 @@
+//! Checks the stages between the HX711 and the connector one at a time, on
+//! inputs picked to sit on their edges:
+//!
+//!     filters     moving_average, running_median and iir_lowpass fed random
+//!                 24-bit samples against plain reference versions, through
+//!                 the fill, at the extremes of the ADC range and after a
+//!                 reset; filter_chain against its stages fed by hand.
+//!     calibration tables from two and four points in any order, against the
+//!                 same lines in double precision over the whole 24-bit range;
+//!                 every reference point maps to its own weight, and duplicate
+//!                 or missing points leave the table invalid.
+//!     zero        zero_tracker's drift limits: a steady drift is followed
+//!                 while the net's lag behind it stays inside capture_mg and
+//!                 lost once it does not; movement past motion_mg and a load
+//!                 over capture_mg are left alone; tare() and
+//!                 capture_for_pill().
+//!     publish     publish_policy's deadband, the extra hysteresis on a
+//!                 reversal and not on a second step the same way, a change
+//!                 held to pmin and sent once it has passed, pmax heartbeats
+//!                 and none with pmax 0, all across the millisecond clock
+//!                 wrapping.
+//!     history     history_log blocks encoded and decoded back: a random walk,
+//!                 jumps between INT32_MIN and INT32_MAX, a ramp whose run
+//!                 token outgrows its block, and a still load whose run
+//!                 reaches the 0xFFFF readings a block can count.
+//!
+//! Prints one line per part; the exit status is 1 if any check failed.
+//!
+//! usage: pipeline_check [seed]
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "calibration.hpp"
+#include "filters.hpp"
+#include "history_log.hpp"
+#include "publish_policy.hpp"
+#include "zero_tracker.hpp"
+
+namespace
+{
+
+int g_failures = 0;
+
+void fail(const char* part, const char* what, int64_t at)
+{
+    if (g_failures++ < 20)
+        std::printf("%s: %s at %" PRId64 "\n", part, what, at);
+}
+
+const int32_t adc_max = (1 << 23) - 1;
+const int32_t adc_min = -(1 << 23);
+
+//! Mostly anywhere in the ADC range, sometimes pinned to one of its ends.
+int32_t adc_sample(std::mt19937& rng)
+{
+    switch (rng() % 16)
+    {
+    case 0: return adc_max;
+    case 1: return adc_min;
+    default: return static_cast<int32_t>(rng() % (1u << 24)) + adc_min;
+    }
+}
+
+template <size_t N>
+void check_average(std::mt19937& rng, int samples)
+{
+    moving_average<N> f;
+    std::vector<int32_t> window;
+    for (int i = 0; i != samples; ++i)
+    {
+        if (i == samples / 2)
+        {
+            f.reset();
+            window.clear();
+        }
+        int32_t x = adc_sample(rng);
+        window.push_back(x);
+        if (window.size() > N)
+            window.erase(window.begin());
+
+        int64_t sum = 0;
+        for (int32_t v : window)
+            sum += v;
+        if (f.update(x) != static_cast<int32_t>(sum / static_cast<int64_t>(window.size())))
+            fail("filters", "moving_average differs from the mean", i);
+        if (f.ready() != (window.size() == N))
+            fail("filters", "moving_average ready() is wrong", i);
+    }
+}
+
+template <size_t N>
+void check_median(std::mt19937& rng, int samples)
+{
+    running_median<N> f;
+    std::vector<int32_t> window;
+    for (int i = 0; i != samples; ++i)
+    {
+        if (i == samples / 2)
+        {
+            f.reset();
+            window.clear();
+        }
+        //! Repeats, so removing one of several equal entries is covered.
+        int32_t x = rng() % 4 ? adc_sample(rng) : window.empty() ? 0 : window.back();
+        window.push_back(x);
+        if (window.size() > N)
+            window.erase(window.begin());
+
+        std::vector<int32_t> sorted(window);
+        std::sort(sorted.begin(), sorted.end());
+        if (f.update(x) != sorted[sorted.size() / 2])
+            fail("filters", "running_median differs from the middle value", i);
+        if (f.ready() != (window.size() == N))
+            fail("filters", "running_median ready() is wrong", i);
+    }
+}
+
+//! A step to each end of the range and back: the first sample is taken as
+//! it is, and after 24 time constants the output sits on the input. Past
+//! Shift 6 the steps a sample makes drop under the state's fraction bits
+//! short of the input, so the larger shifts are not held to this.
+template <unsigned Shift>
+void check_lowpass()
+{
+    const int32_t steps[] = { 0, adc_max, adc_min, 1234, -1, adc_max };
+    iir_lowpass<Shift> f;
+    if (f.update(-4321) != -4321 || !f.ready())
+        fail("filters", "iir_lowpass does not prime on its first sample", Shift);
+
+    for (int32_t target : steps)
+    {
+        int32_t last = f.value();
+        for (int i = 0; i != (1 << Shift) * 24; ++i)
+        {
+            int32_t y = f.update(target);
+            bool between = (y >= last && y <= target) || (y <= last && y >= target);
+            if (!between)
+                fail("filters", "iir_lowpass left the step it was following", target);
+            last = y;
+        }
+        if (std::abs(last - target) > 1)
+            fail("filters", "iir_lowpass did not settle on the step", target);
+    }
+    f.reset();
+    if (f.ready() || f.update(77) != 77)
+        fail("filters", "iir_lowpass does not prime again after reset()", Shift);
+}
+
+void check_chain(std::mt19937& rng, int samples)
+{
+    filter_chain<running_median<5>, moving_average<8>, iir_lowpass<3> > chain;
+    running_median<5> median;
+    moving_average<8> average;
+    iir_lowpass<3> lowpass;
+    for (int i = 0; i != samples; ++i)
+    {
+        int32_t x = adc_sample(rng);
+        if (chain.update(x) != lowpass.update(average.update(median.update(x))))
+            fail("filters", "filter_chain differs from its stages", i);
+        if (chain.ready() != (median.ready() && average.ready() && lowpass.ready()))
+            fail("filters", "filter_chain ready() is wrong", i);
+    }
+}
+
+void check_filters(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    const int samples = 20000;
+    check_average<1>(rng, samples);
+    check_average<8>(rng, samples);
+    check_average<100>(rng, samples);
+    check_average<128>(rng, samples);
+    check_median<3>(rng, samples);
+    check_median<5>(rng, samples);
+    check_median<31>(rng, samples);
+    check_lowpass<1>();
+    check_lowpass<4>();
+    check_lowpass<6>();
+    check_chain(rng, samples);
+    std::printf("filters: %d samples through each stage\n", samples);
+}
+
+//! The line through the two points of p around raw, in double precision,
+//! against the table: off by at most the rounding to nearest plus what the
+//! Q16 slope's own rounding adds over the distance from the segment's start.
+template <size_t N>
+double worst_error(const calibration_table<N>& table, const std::vector<calibration_point>& p, int32_t raw)
+{
+    std::vector<calibration_point> sorted(p);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const calibration_point& a, const calibration_point& b) { return a.raw < b.raw; });
+    size_t i = 0;
+    while (i + 2 < sorted.size() && raw >= sorted[i + 1].raw)
+        ++i;
+    const calibration_point& a = sorted[i];
+    const calibration_point& b = sorted[i + 1];
+    double exact = a.milligrams + double(raw - a.raw) * (b.milligrams - a.milligrams) / (double(b.raw) - a.raw);
+    double bound = 0.5 + (0.5 / 65536) * std::fabs(double(raw) - a.raw) + 1e-6;
+    return std::fabs(table.to_milligrams(raw) - exact) - bound;
+}
+
+void check_table(const char* what, std::vector<calibration_point> p, std::mt19937& rng, int& conversions)
+{
+    for (int order = 0; order != 4; ++order)
+    {
+        calibration_table<4> table;
+        if (!table.load(p.data(), p.size()))
+        {
+            fail("calibration", "a good table did not load", order);
+            return;
+        }
+        for (const calibration_point& q : p)
+            if (table.to_milligrams(q.raw) != q.milligrams)
+                fail("calibration", "a reference point does not map to its weight", q.raw);
+
+        double over = 0;
+        const int32_t ends[] = { adc_min, adc_max, adc_min + 1, adc_max - 1, 0 };
+        for (int i = 0; i != 20000; ++i)
+        {
+            int32_t raw = i < 5 ? ends[i] : adc_sample(rng);
+            over = std::max(over, worst_error(table, p, raw));
+            ++conversions;
+        }
+        if (over > 0)
+        {
+            std::printf("calibration: %s off by %.3f mg more than rounding allows\n", what, over);
+            fail("calibration", "a conversion is off by more than its rounding", order);
+        }
+        std::shuffle(p.begin(), p.end(), rng);
+    }
+}
+
+void check_calibration(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    int conversions = 0;
+    check_table("factory", { { 51860, 0 }, { -38140, 10000 } }, rng, conversions);
+    check_table("four points", { { 51860, 0 }, { 6800, 5000 }, { -38140, 10000 }, { -1200000, 140000 } }, rng, conversions);
+    check_table("rising", { { -1000, -50 }, { 3000, 150 }, { 3001, 151 } }, rng, conversions);
+
+    calibration_table<4> table;
+    const calibration_point twice[] = { { 100, 0 }, { 200, 10 }, { 100, 20 } };
+    const calibration_point one[] = { { 100, 0 } };
+    const calibration_point five[] = { { 1, 1 }, { 2, 2 }, { 3, 3 }, { 4, 4 }, { 5, 5 } };
+    if (table.load(twice, 3) || table.valid() || table.to_milligrams(150) != 0)
+        fail("calibration", "a table with the same raw reading twice is valid", 3);
+    if (table.load(one, 1) || table.valid())
+        fail("calibration", "a table with one point is valid", 1);
+    if (table.load(five, 5) || table.valid())
+        fail("calibration", "a table with too many points is valid", 5);
+    std::printf("calibration: %d conversions over the 24-bit range\n", conversions);
+}
+
+//! Moves gross by step_mg a reading, count times; returns the largest net
+//! seen after the first settle readings.
+int32_t drift(zero_tracker& z, int32_t& gross, int32_t step_mg, int count, int settle)
+{
+    int32_t worst = 0;
+    for (int i = 0; i != count; ++i)
+    {
+        gross += step_mg;
+        int32_t net = z.update(gross);
+        if (i >= settle)
+            worst = std::max(worst, std::abs(net));
+    }
+    return worst;
+}
+
+void check_zero()
+{
+    const int32_t capture = 100, motion = 20;
+    const unsigned shift = 5;
+
+    //! The net lags a steady drift by about step * 2^shift, plus what the
+    //! offset's truncation keeps back. Drift is followed while that lag stays
+    //! inside capture_mg, 3 mg a reading here, and lost once it does not.
+    for (int32_t step : { 1, -1, 2, -2, 3, -3 })
+    {
+        zero_tracker z(capture, motion, 16, shift);
+        int32_t gross = 5000;
+        z.tare(gross);
+        int32_t worst = drift(z, gross, step, 5000, 64);
+        if (worst > (std::abs(step) << shift) + 2 || worst > capture)
+            fail("zero", "slow drift was not followed", step);
+    }
+    for (int32_t step : { 4, -4, motion })
+    {
+        zero_tracker z(capture, motion, 16, shift);
+        int32_t gross = 5000;
+        z.tare(gross);
+        if (drift(z, gross, step, 5000, 64) <= capture)
+            fail("zero", "drift past the limit was followed", step);
+    }
+
+    //! Faster than motion_mg a reading is movement, never zero.
+    {
+        zero_tracker z(capture, motion, 16, shift);
+        z.tare(0);
+        int32_t gross = 0;
+        for (int i = 0; i != 200; ++i)
+        {
+            gross += (i & 1) ? motion + 1 : -(motion + 1);
+            z.update(gross);
+        }
+        if (z.offset() != 0 || z.still())
+            fail("zero", "movement was tracked", z.offset());
+    }
+
+    //! A load over the capture band stays however long it sits.
+    {
+        zero_tracker z(capture, motion, 16, shift);
+        z.tare(-700);
+        int32_t net = 0;
+        for (int i = 0; i != 100000; ++i)
+            net = z.update(-700 + capture + 1);
+        if (net != capture + 1 || z.offset() != -700)
+            fail("zero", "a load over the capture band was tracked away", net);
+    }
+
+    //! Drift parks the zero anywhere, negative included; tare() and
+    //! set_offset() put it back exactly.
+    {
+        zero_tracker z(capture, motion, 16, shift);
+        int32_t gross = 0;
+        drift(z, gross, -1, 3000, 0);
+        if (z.offset() > -2900)
+            fail("zero", "drift below zero was not followed", z.offset());
+        z.tare(123456);
+        if (z.offset() != 123456 || z.update(123456) != 0 || z.still())
+            fail("zero", "tare() did not set the zero", z.offset());
+        z.set_offset(-98765);
+        if (z.offset() != -98765)
+            fail("zero", "set_offset() did not set the zero", z.offset());
+    }
+
+    if (zero_tracker::capture_for_pill(80) != 40 || zero_tracker::capture_for_pill(1000) != 100 ||
+        zero_tracker::capture_for_pill(0) != 0)
+        fail("zero", "capture_for_pill() is off", 0);
+    std::printf("zero: drift followed at 3 mg a reading and lost at 4, with a %d mg capture band\n", capture);
+}
+
+struct publish_case
+{
+    int32_t value;
+    uint32_t after_ms;      // since the previous offer
+    bool sent;
+};
+
+void check_policy(const char* what, const publish_policy::config& cfg, uint32_t start_ms,
+                  const std::vector<publish_case>& cases, int& offers)
+{
+    publish_policy p(cfg);
+    uint32_t now = start_ms;
+    for (size_t i = 0; i != cases.size(); ++i)
+    {
+        now += cases[i].after_ms;
+        if (p.offer(cases[i].value, now) != cases[i].sent)
+        {
+            std::printf("publish: %s, offer %zu of %d\n", what, i, cases[i].value);
+            fail("publish", cases[i].sent ? "held a reading it should send" : "sent a reading it should hold", i);
+        }
+        ++offers;
+    }
+    const publish_policy::statistics& s = p.stats();
+    if (s.offered != cases.size() || p.sent_count() + p.suppressed_count() != s.offered)
+        fail("publish", "the statistics do not add up", s.offered);
+}
+
+void check_publish()
+{
+    int offers = 0;
+    //! Starting 1.5 s before the clock wraps, so every case crosses it.
+    const uint32_t wrap = 0xFFFFFFFFu - 1500;
+    const publish_policy::config edge = { 50, 20, 0, 0 };
+    check_policy("deadband", edge, wrap, {
+        { 0, 0, true }, { 49, 100, false }, { -49, 100, false }, { 50, 100, true },
+        { 99, 100, false }, { 100, 100, true }, { 150, 100, true },
+    }, offers);
+    check_policy("hysteresis", edge, wrap, {
+        { 0, 0, true }, { 50, 100, true },
+        //! Back down needs 70, further down only 50.
+        { 1, 100, false }, { -20, 100, true }, { -70, 100, true }, { 0, 100, true },
+        //! Sitting on the edge of the deadband does not flap.
+        { 50, 100, true }, { 0, 100, false }, { 50, 100, false }, { -20, 100, true },
+    }, offers);
+
+    const publish_policy::config timed = { 10, 0, 1000, 5000 };
+    check_policy("pmin", timed, wrap, {
+        { 0, 0, true }, { 100, 400, false }, { 200, 599, false }, { 200, 1, true },
+        { 0, 999, false }, { 10, 1, true }, { 10, 1000, false },
+    }, offers);
+    check_policy("pmax", timed, wrap, {
+        { 0, 0, true }, { 5, 4999, false }, { 5, 1, true }, { 5, 4999, false }, { 5, 1, true },
+        //! A change restarts the heartbeat's wait.
+        { 50, 2000, true }, { 50, 4999, false }, { 50, 1, true },
+    }, offers);
+
+    const publish_policy::config quiet = { 10, 0, 0, 0 };
+    check_policy("no pmax", quiet, wrap, {
+        { 7, 0, true }, { 7, 100000, false }, { 7, 0x80000000u, false }, { 7, 0x7FFFFFFFu, false },
+    }, offers);
+    std::printf("publish: %d offers across the clock wrapping\n", offers);
+}
+
+typedef history_log<16, 3> tight_log;
+typedef history_log<256, 128> walk_log;
+
+//! Encodes every block log holds and decodes them back, checking each
+//! reading against sent, within resolution_mg, at its slot.
+template <typename Log>
+void round_trip(const char* what, Log& log, uint32_t start_ms, const std::vector<int32_t>& sent, uint32_t& readings)
+{
+    const uint32_t interval = log.cfg().interval_ms;
+    const int32_t resolution = log.cfg().resolution_mg;
+    uint8_t block[Log::max_payload];
+    size_t next = 0;
+    bool ok = true;
+    bool decoded = true;
+    while (size_t length = log.encode_next(block, sizeof(block), 0))
+    {
+        decoded &= Log::decode(block, length, [&](uint32_t ms, int32_t mg) {
+            size_t slot = (ms - start_ms) / interval;
+            bool wrong = slot != next++ || slot >= sent.size() || std::abs(int64_t(mg) - sent[slot]) > resolution;
+            if (wrong && ok)
+            {
+                ok = false;
+                std::printf("history: %s, reading %zu of %zu is %d for %d\n", what, slot, sent.size(), mg,
+                            slot < sent.size() ? sent[slot] : 0);
+                fail("history", "a reading came back wrong", int64_t(slot));
+            }
+        });
+    }
+    if (!decoded)
+        fail("history", "a block did not decode", int64_t(next));
+    if (next != sent.size())
+        fail("history", "readings went missing", int64_t(next));
+    if (log.stats().lost)
+        fail("history", "the ring lost blocks", log.stats().lost);
+    readings += next;
+}
+
+template <typename Log>
+void log_all(Log& log, uint32_t start_ms, const std::vector<int32_t>& values)
+{
+    for (size_t i = 0; i != values.size(); ++i)
+        log.record(values[i], start_ms + static_cast<uint32_t>(i) * log.cfg().interval_ms);
+}
+
+void check_history(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    uint32_t readings = 0;
+
+    //! Still, drifting and stepping, at a resolution of 1 and of 10 mg.
+    for (int32_t resolution : { 1, 10 })
+    {
+        walk_log log(walk_log::config{ 1000, resolution });
+        std::vector<int32_t> values;
+        int32_t mg = 0;
+        for (int i = 0; i != 3000; ++i)
+        {
+            switch (rng() % 8)
+            {
+            case 0: mg += static_cast<int32_t>(rng() % 200001) - 100000; break;
+            case 1: case 2: mg += static_cast<int32_t>(rng() % 7) - 3; break;
+            default: break;
+            }
+            values.push_back(mg);
+        }
+        //! Across the uptime wrapping, too.
+        const uint32_t start = 0xFFFFFFFFu - 1000000;
+        log_all(log, start, values);
+        round_trip("walk", log, start, values, readings);
+    }
+
+    //! The widest deltas there are, both ways, at every resolution.
+    for (int32_t resolution : { 1, 7, 1000 })
+    {
+        walk_log log(walk_log::config{ 1000, resolution });
+        std::vector<int32_t> values = { INT32_MIN, INT32_MAX, INT32_MIN, 0, INT32_MAX, INT32_MAX, INT32_MAX,
+                                        1 << 30, -(1 << 30), INT32_MIN, INT32_MIN + 1, INT32_MAX - 1, -1, 1 };
+        for (int i = 0; i != 64; ++i)
+            values.push_back(static_cast<int32_t>(rng()));
+        log_all(log, 0, values);
+        round_trip("extremes", log, 0, values, readings);
+    }
+
+    //! A ramp of 5 mg a reading: its run token takes a second byte at 64
+    //! readings and a third at 8192, which the 3 byte blocks only have room
+    //! for the first time. Then the same value for longer than a block can
+    //! count.
+    {
+        tight_log log(tight_log::config{ 100, 1 });
+        std::vector<int32_t> values;
+        for (int32_t i = 0; i != 20000; ++i)
+            values.push_back(5 * i - 50000);
+        values.resize(values.size() + 140000, values.back());
+        log_all(log, 1000, values);
+        if (log.stats().blocks < 6)
+            fail("history", "the runs did not roll over into new blocks", log.stats().blocks);
+        round_trip("runs", log, 1000, values, readings);
+    }
+    std::printf("history: %" PRIu32 " readings round-tripped\n", readings);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seed = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], 0, 0)) : 1;
+
+    check_filters(seed);
+    check_calibration(seed);
+    check_zero();
+    check_publish();
+    check_history(seed);
+
+    if (g_failures)
+        std::printf("%d checks failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
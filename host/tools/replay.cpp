@@ -0,0 +1,203 @@
+//! Replays a raw HX711 trace (mbed_code/raw_trace.hpp) through the scale
+//! pipeline the firmware runs, as fast as the host allows, to reproduce a
+//! field complaint or to check an algorithm change against hours of data.
+//!
+//! The conversions are handed to the pipeline on the firmware's own schedule
+//! (sampling every 250 ms, publishing every 500 ms, the missed conversion
+//! rate every minute) on the trace's clock, and the power scheduler runs on
+//! the host board's virtual clock, so conversions the firmware would have
+//! slept through at rest are dropped the same way. With --no-power every
+//! conversion goes through the filter, as with the ADC always on.
+//!
+//! Everything on stdout depends on the trace alone: one line per published
+//! reading, dose event, history batch, load cell state change and missed
+//! rate, each stamped with trace time in ms, then the totals. Diff the output
+//! of two builds to see what a change did. Throughput goes to stderr.
+//!
+//! usage: replay <trace> [--no-power] [--quiet]
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Hx711.h"
+#include "bench_util.hpp"
+#include "mbed.h"
+#include "raw_trace.hpp"
+#include "scale_config.hpp"
+#include "scale_pipeline.hpp"
+
+namespace
+{
+
+struct options
+{
+    const char* path;
+    bool power;
+    bool quiet;
+};
+
+//! Conversions with their time unwrapped to 64 bits, in microseconds.
+struct timed_sample
+{
+    uint64_t t_us;
+    sample s;
+};
+
+bool load(const char* path, std::vector<timed_sample>& out, size_t& ignored)
+{
+    std::FILE* f = std::fopen(path, "r");
+    if (!f)
+        return false;
+
+    char line[256];
+    uint64_t t_us = 0;
+    bool first = true;
+    uint32_t last = 0;
+    ignored = 0;
+    while (std::fgets(line, sizeof(line), f))
+    {
+        timed_sample ts;
+        if (!raw_trace::parse(line, std::strlen(line), ts.s))
+        {
+            ++ignored;
+            continue;
+        }
+        //! Unsigned differences carry the time across the 32-bit wrap.
+        t_us = first ? ts.s.timestamp_us : t_us + (ts.s.timestamp_us - last);
+        last = ts.s.timestamp_us;
+        first = false;
+        ts.t_us = t_us;
+        out.push_back(ts);
+    }
+    std::fclose(f);
+    return true;
+}
+
+void print_fixed(uint32_t now_ms, const char* what, int32_t milli)
+{
+    char text[codec::max_chars];
+    codec::format_fixed(text, sizeof(text), milli, 3);
+    std::printf("%10" PRIu32 " %s %s\n", now_ms, what, text);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt = { 0, true, false };
+    for (int i = 1; i != argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--no-power"))
+            opt.power = false;
+        else if (!std::strcmp(argv[i], "--quiet"))
+            opt.quiet = true;
+        else
+            opt.path = argv[i];
+    }
+    if (!opt.path)
+    {
+        std::fprintf(stderr, "usage: replay <trace> [--no-power] [--quiet]\n");
+        return 2;
+    }
+
+    std::vector<timed_sample> trace;
+    size_t ignored = 0;
+    if (!load(opt.path, trace, ignored))
+    {
+        std::fprintf(stderr, "cannot read %s\n", opt.path);
+        return 1;
+    }
+    if (trace.empty())
+    {
+        std::fprintf(stderr, "%s: no conversions\n", opt.path);
+        return 1;
+    }
+
+    //! Nothing is attached to the pins; the ADC only has to exist for the
+    //! power scheduler to switch it.
+    host::board board;
+    host::board::set_current(&board);
+    Hx711 adc(D13, D12, 128);
+    power_scheduler power(adc, power_config);
+
+    calibration_table<8> calibration = factory_calibration;
+    scale_pipeline scale(scale_config, calibration);
+    if (opt.power)
+        scale.attach(&power);
+
+    uint8_t payload[scale_pipeline::history_batch::max_payload];
+    std::vector<sample> batch;
+    batch.reserve(64);
+
+    uint64_t w0 = bench::wall_ns();
+    uint64_t end_us = trace.back().t_us;
+    size_t next = 0;
+    //! The first run of the sampling task sees the first conversion.
+    uint64_t t_ms = trace.front().t_us / 1000 / sample_period_ms * sample_period_ms;
+    while (next != trace.size() || t_ms * 1000 <= end_us)
+    {
+        t_ms += sample_period_ms;
+        uint32_t now_ms = static_cast<uint32_t>(t_ms);
+
+        batch.clear();
+        while (next != trace.size() && trace[next].t_us <= t_ms * 1000)
+            batch.push_back(trace[next++].s);
+        if (t_ms * 1000000 > board.now_ns())
+            board.advance_to(t_ms * 1000000);
+
+        //! The sampling task.
+        if (scale.update(batch.data(), batch.size(), now_ms) && !opt.quiet)
+        {
+            const dose_detector::event& dose = scale.doses().last();
+            std::printf("%10" PRIu32 " dose %" PRId32 ",%" PRIu32 "\n", now_ms, dose.pills, dose.at_ms);
+        }
+        if (scale.poll_health(now_ms) && !opt.quiet)
+            std::printf("%10" PRIu32 " load cell %s\n", now_ms, sensor_health::name(scale.health().current()));
+
+        //! The publishing task.
+        if (t_ms % publish_period_ms == 0)
+        {
+            if (scale.record(now_ms))
+            {
+                size_t length = scale.history().encode(payload, sizeof(payload), now_ms);
+                if (!opt.quiet)
+                    std::printf("%10" PRIu32 " history %zu bytes\n", now_ms, length);
+            }
+            if (scale.offer(now_ms) && !opt.quiet)
+                print_fixed(now_ms, "reading", scale.net_mg());
+        }
+
+        //! The bookkeeping task.
+        if (t_ms % health_interval_ms == 0)
+        {
+            uint32_t missed = scale.health().take_missed_per_mille();
+            if (!opt.quiet)
+                std::printf("%10" PRIu32 " missed %" PRIu32 "/1000\n", now_ms, missed);
+        }
+    }
+    uint64_t w1 = bench::wall_ns();
+
+    const sensor_health::statistics& health = scale.health().stats();
+    const publish_policy::statistics& publish = scale.publish().stats();
+    std::printf("%zu conversions over %.1f s, %zu other lines\n", trace.size(),
+                (end_us - trace.front().t_us) / 1e6, ignored);
+    std::printf("%" PRIu32 " dose events\n", scale.doses().stats().events);
+    std::printf("load cell: %" PRIu32 " of %" PRIu32 " conversions missed, %" PRIu32 " railed, %" PRIu32 " faults\n",
+                health.missed, health.expected, health.railed, health.faults);
+    std::printf("history: %" PRIu32 " samples in %" PRIu32 " batches\n", scale.history().stats().samples,
+                scale.history().stats().batches);
+    std::printf("published %" PRIu32 " of %" PRIu32 " readings\n", scale.publish().sent_count(), publish.offered);
+    if (opt.power)
+        std::printf("power: %" PRIu32 " wake-ups, %" PRIu32 " times active\n", power.stats().wakeups,
+                    power.stats().activations);
+
+    double wall = (w1 - w0) / 1e9;
+    double span = (end_us - trace.front().t_us) / 1e6;
+    std::fprintf(stderr, "replayed %zu conversions in %.3f s: %.0f samples/s, %.0fx real time\n", trace.size(), wall,
+                 wall > 0 ? trace.size() / wall : 0.0, wall > 0 ? span / wall : 0.0);
+    host::board::set_current(0);
+    return 0;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+//! The last value of each device resource, so a dashboard reading one does
+//! not cost the device a request. Values come from Observe notifications and
+//! from answers to earlier reads, and are good for ttl_ns after they
+//! arrive; the scale notifies at least once a pmax (a minute), so an
+//! observed resource longer than that never goes stale while the device is
+//! up.
+//!
+//! A read of a missing or stale value asks the device through the fetch
+//! function, once: reads of the same resource that come in while that
+//! request is out wait for its answer instead of sending their own. The
+//! requests a device sees then depend on how many resources are read and
+//! how often they change, not on how many dashboards are reading them.
+//!
+//! A read that brings back nothing leaves nothing behind: entries are only
+//! kept for resources that have had a value, so reads of resources a device
+//! does not have cannot grow the cache.
+//!
+//! Single-threaded, like the gateway it lives in. Value is whatever the
+//! owner wants to hand back on a hit; the gateway keeps the encoded frame.
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename Value>
+class resource_cache
+{
+public:
+    //! Called with the value, or null if the device could not give one.
+    typedef std::function<void(const Value*)> reader;
+
+    //! Sends the device a request whose answer comes back through answer().
+    //! Returns false if it could not be sent (no such device).
+    typedef std::function<bool(const std::string& endpoint, const std::string& path)> fetcher;
+
+    struct statistics
+    {
+        uint64_t hits;          // answered from the cache
+        uint64_t misses;        // sent a request to the device
+        uint64_t coalesced;     // waited for a request already out
+        uint64_t stale;         // misses that found an expired value
+        uint64_t failures;      // requests that brought back no value
+        uint64_t updates;       // values stored from notifications
+    };
+
+    resource_cache(uint64_t ttl_ns, fetcher fetch) : m_ttl_ns(ttl_ns), m_fetch(fetch), m_stats() {}
+
+    //! A value the device sent on its own, such as a notification.
+    void store(const std::string& endpoint, const std::string& path, const Value& value, uint64_t now_ns)
+    {
+        entry& e = m_entries[key(endpoint, path)];
+        e.value = value;
+        e.stored_ns = now_ns;
+        e.valid = true;
+        ++m_stats.updates;
+    }
+
+    //! Runs r now if there is a fresh value, otherwise once the device has
+    //! answered.
+    void read(const std::string& endpoint, const std::string& path, uint64_t now_ns, reader r)
+    {
+        entry& e = m_entries[key(endpoint, path)];
+        if (e.valid && now_ns - e.stored_ns < m_ttl_ns)
+        {
+            ++m_stats.hits;
+            r(&e.value);
+            return;
+        }
+
+        e.waiting.push_back(r);
+        if (e.waiting.size() > 1)
+        {
+            ++m_stats.coalesced;
+            return;
+        }
+        ++m_stats.misses;
+        if (e.valid)
+            ++m_stats.stale;
+        if (!m_fetch(endpoint, path))
+            answer(endpoint, path, 0, now_ns);
+    }
+
+    //! The device's answer to a fetch: value, or null on an error or timeout.
+    //! Stored if there is one, and handed to every read waiting for it. An
+    //! entry that has never had a value goes once nothing waits on it.
+    void answer(const std::string& endpoint, const std::string& path, const Value* value, uint64_t now_ns)
+    {
+        typename std::map<std::pair<std::string, std::string>, entry>::iterator it =
+            m_entries.find(key(endpoint, path));
+        if (it == m_entries.end())
+            return;
+        entry& e = it->second;
+        if (value)
+        {
+            e.value = *value;
+            e.stored_ns = now_ns;
+            e.valid = true;
+        }
+        else
+            ++m_stats.failures;
+
+        //! A reader may read again, which must start a new request.
+        std::vector<reader> waiting;
+        waiting.swap(e.waiting);
+        for (size_t i = 0; i != waiting.size(); ++i)
+            waiting[i](value ? &e.value : 0);
+
+        //! Found again: a reader may also have made the device go.
+        it = m_entries.find(key(endpoint, path));
+        if (it != m_entries.end() && !it->second.valid && it->second.waiting.empty())
+            m_entries.erase(it);
+    }
+
+    //! Drops what is known about a device, when it goes. Reads still waiting
+    //! are answered when their requests time out.
+    void forget(const std::string& endpoint)
+    {
+        typename std::map<std::pair<std::string, std::string>, entry>::iterator it =
+            m_entries.lower_bound(key(endpoint, std::string()));
+        while (it != m_entries.end() && it->first.first == endpoint)
+        {
+            if (it->second.waiting.empty())
+                m_entries.erase(it++);
+            else
+                (it++)->second.valid = false;
+        }
+    }
+
+    size_t size() const { return m_entries.size(); }
+    const statistics& stats() const { return m_stats; }
+
+private:
+    struct entry
+    {
+        entry() : stored_ns(0), valid(false) {}
+
+        Value value;
+        uint64_t stored_ns;
+        bool valid;
+        std::vector<reader> waiting;
+    };
+
+    static std::pair<std::string, std::string> key(const std::string& endpoint, const std::string& path)
+    {
+        return std::make_pair(endpoint, path);
+    }
+
+    uint64_t m_ttl_ns;
+    fetcher m_fetch;
+    std::map<std::pair<std::string, std::string>, entry> m_entries;
+    statistics m_stats;
+};
@@ -0,0 +1,478 @@
+//! Checks the timer wheel and the dose schedule on the virtual clock, where
+//! days pass in milliseconds and every run is the same:
+//!
+//!     wheel       random timers added, moved, cancelled and re-added from
+//!                 their own expiry, some beyond the wheel's reach, against
+//!                 a plain list; the tick count starts just short of 2^32,
+//!                 so it wraps, and the steps are sometimes long enough to
+//!                 cascade several levels at once. Every timer must fire
+//!                 exactly once, on its tick, in tick order.
+//!     day         one day of three doses: due, taken on time, taken late
+//!                 across the due time, missed, pills taken with nothing
+//!                 due, and the next day's first dose armed again.
+//!     set_clock   the clock moved forward while a dose was waiting and
+//!                 back while one was due; the doses rearm from the new time.
+//!     at_time     the clock or the prescription set 1 s after a dose's
+//!                 time, at exactly its time and in its late window: it is
+//!                 due or late at once, then taken or missed, not put off
+//!                 to the next day.
+//!     days        scale_app's uptime_s() on a host board for 60 days, past
+//!                 the 49.7 days after which uptime_ms() wraps, with doses
+//!                 taken, taken late and missed, every due time checked
+//!                 against the time of day.
+//!
+//! Prints one line per part; the exit status is 1 if any check failed.
+//!
+//! usage: schedule_check [seed]
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "scale_app.hpp"
+#include "timer_wheel.hpp"
+
+namespace
+{
+
+int g_failures = 0;
+
+void fail(const char* part, const char* what, uint32_t at)
+{
+    if (g_failures++ < 20)
+        std::printf("%s: %s at %" PRIu32 "\n", part, what, at);
+}
+
+typedef timer_wheel<> wheel;
+
+struct probe : wheel::timer
+{
+    probe() : due(0), armed(false), fired(0) {}
+
+    uint32_t due;       // the tick it has to fire on
+    bool armed;
+    uint32_t fired;
+};
+
+struct wheel_check
+{
+    explicit wheel_check(uint32_t seed) : rng(seed), w(start), last(start), fired(0), rearmed(0) {}
+
+    static const uint32_t start = 0xFFFFFFFFu - 200000;
+
+    //! Some delays stay in the first level, some need two or three, a few
+    //! go beyond the top and are parked.
+    uint32_t delay()
+    {
+        switch (rng() % 8)
+        {
+        case 0: return 0;
+        case 1: case 2: return rng() % 64;
+        case 3: case 4: return rng() % 4096;
+        case 5: case 6: return rng() % 262144;
+        default: return 262144 + rng() % 400000;
+        }
+    }
+
+    void arm(probe& p, uint32_t at)
+    {
+        p.due = static_cast<int32_t>(at - w.now()) > 0 ? at : w.now() + 1;
+        p.armed = true;
+        w.add(p, at);
+    }
+
+    //! advance() takes its callback by value.
+    struct firer
+    {
+        explicit firer(wheel_check& c) : check(c) {}
+        void operator()(wheel::timer& t) { check.fire(t); }
+        wheel_check& check;
+    };
+
+    void fire(wheel::timer& t)
+    {
+        probe& p = static_cast<probe&>(t);
+        uint32_t now = w.now();
+        if (!p.armed || p.due != now)
+            fail("wheel", "timer fired off its tick", now);
+        if (static_cast<int32_t>(now - last) < 0)
+            fail("wheel", "timers fired out of order", now);
+        last = now;
+        p.armed = false;
+        ++p.fired;
+        ++fired;
+
+        //! Add from inside the callback, as dose_schedule does.
+        if (rng() % 4 == 0)
+        {
+            arm(p, now + delay());
+            ++rearmed;
+        }
+    }
+
+    void run(int steps)
+    {
+        std::vector<probe> probes(256);
+        uint32_t now = start;
+        uint64_t armed = 0;
+        for (int k = 0; k != steps; ++k)
+        {
+            probe& p = probes[rng() % probes.size()];
+            uint32_t op = rng() % 10;
+            if (op < 6)
+            {
+                arm(p, w.now() + delay());
+                ++armed;
+            }
+            else if (op < 7)
+            {
+                w.cancel(p);
+                p.armed = false;
+            }
+
+            now += rng() % 16 == 0 ? rng() % 300000 : rng() % 100;
+            w.advance(now, firer(*this));
+            if (w.now() != now)
+                fail("wheel", "did not reach the tick it was advanced to", now);
+        }
+
+        //! Everything still armed fires within the wheel's reach of now.
+        now += 2 * 262144 + 400000;
+        w.advance(now, firer(*this));
+        for (size_t i = 0; i != probes.size(); ++i)
+            if (probes[i].armed)
+                fail("wheel", "timer never fired", probes[i].due);
+        if (w.size())
+            fail("wheel", "timers left on the wheel", now);
+        if (w.now() >= start)
+            fail("wheel", "tick count did not wrap", w.now());
+
+        std::printf("wheel: %" PRIu64 " timers armed, %" PRIu64 " re-armed as they fired, %" PRIu64
+                    " fired, ticks %08" PRIx32 " to %08" PRIx32 "\n",
+                    armed, rearmed, fired, start, w.now());
+    }
+
+    std::mt19937 rng;
+    wheel w;
+    uint32_t last;
+    uint64_t fired;
+    uint64_t rearmed;
+};
+
+//! What the schedule reported, and when.
+struct report
+{
+    uint32_t now_s;
+    uint32_t at_s;
+    uint16_t taken;
+    dose_schedule::status state;
+};
+
+bool set_prescription(dose_schedule& s, const char* text, uint32_t now_s)
+{
+    return s.set_prescription(reinterpret_cast<const uint8_t*>(text), std::strlen(text), now_s);
+}
+
+uint32_t hm(uint32_t hours, uint32_t minutes) { return hours * 3600 + minutes * 60; }
+
+//! Collects what s reported at now_s, if anything.
+void collect(dose_schedule& s, uint32_t now_s, std::vector<report>& out)
+{
+    if (s.take_changed())
+    {
+        const dose_schedule::outcome& o = s.last();
+        report r = { now_s, o.at_s, o.taken, o.state };
+        out.push_back(r);
+    }
+}
+
+//! Ticks s once a second from now_s to end_s, collecting its reports.
+void tick_to(dose_schedule& s, uint32_t& now_s, uint32_t end_s, std::vector<report>& out)
+{
+    while (now_s != end_s)
+    {
+        ++now_s;
+        s.tick(now_s);
+        collect(s, now_s, out);
+    }
+}
+
+void take(dose_schedule& s, uint32_t pills, uint32_t now_s, std::vector<report>& out)
+{
+    s.on_taken(pills, now_s);
+    collect(s, now_s, out);
+}
+
+void expect(const char* part, const std::vector<report>& got, const report* want, size_t count)
+{
+    for (size_t i = 0; i != got.size() || i != count; ++i)
+    {
+        if (i == got.size() || i == count)
+        {
+            fail(part, i == count ? "unexpected report" : "missing report", i == count ? got[i].now_s : want[i].now_s);
+            return;
+        }
+        const report& g = got[i];
+        const report& w = want[i];
+        if (g.now_s != w.now_s || g.at_s != w.at_s || g.taken != w.taken || g.state != w.state)
+        {
+            std::printf("%s: report %zu: %" PRIu32 " %" PRIu32 " %u %s, want %" PRIu32 " %" PRIu32 " %u %s\n", part, i,
+                        g.now_s, g.at_s, g.taken, dose_schedule::name(g.state), w.now_s, w.at_s, w.taken,
+                        dose_schedule::name(w.state));
+            ++g_failures;
+            return;
+        }
+    }
+}
+
+void check_day()
+{
+    dose_schedule s(schedule_config);
+    std::vector<report> got;
+
+    //! 08:00 at uptime 1000 s; the 08:30 dose's window opens right now.
+    uint32_t now = 1000;
+    uint32_t t0 = now - hm(8, 0);
+    s.set_clock(hm(8, 0), now);
+    if (!set_prescription(s, "12:00=2, 08:30=1,20:00=1", now) || s.size() != 3)
+        fail("day", "prescription refused", now);
+    if (set_prescription(s, "25:00=1", now) || set_prescription(s, "08:00=0", now) || s.size() != 3)
+        fail("day", "bad prescription taken", now);
+
+    tick_to(s, now, t0 + hm(8, 30) - 1, got);
+    if (s.reminding())
+        fail("day", "reminding before the due time", now);
+    tick_to(s, now, t0 + hm(8, 40), got);
+    if (!s.reminding())
+        fail("day", "not reminding after the due time", now);
+    take(s, 1, now, got);
+    if (s.reminding())
+        fail("day", "still reminding once taken", now);
+
+    //! One of the noon dose's two pills early, the other after its half hour.
+    tick_to(s, now, t0 + hm(11, 45), got);
+    take(s, 1, now, got);
+    tick_to(s, now, t0 + hm(12, 40), got);
+    take(s, 1, now, got);
+
+    //! Nothing is open at three, so this pill is unscheduled.
+    tick_to(s, now, t0 + hm(15, 0), got);
+    take(s, 1, now, got);
+
+    //! The evening dose runs its course; the next morning's is due again.
+    tick_to(s, now, t0 + hm(24 + 8, 30), got);
+
+    const report want[] = {
+        { t0 + hm(8, 30), hm(8, 30), 0, dose_schedule::due },
+        { t0 + hm(8, 40), hm(8, 30), 1, dose_schedule::taken },
+        { t0 + hm(12, 0), hm(12, 0), 1, dose_schedule::due },
+        { t0 + hm(12, 40), hm(12, 0), 2, dose_schedule::late },
+        { t0 + hm(20, 0), hm(20, 0), 0, dose_schedule::due },
+        { t0 + hm(22, 0), hm(20, 0), 0, dose_schedule::missed },
+        { t0 + hm(24 + 8, 30), hm(8, 30), 0, dose_schedule::due },
+    };
+    expect("day", got, want, sizeof(want) / sizeof(want[0]));
+
+    const dose_schedule::statistics& st = s.stats();
+    if (st.reminders != 4 || st.on_time != 1 || st.late != 1 || st.missed != 1 || st.unscheduled != 1)
+        fail("day", "statistics off", now);
+    if (s.time_of_day(now) != hm(8, 30))
+        fail("day", "time of day off", now);
+
+    std::printf("day: %zu reports, %" PRIu32 " reminders, %" PRIu32 " on time, %" PRIu32 " late, %" PRIu32
+                " missed, %" PRIu32 " unscheduled\n",
+                got.size(), st.reminders, st.on_time, st.late, st.missed, st.unscheduled);
+}
+
+void check_set_clock()
+{
+    dose_schedule s(schedule_config);
+    std::vector<report> got;
+
+    //! Before the clock is set nothing is armed.
+    uint32_t now = 500;
+    set_prescription(s, "09:00=1,10:00=1", now);
+    tick_to(s, now, now + 2 * 86400, got);
+    if (!got.empty() || s.clock_set())
+        fail("set_clock", "armed without a clock", now);
+
+    //! 08:00; twenty minutes on the clock moves to 08:45, which opens the
+    //! 09:00 window at once.
+    s.set_clock(hm(8, 0), now);
+    tick_to(s, now, now + hm(0, 20), got);
+    s.set_clock(hm(8, 45), now);
+    uint32_t t0 = now - hm(8, 45);
+    tick_to(s, now, t0 + hm(9, 1), got);
+    if (!s.reminding())
+        fail("set_clock", "not reminding after moving forward", now);
+
+    //! Back to 08:00 while it is due: the reminder stops, both doses wait
+    //! for their times again, and early pills count.
+    s.set_clock(hm(8, 0), now);
+    if (s.reminding())
+        fail("set_clock", "still reminding after moving back", now);
+    uint32_t t1 = now - hm(8, 0);
+    tick_to(s, now, t1 + hm(8, 50), got);
+    take(s, 1, now, got);
+    tick_to(s, now, t1 + hm(12, 30), got);
+
+    const report want[] = {
+        { t0 + hm(9, 0), hm(9, 0), 0, dose_schedule::due },
+        { t1 + hm(8, 50), hm(9, 0), 1, dose_schedule::taken },
+        { t1 + hm(10, 0), hm(10, 0), 0, dose_schedule::due },
+        { t1 + hm(12, 0), hm(10, 0), 0, dose_schedule::missed },
+    };
+    expect("set_clock", got, want, sizeof(want) / sizeof(want[0]));
+    std::printf("set_clock: %zu reports, %" PRIu32 " reminders\n", got.size(), s.stats().reminders);
+}
+
+//! The clock or the prescription set once a dose's time has come, or at
+//! exactly that time: the dose is due or late from then on, not tomorrow.
+void check_at_time()
+{
+    //! The clock set 1 s after 09:00: due at once, late at 09:30, and the
+    //! pill taken at 09:40 is late.
+    dose_schedule a(schedule_config);
+    std::vector<report> got_a;
+    uint32_t now = 1000;
+    set_prescription(a, "09:00=1", now);
+    a.set_clock(hm(9, 0) + 1, now);
+    collect(a, now, got_a);
+    uint32_t t0 = now - hm(9, 0) - 1;
+    if (!a.reminding())
+        fail("at_time", "not reminding with the clock set 1 s late", now);
+    tick_to(a, now, t0 + hm(9, 40), got_a);
+    take(a, 1, now, got_a);
+    const report want_a[] = {
+        { t0 + hm(9, 0) + 1, hm(9, 0), 0, dose_schedule::due },
+        { t0 + hm(9, 40), hm(9, 0), 1, dose_schedule::late },
+    };
+    expect("at_time", got_a, want_a, sizeof(want_a) / sizeof(want_a[0]));
+
+    //! The prescription written at exactly 09:00: due at once, and the pill
+    //! taken at 09:10 is on time.
+    dose_schedule b(schedule_config);
+    std::vector<report> got_b;
+    now = 1000;
+    b.set_clock(hm(8, 0), now);
+    uint32_t t1 = now - hm(8, 0);
+    tick_to(b, now, t1 + hm(9, 0), got_b);
+    set_prescription(b, "09:00=1", now);
+    collect(b, now, got_b);
+    if (!b.reminding())
+        fail("at_time", "not reminding with the prescription set on time", now);
+    tick_to(b, now, t1 + hm(9, 10), got_b);
+    take(b, 1, now, got_b);
+    const report want_b[] = {
+        { t1 + hm(9, 0), hm(9, 0), 0, dose_schedule::due },
+        { t1 + hm(9, 10), hm(9, 0), 1, dose_schedule::taken },
+    };
+    expect("at_time", got_b, want_b, sizeof(want_b) / sizeof(want_b[0]));
+
+    //! The clock set to 09:45, already late: missed at 11:00, and due again
+    //! the next morning.
+    dose_schedule c(schedule_config);
+    std::vector<report> got_c;
+    now = 1000;
+    set_prescription(c, "09:00=1", now);
+    c.set_clock(hm(9, 45), now);
+    collect(c, now, got_c);
+    uint32_t t2 = now - hm(9, 45);
+    if (!c.reminding())
+        fail("at_time", "not reminding with the clock set in the late window", now);
+    tick_to(c, now, t2 + hm(24 + 9, 0), got_c);
+    const report want_c[] = {
+        { t2 + hm(11, 0), hm(9, 0), 0, dose_schedule::missed },
+        { t2 + hm(24 + 9, 0), hm(9, 0), 0, dose_schedule::due },
+    };
+    expect("at_time", got_c, want_c, sizeof(want_c) / sizeof(want_c[0]));
+
+    std::printf("at_time: %zu reports\n", got_a.size() + got_b.size() + got_c.size());
+}
+
+//! The application is only there for its clock: it never starts
+//! converting, so days pass without an event between the ticks.
+void check_days()
+{
+    host::board board;
+    host::board::set_current(&board);
+    {
+        scale_app::loop_type loop;
+        scale_app app(loop);
+        Hx711 load_cell(D13, D12, 128);
+        power_scheduler power(load_cell, power_config);
+        app.start(power);
+
+        dose_schedule s(schedule_config);
+        s.set_clock(hm(7, 0), app.uptime_s());
+        set_prescription(s, "08:00=1,20:00=2", app.uptime_s());
+
+        const uint32_t days = 60;
+        uint32_t last_s = app.uptime_s();
+        uint32_t last_ms_s = app.uptime_ms() / 1000;
+        bool ms_wrapped = false;
+        uint32_t due = 0;
+        for (uint32_t t = 1; t <= days * 86400; ++t)
+        {
+            board.advance(1000000000ull);
+            uint32_t now = app.uptime_s();
+            if (now != last_s + 1)
+                fail("days", "uptime_s() did not move by one", now);
+            last_s = now;
+            uint32_t ms_s = app.uptime_ms() / 1000;
+            ms_wrapped = ms_wrapped || ms_s < last_ms_s;
+            last_ms_s = ms_s;
+
+            s.tick(now);
+            uint32_t day = t / 86400;
+            uint32_t tod = s.time_of_day(now);
+            if (tod != (hm(7, 0) + t) % 86400)
+                fail("days", "time of day drifted", now);
+
+            //! Mornings on time but every third missed; evenings late.
+            if (tod == hm(8, 10) && day % 3 != 2)
+                s.on_taken(1, now);
+            if (tod == hm(20, 40))
+                s.on_taken(2, now);
+
+            if (s.take_changed() && s.last().state == dose_schedule::due)
+            {
+                ++due;
+                if (tod != s.last().at_s)
+                    fail("days", "due off its time", now);
+            }
+        }
+
+        const dose_schedule::statistics& st = s.stats();
+        if (!ms_wrapped)
+            fail("days", "the run did not reach the uptime_ms() wrap", last_s);
+        if (due != 2 * days || st.reminders != 2 * days || st.on_time != 40 || st.missed != 20 || st.late != 60 ||
+            st.unscheduled)
+            fail("days", "statistics off", last_s);
+
+        std::printf("days: %" PRIu32 " days, uptime_ms() wrapped, %" PRIu32 " reminders, %" PRIu32 " on time, %" PRIu32
+                    " late, %" PRIu32 " missed\n",
+                    days, st.reminders, st.on_time, st.late, st.missed);
+    }
+    host::board::set_current(0);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seed = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], 0, 0)) : 1;
+
+    wheel_check(seed).run(200000);
+    check_day();
+    check_set_clock();
+    check_at_time();
+    check_days();
+
+    if (g_failures)
+        std::printf("%d checks failed\n", g_failures);
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,395 @@
+#include "websocket.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+
+namespace ws
+{
+
+namespace
+{
+
+const char* const handshake_guid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+uint32_t rotl(uint32_t v, int n)
+{
+    return v << n | v >> (32 - n);
+}
+
+//! SHA-1 (RFC 3174), which the handshake needs and nothing else; it is not
+//! used for anything that has to be secure.
+void sha1(const std::string& in, uint8_t digest[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    std::string m = in;
+    uint64_t bits = static_cast<uint64_t>(in.size()) * 8;
+    m += static_cast<char>(0x80);
+    while (m.size() % 64 != 56)
+        m += '\0';
+    for (int i = 7; i >= 0; --i)
+        m += static_cast<char>(bits >> (8 * i));
+
+    for (size_t block = 0; block != m.size(); block += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i != 16; ++i)
+        {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(m.data() + block + 4 * i);
+            w[i] = static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+        }
+        for (int i = 16; i != 80; ++i)
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i != 80; ++i)
+        {
+            uint32_t f, k;
+            if (i < 20)
+                f = (b & c) | (~b & d), k = 0x5A827999;
+            else if (i < 40)
+                f = b ^ c ^ d, k = 0x6ED9EBA1;
+            else if (i < 60)
+                f = (b & c) | (b & d) | (c & d), k = 0x8F1BBCDC;
+            else
+                f = b ^ c ^ d, k = 0xCA62C1D6;
+            uint32_t t = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i != 20; ++i)
+        digest[i] = static_cast<uint8_t>(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+std::string base64(const uint8_t* data, size_t size)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < size; i += 3)
+    {
+        uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+        if (i + 1 < size)
+            v |= static_cast<uint32_t>(data[i + 1]) << 8;
+        if (i + 2 < size)
+            v |= data[i + 2];
+        out += digits[v >> 18 & 63];
+        out += digits[v >> 12 & 63];
+        out += i + 1 < size ? digits[v >> 6 & 63] : '=';
+        out += i + 2 < size ? digits[v & 63] : '=';
+    }
+    return out;
+}
+
+bool same_text(const std::string& a, const char* b)
+{
+    size_t n = std::strlen(b);
+    if (a.size() != n)
+        return false;
+    for (size_t i = 0; i != n; ++i)
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    return true;
+}
+
+//! Whether a comma-separated header value lists token, ignoring case.
+bool lists(const std::string& value, const char* token)
+{
+    size_t start = 0;
+    while (start <= value.size())
+    {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.size();
+        size_t b = value.find_first_not_of(' ', start);
+        size_t e = value.find_last_not_of(' ', end - 1);
+        if (b != std::string::npos && b < end && same_text(value.substr(b, e + 1 - b), token))
+            return true;
+        start = end + 1;
+    }
+    return false;
+}
+
+//! Splits a head into its first line and headers; the length of the head
+//! including the blank line, 0 while incomplete, -1 if too long.
+long split_head(const std::string& in, std::string& first, std::vector<std::pair<std::string, std::string> >& headers)
+{
+    size_t end = in.find("\r\n\r\n");
+    if (end == std::string::npos)
+        return in.size() > max_head ? -1 : 0;
+
+    size_t line_end = in.find("\r\n");
+    first = in.substr(0, line_end);
+    size_t start = line_end + 2;
+    while (start < end)
+    {
+        line_end = in.find("\r\n", start);
+        std::string line = in.substr(start, line_end - start);
+        start = line_end + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+        size_t value = line.find_first_not_of(' ', colon + 1);
+        headers.push_back(std::make_pair(line.substr(0, colon),
+                                         value == std::string::npos ? std::string() : line.substr(value)));
+    }
+    return static_cast<long>(end + 4);
+}
+
+const std::string* header(const std::vector<std::pair<std::string, std::string> >& headers, const char* name)
+{
+    for (size_t i = 0; i != headers.size(); ++i)
+        if (same_text(headers[i].first, name))
+            return &headers[i].second;
+    return 0;
+}
+
+int nonblocking(int fd)
+{
+    if (fd < 0)
+        return -1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    //! Frames are small and each is sent whole; don't hold them back.
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+sockaddr_in to_sockaddr(const coap::address& a)
+{
+    sockaddr_in sa = sockaddr_in();
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(a.ip);
+    sa.sin_port = htons(a.port);
+    return sa;
+}
+
+}
+
+std::string accept_key(const std::string& key)
+{
+    uint8_t digest[20];
+    sha1(key + handshake_guid, digest);
+    return base64(digest, sizeof(digest));
+}
+
+long parse_upgrade(const std::string& in, std::string& path, std::string& key)
+{
+    std::string first;
+    std::vector<std::pair<std::string, std::string> > headers;
+    long length = split_head(in, first, headers);
+    if (length <= 0)
+        return length;
+
+    //! "GET /scale HTTP/1.1"
+    size_t space = first.find(' ');
+    size_t second = first.find(' ', space + 1);
+    if (first.compare(0, 4, "GET ") != 0 || second == std::string::npos)
+        return -1;
+    path = first.substr(space + 1, second - space - 1);
+
+    const std::string* upgrade = header(headers, "Upgrade");
+    const std::string* connection = header(headers, "Connection");
+    const std::string* version = header(headers, "Sec-WebSocket-Version");
+    const std::string* k = header(headers, "Sec-WebSocket-Key");
+    if (!upgrade || !lists(*upgrade, "websocket") || !connection || !lists(*connection, "upgrade") || !version ||
+        *version != "13" || !k || k->empty())
+        return -1;
+    key = *k;
+    return length;
+}
+
+std::string upgrade_response(const std::string& key)
+{
+    return "HTTP/1.1 101 Switching Protocols\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: " + accept_key(key) + "\r\n\r\n";
+}
+
+std::string reject_response(int status, const char* reason)
+{
+    return "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+}
+
+std::string upgrade_request(const std::string& host, const std::string& path, const std::string& key)
+{
+    return "GET " + path + " HTTP/1.1\r\n"
+           "Host: " + host + "\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Key: " + key + "\r\n"
+           "Sec-WebSocket-Version: 13\r\n\r\n";
+}
+
+long check_upgrade_response(const std::string& in, const std::string& key)
+{
+    std::string first;
+    std::vector<std::pair<std::string, std::string> > headers;
+    long length = split_head(in, first, headers);
+    if (length <= 0)
+        return length ? -1 : 0;
+    const std::string* accept = header(headers, "Sec-WebSocket-Accept");
+    if (first.compare(0, 13, "HTTP/1.1 101 ") != 0 || !accept || *accept != accept_key(key))
+        return -1;
+    return length;
+}
+
+void encode(uint8_t op, const void* payload, size_t size, std::vector<uint8_t>& out, bool masked, uint32_t mask)
+{
+    out.push_back(static_cast<uint8_t>(0x80 | op));
+    uint8_t mask_bit = masked ? 0x80 : 0;
+    if (size < 126)
+        out.push_back(static_cast<uint8_t>(mask_bit | size));
+    else if (size <= 0xFFFF)
+    {
+        out.push_back(static_cast<uint8_t>(mask_bit | 126));
+        out.push_back(static_cast<uint8_t>(size >> 8));
+        out.push_back(static_cast<uint8_t>(size));
+    }
+    else
+    {
+        out.push_back(static_cast<uint8_t>(mask_bit | 127));
+        for (int i = 7; i >= 0; --i)
+            out.push_back(static_cast<uint8_t>(static_cast<uint64_t>(size) >> (8 * i)));
+    }
+
+    const uint8_t* p = static_cast<const uint8_t*>(payload);
+    if (!masked)
+    {
+        out.insert(out.end(), p, p + size);
+        return;
+    }
+    uint8_t key[4] = { uint8_t(mask >> 24), uint8_t(mask >> 16), uint8_t(mask >> 8), uint8_t(mask) };
+    out.insert(out.end(), key, key + 4);
+    for (size_t i = 0; i != size; ++i)
+        out.push_back(p[i] ^ key[i % 4]);
+}
+
+long decode(const uint8_t* data, size_t size, uint8_t& op, std::string& payload)
+{
+    if (size < 2)
+        return 0;
+    //! Reserved bits mean an extension we never agreed to; a clear FIN is a
+    //! fragment, which nothing here sends.
+    if ((data[0] & 0x70) || !(data[0] & 0x80))
+        return -1;
+    op = data[0] & 0x0F;
+    bool masked = (data[1] & 0x80) != 0;
+    uint64_t length = data[1] & 0x7F;
+    size_t at = 2;
+    if (length == 126)
+    {
+        if (size < 4)
+            return 0;
+        length = static_cast<uint64_t>(data[2]) << 8 | data[3];
+        at = 4;
+    }
+    else if (length == 127)
+    {
+        if (size < 10)
+            return 0;
+        length = 0;
+        for (int i = 0; i != 8; ++i)
+            length = length << 8 | data[2 + i];
+        at = 10;
+    }
+    if (length > max_payload)
+        return -1;
+
+    const uint8_t* key = data + at;
+    if (masked)
+        at += 4;
+    if (size < at + length)
+        return 0;
+
+    payload.assign(reinterpret_cast<const char*>(data + at), static_cast<size_t>(length));
+    if (masked)
+        for (size_t i = 0; i != payload.size(); ++i)
+            payload[i] = static_cast<char>(payload[i] ^ key[i % 4]);
+    return static_cast<long>(at + length);
+}
+
+int listen_tcp(const coap::address& local, int backlog)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in sa = to_sockaddr(local);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 || ::listen(fd, backlog) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return nonblocking(fd);
+}
+
+int accept_tcp(int listener)
+{
+    return nonblocking(accept(listener, 0, 0));
+}
+
+int connect_tcp(const coap::address& remote)
+{
+    int fd = nonblocking(socket(AF_INET, SOCK_STREAM, 0));
+    if (fd < 0)
+        return -1;
+    sockaddr_in sa = to_sockaddr(remote);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) != 0 && errno != EINPROGRESS)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+coap::address local_address(int fd)
+{
+    sockaddr_in sa = sockaddr_in();
+    socklen_t length = sizeof(sa);
+    coap::address a;
+    if (getsockname(fd, reinterpret_cast<sockaddr*>(&sa), &length) == 0)
+    {
+        a.ip = ntohl(sa.sin_addr.s_addr);
+        a.port = ntohs(sa.sin_port);
+    }
+    return a;
+}
+
+unsigned long raise_descriptor_limit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return 0;
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    return static_cast<unsigned long>(limit.rlim_cur);
+}
+
+} // namespace ws
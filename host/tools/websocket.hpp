@@ -0,0 +1,63 @@
+#pragma once
+
+//! The part of WebSocket (RFC 6455) the dashboard gateway and its load test
+//! speak: the HTTP upgrade on both sides, and unfragmented frames. No
+//! extensions, no subprotocols, no fragmentation; a fragmented message is a
+//! protocol error here. Plus non-blocking TCP sockets to run it on, IPv4
+//! only like the CoAP side (hal/coap.hpp).
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "coap.hpp"
+
+namespace ws
+{
+
+enum opcode { text = 0x1, binary = 0x2, close = 0x8, ping = 0x9, pong = 0xA };
+
+//! Longest request or response head either side accepts.
+const size_t max_head = 4096;
+
+//! Largest payload accepted from a peer. Dashboards only send short requests.
+const size_t max_payload = 64 * 1024;
+
+//! Sec-WebSocket-Accept for a Sec-WebSocket-Key.
+std::string accept_key(const std::string& key);
+
+//! The client's upgrade request. Returns the bytes it took from in, 0 while
+//! it is incomplete and -1 if it is not a WebSocket upgrade; path is the
+//! request target, such as "/scale".
+long parse_upgrade(const std::string& in, std::string& path, std::string& key);
+
+//! The server's answer to it.
+std::string upgrade_response(const std::string& key);
+std::string reject_response(int status, const char* reason);
+
+//! The client's side of the upgrade, and whether the head of the response
+//! (ending in a blank line, -1 while incomplete) accepts it.
+std::string upgrade_request(const std::string& host, const std::string& path, const std::string& key);
+long check_upgrade_response(const std::string& in, const std::string& key);
+
+//! Appends one final frame. Clients mask what they send (mask is then the
+//! key), servers must not.
+void encode(uint8_t op, const void* payload, size_t size, std::vector<uint8_t>& out, bool masked = false,
+            uint32_t mask = 0);
+
+//! Takes one frame off the front of [data, data + size), unmasking it. Returns
+//! the bytes it took, 0 while it is incomplete and -1 on a protocol error.
+long decode(const uint8_t* data, size_t size, uint8_t& op, std::string& payload);
+
+//! Non-blocking TCP sockets; -1 on failure.
+int listen_tcp(const coap::address& local, int backlog);
+int accept_tcp(int listener);
+int connect_tcp(const coap::address& remote);
+coap::address local_address(int fd);
+
+//! As many descriptors as the hard limit allows, since every dashboard is
+//! one. Returns the new soft limit.
+unsigned long raise_descriptor_limit();
+
+} // namespace ws
@@ -0,0 +1,143 @@
+#pragma once
+
+//! A fixed set of worker threads, each with its own deque of jobs. A worker
+//! runs jobs from the back of its own deque, so a job it puts back runs
+//! again on the same core while its data is still in cache; a worker with
+//! nothing left steals from the front of another's, which takes the jobs
+//! that owner would get to last.
+//!
+//! Jobs return true to be run again. That is how the fleet simulator runs a
+//! device in slices of virtual time, which keeps the work balanced between
+//! cores without any device hopping between them more than it has to.
+//!
+//! Each deque has its own lock; the work here is milliseconds per job, far
+//! longer than any contention on them.
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class work_stealing_pool
+{
+public:
+    //! Returns true to be put back and run again later.
+    typedef std::function<bool()> job;
+
+    struct statistics
+    {
+        uint64_t runs;
+        uint64_t steals;
+    };
+
+    explicit work_stealing_pool(unsigned threads) : m_queues(threads ? threads : 1), m_next(0), m_outstanding(0)
+    {
+        for (size_t i = 0; i != m_queues.size(); ++i)
+            m_queues[i].reset(new queue());
+    }
+
+    unsigned threads() const { return static_cast<unsigned>(m_queues.size()); }
+
+    //! Before run(); jobs are dealt out round robin.
+    void submit(job j)
+    {
+        queue& q = *m_queues[m_next++ % m_queues.size()];
+        std::lock_guard<std::mutex> lock(q.lock);
+        q.jobs.push_back(j);
+        ++m_outstanding;
+    }
+
+    //! Blocks until every job has returned false. worker_started runs first
+    //! on each worker thread, with its index.
+    void run(std::function<void(unsigned)> worker_started = std::function<void(unsigned)>())
+    {
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i != m_queues.size(); ++i)
+            workers.push_back(std::thread([this, i, worker_started]() {
+                if (worker_started)
+                    worker_started(i);
+                work(i);
+            }));
+        for (size_t i = 0; i != workers.size(); ++i)
+            workers[i].join();
+    }
+
+    statistics stats() const
+    {
+        statistics s = { 0, 0 };
+        for (size_t i = 0; i != m_queues.size(); ++i)
+        {
+            s.runs += m_queues[i]->runs;
+            s.steals += m_queues[i]->steals;
+        }
+        return s;
+    }
+
+private:
+    struct queue
+    {
+        queue() : runs(0), steals(0) {}
+
+        std::mutex lock;
+        std::deque<job> jobs;
+        uint64_t runs;      // written by the owner only
+        uint64_t steals;
+    };
+
+    void work(unsigned self)
+    {
+        queue& own = *m_queues[self];
+        while (m_outstanding.load() != 0)
+        {
+            job j;
+            if (!take(own, j) && !steal(self, j))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            ++own.runs;
+            if (j())
+            {
+                std::lock_guard<std::mutex> lock(own.lock);
+                own.jobs.push_back(j);
+            }
+            else
+                --m_outstanding;
+        }
+    }
+
+    bool take(queue& own, job& j)
+    {
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (own.jobs.empty())
+            return false;
+        j = own.jobs.back();
+        own.jobs.pop_back();
+        return true;
+    }
+
+    bool steal(unsigned self, job& j)
+    {
+        for (size_t k = 1; k != m_queues.size(); ++k)
+        {
+            queue& victim = *m_queues[(self + k) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (victim.jobs.empty())
+                continue;
+            j = victim.jobs.front();
+            victim.jobs.pop_front();
+            ++m_queues[self]->steals;
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<queue> > m_queues;
+    size_t m_next;
+    std::atomic<size_t> m_outstanding;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "mbed.h"
+
+//! Calls a function on every beat of a tempo. Beat k of a tempo is due at
+//! anchor + k * 60 s / bpm, worked out in whole microseconds from k itself
+//! rather than by adding up a rounded period, so the error never exceeds a
+//! microsecond however long it runs. Each beat re-arms a Timeout for the
+//! time left until the next deadline; a late interrupt delays that one beat
+//! and nothing after it.
+//!
+//! A tempo change keeps the phase: if the current beat is 30% through, the
+//! next one comes after the remaining 70% of a beat at the new tempo.
+class beat_scheduler
+{
+public:
+    struct statistics
+    {
+        uint32_t beats;
+        uint32_t skipped;       // deadlines already past when a beat ran
+        uint32_t late_max_us;   // worst lateness of a beat
+        uint64_t late_total_us;
+    };
+
+    explicit beat_scheduler(Callback<void()> on_beat)
+    : m_on_beat(on_beat), m_anchor_us(0), m_beat(0), m_bpm(0), m_stats()
+    {
+        m_clock.start();
+    }
+
+    //! Start at bpm with the first beat one period from now, or change the
+    //! tempo of the running beat without a jump in phase.
+    void set_bpm(size_t bpm)
+    {
+        if (!bpm)
+            return;
+
+        __disable_irq();
+        uint64_t now = now_us();
+        if (!m_bpm)
+        {
+            m_anchor_us = now;
+            m_beat = 1;
+        }
+        else
+        {
+            //! What is left of the current beat, scaled to the new tempo.
+            uint64_t next = deadline(m_beat);
+            uint64_t left = next > now ? next - now : 0;
+            m_anchor_us = now + left * m_bpm / bpm;
+            m_beat = 0;
+        }
+        m_bpm = bpm;
+        arm(now);
+        __enable_irq();
+    }
+
+    void stop()
+    {
+        __disable_irq();
+        m_timeout.detach();
+        m_bpm = 0;
+        __enable_irq();
+    }
+
+    bool running() const { return m_bpm != 0; }
+    size_t bpm() const { return m_bpm; }
+
+    const statistics& stats() const { return m_stats; }
+
+private:
+    static const uint64_t minute_us = 60ull * 1000 * 1000;
+
+    uint64_t now_us() { return m_clock.read_high_resolution_us(); }
+
+    uint64_t deadline(uint64_t beat) const { return m_anchor_us + beat * minute_us / m_bpm; }
+
+    void arm(uint64_t now)
+    {
+        uint64_t due = deadline(m_beat);
+        m_timeout.attach_us(callback(this, &beat_scheduler::fire), due > now ? due - now : 0);
+    }
+
+    //! Timeout handler.
+    void fire()
+    {
+        if (!m_bpm)
+            return;
+
+        uint64_t now = now_us();
+        uint64_t due = deadline(m_beat);
+        uint64_t late = now > due ? now - due : 0;
+        ++m_stats.beats;
+        m_stats.late_total_us += late;
+        if (late > m_stats.late_max_us)
+            m_stats.late_max_us = static_cast<uint32_t>(late);
+
+        //! Beats whose time has gone as well are dropped, not bunched up.
+        ++m_beat;
+        while (deadline(m_beat) <= now)
+        {
+            ++m_beat;
+            ++m_stats.skipped;
+        }
+
+        arm(now);
+        m_on_beat();
+    }
+
+    Callback<void()> m_on_beat;
+    Timer m_clock;
+    Timeout m_timeout;
+
+    uint64_t m_anchor_us;   // time of beat 0 of the current tempo
+    uint64_t m_beat;        // the next beat due
+    size_t m_bpm;           // 0: stopped
+    statistics m_stats;
+};
@@ -4,8 +4,11 @@
 #include "EthernetInterface.h"
 #include "frdm_client.hpp"
 
+#include "beat_scheduler.hpp"
+#include "event_loop.hpp"
 #include "metronome.hpp"
 #include "utils.hpp"
+#include "value_codec.hpp"
 
 #define IOT_ENABLED
 
@@ -26,30 +29,65 @@ InterruptIn g_button_mode(SW3);
 InterruptIn g_button_tap(SW2);
 
 metronome g_metronome;
-//! Since the green LED will blink asynchronously from user input, we will use
-//! a Ticker to set up a timer callback to call the pulse() function.
-Ticker g_ticker;
+
+//! The function that is called on each beat must have a signature of void(),
+//! so wrap the pulse utility with our desired arguments.
+void pulse_led_green() { utils::pulse(g_led_green); }
+
+//! Since the green LED will blink asynchronously from user input, the beat
+//! scheduler calls pulse_led_green() from a timer interrupt on every beat.
+beat_scheduler g_beats(pulse_led_green);
 
 size_t current_bpm = 0;
 //! The minimum and maximum invalid/unset states are when the value is 0 here.
 size_t minimum_bpm = 0;
 size_t maximum_bpm = 0;
+
 //! Network requests cannot be created (getting/setting the resource objects) in
-//! secondary threads / interrupt contexts. Instead, we must mark that a value
-//! changed in these cases and have the main loop complete the operation.
-volatile bool bpm_changed = false;
-volatile bool bpm_updated = false;
+//! secondary threads / interrupt contexts. Instead, the buttons and resource
+//! callbacks post the work to the main loop, which sleeps until there is some.
+event_loop<8> g_loop;
 
-//! The function that is attached to a Ticker must have a signature of void(),
-//! so wrap the pulse utility with our desired arguments.
-void pulse_led_green() { utils::pulse(g_led_green); }
+//! How often the main loop checks on the connector.
+const uint32_t client_period_ms = 1000;
+
+//! Tapped in by the mode button; handed to the loop with the work item.
+volatile size_t learned_bpm = 0;
+
+#ifdef IOT_ENABLED
+frdm_client* g_client = 0;
+M2MResource* g_set_point = 0;
+M2MResource* g_min_value = 0;
+M2MResource* g_max_value = 0;
+#endif
+
+//! A utility function for formatting values to their string equivalent.
+void format_resource_value(size_t value, M2MResource* resource)
+{
+	//! The codec writes the digits straight into a stack buffer; no printf.
+	char result_string[codec::max_chars];
+	size_t size = codec::format_uint(result_string, sizeof(result_string), static_cast<uint32_t>(value));
+
+	const uint8_t* buffer = reinterpret_cast<const uint8_t*>(result_string);
+	resource->set_value(buffer, size);
+}
+
+//! Our three values that can change may all be updated when the BPM changes,
+//! so just update them every time to be safe.
+void publish_bpm()
+{
+#ifdef IOT_ENABLED
+	format_resource_value(current_bpm, g_set_point);
+	format_resource_value(minimum_bpm, g_min_value);
+	format_resource_value(maximum_bpm, g_max_value);
+#endif
+}
 
 //! A helper function to unify the logic between the user manually setting the
 //! BPM, and the BPM being set through the resource endpoint.
 void update_bpm(size_t bpm)
 {
 	current_bpm = bpm;
-	bpm_changed = true;
 
     //! Each time the BPM changes, check if the max/min need upadting.
     if (!minimum_bpm || current_bpm < minimum_bpm)
@@ -57,8 +95,23 @@ void update_bpm(size_t bpm)
     if (!maximum_bpm || current_bpm > maximum_bpm)
         maximum_bpm = current_bpm;
 
-    //! Convert BPM (frequency) into period for the ticker.
-    g_ticker.attach(pulse_led_green, 60.0f / current_bpm);
+    //! Start beating, or carry on at the new tempo from the current phase.
+    g_beats.set_bpm(current_bpm);
+    publish_bpm();
+}
+
+//! Posted by the mode button. The beat stops while a new tempo is tapped in.
+void stop_beat()
+{
+    g_beats.stop();
+}
+
+void apply_learned_bpm()
+{
+    size_t bpm = learned_bpm;
+    learned_bpm = 0;
+    if (bpm)
+        update_bpm(bpm);
 }
 
 void on_mode()
@@ -72,16 +125,20 @@ void on_mode()
         //! Ensure the user pressed the button enough times to actually
         //! calculate a new BPM before updating everything.
         if (bpm)
-        	update_bpm(bpm);
+        {
+            learned_bpm = bpm;
+            g_loop.post(apply_learned_bpm);
+        }
     }
     //! The metronome was not timing, so we should start
     else
     {
-        g_ticker.detach();
+        g_loop.post(stop_beat);
         g_metronome.start_timing();
     }
 }
 
+//! Taps stay in the interrupt: the tap time is the whole point.
 void on_tap()
 {
     //! A tap is only valid in the timing mode. The metronome class already
@@ -93,30 +150,52 @@ void on_tap()
     utils::pulse(g_led_red);
 }
 
+#ifdef IOT_ENABLED
+//! Posted on a PUT to the set point.
+void apply_set_point()
+{
+	//! Parse the new BPM in place from the resource's own buffer; get_value()
+	//! would hand back a heap copy.
+	uint32_t bpm = 0;
+	codec::parse_uint(g_set_point->value(), g_set_point->value_length(), bpm);
+
+	//! The user cannot set the BPM to zero, and a payload that is not a
+	//! number leaves bpm at zero too; just ignore those.
+	if (bpm)
+		update_bpm(bpm);
+}
+#endif
+
 void set_point_PUT(const char*)
 {
-	bpm_updated = true;
+#ifdef IOT_ENABLED
+	g_loop.post(apply_set_point);
+#endif
 }
 
-void reset_values_POST(void*)
+void reset_values()
 {
 	minimum_bpm = 0;
 	maximum_bpm = 0;
 
 	//! Make sure these updates are reflected in the resource.
-	bpm_changed = true;
+	publish_bpm();
 }
 
-//! A utility function for formatting values to their string equivalent.
-void format_resource_value(size_t value, M2MResource* resource)
+void reset_values_POST(void*)
 {
-	//! Use sprintf to convert the integral value to a string.
-	char result_string[30];
-	size_t size = sprintf(result_string, "%u", value);
+	g_loop.post(reset_values);
+}
 
-	const uint8_t* buffer = reinterpret_cast<const uint8_t*>(result_string);
-	resource->set_value(buffer, size);
+#ifdef IOT_ENABLED
+//! Periodic: the loop ends when the connector does.
+void client_task()
+{
+	frdm_client::state state = g_client->get_state();
+	if (state == frdm_client::state::error || state == frdm_client::state::unregistered)
+		g_loop.stop();
 }
+#endif
 
 int main()
 {
@@ -148,6 +227,7 @@ int main()
     frdm_client client("coap://api.connector.mbed.com:5684", &ethernet);
     if (client.get_state() == frdm_client::state::error)
         return 1;
+    g_client = &client;
 
 	// The REST endpoints for this device
 	// Add your own M2MObjects to this list with push_back before client.connect()
@@ -169,25 +249,25 @@ int main()
 
     //! Set Point allows the user to read/write the BPM value itself through
     //! GET and PUT.
-    M2MResource* set_point = bpm_counter->create_dynamic_resource("5700", "integer", M2MResourceInstance::INTEGER, true);
-    set_point->set_operation(M2MBase::GET_PUT_ALLOWED);
+    g_set_point = bpm_counter->create_dynamic_resource("5700", "integer", M2MResourceInstance::INTEGER, true);
+    g_set_point->set_operation(M2MBase::GET_PUT_ALLOWED);
 
     //! Give the resource a default value, and set an action for when PUT occurs.
-    format_resource_value(0, set_point);
-    set_point->set_value_updated_function(set_point_PUT);
+    format_resource_value(0, g_set_point);
+    g_set_point->set_value_updated_function(set_point_PUT);
 
     //! Min value records the smallest BPM ever set, or 0 if nothing.
-    M2MResource* min_value = bpm_counter->create_dynamic_resource("5601", "integer", M2MResourceInstance::INTEGER, true);
-    min_value->set_operation(M2MBase::GET_ALLOWED);
+    g_min_value = bpm_counter->create_dynamic_resource("5601", "integer", M2MResourceInstance::INTEGER, true);
+    g_min_value->set_operation(M2MBase::GET_ALLOWED);
 
     //! Every resource that can respond to GET needs a default value.
-    format_resource_value(0, min_value);
+    format_resource_value(0, g_min_value);
 
     //! Max value records the smallest BPM ever set, or 0 if nothing.
-    M2MResource* max_value = bpm_counter->create_dynamic_resource("5602", "integer", M2MResourceInstance::INTEGER, true);
-    max_value->set_operation(M2MBase::GET_ALLOWED);
+    g_max_value = bpm_counter->create_dynamic_resource("5602", "integer", M2MResourceInstance::INTEGER, true);
+    g_max_value->set_operation(M2MBase::GET_ALLOWED);
 
-    format_resource_value(0, max_value);
+    format_resource_value(0, g_max_value);
 
     //! Reset Min/Max returns min & max to their invalid state; a value of 0.
     //! This resource can be POST-ed to execute its functionality.
@@ -221,45 +301,19 @@ int main()
     g_led_blue = active_low::off;
 #endif
 
-    while (true)
-    {
 #ifdef IOT_ENABLED
-        if (client.get_state() == frdm_client::state::error)
-            break;
+    g_loop.every(client_period_ms, client_task);
 #endif
-
-        //! Here we must check for when our BPM/state is updated asynchronously,
-        //! and update the resource values as necessary.
-        if (bpm_changed)
-        {
-        	//! Our three values that can change may all be updated when the BPM
-        	//! changes, so just update them every time to be safe.
-        	format_resource_value(current_bpm, set_point);
-        	format_resource_value(minimum_bpm, min_value);
-        	format_resource_value(maximum_bpm, max_value);
-
-        	bpm_changed = false;
-        }
-        if (bpm_updated)
-        {
-        	uint8_t* buffer;
-					size_t buffer_length;
-
-			//! Retrieve the value the endpoint has been set to.
-			set_point->get_value(buffer, buffer_length);
-			String bpm_string(reinterpret_cast<const char*>(buffer), buffer_length);
-
-			//! Extract the new BPM as an actual integer with sscanf().
-			size_t bpm;
-			sscanf(bpm_string.c_str(), "%u", &bpm);
-
-			//! The user cannot set the BPM to zero; just ignore if that is the case.
-			if (bpm)
-				update_bpm(bpm);
-
-			bpm_updated = false;
-		}
-    }
+    g_loop.run();
+
+    const event_loop<8>::statistics& loop = g_loop.stats();
+    printf("loop: %lu.%lu%% idle, %lu posts run (%lu us avg, %lu us max latency), %lu dropped\r\n",
+           static_cast<unsigned long>(g_loop.idle_per_mille() / 10),
+           static_cast<unsigned long>(g_loop.idle_per_mille() % 10),
+           static_cast<unsigned long>(loop.dispatched),
+           static_cast<unsigned long>(loop.dispatched ? loop.latency_total_us / loop.dispatched : 0),
+           static_cast<unsigned long>(loop.latency_max_us),
+           static_cast<unsigned long>(loop.dropped));
 
 #ifdef IOT_ENABLED
     client.disconnect();
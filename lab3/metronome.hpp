@@ -2,47 +2,80 @@
 
 #include "mbed.h"
 
-class metronome
+//! Learns a tempo from taps. The last BeatSamples tap times are kept in a
+//! circular buffer, and the BPM is worked out as each tap comes in, so
+//! get_bpm() only returns the cached value.
+//!
+//! Two estimators are offered. The mean uses the average interval, which is
+//! just the time from the oldest to the newest tap over the number of
+//! intervals. The median takes the middle interval and so ignores a single
+//! missed or doubled tap; the intervals are kept sorted as they come and go.
+template <size_t BeatSamples>
+class basic_metronome
 {
+    static_assert(BeatSamples >= 2, "a tempo needs at least two taps");
+
 public:
-	//! Change the samples to 4. Since we are storing absolute times and
-	//! calculating deltas at the end, 4 samples are needed for 3 deltas.
-    enum { beat_samples = 4 };
+    //! Since we are storing absolute times and calculating deltas, N samples
+    //! give N - 1 deltas.
+    enum { beat_samples = BeatSamples, beat_deltas = BeatSamples - 1 };
+
+    enum estimator { mean, median };
 
 public:
-    metronome()
-    : m_timing(false), m_beat_count(0) {}
-    ~metronome() {}
+    explicit basic_metronome(estimator e = mean)
+    : m_estimator(e), m_timing(false), m_beat_count(0), m_next(0), m_bpm(0) {}
+    ~basic_metronome() {}
 
 public:
-	// Call when entering "learn" mode
+    // Call when entering "learn" mode
     void start_timing();
-	// Call when leaving "learn" mode
+    // Call when leaving "learn" mode
     void stop_timing();
 
-	// Should only record the current time when timing
-	// Insert the time at the next free position of m_beats
+    // Should only record the current time when timing
+    // Overwrites the oldest sample once the buffer is full
     void tap();
 
     bool is_timing() const { return m_timing; }
-	// Calculate the BPM from the deltas between m_beats
-	// Return 0 if there are not enough samples
-    size_t get_bpm() const;
+    // The BPM as of the last tap
+    // Return 0 if there are not enough samples
+    size_t get_bpm() const { return m_bpm; }
 
 private:
+    //! One minute in tap time units, microseconds.
+    static const uint64_t minute_us = 60ull * 1000 * 1000;
+
+    void insert_delta(uint32_t delta);
+    void remove_delta(uint32_t delta);
+    static size_t to_bpm(uint64_t intervals, uint64_t total_us);
+
+    estimator m_estimator;
     bool m_timing;
     Timer m_timer;
 
-	// Insert new samples at the end of the array, removing the oldest
-    size_t m_beats[beat_samples];
+    //! Tap times in microseconds; m_next is where the next one goes, which
+    //! once the buffer is full is also the oldest.
+    uint32_t m_beats[beat_samples];
     size_t m_beat_count;
+    size_t m_next;
+
+    //! The intervals between the kept taps, in ascending order (median only).
+    uint32_t m_sorted[beat_deltas];
+
+    size_t m_bpm;
 };
 
+typedef basic_metronome<4> metronome;
+
 //! When we start timing, the previous information is no longer needed. We clear
 //! out the samples, and start the timer anew.
-void metronome::start_timing()
+template <size_t BeatSamples>
+void basic_metronome<BeatSamples>::start_timing()
 {
     m_beat_count = 0;
+    m_next = 0;
+    m_bpm = 0;
 
     m_timing = true;
     m_timer.start();
@@ -50,7 +83,8 @@ void metronome::start_timing()
 
 //! Once timing is done, we prepare the timer for the next start_timing by
 //! resetting it.
-void metronome::stop_timing()
+template <size_t BeatSamples>
+void basic_metronome<BeatSamples>::stop_timing()
 {
     m_timing = false;
     m_timer.stop();
@@ -59,45 +93,72 @@ void metronome::stop_timing()
 }
 
 //! This function is only valid when timing is occurring, since it reads the
-//! timer value for information. Inserts a new sample into the array
-void metronome::tap()
+//! timer value for information. Stores the new sample over the oldest one and
+//! brings the estimate up to date; constant time for the mean, linear in the
+//! (small) number of samples for the median.
+template <size_t BeatSamples>
+void basic_metronome<BeatSamples>::tap()
 {
     if (!m_timing)
         return;
 
-    //! The array is full; push out the oldest sample to make room.
-    if (m_beat_count == beat_samples)
-    {
-        //! Shift every element down one, starting at the second. This
-        //! overwrites the first element and makes the last available.
-        for (size_t i = 1; i != m_beat_count; ++i)
-            m_beats[i-1] = m_beats[i];
+    //! Microseconds; the 32-bit value wraps after 71 minutes, but intervals
+    //! are taken by unsigned subtraction and stay right across the wrap.
+    uint32_t now = static_cast<uint32_t>(m_timer.read_high_resolution_us());
 
-        //! Decrease the count since the normal path increases it when storing
-        m_beat_count -= 1;
+    size_t newest = (m_next + beat_samples - 1) % beat_samples;
+    size_t oldest = m_beat_count == beat_samples ? m_next : 0;
+
+    if (m_estimator == median && m_beat_count)
+    {
+        //! The interval that falls out of the window is the one after the
+        //! oldest tap.
+        if (m_beat_count == beat_samples)
+            remove_delta(m_beats[(oldest + 1) % beat_samples] - m_beats[oldest]);
+        insert_delta(now - m_beats[newest]);
     }
 
-    //! Milliseconds are high enough resolution for our timing purposes.
-    m_beats[m_beat_count++] = m_timer.read_ms();
-}
+    m_beats[m_next] = now;
+    m_next = (m_next + 1) % beat_samples;
+    if (m_beat_count < beat_samples)
+        ++m_beat_count;
 
-//! The user has requested the BPM, so we can calculate it from our absolute
-//! time samples (given there are currently enough). In this case, there is
-//! no caching done by the metronome itself, and the value is recalculated on
-//! each call.
-size_t metronome::get_bpm() const
-{
     if (m_beat_count < beat_samples)
-        return 0;
+        return;
 
-    size_t average = 0;
-    for (size_t i = 1; i != m_beat_count; ++i)
-    {
-        size_t delta = m_beats[i] - m_beats[i-1];
-        size_t bpm = (60 * 1000) / delta;
+    if (m_estimator == median)
+        m_bpm = to_bpm(1, m_sorted[beat_deltas / 2]);
+    else
+        m_bpm = to_bpm(beat_deltas, now - m_beats[m_next]);
+}
 
-        average += bpm;
-    }
+//! Keep m_sorted ordered: shift the larger intervals up and drop the new one in.
+template <size_t BeatSamples>
+void basic_metronome<BeatSamples>::insert_delta(uint32_t delta)
+{
+    size_t i = m_beat_count - 1;
+    if (m_beat_count == beat_samples)
+        --i;
+    for (; i != 0 && m_sorted[i - 1] > delta; --i)
+        m_sorted[i] = m_sorted[i - 1];
+    m_sorted[i] = delta;
+}
+
+template <size_t BeatSamples>
+void basic_metronome<BeatSamples>::remove_delta(uint32_t delta)
+{
+    size_t i = 0;
+    while (i != beat_deltas - 1 && m_sorted[i] != delta)
+        ++i;
+    for (; i != beat_deltas - 1; ++i)
+        m_sorted[i] = m_sorted[i + 1];
+}
 
-    return average / (beat_samples - 1);
+//! Rounded to the nearest beat; taps in the same microsecond have no tempo.
+template <size_t BeatSamples>
+size_t basic_metronome<BeatSamples>::to_bpm(uint64_t intervals, uint64_t total_us)
+{
+    if (!total_us)
+        return 0;
+    return static_cast<size_t>((intervals * minute_us + total_us / 2) / total_us);
 }
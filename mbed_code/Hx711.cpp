@@ -14,8 +14,11 @@ void Hx711::set_gain(uint8_t gain) {
             break;
     }
 
+    // the next conversion is read with the old gain and selects the new one;
+    // if the chip never answers the gain is applied by the first later read
+    uint32_t value;
     sck_.write(LOW);
-    read();
+    readRaw(value, SETTLE_TIMEOUT_US);
 }
 
 uint32_t Hx711::readRaw() {
@@ -24,14 +27,61 @@ uint32_t Hx711::readRaw() {
     // becomes ready...
     while (!is_ready());
 
-    uint32_t value = 0;
-    uint8_t data[3] = { 0 };
-    uint8_t filler = 0x00;
+    return shiftInSample();
+}
+
+Hx711::Status Hx711::readRaw(uint32_t& value, uint32_t timeout_us) {
+    Timer waited;
+    waited.start();
+    while (!is_ready()) {
+        if (static_cast<uint32_t>(waited.read_us()) >= timeout_us) {
+            return READ_TIMEOUT;
+        }
+    }
+
+    value = shiftInSample();
+    return is_saturated(value) ? READ_SATURATED : READ_OK;
+}
+
+void Hx711::start_async(Callback<void(uint32_t)> handler) {
+    handler_ = handler;
+    async_ = true;
+    dt_.fall(callback(this, &Hx711::on_data_ready));
+
+    // DOUT stays low until the pending conversion is read, so if it is
+    // already low no edge will ever come; collect that sample ourselves
+    __disable_irq();
+    on_data_ready();
+    __enable_irq();
+}
+
+void Hx711::stop_async() {
+    dt_.fall(Callback<void()>());
+    async_ = false;
+}
 
+void Hx711::on_data_ready() {
+    // DOUT also falls while the data bits are shifted out, and those edges
+    // are latched while the interrupt is masked; only a low DOUT with no
+    // read in progress means a conversion is waiting
+    if (!is_ready()) {
+        return;
+    }
+
+    dt_.disable_irq();
+    uint32_t value = shiftInSample();
+    dt_.enable_irq();
+
+    if (handler_) {
+        handler_(value);
+    }
+}
+
+uint32_t Hx711::shiftInSample() {
     // pulse the clock pin 24 times to read the data
-    data[2] = shiftInMsbFirst();
-    data[1] = shiftInMsbFirst();
-    data[0] = shiftInMsbFirst();
+    uint32_t bits = static_cast<uint32_t>(shiftInMsbFirst()) << 16;
+    bits |= static_cast<uint32_t>(shiftInMsbFirst()) << 8;
+    bits |= shiftInMsbFirst();
 
     // set the channel and the gain factor for the next reading using the clock pin
     for (unsigned int i = 0; i < gain_; i++) {
@@ -39,6 +89,17 @@ uint32_t Hx711::readRaw() {
         sck_.write(LOW);
     }
 
+    return decode(bits);
+}
+
+uint32_t Hx711::decode(uint32_t bits) {
+    uint8_t data[3] = {
+        static_cast<uint8_t>(bits),
+        static_cast<uint8_t>(bits >> 8),
+        static_cast<uint8_t>(bits >> 16)
+    };
+    uint8_t filler = 0x00;
+
     // Datasheet indicates the value is returned as a two's complement value
     // Flip all the bits
     data[2] = ~data[2];
@@ -55,10 +116,10 @@ uint32_t Hx711::readRaw() {
     }
 
     // Construct a 32-bit signed integer
-    value = ( static_cast<uint32_t>(filler)  << 24
-            | static_cast<uint32_t>(data[2]) << 16
-            | static_cast<uint32_t>(data[1]) << 8
-            | static_cast<uint32_t>(data[0]) );
+    uint32_t value = ( static_cast<uint32_t>(filler)  << 24
+                     | static_cast<uint32_t>(data[2]) << 16
+                     | static_cast<uint32_t>(data[1]) << 8
+                     | static_cast<uint32_t>(data[0]) );
 
     // ... and add 1
     return static_cast<int>(++value);
@@ -13,6 +13,21 @@ class Hx711 {
 
 public:
 
+    /**
+     * Outcome of a read with a deadline
+     */
+    enum Status {
+        READ_OK = 0,        // a conversion was read
+        READ_TIMEOUT,       // DOUT did not go low in time; nothing was read
+        READ_SATURATED      // read, but the code is at either rail
+    };
+
+    /**
+     * How long set_gain() waits for the conversion that applies the gain:
+     * the output settling time at 10 SPS plus one conversion
+     */
+    static const uint32_t SETTLE_TIMEOUT_US = 500000;
+
     /**
      * Create an Hx711 ADC object
      * @param pin_sck PinName of the clock pin (digital output)
@@ -24,7 +39,8 @@ public:
      */
      Hx711(PinName pin_sck, PinName pin_dt, int offset, float scale, uint8_t gain = 128) :
         sck_(pin_sck),
-        dt_(pin_dt) {
+        dt_(pin_dt),
+        async_(false) {
         set_offset(offset);
         set_scale(scale);
         set_gain(gain);
@@ -40,7 +56,8 @@ public:
      */
      Hx711(PinName pin_sck, PinName pin_dt, uint8_t gain = 128) :
         sck_(pin_sck),
-        dt_(pin_dt) {
+        dt_(pin_dt),
+        async_(false) {
         set_offset(0);
         set_scale(1.0f);
         set_gain(gain);
@@ -61,10 +78,62 @@ public:
 
     /**
      * Waits for the chip to be ready and returns a raw int reading
+     * Must not be called while asynchronous acquisition is running.
      * @return int sensor output value
      */
     uint32_t readRaw();
 
+    /**
+     * Waits at most timeout_us for the chip to be ready and reads it, so a
+     * dead or unplugged chip cannot hang the caller
+     * Must not be called while asynchronous acquisition is running.
+     * @param value receives the sensor output value, as readRaw() returns it;
+     *      left alone on READ_TIMEOUT
+     * @param timeout_us how long to wait for DOUT to go low
+     * @return READ_OK, READ_TIMEOUT or READ_SATURATED
+     */
+    Status readRaw(uint32_t& value, uint32_t timeout_us);
+
+    /**
+     * Check a value for a code at either rail, which an overloaded,
+     * disconnected or shorted bridge reads as
+     * @param value sensor output value, as readRaw() returns it
+     * @return true for 0x7FFFFF and 0x800000
+     */
+    static bool is_saturated(uint32_t value) {
+        return value == decode(0x7FFFFF) || value == decode(0x800000);
+    }
+
+    /**
+     * Start interrupt-driven acquisition: each falling edge of DOUT (data
+     * ready) shifts one conversion in from the interrupt handler and passes
+     * it to handler, so nothing has to spin on is_ready().
+     * The handler runs in interrupt context and must be short.
+     * @param handler receives each sample, as readRaw() would return it
+     */
+    void start_async(Callback<void(uint32_t)> handler);
+
+    /**
+     * Stop interrupt-driven acquisition; readRaw() may be used again
+     */
+    void stop_async();
+
+    /**
+     * Check if asynchronous acquisition is running
+     * @return true between start_async() and stop_async()
+     */
+     bool is_async() {
+        return async_;
+    }
+
+    /**
+     * Decode the 24 bits clocked out of the chip, MSB first
+     * Shared with Hx711Array, which clocks several chips at once.
+     * @param bits the 24 data bits in the low bits
+     * @return sensor output value, as returned by readRaw()
+     */
+    static uint32_t decode(uint32_t bits);
+
     /**
      * Obtain offset and scaled sensor output; i.e. a real value
      * @return float
@@ -84,17 +153,26 @@ public:
 
     /**
      * Puts the chip into power down mode
+     * During asynchronous acquisition the data ready interrupt is masked
+     * until power_up(); a read would pull SCK low and wake the chip.
      */
      void power_down() {
+        if (async_) {
+            dt_.disable_irq();
+        }
         sck_.write(LOW);
         sck_.write(HIGH);
     }
 
     /**
      * Wakes up the chip after power down mode
+     * The first conversion is ready after the output settling time.
      */
      void power_up() {
         sck_.write(LOW);
+        if (async_) {
+            dt_.enable_irq();
+        }
     }
 
     /**
@@ -151,12 +229,26 @@ private:
     static const uint8_t HIGH     = 1; // digital high
 
     DigitalOut sck_;    // clock line
-    DigitalIn dt_;      // data line
+    InterruptIn dt_;    // data line; falls when a conversion is ready
 
     uint8_t gain_;      // amplification factor at chip
     int offset_;        // offset chip value
     float scale_;       // scale output after offset
 
+    bool async_;                            // acquisition is interrupt driven
+    Callback<void(uint32_t)> handler_;      // receives asynchronous samples
+
+    /**
+     * Clock out one conversion and decode it; DOUT must already be low
+     * @return sensor output value, as returned by readRaw()
+     */
+    uint32_t shiftInSample();
+
+    /**
+     * DOUT falling edge handler for asynchronous acquisition
+     */
+    void on_data_ready();
+
     /**
      * Port of the Arduino shiftIn function; shifts a byte one bit at a time
      * @return incoming but
@@ -0,0 +1,112 @@
+#include "mbed.h"
+#include "Hx711.h"
+#include "Hx711Array.h"
+
+Hx711Array::Hx711Array(PinName pin_sck, PortName port_dt, const int* dt_bits, size_t count, uint8_t gain) :
+    sck_(pin_sck),
+    port_(port_dt, static_cast<int>(make_mask(dt_bits, count))),
+    mask_(make_mask(dt_bits, count)),
+    count_(count > MAX_CHANNELS ? MAX_CHANNELS : count),
+    late_(0) {
+    for (size_t i = 0; i < count_; ++i) {
+        bit_[i] = static_cast<uint8_t>(dt_bits[i]);
+        offset_[i] = 0;
+        scale_[i] = 1.0f;
+    }
+    set_gain(gain);
+}
+
+uint32_t Hx711Array::make_mask(const int* dt_bits, size_t count) {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < count && i < MAX_CHANNELS; ++i) {
+        mask |= 1u << dt_bits[i];
+    }
+    return mask;
+}
+
+void Hx711Array::set_gain(uint8_t gain) {
+    switch (gain) {
+        case 128:       // channel A, gain factor 128
+            gain_ = 1;
+            break;
+        case 64:        // channel A, gain factor 64
+            gain_ = 3;
+            break;
+        case 32:        // channel B, gain factor 32
+            gain_ = 2;
+            break;
+    }
+
+    // as Hx711::set_gain(): a chip that does not answer now takes the gain
+    // with the first later read it is in
+    uint32_t values[MAX_CHANNELS];
+    sck_.write(LOW);
+    readRaw(values, Hx711::SETTLE_TIMEOUT_US);
+}
+
+Hx711::Status Hx711Array::readRaw(uint32_t* values, uint32_t timeout_us) {
+    // wait for the slowest chip; the others keep their latest conversion
+    Timer waited;
+    waited.start();
+    uint32_t pending;
+    while ((pending = static_cast<uint32_t>(port_.read()) & mask_) != 0) {
+        if (static_cast<uint32_t>(waited.read_us()) >= timeout_us) {
+            break;
+        }
+    }
+
+    late_ = 0;
+    for (size_t c = 0; c < count_; ++c) {
+        if (pending & (1u << bit_[c])) {
+            late_ |= 1u << c;
+        }
+    }
+    if (pending == mask_) {
+        return Hx711::READ_TIMEOUT;
+    }
+
+    // one port read per clock pulse: word i holds bit 23 - i of every chip;
+    // a chip with nothing to send ignores the clock
+    uint32_t words[24];
+    for (int i = 0; i < 24; ++i) {
+        sck_.write(HIGH);
+        words[i] = static_cast<uint32_t>(port_.read());
+        sck_.write(LOW);
+    }
+
+    // set the channel and the gain factor for the next reading using the clock pin
+    for (unsigned int i = 0; i < gain_; i++) {
+        sck_.write(HIGH);
+        sck_.write(LOW);
+    }
+
+    // gather each chip's bits out of the port words
+    bool saturated = false;
+    for (size_t c = 0; c < count_; ++c) {
+        if (late_ & (1u << c)) {
+            continue;
+        }
+        uint32_t bits = 0;
+        for (int i = 0; i < 24; ++i) {
+            bits = (bits << 1) | ((words[i] >> bit_[c]) & 1u);
+        }
+        values[c] = Hx711::decode(bits);
+        saturated = saturated || Hx711::is_saturated(values[c]);
+    }
+
+    if (late_) {
+        return Hx711::READ_TIMEOUT;
+    }
+    return saturated ? Hx711::READ_SATURATED : Hx711::READ_OK;
+}
+
+Hx711::Status Hx711Array::read(float* values, uint32_t timeout_us) {
+    uint32_t raw[MAX_CHANNELS];
+    Hx711::Status status = readRaw(raw, timeout_us);
+    for (size_t c = 0; c < count_; ++c) {
+        if (!(late_ & (1u << c))) {
+            values[c] = convert_to_real(c, static_cast<int>(raw[c]));
+        }
+    }
+    return status;
+}
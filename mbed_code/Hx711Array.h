@@ -0,0 +1,164 @@
+#ifndef _HX711_ARRAY_H_
+#define _HX711_ARRAY_H_
+#include "mbed.h"
+#include "Hx711.h"
+
+/**
+ * Several HX711s on one shared clock line, one per compartment.
+ * Every DOUT line must be on the same GPIO port, so that a single port read
+ * on each clock pulse captures one bit from every chip: N conversions are
+ * shifted in with the 24 + gain pulses it takes to read one.
+ * Because every chip sees every pulse, they all get the same PGA gain and
+ * channel; offset and scale are kept per chip.
+ */
+class Hx711Array {
+
+public:
+
+    static const size_t MAX_CHANNELS = 8;
+
+    /**
+     * Create an array of Hx711 ADCs with zero offsets and unit scaling
+     * @param pin_sck PinName of the shared clock pin (digital output)
+     * @param port_dt GPIO port all the data pins are on
+     * @param dt_bits bit number of each chip's data pin within port_dt,
+     *      e.g. {2, 3} for D11 (PTD2) and D12 (PTD3)
+     * @param count number of chips, at most MAX_CHANNELS
+     * @param gain 128 or 64 for channel A, 32 for channel B, for all chips
+     */
+    Hx711Array(PinName pin_sck, PortName port_dt, const int* dt_bits, size_t count, uint8_t gain = 128);
+
+    /**
+     * Number of chips in the array
+     * @return count_
+     */
+     size_t size() {
+        return count_;
+    }
+
+    /**
+     * Check if every chip has a conversion ready, in one port read
+     * @return true if all data pins are LOW
+     */
+     bool is_ready() {
+        return (port_.read() & mask_) == 0;
+    }
+
+    /**
+     * Waits at most timeout_us for every chip to be ready and reads them in
+     * one pass, so a dead or unplugged chip cannot hang the caller. Chips
+     * still not ready by then are left out and the others read anyway; a
+     * chip that comes ready in the middle of the read loses that conversion.
+     * @param values receives size() raw values, as Hx711::readRaw() returns
+     *      them; those of the chips in late() are left alone
+     * @param timeout_us how long to wait for every DOUT to go low
+     * @return READ_TIMEOUT if any chip was late, else READ_SATURATED if any
+     *      code is at either rail, else READ_OK
+     */
+    Hx711::Status readRaw(uint32_t* values, uint32_t timeout_us);
+
+    /**
+     * Obtain offset and scaled output of every chip; i.e. real values
+     * @param values receives size() values; those of late chips are left alone
+     * @param timeout_us how long to wait for every chip
+     * @return as readRaw()
+     */
+    Hx711::Status read(float* values, uint32_t timeout_us = Hx711::SETTLE_TIMEOUT_US);
+
+    /**
+     * Chips the last read gave up on
+     * @return bit c set if chip c was not ready by the deadline
+     */
+    uint32_t late() {
+        return late_;
+    }
+
+    /**
+     * Convert integer value from one chip to offset and scaled real value
+     * @param channel chip index
+     * @param val integer value
+     * @return (val - get_offset(channel)) * get_scale(channel)
+     */
+     float convert_to_real(size_t channel, int val) {
+        return ((float)(val - offset_[channel])) * scale_[channel];
+    }
+
+    /**
+     * Set the gain factor of all chips; takes effect only after a read
+     * @param gain 128, 64 or 32
+     */
+    void set_gain(uint8_t gain = 128);
+
+    /**
+     * Set the scale factor of one chip
+     * @param channel chip index
+     * @param scale desired scale
+     */
+     void set_scale(size_t channel, float scale = 1.0f) {
+        scale_[channel] = scale;
+    }
+
+    /**
+     * Get the scale factor of one chip
+     * @param channel chip index
+     * @return scale
+     */
+     float get_scale(size_t channel) {
+        return scale_[channel];
+    }
+
+    /**
+     * Set the offset of one chip
+     * @param channel chip index
+     * @param offset the desired offset
+     */
+     void set_offset(size_t channel, int offset = 0) {
+        offset_[channel] = offset;
+    }
+
+    /**
+     * Get the offset of one chip
+     * @param channel chip index
+     * @return offset
+     */
+     int get_offset(size_t channel) {
+        return offset_[channel];
+    }
+
+    /**
+     * Puts all chips into power down mode
+     */
+     void power_down() {
+        sck_.write(LOW);
+        sck_.write(HIGH);
+    }
+
+    /**
+     * Wakes up all chips after power down mode; they restart together, so
+     * their conversions line up again
+     */
+     void power_up() {
+        sck_.write(LOW);
+    }
+
+
+private:
+
+    static const uint8_t LOW      = 0; // digital low
+    static const uint8_t HIGH     = 1; // digital high
+
+    DigitalOut sck_;    // shared clock line
+    PortIn port_;       // all data lines
+    uint32_t mask_;     // data line bits within port_
+
+    size_t count_;
+    uint8_t bit_[MAX_CHANNELS];     // data line of each chip
+    uint8_t gain_;                  // clock pulses after the data bits
+    uint32_t late_;                 // chips the last read gave up on
+    int offset_[MAX_CHANNELS];
+    float scale_[MAX_CHANNELS];
+
+    static uint32_t make_mask(const int* dt_bits, size_t count);
+};
+
+#endif
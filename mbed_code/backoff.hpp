@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+//! How long to wait before each attempt to reach the connector again: the
+//! delay doubles from initial_ms up to max_ms, and each wait is drawn from
+//! the upper half of it, so scales that lost the connector together do not
+//! all come back in the same second.
+class backoff
+{
+public:
+    struct config
+    {
+        uint32_t initial_ms;
+        uint32_t max_ms;
+    };
+
+    explicit backoff(const config& cfg) : m_cfg(cfg), m_delay_ms(cfg.initial_ms), m_attempts(0) {}
+
+    //! The wait before the next attempt; random is any random number.
+    uint32_t next_ms(uint32_t random)
+    {
+        uint32_t delay = m_delay_ms;
+        m_delay_ms = delay >= m_cfg.max_ms / 2 ? m_cfg.max_ms : delay * 2;
+        ++m_attempts;
+        return delay - delay / 2 + random % (delay / 2 + 1);
+    }
+
+    //! Connected again: the next loss starts over from initial_ms.
+    void reset()
+    {
+        m_delay_ms = m_cfg.initial_ms;
+        m_attempts = 0;
+    }
+
+    //! Attempts since the last reset().
+    uint32_t attempts() const { return m_attempts; }
+
+private:
+    config m_cfg;
+    uint32_t m_delay_ms;
+    uint32_t m_attempts;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! A reference weight and the raw reading (as returned by Hx711::readRaw())
+//! the scale gave for it.
+struct calibration_point
+{
+    int32_t raw;
+    int32_t milligrams;
+};
+
+//! Piecewise-linear map from raw counts to milligrams, built from up to
+//! MaxPoints reference weights. Between two points the mass is interpolated;
+//! beyond the first and last point the end segments are extended.
+//!
+//! Each segment stores its slope in Q16 (milligrams per count * 65536), so a
+//! conversion is a segment lookup plus one 32x32->64 multiply, an add and a
+//! shift. There is no floating point anywhere.
+//!
+//! Tables can be constant-initialised from an array, or loaded at runtime:
+//!     constexpr calibration_point points[] = { { 51860, 0 }, { -38140, 10000 } };
+//!     constexpr calibration_table<4> factory(points);
+//!     calibration_table<4> live = factory;
+//!     live.load(measured, count);
+template <size_t MaxPoints>
+class calibration_table
+{
+public:
+    static_assert(MaxPoints >= 2, "calibration needs at least two points");
+
+    constexpr calibration_table() : m_count(0), m_raw(), m_mg(), m_slope_q16() {}
+
+    template <size_t N>
+    constexpr calibration_table(const calibration_point (&points)[N])
+    : m_count(0), m_raw(), m_mg(), m_slope_q16()
+    {
+        static_assert(N <= MaxPoints, "too many calibration points for this table");
+        build(points, N);
+    }
+
+    //! Replace the table. Points may come in any order; two points with the
+    //! same raw reading, or fewer than two points, leave the table invalid.
+    constexpr bool load(const calibration_point* points, size_t count)
+    {
+        return build(points, count);
+    }
+
+    constexpr bool valid() const { return m_count >= 2; }
+    constexpr size_t size() const { return m_count; }
+    constexpr calibration_point point(size_t i) const { return calibration_point{ m_raw[i], m_mg[i] }; }
+
+    //! Convert a raw reading to milligrams, rounded to nearest.
+    constexpr int32_t to_milligrams(int32_t raw) const
+    {
+        if (!valid())
+            return 0;
+
+        //! Binary search for the segment [i, i + 1] containing raw; readings
+        //! outside the table use the first or last segment.
+        size_t lo = 0, hi = m_count - 2;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi + 1) / 2;
+            if (raw < m_raw[mid])
+                hi = mid - 1;
+            else
+                lo = mid;
+        }
+
+        //! Readings are 24-bit, so the difference always fits in 32 bits.
+        int32_t delta = raw - m_raw[lo];
+        return m_mg[lo] + static_cast<int32_t>((static_cast<int64_t>(delta) * m_slope_q16[lo] + (1 << 15)) >> 16);
+    }
+
+private:
+    constexpr bool build(const calibration_point* points, size_t count)
+    {
+        m_count = 0;
+        if (count < 2 || count > MaxPoints)
+            return false;
+
+        //! Insertion sort by raw reading; the tables are tiny.
+        for (size_t i = 0; i != count; ++i)
+        {
+            size_t j = i;
+            while (j > 0 && m_raw[j - 1] > points[i].raw)
+            {
+                m_raw[j] = m_raw[j - 1];
+                m_mg[j] = m_mg[j - 1];
+                --j;
+            }
+            m_raw[j] = points[i].raw;
+            m_mg[j] = points[i].milligrams;
+        }
+
+        for (size_t i = 0; i + 1 != count; ++i)
+        {
+            int64_t run = static_cast<int64_t>(m_raw[i + 1]) - m_raw[i];
+            if (run == 0)
+                return false;
+
+            //! Round to nearest; run is positive after the sort.
+            int64_t rise = static_cast<int64_t>(m_mg[i + 1]) - m_mg[i];
+            int64_t scaled = rise * 65536;
+            m_slope_q16[i] = static_cast<int32_t>((scaled + (scaled >= 0 ? run / 2 : -run / 2)) / run);
+        }
+
+        m_count = count;
+        return true;
+    }
+
+    size_t m_count;
+    int32_t m_raw[MaxPoints];
+    int32_t m_mg[MaxPoints];
+    int32_t m_slope_q16[MaxPoints - 1];
+};
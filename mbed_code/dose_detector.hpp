@@ -0,0 +1,217 @@
+#pragma once
+
+#include <stdint.h>
+
+//! Turns the filtered net mass into discrete "N pills taken out / put back"
+//! events for one medication with a known pill weight.
+//!
+//! The detector waits for the reading to settle (stay within motion_mg for
+//! settle_ms), averages the settled level and compares it with the reference,
+//! the last level it accounted for. A difference close to a whole number of
+//! pills is an event and becomes the new reference; a difference of less than
+//! a pill is drift and is absorbed. A rise of more than max_pills is a bottle
+//! being put on and is adopted without an event. Anything else, such as the
+//! bottle being lifted off while pills are taken out, is ignored: when the
+//! bottle comes back the level is compared with the reference from before it
+//! was lifted. A foreign level that stays put for rebase_ms (the bottle taken
+//! away for good) becomes the reference without an event.
+//!
+//! An event is stamped with the time the reading first left the reference,
+//! i.e. when the bottle was picked up, not when the detector caught up.
+class dose_detector
+{
+public:
+    //! A settling window's level is the mean of at most this many readings;
+    //! a level that stays put longer keeps that mean. 12.8 s at 80 SPS.
+    enum { max_window = 1024 };
+
+    //! The window sums readings as offsets from its first, each within
+    //! motion_mg of it, in 32 bits: a Cortex-M4 divides those in hardware,
+    //! where a 64 bit sum costs a library call per sample. motion_mg is held
+    //! to this so the sum cannot overflow; 2 kg is far more than a fifth of
+    //! any pill.
+    static const int32_t max_motion_mg = 2000000;
+
+    struct config
+    {
+        int32_t pill_mg;        // weight of one pill
+        int32_t tolerance_mg;   // how far from a whole number of pills still counts
+        int32_t motion_mg;      // readings within this of each other are settled
+        uint32_t settle_ms;     // ... once they have been for this long
+        uint32_t confirm_ms;    // readings away from the reference this long are a change
+        int32_t max_pills;      // larger changes are not taken as doses
+        uint32_t rebase_ms;     // a settled level nothing explains is adopted after this
+    };
+
+    //! Defaults that suit pills from about 100 mg up: a third of a pill either
+    //! way, settled within a fifth of a pill for 800 ms.
+    static config for_pill(int32_t pill_mg)
+    {
+        config c = { pill_mg, pill_mg / 3, pill_mg / 5, 800, 200, 20, 60000 };
+        return c;
+    }
+
+    struct event
+    {
+        int32_t pills;          // negative: taken out
+        int32_t delta_mg;
+        uint32_t at_ms;         // when the reading left the previous level
+        uint32_t detected_ms;   // when the new level had settled
+    };
+
+    struct statistics
+    {
+        uint32_t events;
+        uint32_t drifts;        // sub-pill changes absorbed into the reference
+        uint32_t ignored;       // settled levels that were not a dose
+        uint32_t rebases;
+    };
+
+    explicit dose_detector(const config& cfg)
+    : m_cfg(bounded(cfg)), m_have_reference(false), m_reference(0), m_away(false), m_leaving(false), m_left_ms(0),
+      m_anchor(0), m_start_ms(0), m_sum(0), m_count(0), m_evaluated(false), m_last(), m_stats() {}
+
+    //! Feed one net reading; returns true when it completes an event, which
+    //! last() then describes.
+    bool update(int32_t mg, uint32_t now_ms)
+    {
+        //! The change starts with the first of a run of readings away from the
+        //! reference lasting confirm_ms; a noise spike is over sooner. Once
+        //! confirmed, only a settled level ends it.
+        if (m_have_reference && !m_leaving)
+        {
+            if (!outside(mg - m_reference, m_cfg.motion_mg))
+                m_away = false;
+            else if (!m_away)
+            {
+                m_away = true;
+                m_left_ms = now_ms;
+            }
+            else if (now_ms - m_left_ms >= m_cfg.confirm_ms)
+                m_leaving = true;
+        }
+
+        //! Restart the settling window whenever the reading moves.
+        if (!m_count || outside(mg - m_anchor, m_cfg.motion_mg))
+        {
+            m_anchor = mg;
+            m_start_ms = now_ms;
+            m_sum = 0;
+            m_count = 0;
+            m_evaluated = false;
+        }
+        if (m_count < max_window)
+        {
+            m_sum += mg - m_anchor;
+            ++m_count;
+        }
+
+        uint32_t settled_for = now_ms - m_start_ms;
+        if (settled_for < m_cfg.settle_ms)
+            return false;
+
+        //! Each settled window is judged once, and once more if it is still
+        //! unexplained after rebase_ms.
+        if (m_evaluated)
+        {
+            if (!m_leaving || settled_for < m_cfg.rebase_ms)
+                return false;
+            ++m_stats.rebases;
+            adopt(level());
+            return false;
+        }
+        if (!m_have_reference)
+        {
+            adopt(level());
+            return false;
+        }
+        m_evaluated = true;
+        return evaluate(level(), now_ms);
+    }
+
+    //! Forget the reference, e.g. after a tare or a new pill weight.
+    void reset() { m_have_reference = false; m_away = m_leaving = false; m_count = 0; }
+    void set_pill_mg(int32_t pill_mg) { m_cfg = bounded(for_pill(pill_mg)); reset(); }
+
+    int32_t pill_mg() const { return m_cfg.pill_mg; }
+    const event& last() const { return m_last; }
+    const statistics& stats() const { return m_stats; }
+
+private:
+    static_assert(static_cast<int64_t>(max_window) * max_motion_mg <= INT32_MAX,
+                  "the settling window sum must fit in 32 bits");
+
+    static bool outside(int32_t delta, int32_t band) { return delta > band || delta < -band; }
+
+    static config bounded(config cfg)
+    {
+        if (cfg.motion_mg > max_motion_mg)
+            cfg.motion_mg = max_motion_mg;
+        return cfg;
+    }
+
+    //! Mean of the settling window.
+    int32_t level() const { return m_anchor + m_sum / static_cast<int32_t>(m_count); }
+
+    bool evaluate(int32_t settled, uint32_t now_ms)
+    {
+        int32_t delta = settled - m_reference;
+        if (!outside(delta, m_cfg.tolerance_mg))
+        {
+            ++m_stats.drifts;
+            adopt(settled);
+            return false;
+        }
+
+        //! Nearest whole number of pills, rounding halves away from zero.
+        int32_t half = m_cfg.pill_mg / 2;
+        int32_t pills = (delta >= 0 ? delta + half : delta - half) / m_cfg.pill_mg;
+
+        //! Far more than a dose heavier: a bottle was put on. Far lighter is
+        //! taken to be the bottle lifted off, and waits for it to come back.
+        if (pills > m_cfg.max_pills)
+        {
+            ++m_stats.rebases;
+            adopt(settled);
+            return false;
+        }
+        if (!pills || pills < -m_cfg.max_pills || outside(delta - pills * m_cfg.pill_mg, m_cfg.tolerance_mg))
+        {
+            ++m_stats.ignored;
+            return false;
+        }
+
+        m_last.pills = pills;
+        m_last.delta_mg = delta;
+        m_last.at_ms = m_leaving ? m_left_ms : m_start_ms;
+        m_last.detected_ms = now_ms;
+        ++m_stats.events;
+        adopt(settled);
+        return true;
+    }
+
+    void adopt(int32_t settled)
+    {
+        m_have_reference = true;
+        m_reference = settled;
+        m_away = m_leaving = false;
+        m_evaluated = true;
+    }
+
+    config m_cfg;
+    bool m_have_reference;
+    int32_t m_reference;
+    bool m_away;
+    bool m_leaving;
+    uint32_t m_left_ms;
+
+    //! The current settling window.
+    int32_t m_anchor;
+    uint32_t m_start_ms;
+    int32_t m_sum;              // offsets from m_anchor
+    uint32_t m_count;
+    bool m_evaluated;
+
+    event m_last;
+    statistics m_stats;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "timer_wheel.hpp"
+
+//! The bottle's prescription, kept on the device: the times of day a dose is
+//! due and how many pills each is. Every dose has one timer on a
+//! timer_wheel, which walks it through the day:
+//!
+//!     open    early_s before its time; pills taken out from now count for it
+//!     due     at its time, unless already taken: the reminder starts
+//!     late    on_time_s after; pills taken from now make it late
+//!     closed  missed_s after; a dose still short of pills is missed
+//!
+//! and then on to the next day's open. Dose events from the detector
+//! (on_taken()) go to the earliest open dose still short of pills, any left
+//! over to the next; pills taken with no dose open are unscheduled. Pills
+//! put back are not taken off a dose.
+//!
+//! The device has no calendar, so times are seconds of uptime; set_clock()
+//! says what time of day it is, and until then nothing is armed.
+class dose_schedule
+{
+public:
+    enum { max_doses = 8, day_s = 24 * 60 * 60 };
+
+    struct config
+    {
+        uint32_t early_s;
+        uint32_t on_time_s;
+        uint32_t missed_s;
+    };
+
+    enum status { idle, open, due, taken, late, missed };
+
+    //! What became of a dose, as last reported.
+    struct outcome
+    {
+        uint32_t at_s;          // its time of day
+        uint16_t pills;
+        uint16_t taken;
+        status state;           // due (reminding), taken, late or missed
+    };
+
+    struct statistics
+    {
+        uint32_t reminders;
+        uint32_t on_time;
+        uint32_t late;
+        uint32_t missed;
+        uint32_t unscheduled;   // pills taken with no dose open
+    };
+
+    explicit dose_schedule(const config& cfg)
+    : m_cfg(cfg), m_count(0), m_clock_set(false), m_offset_s(0), m_reminding(0), m_changed(false), m_last(),
+      m_stats()
+    {
+    }
+
+    //! It is seconds_of_day o'clock at uptime now_s. Rearms every dose.
+    void set_clock(uint32_t seconds_of_day, uint32_t now_s)
+    {
+        m_wheel.advance(now_s, firer(*this));
+        m_offset_s = (seconds_of_day % day_s) + day_s - now_s % day_s;
+        m_clock_set = true;
+        rearm(now_s);
+    }
+
+    //! Replaces the prescription with "HH:MM=pills" entries separated by
+    //! commas, e.g. "08:00=1,16:00=2"; empty clears it. Returns false and
+    //! keeps the old one if the text is malformed or has too many entries.
+    bool set_prescription(const uint8_t* text, size_t size, uint32_t now_s)
+    {
+        dose parsed[max_doses];
+        size_t count = 0;
+        const uint8_t* p = text;
+        const uint8_t* end = text + size;
+        skip_spaces(p, end);
+        while (p != end)
+        {
+            uint32_t hours = 0, minutes = 0, pills = 0;
+            if (count == max_doses || !number(p, end, hours) || hours > 23 || !expect(p, end, ':') ||
+                !number(p, end, minutes) || minutes > 59 || !expect(p, end, '=') || !number(p, end, pills) ||
+                !pills || pills > 0xFFFF)
+                return false;
+            parsed[count].at_s = hours * 3600 + minutes * 60;
+            parsed[count].pills = static_cast<uint16_t>(pills);
+            ++count;
+            skip_spaces(p, end);
+            if (p != end && !expect(p, end, ','))
+                return false;
+            skip_spaces(p, end);
+        }
+
+        m_wheel.advance(now_s, firer(*this));
+        for (size_t i = 0; i != m_count; ++i)
+            m_wheel.cancel(m_doses[i]);
+        m_count = 0;
+        for (size_t i = 0; i != count; ++i)
+        {
+            dose& d = m_doses[m_count++];
+            d.at_s = parsed[i].at_s;
+            d.pills = parsed[i].pills;
+        }
+        sort();
+        rearm(now_s);
+        return true;
+    }
+
+    //! Once a second or so: fires whatever has come due. O(1) a tick,
+    //! however many doses there are.
+    void tick(uint32_t now_s) { m_wheel.advance(now_s, firer(*this)); }
+
+    //! Pills taken out at uptime now_s.
+    void on_taken(uint32_t pills, uint32_t now_s)
+    {
+        tick(now_s);
+        for (size_t i = 0; i != m_count && pills; ++i)
+        {
+            dose& d = m_doses[i];
+            if (d.state != open && d.state != due && d.state != late)
+                continue;
+            uint32_t short_by = static_cast<uint32_t>(d.pills - d.taken);
+            uint32_t use = short_by < pills ? short_by : pills;
+            d.taken = static_cast<uint16_t>(d.taken + use);
+            pills -= use;
+            if (d.taken >= d.pills)
+                finish(d, d.state == late ? late : taken);
+        }
+        m_stats.unscheduled += pills;
+    }
+
+    //! A reminder is going: a dose is past its time and not yet taken.
+    bool reminding() const { return m_reminding != 0; }
+
+    //! True once after the last outcome changed, so it can be published.
+    bool take_changed()
+    {
+        bool changed = m_changed;
+        m_changed = false;
+        return changed;
+    }
+
+    const outcome& last() const { return m_last; }
+    const statistics& stats() const { return m_stats; }
+    size_t size() const { return m_count; }
+    bool clock_set() const { return m_clock_set; }
+
+    //! Seconds of day at uptime now_s.
+    uint32_t time_of_day(uint32_t now_s) const { return (now_s + m_offset_s) % day_s; }
+
+    //! "HH:MM" into out, which must hold 6; returns 5.
+    static size_t format_time(char* out, uint32_t seconds_of_day)
+    {
+        uint32_t minutes = seconds_of_day / 60 % (24 * 60);
+        out[0] = static_cast<char>('0' + minutes / 600);
+        out[1] = static_cast<char>('0' + minutes / 60 % 10);
+        out[2] = ':';
+        out[3] = static_cast<char>('0' + minutes % 60 / 10);
+        out[4] = static_cast<char>('0' + minutes % 10);
+        out[5] = 0;
+        return 5;
+    }
+
+    static const char* name(status s)
+    {
+        return s == due ? "due" : s == taken ? "taken" : s == late ? "late" : s == missed ? "missed" : "waiting";
+    }
+
+private:
+    typedef timer_wheel<> wheel;
+
+    struct dose : wheel::timer
+    {
+        dose() : at_s(0), pills(0), taken(0), state(idle) {}
+
+        uint32_t at_s;
+        uint16_t pills;
+        uint16_t taken;
+        status state;
+    };
+
+    struct firer
+    {
+        explicit firer(dose_schedule& s) : self(s) {}
+        void operator()(wheel::timer& t) { self.fire(static_cast<dose&>(t)); }
+        dose_schedule& self;
+    };
+
+    //! The next phase of a dose, its timer having run out.
+    void fire(dose& d)
+    {
+        uint32_t now_s = m_wheel.now();
+        switch (d.state)
+        {
+        case idle:
+            d.state = open;
+            d.taken = 0;
+            m_wheel.add(d, now_s + m_cfg.early_s);
+            break;
+        case open:
+            d.state = due;
+            ++m_reminding;
+            ++m_stats.reminders;
+            report(d);
+            m_wheel.add(d, now_s + m_cfg.on_time_s);
+            break;
+        case due:
+            d.state = late;
+            m_wheel.add(d, now_s + (m_cfg.missed_s - m_cfg.on_time_s));
+            break;
+        default:
+            finish(d, missed);
+            break;
+        }
+    }
+
+    //! The dose is over for today: count it, and wait for tomorrow's.
+    void finish(dose& d, status how)
+    {
+        if (d.state == due || d.state == late)
+            --m_reminding;
+        d.state = how;
+        ++(how == taken ? m_stats.on_time : how == late ? m_stats.late : m_stats.missed);
+        report(d);
+
+        //! Tomorrow's window opens a day after today's did.
+        uint32_t now_s = m_wheel.now();
+        d.state = idle;
+        m_wheel.add(d, now_s + day_s - since(opens_at(d), now_s));
+    }
+
+    void report(const dose& d)
+    {
+        m_last.at_s = d.at_s;
+        m_last.pills = d.pills;
+        m_last.taken = d.taken;
+        m_last.state = d.state;
+        m_changed = true;
+    }
+
+    //! Time of day a dose's window opens.
+    uint32_t opens_at(const dose& d) const { return (d.at_s + day_s - m_cfg.early_s % day_s) % day_s; }
+
+    //! Every dose back to the phase it is in at now_s, with nothing taken:
+    //! open, due or late if now_s falls in its window, from early_s before
+    //! its time up to missed_s after; otherwise waiting for the next window.
+    void rearm(uint32_t now_s)
+    {
+        m_reminding = 0;
+        for (size_t i = 0; i != m_count; ++i)
+        {
+            dose& d = m_doses[i];
+            m_wheel.cancel(d);
+            d.state = idle;
+            d.taken = 0;
+            if (!m_clock_set)
+                continue;
+            uint32_t past = since(d.at_s, now_s);
+            if (past < m_cfg.on_time_s)
+            {
+                d.state = due;
+                ++m_reminding;
+                ++m_stats.reminders;
+                report(d);
+                m_wheel.add(d, now_s + (m_cfg.on_time_s - past));
+            }
+            else if (past < m_cfg.missed_s)
+            {
+                d.state = late;
+                ++m_reminding;
+                m_wheel.add(d, now_s + (m_cfg.missed_s - past));
+            }
+            else if (day_s - past <= m_cfg.early_s)
+            {
+                d.state = open;
+                m_wheel.add(d, now_s + (day_s - past));
+            }
+            else
+                m_wheel.add(d, now_s + day_s - since(opens_at(d), now_s));
+        }
+    }
+
+    //! Seconds since seconds_of_day last came round at uptime now_s; 0 if
+    //! it is that time now.
+    uint32_t since(uint32_t seconds_of_day, uint32_t now_s) const
+    {
+        return (time_of_day(now_s) + day_s - seconds_of_day) % day_s;
+    }
+
+    //! By time of day, so earlier doses take pills first.
+    void sort()
+    {
+        for (size_t i = 1; i < m_count; ++i)
+            for (size_t j = i; j != 0 && m_doses[j].at_s < m_doses[j - 1].at_s; --j)
+            {
+                uint32_t at_s = m_doses[j - 1].at_s;
+                uint16_t pills = m_doses[j - 1].pills;
+                m_doses[j - 1].at_s = m_doses[j].at_s;
+                m_doses[j - 1].pills = m_doses[j].pills;
+                m_doses[j].at_s = at_s;
+                m_doses[j].pills = pills;
+            }
+    }
+
+    static void skip_spaces(const uint8_t*& p, const uint8_t* end)
+    {
+        while (p != end && *p == ' ')
+            ++p;
+    }
+
+    static bool expect(const uint8_t*& p, const uint8_t* end, char c)
+    {
+        if (p == end || *p != c)
+            return false;
+        ++p;
+        return true;
+    }
+
+    static bool number(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+    {
+        value = 0;
+        const uint8_t* start = p;
+        while (p != end && *p >= '0' && *p <= '9' && p - start < 5)
+            value = value * 10 + (*p++ - '0');
+        return p != start;
+    }
+
+    config m_cfg;
+    wheel m_wheel;
+    dose m_doses[max_doses];
+    size_t m_count;
+    bool m_clock_set;
+    uint32_t m_offset_s;        // time of day minus uptime, modulo a day
+    uint32_t m_reminding;       // doses due or late and not yet taken
+    bool m_changed;
+    outcome m_last;
+    statistics m_stats;
+};
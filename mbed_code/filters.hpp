@@ -0,0 +1,221 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//! Streaming filters for load cell samples. Every stage works on raw ADC
+//! counts in integer arithmetic only, keeps its window size as a template
+//! parameter so all storage is static, and does a fixed amount of work per
+//! sample. Each stage has the same small interface:
+//!
+//!     int32_t update(int32_t x)   feed one sample, get the filtered value
+//!     int32_t value() const       last filtered value
+//!     bool ready() const          the window has filled since reset()
+//!     void reset()
+//!
+//! Stages compose with filter_chain, e.g.
+//!     filter_chain<running_median<5>, moving_average<8> > f;
+
+//! Mean of the last N samples. A running sum makes it O(1) per sample; the
+//! division by a constant N compiles to a multiply (a shift for powers of two).
+template <size_t N>
+class moving_average
+{
+public:
+    //! 24-bit samples times N must fit the 32-bit sum; 64-bit division is a
+    //! library call on Cortex-M.
+    static_assert(N >= 1 && N <= 128, "moving_average window must be 1..128");
+
+    moving_average() { reset(); }
+
+    int32_t update(int32_t x)
+    {
+        m_sum += x - m_window[m_next];
+        m_window[m_next] = x;
+        m_next = (m_next + 1) % N;
+        if (m_count < N)
+            ++m_count;
+
+        //! Until the window fills, average what there is.
+        m_value = m_count == N ? m_sum / static_cast<int32_t>(N) : m_sum / static_cast<int32_t>(m_count);
+        return m_value;
+    }
+
+    int32_t value() const { return m_value; }
+    bool ready() const { return m_count == N; }
+
+    void reset()
+    {
+        memset(m_window, 0, sizeof(m_window));
+        m_sum = 0;
+        m_next = 0;
+        m_count = 0;
+        m_value = 0;
+    }
+
+private:
+    int32_t m_window[N];
+    int32_t m_sum;
+    size_t m_next;
+    size_t m_count;
+    int32_t m_value;
+};
+
+//! Median of the last N samples; rejects spikes a mean would smear out. The
+//! window is kept both in arrival order (to know what leaves) and sorted (to
+//! read the middle). Each sample moves at most N - 1 entries, a bound fixed
+//! at compile time, so keep N small (3..15).
+template <size_t N>
+class running_median
+{
+public:
+    static_assert(N % 2 == 1 && N <= 31, "running_median window must be odd and at most 31");
+
+    running_median() { reset(); }
+
+    int32_t update(int32_t x)
+    {
+        if (m_count == N)
+        {
+            remove(m_fifo[m_next]);
+            --m_count;
+        }
+        insert(x);
+        ++m_count;
+
+        m_fifo[m_next] = x;
+        m_next = (m_next + 1) % N;
+
+        m_value = m_sorted[m_count / 2];
+        return m_value;
+    }
+
+    int32_t value() const { return m_value; }
+    bool ready() const { return m_count == N; }
+
+    void reset()
+    {
+        m_next = 0;
+        m_count = 0;
+        m_value = 0;
+    }
+
+private:
+    //! Sorted insert: shift the larger entries up by one.
+    void insert(int32_t x)
+    {
+        size_t i = m_count;
+        while (i > 0 && m_sorted[i - 1] > x)
+        {
+            m_sorted[i] = m_sorted[i - 1];
+            --i;
+        }
+        m_sorted[i] = x;
+    }
+
+    //! Remove one entry equal to x: shift the larger entries down by one.
+    void remove(int32_t x)
+    {
+        size_t i = 0;
+        while (i < m_count && m_sorted[i] != x)
+            ++i;
+        for (; i + 1 < m_count; ++i)
+            m_sorted[i] = m_sorted[i + 1];
+    }
+
+    int32_t m_fifo[N];
+    int32_t m_sorted[N];
+    size_t m_next;
+    size_t m_count;
+    int32_t m_value;
+};
+
+//! Single-pole low-pass, y += (x - y) / 2^Shift, i.e. a time constant of
+//! about 2^Shift samples. The state carries FracBits extra bits of precision
+//! so small steps are not lost to truncation. The first sample primes the
+//! state, so there is no ramp up from zero.
+template <unsigned Shift, unsigned FracBits = 6>
+class iir_lowpass
+{
+public:
+    //! 24-bit samples plus FracBits must fit in the 32-bit state.
+    static_assert(Shift >= 1 && Shift <= 16, "iir_lowpass shift must be 1..16");
+    static_assert(24 + FracBits <= 31, "iir_lowpass fraction bits overflow 32-bit state");
+
+    iir_lowpass() { reset(); }
+
+    int32_t update(int32_t x)
+    {
+        int32_t scaled = x * (1 << FracBits);
+        if (!m_primed)
+        {
+            m_state = scaled;
+            m_primed = true;
+        }
+        else
+        {
+            m_state += (scaled - m_state) / (1 << Shift);
+        }
+
+        //! Round to nearest when dropping the fraction.
+        m_value = (m_state + (1 << (FracBits - 1))) >> FracBits;
+        return m_value;
+    }
+
+    int32_t value() const { return m_value; }
+    bool ready() const { return m_primed; }
+
+    void reset()
+    {
+        m_state = 0;
+        m_primed = false;
+        m_value = 0;
+    }
+
+private:
+    int32_t m_state;
+    bool m_primed;
+    int32_t m_value;
+};
+
+//! Stages applied left to right; the chain is ready once every stage is.
+template <typename... Stages>
+class filter_chain;
+
+template <>
+class filter_chain<>
+{
+public:
+    int32_t update(int32_t x) { return x; }
+    bool ready() const { return true; }
+    void reset() {}
+};
+
+template <typename First, typename... Rest>
+class filter_chain<First, Rest...>
+{
+public:
+    filter_chain() : m_value(0) {}
+
+    int32_t update(int32_t x)
+    {
+        m_value = m_rest.update(m_first.update(x));
+        return m_value;
+    }
+
+    int32_t value() const { return m_value; }
+    bool ready() const { return m_first.ready() && m_rest.ready(); }
+
+    void reset()
+    {
+        m_first.reset();
+        m_rest.reset();
+        m_value = 0;
+    }
+
+private:
+    First m_first;
+    filter_chain<Rest...> m_rest;
+    int32_t m_value;
+};
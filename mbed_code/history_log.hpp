@@ -0,0 +1,366 @@
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! The mass history kept on the device for when it cannot reach the
+//! connector: one reading per interval_ms, in a ring of Blocks fixed-size
+//! blocks that overwrites its oldest block when full. The live history
+//! (senml_batch) goes nowhere while the link is down; this is what is sent
+//! instead once it is back, one block at a time (encode_next()).
+//!
+//! Readings are kept in units of resolution_mg. Each block starts from a
+//! full value and then holds one varint token per change of slope:
+//!
+//!     zigzag(delta) << 1          the next reading, delta units from the last
+//!     (count << 1) | 1            the next count readings, each moving by the
+//!                                 same delta as the one before
+//!
+//! A reading within one unit of where the last delta would put it is taken
+//! to be there, so a load sitting still costs a run however its filtered
+//! reading wanders, and so does a steady ramp; no reading is off by more
+//! than resolution_mg. Deltas are taken modulo 2^32, so any two readings are
+//! a token apart; a token is then 33 bits, at most five bytes. A bottle left alone for an hour takes three bytes
+//! and a pill taken out a handful of tokens, so a few KB hold hours.
+//!
+//! A block goes out as a little-endian header followed by its tokens:
+//!
+//!     u32 sequence    u32 start_ms    u32 now_ms    u16 interval_ms
+//!     u16 resolution_mg    i32 first (in resolution units)    u16 count
+//!
+//! Times are device uptime; now_ms is the uptime when the block was encoded,
+//! so the receiver can place start_ms on its own clock. decode() reads one
+//! back.
+template <size_t Blocks, size_t BlockBytes>
+class history_log
+{
+public:
+    struct config
+    {
+        uint32_t interval_ms;
+        int32_t resolution_mg;
+    };
+
+    struct statistics
+    {
+        uint32_t samples;       // readings logged
+        uint32_t blocks;        // blocks started
+        uint32_t overwritten;   // blocks lost to the ring filling up
+        uint32_t lost;          // of those, ones that had not been sent
+        uint32_t uploaded;      // blocks encoded for sending
+    };
+
+    enum { header_bytes = 22, max_payload = header_bytes + BlockBytes };
+
+    //! What a reading costs unlogged: a 32 bit time and a 32 bit value.
+    enum { raw_sample_bytes = 8 };
+
+    explicit history_log(const config& cfg)
+    : m_cfg(cfg), m_first(0), m_size(0), m_open(false), m_next_sequence(0), m_send_from(0), m_last(0), m_delta(0),
+      m_next_ms(0), m_run(0), m_run_at(0), m_stats()
+    {
+        if (m_cfg.resolution_mg < 1)
+            m_cfg.resolution_mg = 1;
+    }
+
+    //! Offer a reading as often as they come; one is kept per interval_ms
+    //! slot. Returns true if this one was.
+    bool record(int32_t mg, uint32_t now_ms)
+    {
+        if (m_open && static_cast<int32_t>(now_ms - m_next_ms) < 0)
+            return false;
+
+        int32_t value = quantize(mg);
+        ++m_stats.samples;
+
+        //! A missed slot breaks the series; the next block starts afresh.
+        if (m_open && now_ms - m_next_ms >= m_cfg.interval_ms)
+            m_open = false;
+        if (!m_open)
+        {
+            start(value, now_ms);
+            return true;
+        }
+        m_next_ms += m_cfg.interval_ms;
+
+        block& b = newest();
+        uint8_t token[5];
+        size_t length = 0;
+        size_t at = b.used;
+        int32_t delta = plus(value, -static_cast<uint32_t>(m_last));
+        if (delta == m_delta)
+        {
+            //! Extend the run in place; the token may grow by a byte.
+            if (m_run)
+                at = m_run_at;
+            length = put_varint(token, (static_cast<uint64_t>(m_run + 1) << 1) | 1);
+        }
+        else
+            length = put_varint(token, static_cast<uint64_t>(zigzag(delta)) << 1);
+
+        if (at + length > BlockBytes || b.count == 0xFFFF)
+        {
+            start(value, m_next_ms - m_cfg.interval_ms);
+            return true;
+        }
+        for (size_t i = 0; i != length; ++i)
+            b.data[at + i] = token[i];
+        b.used = static_cast<uint16_t>(at + length);
+        ++b.count;
+        if (delta == m_delta)
+        {
+            m_run_at = at;
+            ++m_run;
+        }
+        else
+            m_run = 0;
+        m_last = value;
+        m_delta = delta;
+        return true;
+    }
+
+    //! Everything logged so far counts as delivered, except the open block:
+    //! it is still filling, and goes out whole if the link drops before it is
+    //! done, so the receiver may see some of it twice.
+    void mark_sent()
+    {
+        m_send_from = m_open ? newest().sequence : m_next_sequence;
+    }
+
+    //! Blocks not yet sent, the open one included.
+    uint32_t pending() const { return m_next_sequence - m_send_from; }
+
+    //! Encode the oldest block not yet sent into out, closing it first if it
+    //! is the open one. Returns the payload length, or 0 if there is nothing
+    //! to send or out is smaller than max_payload.
+    size_t encode_next(uint8_t* out, size_t size, uint32_t now_ms)
+    {
+        if (!pending() || size < max_payload)
+            return 0;
+
+        const block& b = m_blocks[(m_first + (m_send_from - oldest().sequence)) % Blocks];
+        if (m_open && &b == &newest())
+            m_open = false;
+
+        uint8_t* p = out;
+        p = put_le(p, b.sequence, 4);
+        p = put_le(p, b.start_ms, 4);
+        p = put_le(p, now_ms, 4);
+        p = put_le(p, m_cfg.interval_ms, 2);
+        p = put_le(p, static_cast<uint32_t>(m_cfg.resolution_mg), 2);
+        p = put_le(p, static_cast<uint32_t>(b.first), 4);
+        p = put_le(p, b.count, 2);
+        for (size_t i = 0; i != b.used; ++i)
+            *p++ = b.data[i];
+
+        ++m_send_from;
+        ++m_stats.uploaded;
+        return static_cast<size_t>(p - out);
+    }
+
+    //! Calls sample(ms, mg) for every reading in an encoded block, ms on the
+    //! device clock. Returns false if the block is malformed.
+    template <typename F>
+    static bool decode(const uint8_t* in, size_t size, F sample)
+    {
+        if (size < header_bytes)
+            return false;
+        uint32_t start_ms = get_le(in + 4, 4);
+        uint32_t interval_ms = get_le(in + 12, 2);
+        int32_t resolution = static_cast<int32_t>(get_le(in + 14, 2));
+        int32_t value = static_cast<int32_t>(get_le(in + 16, 4));
+        uint32_t count = get_le(in + 20, 2);
+
+        const uint8_t* p = in + header_bytes;
+        const uint8_t* end = in + size;
+        uint32_t ms = start_ms;
+        int32_t delta = 0;
+        uint32_t taken = 0;
+        if (count)
+        {
+            sample(ms, value * resolution);
+            ++taken;
+        }
+        while (taken < count)
+        {
+            uint64_t token = 0;
+            if (!get_varint(p, end, token))
+                return false;
+            uint32_t n = token & 1 ? static_cast<uint32_t>(token >> 1) : 1;
+            if (!(token & 1))
+                delta = unzigzag(static_cast<uint32_t>(token >> 1));
+            for (uint32_t i = 0; i != n && taken < count; ++i, ++taken)
+            {
+                value = plus(value, delta);
+                ms += interval_ms;
+                sample(ms, value * resolution);
+            }
+        }
+        return p == end;
+    }
+
+    //! Readings held and the bytes they take encoded, headers included.
+    uint32_t stored_samples() const
+    {
+        uint32_t n = 0;
+        for (size_t i = 0; i != m_size; ++i)
+            n += at(i).count;
+        return n;
+    }
+
+    uint32_t stored_bytes() const
+    {
+        uint32_t n = 0;
+        for (size_t i = 0; i != m_size; ++i)
+            n += header_bytes + at(i).used;
+        return n;
+    }
+
+    //! Raw size over encoded size, in hundredths (1250 is 12.5 to 1).
+    uint32_t compression_x100() const
+    {
+        uint32_t bytes = stored_bytes();
+        return bytes ? static_cast<uint32_t>(uint64_t(stored_samples()) * raw_sample_bytes * 100 / bytes) : 0;
+    }
+
+    //! How far back the oldest reading held goes from the newest.
+    uint32_t retention_ms() const
+    {
+        if (!m_size)
+            return 0;
+        const block& b = newest();
+        return b.start_ms + (b.count - 1) * m_cfg.interval_ms - oldest().start_ms;
+    }
+
+    const config& cfg() const { return m_cfg; }
+    const statistics& stats() const { return m_stats; }
+
+private:
+    struct block
+    {
+        uint32_t sequence;
+        uint32_t start_ms;
+        int32_t first;
+        uint16_t count;
+        uint16_t used;
+        uint8_t data[BlockBytes];
+    };
+
+    const block& at(size_t i) const { return m_blocks[(m_first + i) % Blocks]; }
+    const block& oldest() const { return m_blocks[m_first]; }
+    const block& newest() const { return at(m_size - 1); }
+    block& newest() { return m_blocks[(m_first + m_size - 1) % Blocks]; }
+
+    //! Rounds to the nearest unit whose milligrams still fit in 32 bits, so
+    //! decode() can give them back.
+    int32_t quantize(int32_t mg) const
+    {
+        int32_t r = m_cfg.resolution_mg;
+        if (m_open)
+        {
+            int32_t predicted = plus(m_last, m_delta);
+            int64_t off = mg - static_cast<int64_t>(predicted) * r;
+            if (off <= r && off >= -r && predicted <= INT32_MAX / r && predicted >= INT32_MIN / r)
+                return predicted;
+        }
+        int32_t value = mg / r;
+        int32_t rest = mg % r;
+        if (rest >= r - r / 2 && value < INT32_MAX / r)
+            ++value;
+        else if (-rest >= r - r / 2 && value > INT32_MIN / r)
+            --value;
+        return value;
+    }
+
+    //! A new block holding one reading, in place of the oldest if the ring
+    //! is full.
+    void start(int32_t value, uint32_t slot_ms)
+    {
+        if (m_size == Blocks)
+        {
+            ++m_stats.overwritten;
+            if (static_cast<int32_t>(oldest().sequence - m_send_from) >= 0)
+            {
+                ++m_stats.lost;
+                m_send_from = oldest().sequence + 1;
+            }
+            m_first = (m_first + 1) % Blocks;
+            --m_size;
+        }
+        ++m_size;
+        block& b = newest();
+        b.sequence = m_next_sequence++;
+        b.start_ms = slot_ms;
+        b.first = value;
+        b.count = 1;
+        b.used = 0;
+        ++m_stats.blocks;
+
+        m_open = true;
+        m_last = value;
+        m_delta = 0;
+        m_run = 0;
+        m_next_ms = slot_ms + m_cfg.interval_ms;
+    }
+
+    //! a + b modulo 2^32.
+    static int32_t plus(int32_t a, uint32_t b) { return static_cast<int32_t>(static_cast<uint32_t>(a) + b); }
+
+    static uint32_t zigzag(int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+    static int32_t unzigzag(uint32_t v) { return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1); }
+
+    static size_t put_varint(uint8_t* out, uint64_t v)
+    {
+        size_t n = 0;
+        while (v >= 0x80)
+        {
+            out[n++] = static_cast<uint8_t>(v | 0x80);
+            v >>= 7;
+        }
+        out[n++] = static_cast<uint8_t>(v);
+        return n;
+    }
+
+    static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v)
+    {
+        v = 0;
+        for (unsigned shift = 0; p != end && shift < 35; shift += 7)
+        {
+            uint8_t byte = *p++;
+            v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    static uint8_t* put_le(uint8_t* out, uint32_t v, size_t bytes)
+    {
+        for (size_t i = 0; i != bytes; ++i, v >>= 8)
+            *out++ = static_cast<uint8_t>(v);
+        return out;
+    }
+
+    static uint32_t get_le(const uint8_t* in, size_t bytes)
+    {
+        uint32_t v = 0;
+        for (size_t i = bytes; i-- != 0;)
+            v = (v << 8) | in[i];
+        return v;
+    }
+
+    config m_cfg;
+    block m_blocks[Blocks];
+    size_t m_first;             // index of the oldest block
+    size_t m_size;              // blocks held
+    bool m_open;                // the newest block takes more readings
+    uint32_t m_next_sequence;
+    uint32_t m_send_from;       // sequence of the oldest block not yet sent
+    int32_t m_last;             // last value logged, in resolution units
+    int32_t m_delta;            // and how far it was from the one before
+    uint32_t m_next_ms;         // start of the next slot
+    uint32_t m_run;             // unchanged readings in the last token, if a run
+    size_t m_run_at;            // where that token starts
+    statistics m_stats;
+};
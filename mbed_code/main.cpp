@@ -2,14 +2,30 @@
 #include "mbed.h"
 
 #include <Hx711.h>
+#include "backoff.hpp"
+#include "event_loop.hpp"
+#include "nv_record.hpp"
+#include "scale_config.hpp"
+#include "value_codec.hpp"
 #include "EthernetInterface.h"
 #include "frdm_client.hpp"
 
-//#include "metronome.hpp"
 #include "utils.hpp"
 
 #define IOT_ENABLED
 
+//! Print every conversion on the serial port as a raw trace (raw_trace.hpp),
+//! so a capture of the log can be replayed on the host.
+//#define TRACE_ENABLED
+
+//! Time the acquisition, conversion and publish stages of the loop into
+//! latency histograms, shown on the diagnostics object (span_trace.hpp).
+//! Off unless asked for, here or with -DSPANS_ENABLED (SPANS=1 on the host).
+//#define SPANS_ENABLED
+
+//! After the switches above, which decide what it compiles in.
+#include "scale_app.hpp"
+
 //! The activation level of a circuit describes what voltage level is needed to
 //! make (in this case) an LED turn ON, or light up. Since the FRDM board's
 //! LEDs are active LOW, they must be pulled to GND (or 0, or false) to turn on.
@@ -23,46 +39,126 @@ DigitalOut g_led_red(LED1);
 DigitalOut g_led_green(LED2);
 DigitalOut g_led_blue(LED3);
 
-DigitalOut CLK(D13); // Clock signal
-DigitalIn DATA(D12); // Input signal
+//! Everything runs from one loop, the sampling, publishing and bookkeeping
+//! tasks each on their own schedule. Requests from the connector are posted
+//! to the same loop, and the core sleeps whenever none of it is due.
+scale_app::loop_type g_loop;
 
-// Global Variables
-int offset = 0;
-int scale = 0;
+const uint32_t client_period_ms = 1000;
 
-//InterruptIn g_button_mode(SW3);
-//InterruptIn g_button_tap(SW2);
+//! The green LED blinks at this half period while a dose is due.
+const uint32_t reminder_blink_ms = 500;
 
-//metronome g_metronome;
-//! Since the green LED will blink asynchronously from user input, we will use
-//! a Ticker to set up a timer callback to call the pulse() function.
-Ticker g_ticker;
+//! The load cell, the signal path and the resources; see scale_app.hpp.
+scale_app g_app(g_loop);
 
-// Declarations for Mass
-size_t current_mass = 0;
-volatile bool mass_changed = false;
+#ifdef IOT_ENABLED
+//! The connector client is made anew for every attempt to reach the
+//! connector, and dropped when the connection is lost; the objects outlive
+//! it. Meanwhile the loop keeps sampling into the history log.
+EthernetInterface* g_ethernet = 0;
+M2MObjectList g_objects;
+frdm_client* g_client = 0;
+bool g_connected = false;
+
+backoff g_reconnect(reconnect_config);
+uint32_t g_reconnect_at_ms = 0;
+#endif
 
-size_t current_bpm = 0;
-size_t minimum_bpm = 0;
-size_t maximum_bpm = 0;
+void tare_POST(void*)
+{
+    g_loop.post(callback(&g_app, &scale_app::tare));
+}
 
-//! Network requests cannot be created (getting/setting the resource objects) in
-//! secondary threads / interrupt contexts. Instead, we must mark that a value
-//! changed in these cases and have the main loop complete the operation.
-volatile bool bpm_changed = false;
-//volatile bool bpm_updated = false;
+void pill_weight_PUT(const char*)
+{
+    g_loop.post(callback(&g_app, &scale_app::update_pill_weight));
+}
 
-//! A utility function for formatting values to their string equivalent.
-void format_resource_value(float value, M2MResource* resource)
+void prescription_PUT(const char*)
 {
-    //! Use sprintf to convert the integral value to a string.
-    char result_string[30];
-    size_t size = sprintf(result_string, "%f", value);
+    g_loop.post(callback(&g_app, &scale_app::update_prescription));
+}
+
+void clock_PUT(const char*)
+{
+    g_loop.post(callback(&g_app, &scale_app::update_clock));
+}
 
-    const uint8_t* buffer = reinterpret_cast<const uint8_t*>(result_string);
-    resource->set_value(buffer, size);
+//! Periodic: green blinks while a dose is due, and red stays on after a
+//! missed one until the next dose is taken.
+void reminder_task()
+{
+    const dose_schedule& reminders = g_app.reminders();
+    g_led_green = reminders.reminding() ? !g_led_green : active_low::off;
+    g_led_red = reminders.last().state == dose_schedule::missed ? active_low::on : active_low::off;
 }
 
+#ifdef IOT_ENABLED
+//! Drop the client after an error, and wait a while before trying again.
+void lose_client()
+{
+    delete g_client;
+    g_client = 0;
+    g_connected = false;
+    g_app.connection_lost();
+
+    uint32_t wait_ms = g_reconnect.next_ms(static_cast<uint32_t>(rand()));
+    g_reconnect_at_ms = g_app.uptime_ms() + wait_ms;
+    printf("connector lost, attempt %lu in %lu ms\r\n", static_cast<unsigned long>(g_reconnect.attempts()),
+           static_cast<unsigned long>(wait_ms));
+
+    // Blue while there is no connector, as at power up
+    g_led_blue = active_low::on;
+}
+
+//! Pair with the device connector and publish the objects. Whether that
+//! worked shows in the client's state on the next client_task().
+void connect_client()
+{
+    g_client = new frdm_client("coap://api.connector.mbed.com:5684", g_ethernet);
+    if (g_client->get_state() == frdm_client::state::error)
+    {
+        lose_client();
+        return;
+    }
+    g_client->connect(g_objects);
+}
+
+//! Periodic: reconnects after a loss once the backoff has passed. The loop
+//! ends when the registration does, which only happens on purpose.
+void client_task()
+{
+    if (!g_client)
+    {
+        if (static_cast<int32_t>(g_app.uptime_ms() - g_reconnect_at_ms) >= 0)
+            connect_client();
+        return;
+    }
+
+    switch (g_client->get_state())
+    {
+    case frdm_client::state::registered:
+        if (!g_connected)
+        {
+            g_connected = true;
+            g_reconnect.reset();
+            g_app.connection_restored();
+            g_led_blue = active_low::off;
+        }
+        break;
+    case frdm_client::state::error:
+        lose_client();
+        break;
+    case frdm_client::state::unregistered:
+        g_loop.stop();
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
 int main()
 {
     // Seed the RNG for networking purposes
@@ -81,97 +177,113 @@ int main()
     EthernetInterface ethernet;
     if (ethernet.connect() != 0)
         return 1;
-
-    // Pair with the device connector
-    frdm_client client("coap://api.connector.mbed.com:5684", &ethernet);
-    if (client.get_state() == frdm_client::state::error)
-        return 1;
+    g_ethernet = &ethernet;
 
     // The REST endpoints for this device
-    // Add your own M2MObjects to this list with push_back before client.connect()
-    M2MObjectList objects;
-
+    // Add your own M2MObjects to this list with push_back before connect_client()
     M2MDevice* device = frdm_client::make_device();
-    objects.push_back(device);
+    g_objects.push_back(device);
 
     //! ***********************
     //! Begin Endpoint Creation
     //! ***********************
 
-    M2MObject* mass = M2MInterfaceFactory::create_object("3318");
-    M2MObjectInstance* mass_counter = mass->create_object_instance();
-
-    //! Set Point allows the user to read/write the mass value itself through
-    //! GET and PUT.
-    M2MResource* set_point = mass_counter->create_dynamic_resource("5700", "float", M2MResourceInstance::FLOAT, true);
-    set_point->set_operation(M2MBase::GET_PUT_ALLOWED);
-
-    //! Units is a simple unchanging resource that specifies what kind of
-    //! measurement is being taken. Since the units (like inches, meters, etc.)
-    //! for BPM is "BPM", this resource will always have a value of "BPM".
-    M2MResource* units = mass_counter->create_dynamic_resource("5701", "string", M2MResourceInstance::STRING, true);
-    units->set_operation(M2MBase::GET_ALLOWED);
-
-    units->set_value(reinterpret_cast<const uint8_t*>("g"), 1);
-
-    //! Once we create our needed endpoints, we have to push the OBJECT.
-    objects.push_back(mass);
+    //! The mass object, the schedule, and the diagnostics with SPANS_ENABLED.
+    g_app.create_objects(g_objects, tare_POST, pill_weight_PUT, prescription_PUT, clock_PUT);
 
     //! *********************
     //! End Endpoint Creation
     //! *********************
 
-    // Publish the RESTful endpoints
-    client.connect(objects);
-
-    // Connect complete; turn off blue LED forever
-    g_led_blue = active_low::off;
-#endif
-
-    // initialize ADC with Hx711 object
-    Hx711 load_cell = Hx711(D13, D12, offset, scale, 128);
-    //Hx711 load_cell = Hx711(D13, D12, 128);
-
-    while (true)
-    {
-#ifdef IOT_ENABLED
-        if (client.get_state() == frdm_client::state::error)
-            break;
+    // Publish the RESTful endpoints; the blue LED goes off once registered.
+    // If the connector cannot be reached the scale runs anyway, and keeps
+    // trying.
+    connect_client();
 #endif
 
-        /*-------LOGIC OF SCALE-------*/
-
-        // read raw data
-        int data = load_cell.readRaw();
-        float mass = -1.0*data;
+    //! Restore the last tare before the first reading goes out.
+    FlashIAP flash;
+    flash.init();
+    uint32_t flash_end = flash.get_flash_start() + flash.get_flash_size();
+    uint32_t settings_sector = flash_end - 2 * flash.get_sector_size(flash_end - 1);
+    nv_record<scale_settings> settings_store(flash, settings_sector);
 
-        //mass = (((((mass / 1000) - 551.8 ) / 25) * 2) + 0.6); <-- OLD SCALE
-        mass /= 1000.00;
-        mass += 51.50;
-        mass /= 9.00;
-        mass += 0.04;
+    if (g_app.restore(settings_store))
+        printf("tare %ld mg restored\r\n", static_cast<long>(g_app.settings().tare_mg));
 
-        if(mass <= 0.05)
-        {
-            mass = 0;
-        }
-
-        mass_changed = true; // IoT boolean
+    // initialize ADC with Hx711 object
+    Hx711 load_cell(D13, D12, 128);
 
-        // print statements for Tera Term
-        wait(2); // Delay for 2 seconds
-        printf("%f", mass); // Print the data to the screen for debugging
-        printf("\r\n");
+    //! Conversions now arrive by interrupt instead of spinning in readRaw(),
+    //! and wait in the ring until the sampling task runs.
+    load_cell.start_async(callback(&g_app, &scale_app::on_sample));
+    power_scheduler power(load_cell, power_config);
+    g_app.start(power);
 
-        if (mass_changed)
-        {
-            format_resource_value(mass, set_point);
-            mass_changed = false;
-        }
+    g_app.schedule();
+    g_loop.every(reminder_blink_ms, reminder_task);
+#ifdef IOT_ENABLED
+    g_loop.every(client_period_ms, client_task);
+#endif
+    g_loop.run();
+
+    const scale_app::loop_type::statistics& loop = g_loop.stats();
+    printf("loop: %lu.%lu%% idle, %lu task runs, %lu of %lu posts run (%lu us avg, %lu us max latency)\r\n",
+           static_cast<unsigned long>(g_loop.idle_per_mille() / 10),
+           static_cast<unsigned long>(g_loop.idle_per_mille() % 10),
+           static_cast<unsigned long>(loop.task_runs),
+           static_cast<unsigned long>(loop.dispatched),
+           static_cast<unsigned long>(loop.posted + loop.dropped),
+           static_cast<unsigned long>(loop.dispatched ? loop.latency_total_us / loop.dispatched : 0),
+           static_cast<unsigned long>(loop.latency_max_us));
+    printf("loop: tasks started %lu us late on average, %lu us at worst\r\n",
+           static_cast<unsigned long>(loop.task_runs ? loop.task_late_total_us / loop.task_runs : 0),
+           static_cast<unsigned long>(loop.task_late_max_us));
+#ifdef SPANS_ENABLED
+    const char* stage_names[3] = { "acquire", "convert", "publish" };
+    for (size_t i = 0; i != 3; ++i)
+    {
+        char histogram[latency_histogram::max_text];
+        g_app.latency(i).format(histogram, sizeof(histogram));
+        printf("span %s: %s\r\n", stage_names[i], histogram);
     }
+#endif
+    printf("ADC on %lu of %lu ms, %lu wake-ups, %lu times active\r\n",
+           static_cast<unsigned long>(power.adc_on_ms()),
+           static_cast<unsigned long>(g_app.uptime_ms()),
+           static_cast<unsigned long>(power.stats().wakeups),
+           static_cast<unsigned long>(power.stats().activations));
+    printf("load cell: %lu of %lu conversions missed, %lu railed, %lu faults\r\n",
+           static_cast<unsigned long>(g_app.scale().health().stats().missed),
+           static_cast<unsigned long>(g_app.scale().health().stats().expected),
+           static_cast<unsigned long>(g_app.scale().health().stats().railed),
+           static_cast<unsigned long>(g_app.scale().health().stats().faults));
+    printf("%lu dose events\r\n", static_cast<unsigned long>(g_app.scale().doses().stats().events));
+    printf("history: %lu samples in %lu batches, %lu bytes\r\n",
+           static_cast<unsigned long>(g_app.scale().history().stats().samples),
+           static_cast<unsigned long>(g_app.scale().history().stats().batches),
+           static_cast<unsigned long>(g_app.scale().history().stats().bytes));
+    printf("published %lu of %lu readings (%lu within deadband, %lu inside pmin)\r\n",
+           static_cast<unsigned long>(g_app.scale().publish().sent_count()),
+           static_cast<unsigned long>(g_app.scale().publish().stats().offered),
+           static_cast<unsigned long>(g_app.scale().publish().stats().held_deadband),
+           static_cast<unsigned long>(g_app.scale().publish().stats().held_pmin));
+    const scale_log& log = g_app.log();
+    printf("history log: %lu samples in %lu bytes (%lu.%02lu to 1), %lu s back; %lu blocks sent, %lu lost\r\n",
+           static_cast<unsigned long>(log.stored_samples()),
+           static_cast<unsigned long>(log.stored_bytes()),
+           static_cast<unsigned long>(log.compression_x100() / 100),
+           static_cast<unsigned long>(log.compression_x100() % 100),
+           static_cast<unsigned long>(log.retention_ms() / 1000),
+           static_cast<unsigned long>(log.stats().uploaded),
+           static_cast<unsigned long>(log.stats().lost));
 
 #ifdef IOT_ENABLED
-    client.disconnect();
+    if (g_client)
+    {
+        g_client->disconnect();
+        delete g_client;
+    }
 #endif
 
     return 1;
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mbed.h"
+
+//! One small settings struct kept in two dedicated flash sectors, used in
+//! turn. Saves append a new slot after the last one instead of erasing, so a
+//! 2 KiB sector takes dozens of saves per erase cycle; load() returns the
+//! newest slot in either sector whose CRC checks out, so a save cut short by
+//! a reset falls back to the previous one. Once a sector is full the next
+//! save erases the other one, which holds only older slots, and starts again
+//! there; the newest saved value stays in flash through a reset at any point,
+//! including between that erase and the write after it.
+//!
+//! The sectors must be left out of the firmware image (the last two sectors
+//! of the part are a safe choice for an image this size). T must be
+//! trivially copyable, and should carry its own version field if its layout
+//! may change.
+template <typename T>
+class nv_record
+{
+public:
+    //! The record uses the sector at first_sector_addr and the one after it.
+    nv_record(FlashIAP& flash, uint32_t first_sector_addr)
+    : m_flash(flash), m_addr(first_sector_addr), m_sector(0), m_next(0), m_sequence(0) {}
+
+    //! Find the newest valid slot in either sector. Returns false (and leaves
+    //! value alone) if nothing has been saved yet.
+    bool load(T& value)
+    {
+        const uint32_t sector = m_flash.get_sector_size(m_addr);
+        bool found = false;
+        uint32_t next[2];
+
+        slot s;
+        for (uint32_t k = 0; k != 2; ++k)
+        {
+            for (next[k] = 0; (next[k] + 1) * slot_size <= sector; ++next[k])
+            {
+                if (m_flash.read(&s, sector_addr(k) + next[k] * slot_size, sizeof(s)) != 0 || s.magic == erased)
+                    break;
+                if (s.magic != magic || s.crc != crc32(&s, offsetof(slot, crc)))
+                    continue;
+                if (found && static_cast<int32_t>(s.sequence - m_sequence) <= 0)
+                    continue;
+
+                m_sector = k;
+                m_sequence = s.sequence;
+                value = s.payload;
+                found = true;
+            }
+        }
+        m_next = next[m_sector];
+        return found;
+    }
+
+    //! Append value; when the current sector is full, erase the other one and
+    //! start over there. Call load() once beforehand so the next free slot is
+    //! known.
+    bool save(const T& value)
+    {
+        const uint32_t sector = m_flash.get_sector_size(m_addr);
+        if (slot_size % m_flash.get_page_size() != 0)
+            return false;
+
+        if ((m_next + 1) * slot_size > sector)
+        {
+            //! The full sector keeps the newest value until the new slot is in.
+            uint32_t other = 1 - m_sector;
+            if (m_flash.erase(sector_addr(other), sector) != 0)
+                return false;
+            m_sector = other;
+            m_next = 0;
+        }
+
+        //! Padding is left erased so it reads back the same as it was written.
+        uint32_t buffer[slot_size / 4];
+        memset(buffer, 0xFF, sizeof(buffer));
+        slot* s = reinterpret_cast<slot*>(buffer);
+        s->magic = magic;
+        s->sequence = ++m_sequence;
+        s->payload = value;
+        s->crc = crc32(s, offsetof(slot, crc));
+
+        if (m_flash.program(buffer, sector_addr(m_sector) + m_next * slot_size, slot_size) != 0)
+        {
+            //! Skip the slot; the next save tries the one after it.
+            ++m_next;
+            return false;
+        }
+        ++m_next;
+        return true;
+    }
+
+    //! Number of slots written in the current sector since it was erased.
+    uint32_t used() const { return m_next; }
+
+private:
+    static const uint32_t magic = 0x5343414cu;   // "SCAL"
+    static const uint32_t erased = 0xFFFFFFFFu;
+
+    struct slot
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        T payload;
+        uint32_t crc;
+    };
+    //! Slots start on 8 byte flash phrase boundaries.
+    static const uint32_t slot_size = (sizeof(slot) + 7) & ~7u;
+
+    uint32_t sector_addr(uint32_t k) const { return m_addr + k * m_flash.get_sector_size(m_addr); }
+
+    //! Bitwise CRC-32 (IEEE); saves are rare, so no table.
+    static uint32_t crc32(const void* data, size_t size)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        uint32_t crc = 0xFFFFFFFFu;
+        while (size--)
+        {
+            crc ^= *p++;
+            for (int k = 0; k != 8; ++k)
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+        return ~crc;
+    }
+
+    FlashIAP& m_flash;
+    uint32_t m_addr;
+    uint32_t m_sector;          // 0 or 1: the one the newest slot is in
+    uint32_t m_next;
+    uint32_t m_sequence;
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "mbed.h"
+#include "Hx711.h"
+
+//! Keeps the HX711 (and the load cell excitation it supplies) powered down
+//! while the load is not moving.
+//!
+//! Active: the ADC converts continuously and every reading goes through the
+//! filter. Once the filtered readings have stayed within still_mg of each
+//! other for quiet_ms the level is remembered and the scale goes idle.
+//!
+//! Idle: the ADC is powered down and woken every idle_period_ms for a single
+//! conversion. Given converted() from the data ready interrupt, it goes back
+//! down the moment that conversion is in, before anything has looked at it;
+//! check() then judges it. If it lands within wake_mg of the remembered
+//! level the ADC stays down until the next wake-up; otherwise the scale goes
+//! active and the ADC comes back up. A single conversion is noisier than a
+//! filtered reading, so wake_mg has to sit well above the sample noise but
+//! well below anything worth reporting.
+//!
+//! After a power-up the HX711 needs its output settling time (400 ms at
+//! 10 SPS, 50 ms at 80 SPS) before the first conversion is ready, so that is
+//! the on-time of each wake-up. Going active costs a second one on top of
+//! the wake-up's, which is the price of not keeping the ADC on while the
+//! sampling task comes round; without converted() the ADC stays up until
+//! check() and going active costs nothing more.
+class power_scheduler
+{
+public:
+    struct config
+    {
+        uint32_t idle_period_ms;    // ADC off this long between idle wake-ups
+        int32_t wake_mg;            // a wake-up sample this far off the level goes active
+        int32_t still_mg;           // filtered readings within this of each other are still
+        uint32_t quiet_ms;          // ... and after this long the scale goes idle
+    };
+
+    struct statistics
+    {
+        uint32_t wakeups;           // idle power-ups
+        uint32_t activations;       // idle -> active
+        uint32_t rests;             // active -> idle
+    };
+
+    power_scheduler(Hx711& adc, const config& cfg)
+    : m_adc(adc), m_cfg(cfg), m_active(true), m_powered(true), m_judge(false), m_level(0), m_anchor(0),
+      m_still_ms(0), m_have_anchor(false), m_stats()
+    {
+        m_on.start();
+    }
+
+    //! True while resting; samples then go to check(), not the filter.
+    bool idle() const { return !m_active; }
+
+    //! Called from the data ready interrupt with every conversion. Idle, the
+    //! one a wake-up was for is all it needs, so the ADC goes down on the
+    //! spot and check() judges it later. A railed one is dropped before it
+    //! gets there, so the ADC stays up for the next.
+    void converted(uint32_t raw)
+    {
+        if (m_active || !m_powered || Hx711::is_saturated(raw))
+            return;
+        m_adc.power_down();
+        m_powered = false;
+        m_on.stop();
+        m_judge = true;
+    }
+
+    //! Idle: judge the single conversion of a wake-up, in milligrams gross.
+    //! Returns true if the load has moved and the scale is now active, in
+    //! which case the caller should restart its filter. Conversions that were
+    //! already queued when the ADC went down are ignored.
+    bool check(int32_t mg, uint32_t now_ms)
+    {
+        if (m_active)
+            return false;
+        __disable_irq();
+        bool judge = m_judge || m_powered;
+        m_judge = false;
+        __enable_irq();
+        if (!judge)
+            return false;
+
+        if (!outside(mg - m_level, m_cfg.wake_mg))
+        {
+            rest();
+            return false;
+        }
+
+        ++m_stats.activations;
+        m_active = true;
+        m_have_anchor = false;
+        if (!m_powered)
+            power_up();
+        track(mg, now_ms);
+        return true;
+    }
+
+    //! Active: follow the filtered reading, in milligrams gross. Returns true
+    //! when the load has been still long enough and the ADC has gone down.
+    bool track(int32_t mg, uint32_t now_ms)
+    {
+        if (!m_active)
+            return false;
+
+        if (!m_have_anchor || outside(mg - m_anchor, m_cfg.still_mg))
+        {
+            m_anchor = mg;
+            m_still_ms = now_ms;
+            m_have_anchor = true;
+            return false;
+        }
+        if (now_ms - m_still_ms < m_cfg.quiet_ms)
+            return false;
+
+        ++m_stats.rests;
+        m_level = mg;
+        rest();
+        return true;
+    }
+
+    //! The level the scale is resting at; only meaningful while idle.
+    int32_t level() const { return m_level; }
+
+    //! How long the ADC has been powered in total.
+    uint32_t adc_on_ms() { return static_cast<uint32_t>(m_on.read_ms()); }
+
+    const statistics& stats() const { return m_stats; }
+
+private:
+    static bool outside(int32_t delta, int32_t band) { return delta > band || delta < -band; }
+
+    //! Idle from here on. Power down, unless converted() already has, and
+    //! come back after idle_period_ms. Going idle and powering down are one
+    //! step as far as converted() can tell, so it never takes a conversion
+    //! from the active run for a wake-up's.
+    void rest()
+    {
+        __disable_irq();
+        m_active = false;
+        if (m_powered)
+        {
+            m_adc.power_down();
+            m_powered = false;
+            m_on.stop();
+        }
+        __enable_irq();
+        m_wake.attach_us(callback(this, &power_scheduler::wake), m_cfg.idle_period_ms * 1000ull);
+    }
+
+    void power_up()
+    {
+        m_on.start();
+        m_powered = true;
+        m_adc.power_up();
+    }
+
+    //! Timeout handler.
+    void wake()
+    {
+        ++m_stats.wakeups;
+        power_up();
+    }
+
+    Hx711& m_adc;
+    config m_cfg;
+    //! Shared with the data ready and wake-up interrupts.
+    volatile bool m_active;
+    volatile bool m_powered;
+    volatile bool m_judge;      // converted() took a wake-up's conversion
+    int32_t m_level;
+
+    //! The current stillness window.
+    int32_t m_anchor;
+    uint32_t m_still_ms;
+    bool m_have_anchor;
+
+    Timeout m_wake;
+    Timer m_on;
+    statistics m_stats;
+};
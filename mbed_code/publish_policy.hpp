@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+//! Decides which readings become notifications, along the lines of the
+//! LWM2M pmin/pmax/step attributes:
+//!
+//!     deadband    a reading is a change once it is this far from the last
+//!                 published value
+//!     hysteresis  extra distance needed when the change reverses the
+//!                 direction of the last one, so a reading sitting near the
+//!                 edge of the deadband does not flap up and down
+//!     pmin        no two notifications closer together than this; a change
+//!                 inside the window goes out once the window has passed
+//!     pmax        a heartbeat with the current value if nothing has been
+//!                 sent for this long (0 disables it)
+//!
+//! Values are integers in whatever unit the caller uses (milligrams for the
+//! scale), times are milliseconds from any free-running clock; differences
+//! are taken modulo 2^32 so the clock may wrap.
+class publish_policy
+{
+public:
+    struct config
+    {
+        int32_t deadband;
+        int32_t hysteresis;
+        uint32_t pmin_ms;
+        uint32_t pmax_ms;
+    };
+
+    struct statistics
+    {
+        uint32_t offered;           // readings passed to offer()
+        uint32_t sent_changes;      // published because the value moved
+        uint32_t sent_heartbeats;   // published because pmax ran out
+        uint32_t held_deadband;     // suppressed: within the deadband
+        uint32_t held_pmin;         // suppressed: a change, but too soon
+    };
+
+    explicit publish_policy(const config& cfg)
+    : m_cfg(cfg), m_primed(false), m_last(0), m_last_ms(0), m_direction(0), m_stats() {}
+
+    //! Returns true if value should be published now, in which case it is
+    //! taken as the new reference.
+    bool offer(int32_t value, uint32_t now_ms)
+    {
+        ++m_stats.offered;
+        if (!m_primed)
+        {
+            ++m_stats.sent_changes;
+            sent(value, now_ms);
+            return true;
+        }
+
+        int32_t delta = value - m_last;
+        int direction = delta > 0 ? 1 : delta < 0 ? -1 : 0;
+        int32_t threshold = m_cfg.deadband;
+        if (direction && m_direction && direction != m_direction)
+            threshold += m_cfg.hysteresis;
+
+        uint32_t elapsed = now_ms - m_last_ms;
+        bool changed = delta >= threshold || -delta >= threshold;
+
+        if (changed && elapsed >= m_cfg.pmin_ms)
+        {
+            ++m_stats.sent_changes;
+            m_direction = direction;
+            sent(value, now_ms);
+            return true;
+        }
+        if (m_cfg.pmax_ms && elapsed >= m_cfg.pmax_ms)
+        {
+            ++m_stats.sent_heartbeats;
+            sent(value, now_ms);
+            return true;
+        }
+
+        ++(changed ? m_stats.held_pmin : m_stats.held_deadband);
+        return false;
+    }
+
+    int32_t last() const { return m_last; }
+    uint32_t sent_count() const { return m_stats.sent_changes + m_stats.sent_heartbeats; }
+    uint32_t suppressed_count() const { return m_stats.held_deadband + m_stats.held_pmin; }
+    const statistics& stats() const { return m_stats; }
+
+private:
+    void sent(int32_t value, uint32_t now_ms)
+    {
+        m_primed = true;
+        m_last = value;
+        m_last_ms = now_ms;
+    }
+
+    config m_cfg;
+    bool m_primed;
+    int32_t m_last;
+    uint32_t m_last_ms;
+    int m_direction;
+    statistics m_stats;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_ring.hpp"
+#include "value_codec.hpp"
+
+//! A capture of raw load cell conversions, for replaying a field complaint
+//! against the scale's logic on the host.
+//!
+//! One conversion per line: "T <timestamp_us> <raw>", the time in
+//! microseconds as us_ticker_read() gave it (it wraps after 71 minutes) and
+//! the value as the HX711 driver returned it, both in decimal. Every other
+//! line is ignored, so the serial log of a firmware built with TRACE_ENABLED
+//! is a trace as it stands, and so is a file written by the host simulator
+//! with HX711_RECORD.
+namespace raw_trace
+{
+
+//! "T ", two numbers, a space and "\r\n", plus the terminator.
+const size_t max_record = 2 + 2 * codec::max_chars + 1 + 2 + 1;
+
+//! Format one record with its line ending; returns the length, or 0 if out
+//! is too small.
+inline size_t format(char* out, size_t capacity, const sample& s)
+{
+    if (capacity < max_record)
+    {
+        if (capacity)
+            out[0] = '\0';
+        return 0;
+    }
+
+    size_t n = 0;
+    out[n++] = 'T';
+    out[n++] = ' ';
+    n += codec::format_uint(out + n, capacity - n, s.timestamp_us);
+    out[n++] = ' ';
+    n += codec::format_int(out + n, capacity - n, s.raw);
+    out[n++] = '\r';
+    out[n++] = '\n';
+    out[n] = '\0';
+    return n;
+}
+
+//! Read one line, without its line ending or with it. Returns false for a
+//! line that is not a record.
+inline bool parse(const char* line, size_t length, sample& s)
+{
+    if (length < 2 || line[0] != 'T' || line[1] != ' ')
+        return false;
+
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(line) + 2;
+    const uint8_t* end = reinterpret_cast<const uint8_t*>(line) + length;
+    while (p != end && *p == ' ')
+        ++p;
+    const uint8_t* split = p;
+    while (split != end && *split != ' ')
+        ++split;
+
+    return split != end && codec::parse_uint(p, split - p, s.timestamp_us) &&
+           codec::parse_int(split, end - split, s.raw);
+}
+
+} // namespace raw_trace
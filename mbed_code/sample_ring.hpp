@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+//! A load cell conversion and the time it was taken.
+struct sample
+{
+    uint32_t timestamp_us;
+    int32_t raw;
+};
+
+//! Fixed-capacity, wait-free ring for exactly one producer (an interrupt
+//! handler) and one consumer (the main loop). Neither side ever blocks or
+//! disables interrupts: each index is written by one side only, and the
+//! acquire/release pairs order the slot contents against the index updates.
+//!
+//! When the ring is full the newest value is dropped and counted, so the
+//! consumer always sees an unbroken run of the oldest unread samples and can
+//! tell from overruns() that it fell behind.
+template <typename T, size_t Capacity>
+class sample_ring
+{
+public:
+    //! Indices run freely and are reduced with a mask, so the capacity must be
+    //! a power of two; one slot is never left unused.
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "sample_ring capacity must be a power of two");
+
+    enum { capacity = Capacity };
+
+    sample_ring() : m_head(0), m_tail(0), m_overruns(0), m_high_water(0) {}
+
+    //! Producer side. Returns false (and counts an overrun) when full.
+    bool push(const T& value)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        uint32_t tail = m_tail.load(std::memory_order_acquire);
+
+        uint32_t used = head - tail;
+        if (used == Capacity)
+        {
+            m_overruns.store(m_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        m_slots[head & (Capacity - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+
+        if (used + 1 > m_high_water.load(std::memory_order_relaxed))
+            m_high_water.store(used + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //! Consumer side. Returns false when empty.
+    bool pop(T& value)
+    {
+        return drain(&value, 1) == 1;
+    }
+
+    //! Consumer side: move up to max_count of the oldest samples into out and
+    //! return how many were taken. One pair of index updates per batch.
+    size_t drain(T* out, size_t max_count)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        uint32_t head = m_head.load(std::memory_order_acquire);
+
+        size_t count = head - tail;
+        if (count > max_count)
+            count = max_count;
+
+        for (size_t i = 0; i != count; ++i)
+            out[i] = m_slots[(tail + i) & (Capacity - 1)];
+
+        m_tail.store(tail + static_cast<uint32_t>(count), std::memory_order_release);
+        return count;
+    }
+
+    //! Either side; only a snapshot when called from the other one.
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+    //! Samples dropped because the ring was full.
+    uint32_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+    //! Deepest the ring has ever been; how close the consumer came to losing data.
+    uint32_t high_water() const { return m_high_water.load(std::memory_order_relaxed); }
+
+private:
+    T m_slots[Capacity];
+
+    std::atomic<uint32_t> m_head;        // written by the producer only
+    std::atomic<uint32_t> m_tail;        // written by the consumer only
+    std::atomic<uint32_t> m_overruns;    // producer only
+    std::atomic<uint32_t> m_high_water;  // producer only
+};
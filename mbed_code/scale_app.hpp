@@ -0,0 +1,545 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mbed.h"
+#include "dose_schedule.hpp"
+#include "event_loop.hpp"
+#include "frdm_client.hpp"
+#include "nv_record.hpp"
+#include "raw_trace.hpp"
+#include "sample_ring.hpp"
+#include "scale_config.hpp"
+#include "scale_pipeline.hpp"
+#include "span_trace.hpp"
+#include "value_codec.hpp"
+
+//! What survives a reset, kept in the last two flash sectors. Restoring the
+//! tare means the first reading after boot is already net of the container.
+struct scale_settings
+{
+    int32_t tare_mg;
+};
+
+//! The scale firmware without its board: the conversion ring the HX711
+//! interrupt fills, the signal path, the LWM2M resources and the tasks the
+//! main loop runs. main.cpp owns one and wires it to the hardware and the
+//! connector; the fleet simulator in host/ runs thousands, one per virtual
+//! board.
+//!
+//! TRACE_ENABLED and SPANS_ENABLED are read here, so define them before
+//! including this.
+class scale_app
+{
+public:
+    //! 16 pending items is far more than a person can request at once.
+    typedef event_loop<16> loop_type;
+
+    //! Auto-zero moves are written back at most this often, and only once
+    //! they add up to more than save_threshold_mg, to spare the flash.
+    static const int save_interval_ms = 10 * 60 * 1000;
+    static const int32_t save_threshold_mg = 20;
+
+    explicit scale_app(loop_type& loop)
+    : m_loop(loop), m_calibration(factory_calibration), m_scale(scale_config, m_calibration), m_log(log_config),
+      m_online(false), m_backlog(false), m_power(0), m_schedule(schedule_config), m_settings_store(0),
+      m_set_point(0), m_dose_event(0), m_pill_weight(0), m_history_resource(0), m_sensor_state(0), m_missed_rate(0),
+      m_log_block(0), m_log_state(0), m_prescription(0), m_clock(0), m_adherence(0), m_reminder(0)
+    {
+        m_settings.tare_mg = 0;
+#ifdef SPANS_ENABLED
+        for (size_t i = 0; i != 3; ++i)
+            m_latency_resource[i] = 0;
+#endif
+    }
+
+    //! The 3318 object, the 26251 schedule (and with SPANS_ENABLED the 26250
+    //! diagnostics) go onto objects. Any callback may be null; they run in
+    //! the connector's context and should post to the loop.
+    void create_objects(M2MObjectList& objects, execute_callback_2 tare_POST, value_updated_callback2 pill_weight_PUT,
+                        value_updated_callback2 prescription_PUT = 0, value_updated_callback2 clock_PUT = 0)
+    {
+        M2MObject* mass = M2MInterfaceFactory::create_object("3318");
+        M2MObjectInstance* mass_counter = mass->create_object_instance();
+
+        //! Set Point allows the user to read/write the mass value itself
+        //! through GET and PUT.
+        m_set_point = mass_counter->create_dynamic_resource("5700", "float", M2MResourceInstance::FLOAT, true);
+        m_set_point->set_operation(M2MBase::GET_PUT_ALLOWED);
+
+        //! Units is a simple unchanging resource that specifies what kind of
+        //! measurement is being taken.
+        M2MResource* units = mass_counter->create_dynamic_resource("5701", "string", M2MResourceInstance::STRING, true);
+        units->set_operation(M2MBase::GET_ALLOWED);
+
+        units->set_value(reinterpret_cast<const uint8_t*>("g"), 1);
+
+        //! POST here to zero the scale with whatever is on it. IPSO 3318 has
+        //! no tare resource of its own, so this borrows the calibration id.
+        M2MResource* tare = mass_counter->create_dynamic_resource("5821", "opaque", M2MResourceInstance::OPAQUE, true);
+        tare->set_operation(M2MBase::POST_ALLOWED);
+        tare->set_execute_function(tare_POST);
+
+        //! Dose events and the pill weight they are counted in. IPSO has
+        //! nothing for either, so they use ids from the private resource
+        //! range. An event reads "<pills>,<ms>": pills taken out (negative)
+        //! or put back, and the device uptime at which the bottle was
+        //! picked up.
+        m_dose_event = mass_counter->create_dynamic_resource("26241", "string", M2MResourceInstance::STRING, true);
+        m_dose_event->set_operation(M2MBase::GET_ALLOWED);
+
+        m_pill_weight = mass_counter->create_dynamic_resource("26242", "float", M2MResourceInstance::FLOAT, true);
+        m_pill_weight->set_operation(M2MBase::GET_PUT_ALLOWED);
+        m_pill_weight->set_value_updated_function(pill_weight_PUT);
+        {
+            char text[codec::max_chars];
+            size_t length = codec::format_fixed(text, sizeof(text), m_scale.doses().pill_mg(), 3);
+            set_resource_text(m_pill_weight, text, length);
+        }
+
+        //! Batches of the mass history in milligrams, application/senml+cbor.
+        m_history_resource = mass_counter->create_dynamic_resource("26243", "opaque", M2MResourceInstance::OPAQUE, true);
+        m_history_resource->set_operation(M2MBase::GET_ALLOWED);
+
+        //! Load cell health: "ok", "no data", "saturated" or "stuck bits",
+        //! and the conversions missed per thousand over the last minute.
+        m_sensor_state = mass_counter->create_dynamic_resource("26244", "string", M2MResourceInstance::STRING, true);
+        m_sensor_state->set_operation(M2MBase::GET_ALLOWED);
+
+        m_missed_rate = mass_counter->create_dynamic_resource("26245", "integer", M2MResourceInstance::INTEGER, true);
+        m_missed_rate->set_operation(M2MBase::GET_ALLOWED);
+
+        //! The history log after a reconnect, one block per notification
+        //! (history_log.hpp has the layout). The connector has no block-wise
+        //! transfer, so the backlog goes out as a run of these rather than
+        //! as one Block2 body.
+        m_log_block = mass_counter->create_dynamic_resource("26246", "opaque", M2MResourceInstance::OPAQUE, true);
+        m_log_block->set_operation(M2MBase::GET_ALLOWED);
+
+        //! "<seconds>,<ratio>": how far back the log reaches, and its raw
+        //! size over its encoded size. Refreshed once a minute.
+        m_log_state = mass_counter->create_dynamic_resource("26247", "string", M2MResourceInstance::STRING, false);
+        m_log_state->set_operation(M2MBase::GET_ALLOWED);
+
+        objects.push_back(mass);
+
+        //! The medication schedule, from the private object range like the
+        //! diagnostics. The prescription is "HH:MM=pills" per dose, comma
+        //! separated ("08:00=1,16:00=2"), and the clock the local time of
+        //! day in seconds; nothing is reminded of until the clock is set.
+        M2MObject* schedule = M2MInterfaceFactory::create_object("26251");
+        M2MObjectInstance* doses = schedule->create_object_instance();
+        m_prescription = doses->create_dynamic_resource("0", "string", M2MResourceInstance::STRING, false);
+        m_prescription->set_operation(M2MBase::GET_PUT_ALLOWED);
+        m_prescription->set_value_updated_function(prescription_PUT);
+
+        m_clock = doses->create_dynamic_resource("1", "integer", M2MResourceInstance::INTEGER, false);
+        m_clock->set_operation(M2MBase::GET_PUT_ALLOWED);
+        m_clock->set_value_updated_function(clock_PUT);
+
+        //! "<on time>,<late>,<missed>,<unscheduled>": doses so far, and pills
+        //! taken with no dose open.
+        m_adherence = doses->create_dynamic_resource("2", "string", M2MResourceInstance::STRING, true);
+        m_adherence->set_operation(M2MBase::GET_ALLOWED);
+
+        //! "<HH:MM>,<pills>,<taken>,<state>" for the dose that last changed:
+        //! due when its reminder starts, then taken, late or missed.
+        m_reminder = doses->create_dynamic_resource("3", "string", M2MResourceInstance::STRING, true);
+        m_reminder->set_operation(M2MBase::GET_ALLOWED);
+        objects.push_back(schedule);
+
+#ifdef SPANS_ENABLED
+        //! Stage latencies: 0 acquisition, 1 conversion, 2 publish. As text
+        //! (see latency_histogram::format), refreshed once a minute. Not
+        //! observable: they are read when someone is looking into a slow
+        //! device.
+        M2MObject* diagnostics = M2MInterfaceFactory::create_object("26250");
+        M2MObjectInstance* stages = diagnostics->create_object_instance();
+        const char* stage_ids[3] = { "0", "1", "2" };
+        for (size_t i = 0; i != 3; ++i)
+        {
+            m_latency_resource[i] = stages->create_dynamic_resource(stage_ids[i], "string", M2MResourceInstance::STRING, false);
+            m_latency_resource[i]->set_operation(M2MBase::GET_ALLOWED);
+        }
+        objects.push_back(diagnostics);
+#endif
+    }
+
+    //! Take the settings from store, and save them there from now on.
+    //! Returns true if there were any.
+    bool restore(nv_record<scale_settings>& store)
+    {
+        m_settings_store = &store;
+        m_save_timer.start();
+        if (!store.load(m_settings))
+            return false;
+        m_scale.zero().set_offset(m_settings.tare_mg);
+        return true;
+    }
+
+    //! Starts the clock the tasks run on; conversions are taken from then on.
+    void start(power_scheduler& power)
+    {
+        m_scale.attach(&power);
+        m_power = &power;
+        m_uptime.start();
+#ifdef SPANS_ENABLED
+        span_clock::start();
+#endif
+    }
+
+    //! The sampling, publishing and bookkeeping tasks, each on its own
+    //! schedule.
+    void schedule()
+    {
+        m_loop.every(sample_period_ms, callback(this, &scale_app::sample_task));
+        m_loop.every(publish_period_ms, callback(this, &scale_app::publish_task));
+        m_loop.every(health_interval_ms, callback(this, &scale_app::health_task));
+        m_loop.every(log_upload_period_ms, callback(this, &scale_app::upload_task));
+        m_loop.every(schedule_tick_ms, callback(this, &scale_app::schedule_task));
+    }
+
+    //! The connector went away: readings stay in the log until it is back.
+    void connection_lost()
+    {
+        m_online = false;
+    }
+
+    //! Registered again: what the log gathered meanwhile starts going out.
+    void connection_restored()
+    {
+        m_online = true;
+        m_backlog = m_log.pending() != 0;
+        if (m_backlog)
+            printf("history log: sending %lu blocks\r\n", static_cast<unsigned long>(m_log.pending()));
+    }
+
+    //! Called from the HX711 data ready interrupt with each new conversion.
+    void on_sample(uint32_t raw)
+    {
+        sample s = { us_ticker_read(), static_cast<int32_t>(raw) };
+        m_samples.push(s);
+        if (m_power)
+            m_power->converted(raw);
+    }
+
+    //! Posted by a POST to the tare resource: the latest reading becomes the
+    //! new zero, and is saved straight away.
+    void tare()
+    {
+        if (!m_scale.tare())
+        {
+            printf("no reading to tare\r\n");
+            return;
+        }
+        save_settings();
+    }
+
+    //! Posted when the pill weight resource is written. Grams, as the
+    //! resource type says; anything unparsable or not positive keeps the old
+    //! weight.
+    void update_pill_weight()
+    {
+        int32_t pill_mg = 0;
+        if (m_pill_weight && codec::parse_fixed(m_pill_weight->value(), m_pill_weight->value_length(), 3, pill_mg) &&
+            pill_mg > 0)
+            m_scale.set_pill_mg(pill_mg);
+    }
+
+    //! Posted when the prescription resource is written; a malformed one
+    //! keeps the old schedule.
+    void update_prescription()
+    {
+        if (!m_prescription)
+            return;
+        if (!m_schedule.set_prescription(m_prescription->value(), m_prescription->value_length(), uptime_s()))
+        {
+            printf("bad prescription\r\n");
+            return;
+        }
+        printf("%lu doses a day\r\n", static_cast<unsigned long>(m_schedule.size()));
+    }
+
+    //! Posted when the clock resource is written.
+    void update_clock()
+    {
+        uint32_t seconds = 0;
+        if (m_clock && codec::parse_uint(m_clock->value(), m_clock->value_length(), seconds))
+            m_schedule.set_clock(seconds, uptime_s());
+    }
+
+    //! Periodic: take every conversion that arrived since the last run
+    //! through the pipeline, and report what came out of it.
+    void sample_task()
+    {
+        sample batch[m_samples.capacity];
+        size_t count = 0;
+        {
+            SPAN(m_acquire_latency);
+            count = m_samples.drain(batch, m_samples.capacity);
+        }
+        uint32_t now_ms = uptime_ms();
+#ifdef TRACE_ENABLED
+        for (size_t i = 0; i != count; ++i)
+        {
+            char line[raw_trace::max_record];
+            raw_trace::format(line, sizeof(line), batch[i]);
+            printf("%s", line);
+        }
+#endif
+        bool dosed = false;
+        {
+            SPAN(m_convert_latency);
+            dosed = m_scale.update(batch, count, now_ms);
+        }
+
+        //! Checked on every run, samples or not.
+        if (m_scale.poll_health(now_ms))
+        {
+            const char* state = sensor_health::name(m_scale.health().current());
+            printf("load cell: %s\r\n", state);
+            set_resource_text(m_sensor_state, state, strlen(state));
+        }
+
+        if (dosed)
+        {
+            const dose_detector::event& dose = m_scale.doses().last();
+            char text[2 * codec::max_chars];
+            size_t length = codec::format_int(text, sizeof(text), dose.pills);
+            text[length++] = ',';
+            length += codec::format_uint(text + length, sizeof(text) - length, dose.at_ms);
+
+            printf("dose %s\r\n", text);
+            set_resource_text(m_dose_event, text, length);
+
+            if (dose.pills < 0)
+            {
+                m_schedule.on_taken(static_cast<uint32_t>(-dose.pills), uptime_s());
+                report_schedule();
+            }
+        }
+    }
+
+    //! Periodic: the latest reading goes to the history and, when the policy
+    //! lets it through, is printed and notified.
+    void publish_task()
+    {
+        SPAN(m_publish_latency);
+        uint32_t now_ms = uptime_ms();
+        if (m_scale.have_reading())
+            m_log.record(m_scale.net_mg(), now_ms);
+        if (m_online && !m_backlog)
+            m_log.mark_sent();
+
+        if (m_scale.record(now_ms))
+        {
+            size_t length = m_scale.history().encode(m_history_payload, sizeof(m_history_payload), now_ms);
+            if (length && m_history_resource)
+                m_history_resource->set_value(m_history_payload, length);
+        }
+
+        if (!m_scale.offer(now_ms))
+            return;
+
+        //! Grams with three decimals, formatted once for both the serial
+        //! output and the resource.
+        char mass[codec::max_chars];
+        size_t mass_length = codec::format_fixed(mass, sizeof(mass), m_scale.net_mg(), 3);
+
+        printf("%s", mass);
+        //! A non-zero overrun count means the sampling task fell behind the
+        //! ADC.
+        if (m_samples.overruns())
+            printf(" (%lu samples dropped)", static_cast<unsigned long>(m_samples.overruns()));
+        printf("\r\n");
+
+        set_resource_text(m_set_point, mass, mass_length);
+    }
+
+    //! Periodic, once a minute: the missed conversion rate, and auto-zero
+    //! drift written back now and then.
+    void health_task()
+    {
+        char text[codec::max_chars];
+        size_t length = codec::format_uint(text, sizeof(text), m_scale.health().take_missed_per_mille());
+        set_resource_text(m_missed_rate, text, length);
+
+#ifdef SPANS_ENABLED
+        for (size_t i = 0; i != 3; ++i)
+        {
+            char histogram[latency_histogram::max_text];
+            size_t histogram_length = latency(i).format(histogram, sizeof(histogram));
+            set_resource_text(m_latency_resource[i], histogram, histogram_length);
+        }
+#endif
+
+        if (m_log_state)
+        {
+            char log_text[2 * codec::max_chars];
+            size_t log_length = codec::format_uint(log_text, sizeof(log_text), m_log.retention_ms() / 1000);
+            log_text[log_length++] = ',';
+            log_length += codec::format_fixed(log_text + log_length, sizeof(log_text) - log_length,
+                                              static_cast<int32_t>(m_log.compression_x100()), 2);
+            set_resource_text(m_log_state, log_text, log_length);
+        }
+
+        //! So a GET of the clock gives the time now, not when it was set.
+        if (m_schedule.clock_set())
+        {
+            length = codec::format_uint(text, sizeof(text), m_schedule.time_of_day(uptime_s()));
+            set_resource_text(m_clock, text, length);
+        }
+
+        int32_t drift = m_scale.zero().offset() - m_settings.tare_mg;
+        if ((drift > save_threshold_mg || drift < -save_threshold_mg) && m_save_timer.read_ms() >= save_interval_ms)
+            save_settings();
+    }
+
+    //! Periodic, once a second: reminders that come due, and doses that
+    //! go late or missed.
+    void schedule_task()
+    {
+        m_schedule.tick(uptime_s());
+        report_schedule();
+    }
+
+    //! Periodic: while connected with a backlog, the next block of it.
+    void upload_task()
+    {
+        if (!m_online || !m_backlog)
+            return;
+        size_t length = m_log.encode_next(m_log_payload, sizeof(m_log_payload), uptime_ms());
+        if (length && m_log_block)
+            m_log_block->set_value(m_log_payload, length);
+        if (!m_log.pending())
+            m_backlog = false;
+    }
+
+    //! Seconds since start(), for the dose schedule: from the 64 bit count,
+    //! so it goes on rising for 136 years where uptime_ms() wraps after 49.7
+    //! days. The schedule's wheel only moves forward, and its time of day is
+    //! an offset from this.
+    uint32_t uptime_s() { return static_cast<uint32_t>(m_uptime.read_high_resolution_us() / 1000000); }
+    uint32_t uptime_ms() { return static_cast<uint32_t>(m_uptime.read_ms()); }
+
+    scale_pipeline& scale() { return m_scale; }
+    const scale_log& log() const { return m_log; }
+    const dose_schedule& reminders() const { return m_schedule; }
+    const scale_settings& settings() const { return m_settings; }
+
+#ifdef SPANS_ENABLED
+    //! Acquisition (taking conversions off the ring), conversion (the
+    //! pipeline) and publishing (history, formatting, serial output and
+    //! resource updates).
+    const latency_histogram& latency(size_t stage) const
+    {
+        return stage == 0 ? m_acquire_latency : stage == 1 ? m_convert_latency : m_publish_latency;
+    }
+#endif
+
+private:
+    //! Set a resource to a text value produced by the codec; a resource that
+    //! was never created (no connector) is skipped.
+    static void set_resource_text(M2MResource* resource, const char* text, size_t size)
+    {
+        if (!resource)
+            return;
+        const uint8_t* buffer = reinterpret_cast<const uint8_t*>(text);
+        resource->set_value(buffer, size);
+    }
+
+    //! The last dose outcome and the adherence counts, if they changed.
+    void report_schedule()
+    {
+        if (!m_schedule.take_changed())
+            return;
+        const dose_schedule::outcome& last = m_schedule.last();
+        char text[4 * codec::max_chars];
+        size_t length = dose_schedule::format_time(text, last.at_s);
+        text[length++] = ',';
+        length += codec::format_uint(text + length, sizeof(text) - length, last.pills);
+        text[length++] = ',';
+        length += codec::format_uint(text + length, sizeof(text) - length, last.taken);
+        text[length++] = ',';
+        const char* state = dose_schedule::name(last.state);
+        size_t state_length = strlen(state);
+        memcpy(text + length, state, state_length + 1);
+        length += state_length;
+
+        printf("schedule %s\r\n", text);
+        set_resource_text(m_reminder, text, length);
+
+        const dose_schedule::statistics& s = m_schedule.stats();
+        const uint32_t counts[4] = { s.on_time, s.late, s.missed, s.unscheduled };
+        length = 0;
+        for (size_t i = 0; i != 4; ++i)
+        {
+            if (i)
+                text[length++] = ',';
+            length += codec::format_uint(text + length, sizeof(text) - length, counts[i]);
+        }
+        set_resource_text(m_adherence, text, length);
+    }
+
+    void save_settings()
+    {
+        m_settings.tare_mg = m_scale.zero().offset();
+        if (m_settings_store && !m_settings_store->save(m_settings))
+            printf("cannot save tare\r\n");
+        m_save_timer.reset();
+    }
+
+    loop_type& m_loop;
+
+    //! Conversions from the load cell, timestamped and queued by the HX711
+    //! data ready interrupt and drained by the sampling task. 64 entries
+    //! holds 0.8 s of samples at 80 SPS before anything is dropped.
+    sample_ring<sample, 64> m_samples;
+
+    //! The live calibration, starting from the factory table, and everything
+    //! from the raw conversions to what gets reported. The zero in it is set
+    //! by a tare, then nudged along by auto-zero tracking while the pan is
+    //! empty.
+    calibration_table<8> m_calibration;
+    scale_pipeline m_scale;
+    uint8_t m_history_payload[scale_pipeline::history_batch::max_payload];
+
+    //! Every reading a second, whether or not anyone hears of it; uploaded
+    //! after a reconnect (m_backlog) and otherwise just kept up to date.
+    scale_log m_log;
+    uint8_t m_log_payload[scale_log::max_payload];
+    bool m_online;
+    bool m_backlog;
+    power_scheduler* m_power;
+
+    //! Reminders and adherence, from the prescription and clock resources.
+    dose_schedule m_schedule;
+
+    nv_record<scale_settings>* m_settings_store;
+    scale_settings m_settings;
+    Timer m_save_timer;
+    Timer m_uptime;
+
+    M2MResource* m_set_point;
+    M2MResource* m_dose_event;
+    M2MResource* m_pill_weight;
+    M2MResource* m_history_resource;
+    M2MResource* m_sensor_state;
+    M2MResource* m_missed_rate;
+    M2MResource* m_log_block;
+    M2MResource* m_log_state;
+    M2MResource* m_prescription;
+    M2MResource* m_clock;
+    M2MResource* m_adherence;
+    M2MResource* m_reminder;
+
+#ifdef SPANS_ENABLED
+    latency_histogram m_acquire_latency;
+    latency_histogram m_convert_latency;
+    latency_histogram m_publish_latency;
+    M2MResource* m_latency_resource[3];
+#endif
+};
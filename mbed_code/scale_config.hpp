@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "backoff.hpp"
+#include "calibration.hpp"
+#include "dose_schedule.hpp"
+#include "history_log.hpp"
+#include "power_scheduler.hpp"
+#include "scale_pipeline.hpp"
+
+//! The scale's tuning, shared by the firmware and the trace replay in host/
+//! so a replay runs with exactly what ships.
+
+//! Factory calibration, equivalent to the constants the scale shipped with:
+//! an empty pan reads 51860 and each 9 counts below that is one milligram.
+//! It is baked in at compile time and copied into the live table, which can
+//! be reloaded at runtime from measured reference weights.
+constexpr calibration_point factory_points[] = {
+    { -38140, 10000 },
+    {  51860,     0 },
+};
+constexpr calibration_table<8> factory_calibration(factory_points);
+
+const scale_pipeline::config scale_config = {
+    //! Pills taken out of (or put back into) the bottle, reported as events
+    //! so the gateway does not have to work them out from the gram series.
+    //! The pill weight is per medication and can be PUT; 500 mg until it is.
+    dose_detector::for_pill(500),
+
+    //! Readings are published when they move, not on a fixed period. A pill
+    //! is 500 mg, so a 50 mg deadband ignores filtered noise (a few mg) but
+    //! nothing that matters; the extra 20 mg on a reversal keeps a reading
+    //! that sits on the edge from flapping. At most one update a second while
+    //! the load moves, and a heartbeat every minute while it does not.
+    {
+        50,         // deadband, mg
+        20,         // hysteresis, mg
+        1000,       // pmin, ms
+        60000,      // pmax, ms
+    },
+
+    //! The mass history, one sample a second, sent 60 at a time as a
+    //! SenML-CBOR pack on its own resource, or sooner if a sample has waited
+    //! five minutes.
+    {
+        "3318/0/5700",  // name
+        "mg",           // unit
+        1000,           // interval, ms
+        5 * 60 * 1000,  // deadline, ms
+        60,             // batch size
+    },
+
+    //! Conversions are expected every 100 ms (10 SPS). At rest the ADC is
+    //! woken every 2.5 s or so, so 5 s without any is a dead sensor. Three
+    //! railed conversions in a row are not noise, and the bottom four code
+    //! bits must each toggle within 64 conversions; the noise is over a
+    //! hundred counts.
+    {
+        100000,     // period, us
+        5000,       // timeout, ms
+        3,          // rail count
+        64,         // window
+        0x0F,       // noise mask
+    },
+};
+
+//! The load cell sits still nearly all day, so the ADC is only kept running
+//! while it moves. At rest it is woken every 2 s for one conversion; 100 mg
+//! is six times the single-sample noise and a fifth of a pill. Readings that
+//! stay within 30 mg for 3 s (long enough for the dose detector to settle)
+//! put it back to rest.
+const power_scheduler::config power_config = {
+    2000,       // idle period, ms
+    100,        // wake, mg
+    30,         // still, mg
+    3000,       // quiet, ms
+};
+
+//! The main loop's schedule: conversions are handled every 250 ms, the
+//! reading is offered for publishing every 500 ms and the slow bookkeeping
+//! (the missed conversion rate, saving auto-zero drift) runs once a minute.
+const uint32_t sample_period_ms = 250;
+const uint32_t publish_period_ms = 500;
+const uint32_t health_interval_ms = 60 * 1000;
+
+//! The history kept for when the connector cannot be reached: a reading a
+//! second to within 10 mg (a fiftieth of a pill), in 32 blocks of 128 bytes.
+//! That is over two hours of the bottle being handled nonstop (see
+//! bench_telemetry), and far longer of one that is mostly left alone, in
+//! 4.6 KB of RAM. Blocks go out one per upload period after a reconnect.
+typedef history_log<32, 128> scale_log;
+
+const scale_log::config log_config = {
+    1000,       // interval, ms
+    10,         // resolution, mg
+};
+
+const uint32_t log_upload_period_ms = 250;
+
+//! A lost connector is tried again after 1 s, then 2, 4 and so on up to
+//! five minutes between attempts.
+const backoff::config reconnect_config = {
+    1000,           // initial, ms
+    5 * 60 * 1000,  // max, ms
+};
+
+//! Reminders (dose_schedule.hpp): pills taken from half an hour before a
+//! dose's time count for it, up to half an hour after it they are on time,
+//! up to two hours after it late, and after that the dose is missed. The
+//! schedule is ticked once a second.
+const dose_schedule::config schedule_config = {
+    30 * 60,        // early, s
+    30 * 60,        // on time, s
+    2 * 60 * 60,    // missed, s
+};
+
+const uint32_t schedule_tick_ms = 1000;
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Hx711.h"
+#include "calibration.hpp"
+#include "dose_detector.hpp"
+#include "filters.hpp"
+#include "power_scheduler.hpp"
+#include "publish_policy.hpp"
+#include "sample_ring.hpp"
+#include "senml_batch.hpp"
+#include "sensor_health.hpp"
+#include "zero_tracker.hpp"
+
+//! The scale's signal path, from raw conversions to what gets reported: load
+//! cell health, filtering, calibration, zero tracking and tare, dose events,
+//! the mass history and the publish policy. It does no I/O and keeps no time
+//! of its own, so the firmware and the trace replay in host/ run exactly the
+//! same logic; the caller supplies the conversions, the clock and whatever
+//! happens to the results.
+//!
+//! With a power scheduler attached, conversions at rest go to it instead of
+//! the filter, as described there.
+class scale_pipeline
+{
+public:
+    //! The median rejects single-sample spikes, the average takes out the
+    //! remaining noise. At 10 SPS the reading settles about 1.2 s after the
+    //! load changes.
+    typedef filter_chain<running_median<5>, moving_average<8> > mass_filter;
+    typedef senml_batch<60> history_batch;
+
+    struct config
+    {
+        dose_detector::config doses;
+        publish_policy::config publish;
+        history_batch::config history;
+        sensor_health::config health;
+    };
+
+    scale_pipeline(const config& cfg, const calibration_table<8>& calibration)
+    : m_calibration(calibration), m_power(0), m_doses(cfg.doses), m_publish(cfg.publish), m_history(cfg.history),
+      m_health(cfg.health), m_have_reading(false), m_gross_mg(0), m_net_mg(0)
+    {
+        m_zero.set_capture_mg(zero_tracker::capture_for_pill(cfg.doses.pill_mg));
+    }
+
+    void attach(power_scheduler* power) { m_power = power; }
+
+    //! Conversions as the HX711 driver returns them, oldest first. Filters,
+    //! calibrates and zeroes every one, not just the ones that get published;
+    //! zero tracking needs to see them all. Returns true if a dose event
+    //! came out of them.
+    bool update(const sample* batch, size_t count, uint32_t now_ms)
+    {
+        for (size_t i = 0; i != count; ++i)
+            m_health.sample(batch[i].timestamp_us, batch[i].raw, now_ms);
+
+        bool dosed = false;
+        for (size_t i = 0; i != count; ++i)
+        {
+            //! A railed conversion says nothing about the load.
+            if (Hx711::is_saturated(static_cast<uint32_t>(batch[i].raw)))
+                continue;
+
+            //! At rest each wake-up brings one conversion. If the load has
+            //! not moved the resting level stands as the reading; if it has,
+            //! the filter starts over at the full rate.
+            if (m_power && m_power->idle())
+            {
+                if (m_power->check(m_calibration.to_milligrams(batch[i].raw), now_ms))
+                {
+                    m_filter.reset();
+                    continue;
+                }
+                m_gross_mg = m_power->level();
+            }
+            else
+            {
+                m_filter.update(batch[i].raw);
+                if (!m_filter.ready())
+                    continue;
+
+                m_gross_mg = m_calibration.to_milligrams(m_filter.value());
+                if (m_power)
+                    m_power->track(m_gross_mg, now_ms);
+            }
+
+            m_net_mg = m_zero.update(m_gross_mg);
+            dosed |= m_doses.update(m_net_mg, now_ms);
+            m_have_reading = true;
+        }
+
+        //! At rest the next conversion comes after a wake-up, not a period.
+        if (count && m_power && m_power->idle())
+            m_health.restart();
+        return dosed;
+    }
+
+    //! Re-evaluate the load cell state, samples or not; a dead sensor is one
+    //! that sends none. Returns true when it changed.
+    bool poll_health(uint32_t now_ms) { return m_health.poll(now_ms); }
+
+    //! The latest reading goes into the history; true when a batch is due.
+    bool record(uint32_t now_ms) { return m_have_reading && m_history.add(m_net_mg, now_ms); }
+
+    //! Offer the latest reading to the publish policy; true when it should go
+    //! out.
+    bool offer(uint32_t now_ms) { return m_have_reading && m_publish.offer(m_net_mg, now_ms); }
+
+    //! The latest reading becomes the new zero. False if there is none yet.
+    bool tare()
+    {
+        if (!m_have_reading)
+            return false;
+        m_zero.tare(m_gross_mg);
+        m_doses.reset();
+        m_net_mg = 0;
+        return true;
+    }
+
+    //! A new pill weight for the dose detector; auto-zero's capture band
+    //! shrinks with it, so a light pill is not tracked away as drift.
+    void set_pill_mg(int32_t pill_mg)
+    {
+        m_doses.set_pill_mg(pill_mg);
+        m_zero.set_capture_mg(zero_tracker::capture_for_pill(pill_mg));
+    }
+
+    bool have_reading() const { return m_have_reading; }
+    int32_t gross_mg() const { return m_gross_mg; }
+    int32_t net_mg() const { return m_net_mg; }
+
+    zero_tracker& zero() { return m_zero; }
+    dose_detector& doses() { return m_doses; }
+    history_batch& history() { return m_history; }
+    sensor_health& health() { return m_health; }
+    const publish_policy& publish() const { return m_publish; }
+
+private:
+    const calibration_table<8>& m_calibration;
+    power_scheduler* m_power;
+
+    mass_filter m_filter;
+    zero_tracker m_zero;
+    dose_detector m_doses;
+    publish_policy m_publish;
+    history_batch m_history;
+    sensor_health m_health;
+
+    bool m_have_reading;
+    int32_t m_gross_mg;
+    int32_t m_net_mg;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cbor.hpp"
+
+//! Collects a regularly sampled series and encodes it as one SenML-CBOR
+//! (RFC 8428) pack, so a history goes out as a single notification instead of
+//! one text value per sample.
+//!
+//! Readings are offered as often as they arrive; one is kept per interval_ms
+//! slot and stamped with the slot time, which keeps the time offsets whole
+//! seconds (one byte each) for whole-second intervals. The batch is due once
+//! it holds batch_size samples or its oldest sample is deadline_ms old.
+//!
+//! The device has no wall clock, so times are relative as SenML allows: the
+//! base time is how many seconds ago the first sample was taken, measured when
+//! the pack is encoded, and each record's time is its offset from that.
+//!
+//! Values go out as CBOR integers in the base unit, as they were offered, so
+//! a reading is never rounded through a float; the scale sends milligrams
+//! with the unit "mg".
+template <size_t Capacity>
+class senml_batch
+{
+public:
+    struct config
+    {
+        const char* name;       // SenML base name
+        const char* unit;       // SenML base unit; values are whole numbers of it
+        uint32_t interval_ms;
+        uint32_t deadline_ms;
+        size_t batch_size;      // at most Capacity
+    };
+
+    struct statistics
+    {
+        uint32_t samples;
+        uint32_t batches;
+        uint32_t bytes;
+    };
+
+    //! Worst case encoding of a full batch, for a name and unit of up to 44
+    //! characters between them; size the output buffer with it.
+    enum { max_payload = 64 + Capacity * 13 };
+
+    explicit senml_batch(const config& cfg)
+    : m_cfg(cfg), m_count(0), m_started(false), m_next_ms(0), m_stats()
+    {
+        if (m_cfg.batch_size > Capacity || !m_cfg.batch_size)
+            m_cfg.batch_size = Capacity;
+    }
+
+    //! Offer a reading in the unit. Returns true when the batch is due and
+    //! should be encoded.
+    bool add(int32_t reading, uint32_t now_ms)
+    {
+        if (m_started && static_cast<int32_t>(now_ms - m_next_ms) < 0)
+            return due(now_ms);
+
+        //! Stay on the slot grid unless we have fallen a whole slot behind.
+        uint32_t slot = m_started && now_ms - m_next_ms < m_cfg.interval_ms ? m_next_ms : now_ms;
+        m_started = true;
+        if (m_count < m_cfg.batch_size)
+        {
+            m_slot_ms[m_count] = slot;
+            m_value[m_count] = reading;
+            ++m_count;
+            ++m_stats.samples;
+        }
+        m_next_ms = slot + m_cfg.interval_ms;
+        return due(now_ms);
+    }
+
+    bool due(uint32_t now_ms) const
+    {
+        return m_count && (m_count >= m_cfg.batch_size || now_ms - m_slot_ms[0] >= m_cfg.deadline_ms);
+    }
+
+    size_t size() const { return m_count; }
+
+    //! Encode the batch into out and empty it. Returns the payload length, or
+    //! 0 if out is too small (the batch is kept).
+    size_t encode(uint8_t* out, size_t capacity, uint32_t now_ms)
+    {
+        if (!m_count)
+            return 0;
+
+        cbor_writer w(out, capacity);
+        w.begin_array(static_cast<uint32_t>(m_count));
+        for (size_t i = 0; i != m_count; ++i)
+        {
+            if (i == 0)
+            {
+                w.begin_map(4);
+                w.integer(base_name);
+                w.text(m_cfg.name);
+                w.integer(base_time);
+                w.number(-static_cast<float>(now_ms - m_slot_ms[0]) / 1000.0f);
+                w.integer(base_unit);
+                w.text(m_cfg.unit);
+            }
+            else
+            {
+                w.begin_map(2);
+                w.integer(time);
+                w.number(static_cast<float>(m_slot_ms[i] - m_slot_ms[0]) / 1000.0f);
+            }
+            w.integer(value);
+            w.integer(m_value[i]);
+        }
+        if (!w.ok())
+            return 0;
+
+        ++m_stats.batches;
+        m_stats.bytes += static_cast<uint32_t>(w.size());
+        m_count = 0;
+        return w.size();
+    }
+
+    const statistics& stats() const { return m_stats; }
+
+private:
+    //! SenML CBOR labels.
+    enum { base_name = -2, base_time = -3, base_unit = -4, value = 2, time = 6 };
+
+    config m_cfg;
+    size_t m_count;
+    bool m_started;
+    uint32_t m_next_ms;
+    uint32_t m_slot_ms[Capacity];
+    int32_t m_value[Capacity];
+    statistics m_stats;
+};
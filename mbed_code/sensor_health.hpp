@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+
+//! Watches the stream of HX711 conversions for the ways a load cell fails:
+//!
+//! - no data: nothing has arrived for timeout_ms (unplugged or dead chip),
+//!   or a read with a deadline gave up on the chip (timed_out());
+//! - saturated: rail_count conversions in a row at either rail (0x7FFFFF or
+//!   0x800000; an open or shorted bridge, or a gross overload);
+//! - stuck bits: one of the low code bits in noise_mask kept the same value
+//!   over a whole window of conversions. Those bits are below the noise, so
+//!   a healthy cell toggles each of them all the time.
+//!
+//! It also counts missing conversions: a gap of n periods between two
+//! conversions means n - 1 were lost. Gaps the firmware causes itself, such
+//! as powering the ADC down, are excused with restart().
+class sensor_health
+{
+public:
+    enum state { ok, no_data, saturated, stuck_bits };
+
+    struct config
+    {
+        uint32_t period_us;     // nominal conversion period
+        uint32_t timeout_ms;    // no conversion for this long: no data
+        uint32_t rail_count;    // this many railed conversions in a row: saturated
+        uint32_t window;        // conversions per stuck bit check
+        uint32_t noise_mask;    // code bits that must toggle within a window
+    };
+
+    struct statistics
+    {
+        uint32_t samples;
+        uint32_t expected;      // conversions the ADC should have made
+        uint32_t missed;
+        uint32_t railed;
+        uint32_t faults;        // times the state left ok
+        uint32_t timeouts;      // reads that gave up waiting
+    };
+
+    explicit sensor_health(const config& cfg)
+    : m_cfg(cfg), m_state(ok), m_running(false), m_last_us(0), m_last_ms(0), m_rail_run(0), m_timed_out(false),
+      m_window_count(0), m_and(~0u), m_or(0), m_stuck(false), m_window_expected(0), m_window_missed(0), m_stats()
+    {}
+
+    //! One conversion, as the HX711 driver returns it (the negated code),
+    //! with its timestamp.
+    void sample(uint32_t timestamp_us, int32_t raw, uint32_t now_ms)
+    {
+        ++m_stats.samples;
+        m_last_ms = now_ms;
+        m_timed_out = false;
+
+        uint32_t expected = 1;
+        if (m_running)
+        {
+            uint32_t gap = timestamp_us - m_last_us;
+            expected = (gap + m_cfg.period_us / 2) / m_cfg.period_us;
+            if (!expected)
+                expected = 1;
+        }
+        m_running = true;
+        m_last_us = timestamp_us;
+        m_stats.expected += expected;
+        m_stats.missed += expected - 1;
+        m_window_expected += expected;
+        m_window_missed += expected - 1;
+
+        //! The driver returns the code negated; +0x800000 comes back as
+        //! -0x800000 as well, by its sign extension.
+        if (raw == -0x7FFFFF || raw == -0x800000)
+        {
+            ++m_stats.railed;
+            ++m_rail_run;
+            return;
+        }
+        m_rail_run = 0;
+
+        uint32_t code = static_cast<uint32_t>(-raw);
+        m_and &= code;
+        m_or |= code;
+        if (++m_window_count >= m_cfg.window)
+        {
+            m_stuck = ((m_and | ~m_or) & m_cfg.noise_mask) != 0;
+            m_window_count = 0;
+            m_and = ~0u;
+            m_or = 0;
+        }
+    }
+
+    //! A read waited its whole deadline and the chip never had a conversion
+    //! ready: no data from the next poll(), without waiting out timeout_ms.
+    //! The next conversion clears it.
+    void timed_out()
+    {
+        ++m_stats.timeouts;
+        m_timed_out = true;
+    }
+
+    //! The ADC was powered down or stopped on purpose; the gap up to the next
+    //! conversion is not a loss.
+    void restart() { m_running = false; }
+
+    //! Re-evaluate the state; call every pass, with or without new samples.
+    //! Returns true when it changed.
+    bool poll(uint32_t now_ms)
+    {
+        state s = ok;
+        if (m_timed_out || now_ms - m_last_ms >= m_cfg.timeout_ms)
+            s = no_data;
+        else if (m_rail_run >= m_cfg.rail_count)
+            s = saturated;
+        else if (m_stuck)
+            s = stuck_bits;
+
+        if (s == m_state)
+            return false;
+        if (m_state == ok)
+            ++m_stats.faults;
+        m_state = s;
+        return true;
+    }
+
+    state current() const { return m_state; }
+
+    static const char* name(state s)
+    {
+        switch (s)
+        {
+        case ok:            return "ok";
+        case no_data:       return "no data";
+        case saturated:     return "saturated";
+        case stuck_bits:    return "stuck bits";
+        }
+        return "?";
+    }
+
+    //! Missed conversions per thousand expected since the last call.
+    uint32_t take_missed_per_mille()
+    {
+        uint32_t rate = m_window_expected ? m_window_missed * 1000u / m_window_expected : 0;
+        m_window_expected = m_window_missed = 0;
+        return rate;
+    }
+
+    const statistics& stats() const { return m_stats; }
+
+private:
+    config m_cfg;
+    state m_state;
+
+    bool m_running;
+    uint32_t m_last_us;
+    uint32_t m_last_ms;
+    uint32_t m_rail_run;
+    bool m_timed_out;
+
+    //! The current stuck bit window.
+    uint32_t m_window_count;
+    uint32_t m_and;
+    uint32_t m_or;
+    bool m_stuck;
+
+    uint32_t m_window_expected;
+    uint32_t m_window_missed;
+    statistics m_stats;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+//! Keeps the scale's zero: a tare offset set on demand, and automatic zero
+//! tracking that follows slow drift (temperature, creep) while the pan is
+//! empty. Works on calibrated milligrams, one filtered reading at a time.
+//!
+//! Tracking only runs while the net reading is within capture_mg of zero and
+//! has been still (every reading within motion_mg of the one before) for
+//! settle readings. Each tracked reading then moves the offset 1/2^shift of
+//! the way towards it. A load over capture_mg is out of reach, and one put
+//! down quickly shows up as motion first, but a light one lowered gently
+//! enough can still be tracked away; keep capture_mg well under the lightest
+//! load that matters (see capture_for_pill()). The offset keeps 4 fraction bits so
+//! small corrections add up.
+class zero_tracker
+{
+public:
+    explicit zero_tracker(int32_t capture_mg = 100, int32_t motion_mg = 20, uint16_t settle = 16, unsigned shift = 5)
+    : m_capture(capture_mg), m_motion(motion_mg), m_settle(settle), m_shift(shift),
+      m_offset_q4(0), m_last(0), m_still(0) {}
+
+    //! The capture band for a pill of pill_mg: half a pill, at most 100 mg,
+    //! so a single pill lowered onto an empty pan is never within it.
+    static int32_t capture_for_pill(int32_t pill_mg)
+    {
+        int32_t half = pill_mg / 2;
+        return half < 100 ? half : 100;
+    }
+
+    void set_capture_mg(int32_t capture_mg) { m_capture = capture_mg; }
+    int32_t capture_mg() const { return m_capture; }
+
+    //! Feed one gross reading; returns it net of the current zero.
+    int32_t update(int32_t gross_mg)
+    {
+        int32_t step = gross_mg - m_last;
+        m_last = gross_mg;
+        if (step > m_motion || step < -m_motion)
+            m_still = 0;
+        else if (m_still < m_settle)
+            ++m_still;
+
+        int32_t net = gross_mg - offset();
+        if (m_still >= m_settle && net <= m_capture && net >= -m_capture)
+            m_offset_q4 += (gross_mg * 16 - m_offset_q4) / (1 << m_shift);
+
+        return gross_mg - offset();
+    }
+
+    //! Make gross_mg the new zero.
+    void tare(int32_t gross_mg)
+    {
+        m_offset_q4 = gross_mg * 16;
+        m_last = gross_mg;
+        m_still = 0;
+    }
+
+    int32_t offset() const { return (m_offset_q4 + 8) >> 4; }
+    void set_offset(int32_t mg) { m_offset_q4 = mg * 16; }
+
+    //! True while readings are steady enough for tracking to run.
+    bool still() const { return m_still >= m_settle; }
+
+private:
+    int32_t m_capture;
+    int32_t m_motion;
+    uint16_t m_settle;
+    unsigned m_shift;
+    int32_t m_offset_q4;
+    int32_t m_last;
+    uint16_t m_still;
+};